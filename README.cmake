@@ -44,6 +44,34 @@ After building, you can run the examples from the build directory:
 ./system_example
 ./popen_example
 ./clone_example
+./fork_server_example
+./output_capture_example
+./supervisor_example
+./command_executor_example
+seq 1 1000 | ./batch_spawn -P 8 -- echo
+./bench_spawn --format csv
+./spawn_profile --perf
+./bench_capture --format csv
+./shm_ring_example
+./fork_map_reduce_example --workers 4
+./bench_shm_ring --format csv
+./bench_fork_memory --format csv
+./polymorphism_example
+./bench_shape_batch --shapes 10000000
+./bench_dispatch --format csv
+./inheritance_example
+./bench_allocators --format csv
+./bench_payment_pipeline --format csv
+./bench_ledger --threads 1,8,64 --format csv
+./bench_ledger_wal --format csv
+./bench_bgsave --format csv
+./bench_payroll --format csv
+./bench_employee_ingest --format csv
+./bench_vehicle_catalog --format csv
+./bench_vehicle_query --format csv
+./bench_audio_pipeline --format csv
+./bench_pcm_dsp --format csv
+./bench_gapless --format csv
 ```
 
 For Rust examples, run from the project root:
@@ -43,9 +43,10 @@ build_cpp_file() {
     local source_file=$1
     local output_name=$2
     local directory=$3
+    local extra_flags=$4  # optional, e.g. "-O2 -pthread"
     
     echo -e "${GREEN}Building ${output_name}...${NC}"
-    g++ -Wall -Wextra -g -std=c++11 -o "${directory}/${output_name}" "${directory}/${source_file}"
+    g++ -Wall -Wextra -g -std=c++11 ${extra_flags} -o "${directory}/${output_name}" "${directory}/${source_file}"
     echo -e "${GREEN}${output_name} built successfully!${NC}"
 }
 
@@ -81,6 +82,70 @@ build_all() {
         build_cpp_file "main.cpp" "oop_demo" "oop_concepts"
     fi
     
+    if [ -f "oop_concepts/polymorphism_example.cpp" ]; then
+        build_cpp_file "polymorphism_example.cpp" "polymorphism_example" "oop_concepts"
+    fi
+    
+    if [ -f "oop_concepts/inheritance_example.cpp" ]; then
+        build_cpp_file "inheritance_example.cpp" "inheritance_example" "oop_concepts"
+    fi
+    
+    if [ -f "oop_concepts/bench_shape_batch.cpp" ]; then
+        build_cpp_file "bench_shape_batch.cpp" "bench_shape_batch" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_dispatch.cpp" ]; then
+        build_cpp_file "bench_dispatch.cpp" "bench_dispatch" "oop_concepts" "-O2 -std=c++17"
+    fi
+    
+    if [ -f "oop_concepts/bench_allocators.cpp" ]; then
+        build_cpp_file "bench_allocators.cpp" "bench_allocators" "oop_concepts" "-O2 -std=c++17"
+    fi
+    
+    if [ -f "oop_concepts/bench_payment_pipeline.cpp" ]; then
+        build_cpp_file "bench_payment_pipeline.cpp" "bench_payment_pipeline" "oop_concepts" "-O2 -std=c++17 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_ledger.cpp" ]; then
+        build_cpp_file "bench_ledger.cpp" "bench_ledger" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_ledger_wal.cpp" ]; then
+        build_cpp_file "bench_ledger_wal.cpp" "bench_ledger_wal" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_bgsave.cpp" ]; then
+        build_cpp_file "bench_bgsave.cpp" "bench_bgsave" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_payroll.cpp" ]; then
+        build_cpp_file "bench_payroll.cpp" "bench_payroll" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_employee_ingest.cpp" ]; then
+        build_cpp_file "bench_employee_ingest.cpp" "bench_employee_ingest" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_vehicle_catalog.cpp" ]; then
+        build_cpp_file "bench_vehicle_catalog.cpp" "bench_vehicle_catalog" "oop_concepts" "-O2"
+    fi
+    
+    if [ -f "oop_concepts/bench_vehicle_query.cpp" ]; then
+        build_cpp_file "bench_vehicle_query.cpp" "bench_vehicle_query" "oop_concepts" "-O2"
+    fi
+    
+    if [ -f "oop_concepts/bench_audio_pipeline.cpp" ]; then
+        build_cpp_file "bench_audio_pipeline.cpp" "bench_audio_pipeline" "oop_concepts" "-O2 -pthread"
+    fi
+    
+    if [ -f "oop_concepts/bench_pcm_dsp.cpp" ]; then
+        build_cpp_file "bench_pcm_dsp.cpp" "bench_pcm_dsp" "oop_concepts" "-O2"
+    fi
+    
+    if [ -f "oop_concepts/bench_gapless.cpp" ]; then
+        build_cpp_file "bench_gapless.cpp" "bench_gapless" "oop_concepts" "-O2 -pthread"
+    fi
+    
     # Build process examples
     if [ -d "processes" ]; then
         if [ -f "processes/basic_fork.cpp" ]; then
@@ -110,6 +175,54 @@ build_all() {
         if [ -f "processes/clone_example.cpp" ]; then
             build_cpp_file "clone_example.cpp" "clone_example" "processes"
         fi
+        
+        if [ -f "processes/fork_server_example.cpp" ]; then
+            build_cpp_file "fork_server_example.cpp" "fork_server_example" "processes"
+        fi
+        
+        if [ -f "processes/output_capture_example.cpp" ]; then
+            build_cpp_file "output_capture_example.cpp" "output_capture_example" "processes"
+        fi
+        
+        if [ -f "processes/supervisor_example.cpp" ]; then
+            build_cpp_file "supervisor_example.cpp" "supervisor_example" "processes"
+        fi
+        
+        if [ -f "processes/command_executor_example.cpp" ]; then
+            build_cpp_file "command_executor_example.cpp" "command_executor_example" "processes"
+        fi
+        
+        if [ -f "processes/batch_spawn.cpp" ]; then
+            build_cpp_file "batch_spawn.cpp" "batch_spawn" "processes"
+        fi
+        
+        if [ -f "processes/bench_spawn.cpp" ]; then
+            build_cpp_file "bench_spawn.cpp" "bench_spawn" "processes"
+        fi
+        
+        if [ -f "processes/spawn_profile.cpp" ]; then
+            build_cpp_file "spawn_profile.cpp" "spawn_profile" "processes"
+        fi
+        
+        if [ -f "processes/shm_ring_example.cpp" ]; then
+            build_cpp_file "shm_ring_example.cpp" "shm_ring_example" "processes"
+        fi
+        
+        if [ -f "processes/fork_map_reduce_example.cpp" ]; then
+            build_cpp_file "fork_map_reduce_example.cpp" "fork_map_reduce_example" "processes"
+        fi
+        
+        if [ -f "processes/bench_shm_ring.cpp" ]; then
+            build_cpp_file "bench_shm_ring.cpp" "bench_shm_ring" "processes"
+        fi
+        
+        if [ -f "processes/bench_fork_memory.cpp" ]; then
+            build_cpp_file "bench_fork_memory.cpp" "bench_fork_memory" "processes"
+        fi
+        
+        if [ -f "processes/bench_capture.cpp" ]; then
+            build_cpp_file "bench_capture.cpp" "bench_capture" "processes"
+        fi
     fi
     
     # Build Rust examples
@@ -135,6 +248,22 @@ clean_all() {
     if [ -f "oop_concepts/oop_demo" ]; then
         rm -f "oop_concepts/oop_demo"
     fi
+    rm -f oop_concepts/polymorphism_example
+    rm -f oop_concepts/bench_shape_batch
+    rm -f oop_concepts/bench_dispatch
+    rm -f oop_concepts/inheritance_example
+    rm -f oop_concepts/bench_allocators
+    rm -f oop_concepts/bench_payment_pipeline
+    rm -f oop_concepts/bench_ledger
+    rm -f oop_concepts/bench_ledger_wal
+    rm -f oop_concepts/bench_bgsave
+    rm -f oop_concepts/bench_payroll
+    rm -f oop_concepts/bench_employee_ingest
+    rm -f oop_concepts/bench_vehicle_catalog
+    rm -f oop_concepts/bench_vehicle_query
+    rm -f oop_concepts/bench_audio_pipeline
+    rm -f oop_concepts/bench_pcm_dsp
+    rm -f oop_concepts/bench_gapless
     
     # Clean process examples
     if [ -d "processes" ]; then
@@ -145,6 +274,18 @@ clean_all() {
         rm -f processes/system_example
         rm -f processes/popen_example
         rm -f processes/clone_example
+        rm -f processes/fork_server_example
+        rm -f processes/output_capture_example
+        rm -f processes/supervisor_example
+        rm -f processes/command_executor_example
+        rm -f processes/batch_spawn
+        rm -f processes/bench_spawn
+        rm -f processes/spawn_profile
+        rm -f processes/bench_capture
+        rm -f processes/shm_ring_example
+        rm -f processes/bench_shm_ring
+        rm -f processes/fork_map_reduce_example
+        rm -f processes/bench_fork_memory
     fi
     
     # Clean Rust examples
@@ -1,53 +1,13 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "music_player.h"
 
-// Example 1: Music Player System
-class MusicPlayer {
-private:
-    std::vector<std::string> playlist;
-    int currentTrack;
-    bool isPlaying;
-    
-    void initializeAudio() {
-        // Complex audio initialization code here
-        std::cout << "Audio system initialized\n";
-    }
-    
-    void decodeAudioFile(std::string filename) {
-        // Complex audio decoding logic here
-        std::cout << "Decoding " << filename << "\n";
-    }
-    
-    void sendToSoundCard(std::string audioData) {
-        // Complex sound card interaction here
-        std::cout << "Playing audio through sound card\n";
-    }
-
-public:
-    MusicPlayer() : currentTrack(0), isPlaying(false) {
-        initializeAudio();
-    }
-
-    // Simple interface for users
-    void play() {
-        if (!playlist.empty()) {
-            decodeAudioFile(playlist[currentTrack]);
-            sendToSoundCard(playlist[currentTrack]);
-            isPlaying = true;
-            std::cout << "Now playing: " << playlist[currentTrack] << std::endl;
-        }
-    }
-
-    void pause() {
-        isPlaying = false;
-        std::cout << "Music paused\n";
-    }
-
-    void addToPlaylist(std::string song) {
-        playlist.push_back(song);
-    }
-};
+// Example 1: Music Player System is in music_player.h.
 
 // Example 2: Car Engine System
 class CarEngine {
@@ -111,11 +71,37 @@ public:
 
 int main() {
     // Testing Music Player
+    // Two seconds of a 440 Hz and a 660 Hz tone to play, in a directory of
+    // our own
+    char dir[] = "/tmp/abstraction_example.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    PcmFormat format = {44100, 2, 16};
+    std::vector<int16_t> tone(2 * 44100 * 2);
+    std::vector<std::string> songs;
+    for (int song = 1; song <= 2; song++) {
+        for (size_t i = 0; i < tone.size(); i++) {
+            tone[i] = (int16_t)(8000 * std::sin(2 * M_PI * 220 * (song + 1) * (i / 2) / 44100.0));
+        }
+        songs.push_back(std::string(dir) + "/Song" + std::to_string(song) + ".wav");
+        if (!writeWavFile(songs.back(), format, &tone[0], tone.size() / 2)) {
+            perror(songs.back().c_str());
+        }
+    }
+
     MusicPlayer player;
-    player.addToPlaylist("Song1.mp3");
-    player.addToPlaylist("Song2.mp3");
+    for (size_t i = 0; i < songs.size(); i++) {
+        player.addToPlaylist(songs[i]);
+    }
     player.play();
+    usleep(500000);
     player.pause();
+    for (size_t i = 0; i < songs.size(); i++) {
+        unlink(songs[i].c_str());
+    }
+    rmdir(dir);
 
     // Testing Car Engine
     CarEngine engine;
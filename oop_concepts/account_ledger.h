@@ -0,0 +1,351 @@
+#ifndef ACCOUNT_LEDGER_H
+#define ACCOUNT_LEDGER_H
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Concurrent ledger for many BankAccount-style balances.
+//
+// BankAccount (encapsulation_example.cpp) keeps one double per object and
+// no locking. AccountLedger keeps millions of balances as integer cents in
+// a sharded table:
+//   - account id a lives in shard a % shards, slot a / shards, so
+//     consecutive (usually equally hot) ids land in different shards
+//   - each shard has its own spinlock on its own cache line and one
+//     contiguous array of balances
+//   - deposit(), withdraw() and transfer() lock only the shards they touch;
+//     transfer() locks its two shards in index order, so two transfers in
+//     opposite directions cannot deadlock
+//   - balance() is a lock-free atomic read
+// Every change of money happens under the lock of its shard, so a transfer
+// is atomic: totalCents() (which locks all shards) never sees money in
+// flight.
+//
+//   AccountLedger ledger(1000000);
+//   int64_t alice = ledger.openAccount(toCents(1000.00));
+//   int64_t bob = ledger.openAccount(0);
+//   if (!ledger.transfer(alice, bob, toCents(250.00))) perror("transfer");
+//
+// Failing operations return false and set errno: EINVAL for an amount <= 0,
+// ENOENT for an unknown account, ERANGE if the balance would drop below
+// zero or overflow.
+
+inline int64_t toCents(double amount) { return (int64_t)llround(amount * 100.0); }
+
+inline double fromCents(int64_t cents) { return cents / 100.0; }
+
+// Test-and-test-and-set lock that yields after a short spin, so it stays
+// usable with more threads than cores
+class LedgerSpinLock {
+private:
+    std::atomic<bool> locked;
+
+public:
+    LedgerSpinLock() : locked(false) {}
+
+    void lock() {
+        for (int spins = 0;; spins++) {
+            if (!locked.load(std::memory_order_relaxed) &&
+                !locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            if (spins >= 64) {
+                std::this_thread::yield();
+            } else {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+        }
+    }
+
+    void unlock() { locked.store(false, std::memory_order_release); }
+};
+
+class AccountLedger {
+public:
+    static const size_t kDefaultShards = 4096;
+
+private:
+    struct alignas(64) Shard {
+        LedgerSpinLock lock;
+        std::unique_ptr<std::atomic<int64_t>[]> balances;
+    };
+
+    size_t shardCount;
+    size_t slotsPerShard;
+    size_t maxAccounts;
+    Shard* shards;   // cache-line aligned array, see the constructor
+    std::atomic<uint64_t> accountCount;
+
+    AccountLedger(const AccountLedger&);
+    AccountLedger& operator=(const AccountLedger&);
+
+    bool known(int64_t account) const {
+        return account >= 0 && (uint64_t)account < accountCount.load(std::memory_order_acquire);
+    }
+
+    Shard& shardOf(int64_t account) const { return shards[(size_t)account % shardCount]; }
+
+    std::atomic<int64_t>& slotOf(int64_t account) const {
+        return shardOf(account).balances[(size_t)account / shardCount];
+    }
+
+    // Caller holds the shard lock
+    static bool debit(std::atomic<int64_t>& balance, int64_t cents) {
+        int64_t current = balance.load(std::memory_order_relaxed);
+        if (current < cents) {
+            errno = ERANGE;
+            return false;
+        }
+        balance.store(current - cents, std::memory_order_relaxed);
+        return true;
+    }
+
+    static bool credit(std::atomic<int64_t>& balance, int64_t cents) {
+        int64_t current = balance.load(std::memory_order_relaxed);
+        if (current > INT64_MAX - cents) {
+            errno = ERANGE;
+            return false;
+        }
+        balance.store(current + cents, std::memory_order_relaxed);
+        return true;
+    }
+
+public:
+    explicit AccountLedger(size_t capacity, size_t shardsWanted = kDefaultShards)
+        : shardCount(shardsWanted > 0 ? shardsWanted : 1),
+          slotsPerShard((capacity + shardCount - 1) / shardCount),
+          maxAccounts(capacity), shards(NULL), accountCount(0) {
+        // new Shard[] only honours alignas(64) from C++17 on
+        void* memory = NULL;
+        if (posix_memalign(&memory, 64, shardCount * sizeof(Shard)) != 0) {
+            throw std::bad_alloc();
+        }
+        shards = static_cast<Shard*>(memory);
+        for (size_t s = 0; s < shardCount; s++) {
+            new (&shards[s]) Shard();
+            shards[s].balances.reset(new std::atomic<int64_t>[slotsPerShard]);
+            for (size_t i = 0; i < slotsPerShard; i++) {
+                shards[s].balances[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ~AccountLedger() {
+        for (size_t s = 0; s < shardCount; s++) {
+            shards[s].~Shard();
+        }
+        free(shards);
+    }
+
+    // Returns the new account's id, or -1 with errno ENOSPC when the ledger
+    // is full (EINVAL for a negative opening balance). Ids are dense, from 0.
+    int64_t openAccount(int64_t initialCents = 0) {
+        if (initialCents < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        // The id is claimed under its shard's lock, so a deposit to it waits
+        // for the opening balance instead of being overwritten by it, and
+        // totalCents() sees the balance together with the account
+        for (;;) {
+            uint64_t id = accountCount.load(std::memory_order_relaxed);
+            if (id >= maxAccounts) {
+                errno = ENOSPC;
+                return -1;
+            }
+            Shard& shard = shardOf((int64_t)id);
+            shard.lock.lock();
+            bool claimed = accountCount.compare_exchange_strong(id, id + 1, std::memory_order_relaxed);
+            if (claimed) {
+                slotOf((int64_t)id).store(initialCents, std::memory_order_relaxed);
+            }
+            shard.lock.unlock();
+            if (claimed) {
+                return (int64_t)id;
+            }
+        }
+    }
+
+    bool deposit(int64_t account, int64_t cents) {
+        if (cents <= 0) {
+            errno = EINVAL;
+            return false;
+        }
+        if (!known(account)) {
+            errno = ENOENT;
+            return false;
+        }
+        Shard& shard = shardOf(account);
+        shard.lock.lock();
+        bool ok = credit(slotOf(account), cents);
+        shard.lock.unlock();
+        return ok;
+    }
+
+    bool withdraw(int64_t account, int64_t cents) {
+        if (cents <= 0) {
+            errno = EINVAL;
+            return false;
+        }
+        if (!known(account)) {
+            errno = ENOENT;
+            return false;
+        }
+        Shard& shard = shardOf(account);
+        shard.lock.lock();
+        bool ok = debit(slotOf(account), cents);
+        shard.lock.unlock();
+        return ok;
+    }
+
+    // Moves cents from one account to the other, or changes nothing
+    bool transfer(int64_t from, int64_t to, int64_t cents) {
+        if (cents <= 0) {
+            errno = EINVAL;
+            return false;
+        }
+        if (!known(from) || !known(to)) {
+            errno = ENOENT;
+            return false;
+        }
+        size_t a = (size_t)from % shardCount;
+        size_t b = (size_t)to % shardCount;
+        // Always lock the lower shard first: no cycle, no deadlock
+        Shard& first = shards[a < b ? a : b];
+        Shard& second = shards[a < b ? b : a];
+        first.lock.lock();
+        if (a != b) {
+            second.lock.lock();
+        }
+        std::atomic<int64_t>& source = slotOf(from);
+        std::atomic<int64_t>& target = slotOf(to);
+        bool ok;
+        if (from == to) {
+            ok = source.load(std::memory_order_relaxed) >= cents;
+            if (!ok) {
+                errno = ERANGE;
+            }
+        } else {
+            ok = debit(source, cents);
+            if (ok && !credit(target, cents)) {
+                source.fetch_add(cents, std::memory_order_relaxed);  // undo the debit
+                ok = false;
+            }
+        }
+        if (a != b) {
+            second.lock.unlock();
+        }
+        first.lock.unlock();
+        return ok;
+    }
+
+    // Current balance in cents, or -1 with errno ENOENT
+    int64_t balance(int64_t account) const {
+        if (!known(account)) {
+            errno = ENOENT;
+            return -1;
+        }
+        return slotOf(account).load(std::memory_order_relaxed);
+    }
+
+    // Consistent sum over all accounts; locks every shard, so keep it for
+    // audits, not hot paths
+    int64_t totalCents() const {
+        for (size_t s = 0; s < shardCount; s++) {
+            shards[s].lock.lock();
+        }
+        int64_t total = 0;
+        uint64_t count = accountCount.load(std::memory_order_acquire);
+        for (uint64_t id = 0; id < count; id++) {
+            total += slotOf((int64_t)id).load(std::memory_order_relaxed);
+        }
+        for (size_t s = shardCount; s > 0; s--) {
+            shards[s - 1].lock.unlock();
+        }
+        return total;
+    }
+
+    // Copies every balance into out, indexed by account id. Locks every
+    // shard like totalCents(), so the copy is consistent.
+    void exportBalances(std::vector<int64_t>& out) const {
+        for (size_t s = 0; s < shardCount; s++) {
+            shards[s].lock.lock();
+        }
+        size_t count = (size_t)accountCount.load(std::memory_order_acquire);
+        out.resize(count);
+        for (size_t s = 0; s < shardCount; s++) {
+            for (size_t id = s; id < count; id += shardCount) {
+                out[id] = shards[s].balances[id / shardCount].load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t s = shardCount; s > 0; s--) {
+            shards[s - 1].lock.unlock();
+        }
+    }
+
+    // Copies the balances of accounts [first, first + count) without any
+    // locking; returns how many were copied. Only for a ledger nobody is
+    // changing, such as the frozen copy a fork()ed child sees.
+    size_t readBalances(size_t first, int64_t* out, size_t count) const {
+        size_t size = (size_t)accountCount.load(std::memory_order_acquire);
+        if (first >= size) {
+            return 0;
+        }
+        if (count > size - first) {
+            count = size - first;
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[i] = slotOf((int64_t)(first + i)).load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    // Fills an empty ledger with count accounts, e.g. from a snapshot.
+    // Returns false with errno EBUSY if accounts exist already, ENOSPC if
+    // count is above the capacity. Not safe against concurrent use.
+    bool restore(const int64_t* balances, size_t count) {
+        if (accountCount.load(std::memory_order_acquire) != 0) {
+            errno = EBUSY;
+            return false;
+        }
+        if (count > maxAccounts) {
+            errno = ENOSPC;
+            return false;
+        }
+        for (size_t id = 0; id < count; id++) {
+            slotOf((int64_t)id).store(balances[id], std::memory_order_relaxed);
+        }
+        accountCount.store(count, std::memory_order_release);
+        return true;
+    }
+
+    // Adds delta (which may be negative) without checking the result. Only
+    // for replaying operations that were already checked once, like a log.
+    bool adjust(int64_t account, int64_t delta) {
+        if (!known(account)) {
+            errno = ENOENT;
+            return false;
+        }
+        Shard& shard = shardOf(account);
+        shard.lock.lock();
+        slotOf(account).fetch_add(delta, std::memory_order_relaxed);
+        shard.lock.unlock();
+        return true;
+    }
+
+    size_t size() const { return (size_t)accountCount.load(std::memory_order_acquire); }
+    size_t capacity() const { return maxAccounts; }
+    size_t shardTotal() const { return shardCount; }
+};
+
+#endif // ACCOUNT_LEDGER_H
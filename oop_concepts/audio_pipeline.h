@@ -0,0 +1,1093 @@
+#ifndef AUDIO_PIPELINE_H
+#define AUDIO_PIPELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include "pcm_dsp.h"
+
+// Streaming playback: a decoder thread and a sink thread joined by a
+// lock-free single-producer, single-consumer ring of PCM blocks.
+//
+//   WAV/PCM file --read() into a free block--> PcmRing --> sink thread
+//   (decoder thread, fixed-size blocks)        (N blocks)  paced at the
+//                                                          sample rate
+//
+// Every block is allocated in start(). After that, neither thread
+// allocates, locks or copies samples twice: the decoder read()s straight
+// into a ring block and the sink write()s it out from there. The sink
+// writes one block per block duration, as a sound card would consume it.
+// If the ring is empty when a block is due, the card would have played
+// silence; that is counted as an underrun. Decode-to-output latency is
+// recorded per block and is bounded by the ring: at most ringBlocks
+// blocks can be waiting.
+//
+// The decoder can also process each block with pcm_dsp.h before
+// publishing it: resample to config.outputRate, and apply a gain that
+// setGain() ramps to over one block. With neither, blocks stay zero-copy.
+//
+// Tracks queued with queueTrack() follow without a gap: the decoder moves
+// on to the next one in the same ring, and the sink keeps its pace.
+// With config.prefetch a third thread prepares the next track while the
+// current one plays: it mmap()s the file with MADV_WILLNEED, so the kernel
+// reads it ahead, and decodes its first prefetchMillis into memory (a
+// PreparedTrack). The decoder then switches tracks by swapping a pointer,
+// and its first blocks of the new track are copies from memory. Without
+// prefetch, the decoder opens and reads the next file itself at the
+// switch, as a plain player would.
+//
+//   AudioPipeline pipeline;
+//   if (!pipeline.start("song.wav", "/dev/null")) perror("start");
+//   pipeline.queueTrack("next.wav");     // plays right after song.wav
+//   pipeline.wait();                     // or stop() at any time
+//   AudioPipelineStats stats = pipeline.stats();
+
+struct PcmFormat {
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint16_t bitsPerSample;   // only 16-bit signed little-endian samples are played
+
+    uint32_t frameBytes() const { return (uint32_t)channels * (bitsPerSample / 8); }
+};
+
+inline int64_t audioNowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+inline void audioSleepUntilNs(int64_t deadline) {
+    struct timespec until;
+    until.tv_sec = (time_t)(deadline / 1000000000);
+    until.tv_nsec = (long)(deadline % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+// Sequential reader for RIFF/WAVE files with 16-bit PCM data, or for raw
+// 16-bit PCM files of a known format. Reads with pread(), or copies from
+// an mmap() of the file (openMapped()).
+class WavReader {
+private:
+    int fd;
+    const char* map;
+    size_t mapSize;
+    PcmFormat pcm;
+    uint64_t dataOffset;
+    uint64_t dataFrames;
+    uint64_t position;   // in frames
+
+    static uint32_t le16(const unsigned char* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8); }
+    static uint32_t le32(const unsigned char* p) { return le16(p) | (le16(p + 2) << 16); }
+
+    bool readAt(void* buffer, size_t size, uint64_t offset) {
+        if (map) {
+            if (offset > mapSize || size > mapSize - offset) {
+                errno = EINVAL;   // truncated header
+                return false;
+            }
+            memcpy(buffer, map + offset, size);
+            return true;
+        }
+        char* out = static_cast<char*>(buffer);
+        while (size > 0) {
+            ssize_t n = pread(fd, out, size, (off_t)offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (n == 0) {
+                    errno = EINVAL;   // truncated header
+                }
+                return false;
+            }
+            out += n;
+            size -= (size_t)n;
+            offset += (uint64_t)n;
+        }
+        return true;
+    }
+
+    bool parseHeader(uint64_t fileSize) {
+        unsigned char riff[12];
+        if (!readAt(riff, sizeof(riff), 0)) {
+            return false;
+        }
+        if (memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+            errno = EINVAL;
+            return false;
+        }
+        bool haveFormat = false;
+        uint64_t offset = 12;
+        while (offset + 8 <= fileSize) {
+            unsigned char chunk[8];
+            if (!readAt(chunk, sizeof(chunk), offset)) {
+                return false;
+            }
+            uint64_t size = le32(chunk + 4);
+            offset += 8;
+            if (memcmp(chunk, "fmt ", 4) == 0) {
+                unsigned char format[16];
+                if (size < sizeof(format) || !readAt(format, sizeof(format), offset)) {
+                    errno = EINVAL;
+                    return false;
+                }
+                // 1 is PCM, 0xFFFE is WAVE_FORMAT_EXTENSIBLE (PCM for our purposes)
+                uint32_t tag = le16(format);
+                pcm.channels = (uint16_t)le16(format + 2);
+                pcm.sampleRate = le32(format + 4);
+                pcm.bitsPerSample = (uint16_t)le16(format + 14);
+                if ((tag != 1 && tag != 0xFFFE) || pcm.bitsPerSample != 16) {
+                    errno = ENOTSUP;
+                    return false;
+                }
+                haveFormat = true;
+            } else if (memcmp(chunk, "data", 4) == 0) {
+                if (!haveFormat || pcm.channels == 0 || pcm.sampleRate == 0) {
+                    errno = EINVAL;
+                    return false;
+                }
+                dataOffset = offset;
+                dataFrames = std::min(size, fileSize - offset) / pcm.frameBytes();
+                return true;
+            }
+            offset += size + (size & 1);   // chunks are padded to even sizes
+        }
+        errno = EINVAL;
+        return false;
+    }
+
+    bool openFile(const std::string& path, const PcmFormat* raw, bool mapped) {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        off_t fileSize = lseek(fd, 0, SEEK_END);
+        bool ok = fileSize >= 0;
+        if (ok && mapped) {
+            // The mapping keeps the file; the descriptor is not needed
+            void* mappedFile = MAP_FAILED;
+            if (fileSize == 0) {
+                errno = EINVAL;   // no header
+            } else {
+                mappedFile = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ok = mappedFile != MAP_FAILED;
+            if (ok) {
+                map = static_cast<const char*>(mappedFile);
+                mapSize = (size_t)fileSize;
+                madvise(mappedFile, mapSize, MADV_WILLNEED);
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        if (ok && raw) {
+            pcm = *raw;
+            ok = pcm.bitsPerSample == 16 && pcm.channels > 0 && pcm.sampleRate > 0;
+            errno = ok ? errno : EINVAL;
+            dataOffset = 0;
+            dataFrames = ok ? (uint64_t)fileSize / pcm.frameBytes() : 0;
+        } else if (ok) {
+            ok = parseHeader((uint64_t)fileSize);
+        }
+        if (!ok) {
+            int error = errno;
+            close();
+            errno = error;
+            return false;
+        }
+        position = 0;
+        return true;
+    }
+
+    WavReader(const WavReader&);
+    WavReader& operator=(const WavReader&);
+
+public:
+    WavReader() : fd(-1), map(NULL), mapSize(0), dataOffset(0), dataFrames(0), position(0) {
+        memset(&pcm, 0, sizeof(pcm));
+    }
+
+    ~WavReader() { close(); }
+
+    // Opens a WAV file. Returns false with errno set: EINVAL if it is not a
+    // WAV file, ENOTSUP if its samples are not 16-bit PCM.
+    bool open(const std::string& path) {
+        return openFile(path, NULL, false);
+    }
+
+    // Opens a WAV file through mmap() and asks the kernel to read all of it
+    // ahead in the background (MADV_WILLNEED). read() then copies from the
+    // mapping without system calls. The file must not shrink while it is
+    // open: reading a page past its end raises SIGBUS.
+    bool openMapped(const std::string& path) {
+        return openFile(path, NULL, true);
+    }
+
+    // Opens a headerless file of 16-bit samples in the given format
+    bool openRaw(const std::string& path, const PcmFormat& format) {
+        return openFile(path, &format, false);
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (map) {
+            munmap(const_cast<char*>(map), mapSize);
+            map = NULL;
+            mapSize = 0;
+        }
+        dataFrames = 0;
+        position = 0;
+    }
+
+    bool isOpen() const { return fd >= 0 || map != NULL; }
+    bool isMapped() const { return map != NULL; }
+    const PcmFormat& format() const { return pcm; }
+    uint64_t frames() const { return dataFrames; }
+    uint64_t tell() const { return position; }
+
+    void seek(uint64_t frame) { position = std::min(frame, dataFrames); }
+
+    // Reads up to maxFrames interleaved frames into out. Returns the number
+    // read, 0 at the end of the data, -1 with errno on a read error.
+    ssize_t read(int16_t* out, size_t maxFrames) {
+        size_t wanted = (size_t)std::min<uint64_t>(maxFrames, dataFrames - position);
+        size_t bytes = wanted * pcm.frameBytes();
+        if (bytes > 0 && !readAt(out, bytes, dataOffset + position * pcm.frameBytes())) {
+            if (errno == EINVAL) {
+                errno = EIO;   // the file shrank under us
+            }
+            return -1;
+        }
+        position += wanted;
+        return (ssize_t)wanted;
+    }
+};
+
+// Writes a 16-bit PCM WAV file (for tests and benchmarks)
+inline bool writeWavFile(const std::string& path, const PcmFormat& format, const int16_t* samples,
+                         uint64_t frames) {
+    uint64_t dataBytes = frames * format.frameBytes();
+    if (format.bitsPerSample != 16 || dataBytes > 0xFFFFFFFFu - 36) {
+        errno = EINVAL;
+        return false;
+    }
+    unsigned char header[44];
+    uint32_t fields[] = {(uint32_t)(36 + dataBytes), 16, format.sampleRate,
+                         format.sampleRate * format.frameBytes(), (uint32_t)dataBytes};
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    memcpy(header + 36, "data", 4);
+    uint32_t offsets[] = {4, 16, 24, 28, 40};
+    for (int f = 0; f < 5; f++) {
+        for (int b = 0; b < 4; b++) {
+            header[offsets[f] + b] = (unsigned char)(fields[f] >> (8 * b));
+        }
+    }
+    uint16_t shorts[] = {1, format.channels, (uint16_t)format.frameBytes(), 16};
+    uint32_t shortOffsets[] = {20, 22, 32, 34};
+    for (int f = 0; f < 4; f++) {
+        header[shortOffsets[f]] = (unsigned char)shorts[f];
+        header[shortOffsets[f] + 1] = (unsigned char)(shorts[f] >> 8);
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const char* parts[] = {reinterpret_cast<const char*>(header), reinterpret_cast<const char*>(samples)};
+    uint64_t sizes[] = {sizeof(header), dataBytes};
+    for (int p = 0; p < 2; p++) {
+        const char* data = parts[p];
+        uint64_t left = sizes[p];
+        while (left > 0) {
+            ssize_t n = ::write(fd, data, (size_t)std::min<uint64_t>(left, 1 << 20));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                int error = errno;
+                ::close(fd);
+                errno = error;
+                return false;
+            }
+            data += n;
+            left -= (uint64_t)n;
+        }
+    }
+    return ::close(fd) == 0;
+}
+
+// A track opened for playback with its first frames already decoded into
+// memory, so that reading the start of it costs no I/O. Prepared off the
+// audio threads; see AudioPipeline::queueTrack().
+class PreparedTrack {
+private:
+    WavReader reader;
+    std::vector<int16_t> head;   // decoded frames from headStart on
+    uint64_t headStart;
+    uint64_t headEnd;
+    uint64_t position;
+    int openError;
+    PreparedTrack* retiredNext;   // AudioPipeline's list of finished tracks
+
+    friend class AudioPipeline;
+
+    PreparedTrack(const PreparedTrack&);
+    PreparedTrack& operator=(const PreparedTrack&);
+
+public:
+    PreparedTrack() : headStart(0), headEnd(0), position(0), openError(0), retiredNext(NULL) {}
+
+    // Opens path (through mmap() with read-ahead if mapped) at fromFrame and
+    // decodes headSeconds of it. Returns false with errno, also kept in
+    // error(), if the file cannot be opened or read.
+    bool prepare(const std::string& path, bool mapped, double headSeconds, uint64_t fromFrame = 0) {
+        bool ok = mapped ? reader.openMapped(path) : reader.open(path);
+        if (ok) {
+            reader.seek(fromFrame);
+            headStart = reader.tell();
+            uint64_t frames = std::min<uint64_t>((uint64_t)(headSeconds * reader.format().sampleRate),
+                                                 reader.frames() - headStart);
+            head.resize((size_t)frames * reader.format().channels);
+            ok = frames == 0 || reader.read(head.empty() ? NULL : &head[0], (size_t)frames) == (ssize_t)frames;
+            headEnd = reader.tell();
+            position = headStart;
+        }
+        openError = ok ? 0 : errno;
+        return ok;
+    }
+
+    int error() const { return openError; }
+    const PcmFormat& format() const { return reader.format(); }
+    uint64_t frames() const { return reader.frames(); }
+    uint64_t tell() const { return position; }
+
+    // As WavReader::read(): from the decoded head while it lasts, then from
+    // the file
+    ssize_t read(int16_t* out, size_t maxFrames) {
+        size_t copied = 0;
+        if (position < headEnd) {
+            unsigned channels = reader.format().channels;
+            copied = (size_t)std::min<uint64_t>(maxFrames, headEnd - position);
+            memcpy(out, &head[(size_t)(position - headStart) * channels], copied * channels * sizeof(int16_t));
+            position += copied;
+            out += copied * channels;
+            if (copied == maxFrames) {
+                return (ssize_t)copied;
+            }
+        }
+        ssize_t frames = reader.read(out, maxFrames - copied);
+        if (frames < 0) {
+            return -1;
+        }
+        position += (uint64_t)frames;
+        return (ssize_t)(copied + (size_t)frames);
+    }
+};
+
+struct PcmBlock {
+    int16_t* samples;      // interleaved, room for the ring's blockFrames
+    uint32_t frames;
+    bool last;             // nothing follows this block
+    int64_t readyNs;       // when the decoder published it
+    uint64_t sourceEnd;    // source frame after the ones in this block, in its track
+    uint32_t track;        // 0 for the track passed to start(), then queueTrack() order
+};
+
+// Single-producer, single-consumer ring of preallocated PCM blocks. The
+// producer fills beginWrite() and publishes it with commitWrite(); the
+// consumer reads beginRead() and hands it back with commitRead(). Each
+// side only stores its own index and keeps a cached copy of the other
+// side's, so the shared cache line is only read when the cache says the
+// ring is full (or empty).
+class PcmRing {
+private:
+    static const size_t kCacheLine = 64;
+
+    std::vector<PcmBlock> blocks;
+    std::vector<int16_t> storage;
+    uint64_t mask;
+    uint32_t framesPerBlock;
+    char pad0[kCacheLine];
+    std::atomic<uint64_t> head;   // next block to write
+    uint64_t cachedTail;          // producer's copy of tail
+    char pad1[kCacheLine];
+    std::atomic<uint64_t> tail;   // next block to read
+    uint64_t cachedHead;          // consumer's copy of head
+    char pad2[kCacheLine];
+
+    PcmRing(const PcmRing&);
+    PcmRing& operator=(const PcmRing&);
+
+public:
+    // Rounds blockCount up to a power of two
+    PcmRing(size_t blockCount, uint32_t blockFrames, uint16_t channels)
+        : mask(0), framesPerBlock(blockFrames), head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t capacity = 1;
+        while (capacity < blockCount) {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        blocks.resize(capacity);
+        storage.resize(capacity * blockFrames * channels);
+        for (size_t i = 0; i < capacity; i++) {
+            blocks[i].samples = &storage[i * blockFrames * channels];
+            blocks[i].frames = 0;
+            blocks[i].last = false;
+            blocks[i].readyNs = 0;
+            blocks[i].sourceEnd = 0;
+            blocks[i].track = 0;
+        }
+    }
+
+    size_t capacity() const { return blocks.size(); }
+    uint32_t blockFrames() const { return framesPerBlock; }
+
+    // Producer: a free block, or NULL if the ring is full
+    PcmBlock* beginWrite() {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        if (position - cachedTail == blocks.size()) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position - cachedTail == blocks.size()) {
+                return NULL;
+            }
+        }
+        return &blocks[position & mask];
+    }
+
+    void commitWrite() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Consumer: the oldest published block, or NULL if the ring is empty
+    PcmBlock* beginRead() {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        if (position == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position == cachedHead) {
+                return NULL;
+            }
+        }
+        return &blocks[position & mask];
+    }
+
+    void commitRead() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+struct AudioPipelineConfig {
+    uint32_t blockFrames;       // frames per block
+    uint32_t ringBlocks;        // blocks in the ring (rounded up to a power of two)
+    double speed;               // sink pace; 1.0 is real time
+    // For testing underrun handling: the decoder sleeps stallMicros after
+    // every stallEveryBlocks blocks (0 never stalls)
+    uint32_t stallEveryBlocks;
+    uint32_t stallMicros;
+    uint32_t outputRate;        // resample to this rate; 0 keeps the track's
+    float gain;                 // initial gain, 1.0 leaves samples as they are
+    bool prefetch;              // prepare queued tracks on a background thread
+    uint32_t prefetchMillis;    // of each prepared track, decoded ahead
+
+    AudioPipelineConfig()
+        : blockFrames(512), ringBlocks(8), speed(1.0), stallEveryBlocks(0), stallMicros(0), outputRate(0),
+          gain(1.0f), prefetch(true), prefetchMillis(500) {}
+};
+
+struct AudioPipelineStats {
+    uint64_t blocks;              // written to the output
+    uint64_t frames;              // at the output rate
+    uint64_t underruns;           // a block was due and the ring was empty
+    double underrunSeconds;       // spent waiting for the decoder after a due block
+    uint64_t decoderWaits;        // the decoder found the ring full (backpressure)
+    double firstAudioSeconds;     // start() to the first block written
+    double latencyP50Seconds;     // block decoded to block written
+    double latencyP99Seconds;
+    double latencyMaxSeconds;
+    double latencyBoundSeconds;   // what a full ring lasts
+    int error;                    // errno of a failed read or write, 0 if none
+    // Track switches. A switch runs from the decoder reaching the end of a
+    // track to it publishing the first block of the next one; the page
+    // faults and blocks read are the decoder thread's in that time.
+    uint32_t tracks;              // played, at least in part
+    uint32_t skippedTracks;       // queued but unreadable, or in another format
+    uint32_t gaps;                // switches the sink reached with the ring empty
+    uint32_t switches;
+    double switchMeanSeconds;
+    double switchMaxSeconds;
+    long switchMajorFaults;
+    long switchMinorFaults;
+    long switchInputBlocks;
+    long decoderMajorFaults;      // decoder thread, whole run
+    long decoderInputBlocks;
+};
+
+class AudioPipeline {
+private:
+    struct ThreadUsage {
+        long majorFaults;
+        long minorFaults;
+        long inputBlocks;   // 512-byte units read from storage
+    };
+
+    PreparedTrack* current;   // the decoder's after start()
+    PcmFormat sourcePcm;      // of the first track; queued tracks must match it
+    int output;
+    AudioPipelineConfig config;
+    PcmRing* ring;
+    size_t ringCapacity;
+    PcmFormat outputPcm;
+    // Decoder-side DSP; buffers are sized in start()
+    PolyphaseResampler resampler;
+    SimdLevel simdLevel;
+    std::vector<int16_t> decoded;
+    std::vector<float> samplesIn;
+    std::vector<float> samplesOut;
+    float currentGain;                // decoder only
+    std::atomic<float> targetGain;
+    std::thread decoder;
+    std::thread sink;
+    std::thread prefetcher;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> done;
+    std::atomic<int> error;
+    int64_t startNs;
+    uint64_t startFrame;
+    // Queued tracks: paths waiting for the prefetcher (or, without it, the
+    // decoder), then one prepared track waiting for the decoder, which
+    // waits on queueChanged when it is not there yet. Finished tracks are
+    // pushed on a list for the prefetcher to unmap.
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<std::string> queued;
+    std::atomic<uint32_t> pendingTracks;   // queued, not yet taken by the decoder
+    std::atomic<PreparedTrack*> nextTrack;
+    std::atomic<PreparedTrack*> retiredTracks;
+    // Written by the decoder
+    uint64_t decoderWaits;
+    uint32_t skippedTracks;
+    uint32_t switches;
+    int64_t switchTotalNs;
+    int64_t switchMaxNs;
+    ThreadUsage switchUsage;
+    ThreadUsage decoderUsage;
+    // Written by the sink
+    uint64_t blocksWritten;
+    uint64_t framesWritten;
+    std::atomic<uint64_t> sourceWritten;   // source frames behind the written blocks
+    std::atomic<uint32_t> trackWritten;    // the track they came from
+    uint64_t underruns;
+    int64_t underrunNs;
+    int64_t firstAudioNs;
+    uint32_t tracksPlayed;
+    uint32_t gaps;
+    std::vector<int64_t> latencies;   // reserved in start(), never grows past it
+
+    AudioPipeline(const AudioPipeline&);
+    AudioPipeline& operator=(const AudioPipeline&);
+
+    static ThreadUsage threadUsage() {
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+        ThreadUsage result = {usage.ru_majflt, usage.ru_minflt, usage.ru_inblock};
+        return result;
+    }
+
+    int64_t blockDurationNs(uint64_t frames) const {
+        return (int64_t)(frames * 1e9 / (outputPcm.sampleRate * config.speed));
+    }
+
+    // Reads up to blockFrames source frames into block, through the DSP
+    // stage when it has anything to do
+    ssize_t fill(PcmBlock* block) {
+        float target = targetGain.load(std::memory_order_relaxed);
+        if (resampler.passthrough() && currentGain == 1.0f && target == 1.0f) {
+            return current->read(block->samples, config.blockFrames);
+        }
+        ssize_t frames = current->read(&decoded[0], config.blockFrames);
+        if (frames <= 0) {
+            return frames;
+        }
+        unsigned channels = outputPcm.channels;
+        dsp_kernels::int16ToFloat(simdLevel, &decoded[0], &samplesIn[0], (size_t)frames * channels);
+        float* samples = &samplesIn[0];
+        ssize_t produced = frames;
+        if (!resampler.passthrough()) {
+            produced = resampler.process(samples, (size_t)frames, &samplesOut[0]);
+            samples = &samplesOut[0];
+        }
+        if (currentGain != 1.0f || target != 1.0f) {
+            dsp_kernels::gainRamp(simdLevel, samples, (size_t)produced, channels, currentGain, target);
+            currentGain = target;
+        }
+        dsp_kernels::floatToInt16(simdLevel, samples, block->samples, (size_t)produced * channels);
+        return produced;
+    }
+
+    // At the end of the stream the resampler still holds the last source
+    // frames; appends them to block after its first frames
+    size_t flushResampler(PcmBlock* block, size_t frames) {
+        unsigned channels = outputPcm.channels;
+        size_t flushed = resampler.flush(&samplesOut[0]);
+        if (currentGain != 1.0f) {
+            dsp_kernels::gainRamp(simdLevel, &samplesOut[0], flushed, channels, currentGain, currentGain);
+        }
+        dsp_kernels::floatToInt16(simdLevel, &samplesOut[0], block->samples + frames * channels, flushed * channels);
+        return flushed;
+    }
+
+    // Finished tracks are unmapped on the prefetcher, never on the decoder.
+    // The prefetcher takes the whole list at once, so the push is all the
+    // decoder does.
+    void retire(PreparedTrack* track) {
+        if (!config.prefetch) {
+            delete track;
+            return;
+        }
+        track->retiredNext = retiredTracks.load(std::memory_order_relaxed);
+        while (!retiredTracks.compare_exchange_weak(track->retiredNext, track, std::memory_order_release,
+                                                    std::memory_order_relaxed)) {
+        }
+    }
+
+    void freeRetired() {
+        PreparedTrack* track = retiredTracks.exchange(NULL, std::memory_order_acquire);
+        while (track) {
+            PreparedTrack* next = track->retiredNext;
+            delete track;
+            track = next;
+        }
+    }
+
+    // Replaces the finished current track with the next queued one that
+    // can be played, counting skipped ones in track. False if none is left
+    // or stop() was called.
+    bool advanceTrack(uint32_t& track) {
+        while (pendingTracks.load(std::memory_order_acquire) > 0) {
+            PreparedTrack* next = NULL;
+            if (config.prefetch) {
+                next = nextTrack.exchange(NULL, std::memory_order_acq_rel);
+                if (!next) {
+                    // The prefetcher is behind; the ring plays on meanwhile
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueChanged.wait(lock, [this] {
+                        return nextTrack.load(std::memory_order_acquire) || stopRequested.load();
+                    });
+                    if (stopRequested.load()) {
+                        return false;
+                    }
+                    continue;
+                }
+            } else {
+                std::string path;
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    path = queued.front();
+                    queued.pop_front();
+                }
+                // The open and reads that the prefetcher keeps off this thread
+                next = new PreparedTrack();
+                next->prepare(path, false, 0.0);
+            }
+            pendingTracks.fetch_sub(1, std::memory_order_acq_rel);
+            track++;
+            if (next->error() == 0 && next->format().sampleRate == sourcePcm.sampleRate &&
+                next->format().channels == sourcePcm.channels) {
+                retire(current);
+                current = next;
+                return true;
+            }
+            skippedTracks++;
+            retire(next);
+        }
+        return false;
+    }
+
+    void decodeLoop() {
+        ThreadUsage begin = threadUsage();
+        uint64_t blocksDecoded = 0;
+        bool waiting = false;
+        uint32_t track = 0;
+        int64_t switchStartNs = 0;   // until the first block of a new track is published
+        ThreadUsage switchStart = begin;
+        while (!stopRequested.load(std::memory_order_relaxed)) {
+            PcmBlock* block = ring->beginWrite();
+            if (!block) {
+                // Full: the sink frees a block per block duration
+                decoderWaits += waiting ? 0 : 1;
+                waiting = true;
+                std::this_thread::sleep_for(std::chrono::nanoseconds(blockDurationNs(config.blockFrames) / 4));
+                continue;
+            }
+            waiting = false;
+            // Switching once there is a block to fill, so that a full ring
+            // does not count as switch time
+            if (current->tell() == current->frames() && pendingTracks.load(std::memory_order_acquire) > 0) {
+                switchStartNs = audioNowNs();
+                switchStart = threadUsage();
+                if (!advanceTrack(track)) {
+                    switchStartNs = 0;   // nothing to switch to: this block ends playback
+                }
+            }
+            ssize_t frames = fill(block);
+            if (frames < 0) {
+                error.store(errno);
+                frames = 0;
+            }
+            bool ended = current->tell() == current->frames();
+            bool last = error.load() != 0 || (ended && pendingTracks.load(std::memory_order_acquire) == 0);
+            if (last && error.load() == 0 && !resampler.passthrough()) {
+                frames += (ssize_t)flushResampler(block, (size_t)frames);
+            }
+            block->frames = (uint32_t)frames;
+            block->last = last;
+            block->readyNs = audioNowNs();
+            block->sourceEnd = current->tell();
+            block->track = track;
+            ring->commitWrite();
+            if (switchStartNs != 0) {
+                ThreadUsage now = threadUsage();
+                int64_t took = audioNowNs() - switchStartNs;
+                switches++;
+                switchTotalNs += took;
+                switchMaxNs = std::max(switchMaxNs, took);
+                switchUsage.majorFaults += now.majorFaults - switchStart.majorFaults;
+                switchUsage.minorFaults += now.minorFaults - switchStart.minorFaults;
+                switchUsage.inputBlocks += now.inputBlocks - switchStart.inputBlocks;
+                switchStartNs = 0;
+            }
+            if (last) {
+                break;
+            }
+            blocksDecoded++;
+            if (config.stallEveryBlocks > 0 && blocksDecoded % config.stallEveryBlocks == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(config.stallMicros));
+            }
+        }
+        ThreadUsage end = threadUsage();
+        decoderUsage.majorFaults = end.majorFaults - begin.majorFaults;
+        decoderUsage.minorFaults = end.minorFaults - begin.minorFaults;
+        decoderUsage.inputBlocks = end.inputBlocks - begin.inputBlocks;
+    }
+
+    // Prepares queued tracks one at a time, keeping at most one ready for
+    // the decoder, and frees the ones it has finished
+    void prefetchLoop() {
+        while (!stopRequested.load(std::memory_order_relaxed)) {
+            freeRetired();
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                if (queued.empty() || nextTrack.load(std::memory_order_acquire)) {
+                    // Woken by queueTrack(); the decoder taking a track is
+                    // noticed at the next timeout, without a syscall on its side
+                    queueChanged.wait_for(lock, std::chrono::milliseconds(10));
+                    continue;
+                }
+                path = queued.front();
+                queued.pop_front();
+            }
+            PreparedTrack* track = new PreparedTrack();
+            track->prepare(path, true, config.prefetchMillis / 1000.0);
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                nextTrack.store(track, std::memory_order_release);
+            }
+            queueChanged.notify_all();   // the decoder may be waiting for it
+        }
+    }
+
+    bool writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(output, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                error.store(errno);
+                return false;
+            }
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    void sinkLoop() {
+        int64_t deadline = 0;
+        bool started = false;
+        uint32_t frameBytes = outputPcm.frameBytes();
+        while (!stopRequested.load(std::memory_order_relaxed)) {
+            PcmBlock* block = ring->beginRead();
+            bool underran = false;
+            if (!block) {
+                // Before the first block this is just startup; after it, the
+                // card would be playing silence now
+                int64_t waitStart = audioNowNs();
+                underran = started;
+                underruns += started ? 1 : 0;
+                while (!(block = ring->beginRead()) && !stopRequested.load(std::memory_order_relaxed)) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                if (!block) {
+                    break;
+                }
+                if (started) {
+                    int64_t now = audioNowNs();
+                    underrunNs += now - waitStart;
+                    deadline = std::max(deadline, now);   // playback resumes late
+                }
+            }
+            if (!started) {
+                started = true;
+                deadline = audioNowNs();
+                firstAudioNs = deadline;
+                tracksPlayed = 1;
+            } else if (block->track != trackWritten.load(std::memory_order_relaxed)) {
+                tracksPlayed++;
+                gaps += underran ? 1 : 0;
+            }
+            bool ok = writeAll(reinterpret_cast<const char*>(block->samples), (size_t)block->frames * frameBytes);
+            int64_t now = audioNowNs();
+            if (latencies.size() < latencies.capacity()) {
+                latencies.push_back(now - block->readyNs);
+            }
+            blocksWritten++;
+            framesWritten += block->frames;
+            sourceWritten.store(block->sourceEnd, std::memory_order_relaxed);
+            trackWritten.store(block->track, std::memory_order_relaxed);
+            bool last = block->last;
+            uint32_t frames = block->frames;
+            ring->commitRead();
+            if (last || !ok) {
+                break;
+            }
+            deadline += blockDurationNs(frames);
+            audioSleepUntilNs(deadline);
+        }
+        done.store(true);
+    }
+
+    void resetCounters() {
+        decoderWaits = 0;
+        skippedTracks = 0;
+        switches = 0;
+        switchTotalNs = 0;
+        switchMaxNs = 0;
+        memset(&switchUsage, 0, sizeof(switchUsage));
+        memset(&decoderUsage, 0, sizeof(decoderUsage));
+        blocksWritten = 0;
+        framesWritten = 0;
+        underruns = 0;
+        underrunNs = 0;
+        firstAudioNs = 0;
+        tracksPlayed = 0;
+        gaps = 0;
+        error.store(0);
+        sourceWritten.store(startFrame);
+        trackWritten.store(0);
+        latencies.clear();
+    }
+
+public:
+    AudioPipeline()
+        : current(NULL), output(-1), ring(NULL), ringCapacity(0), simdLevel(detectSimdLevel()), currentGain(1.0f),
+          targetGain(1.0f), stopRequested(false), done(true), error(0), startNs(0), startFrame(0),
+          pendingTracks(0), nextTrack(NULL), retiredTracks(NULL) {
+        memset(&sourcePcm, 0, sizeof(sourcePcm));
+        memset(&outputPcm, 0, sizeof(outputPcm));
+        resetCounters();
+    }
+
+    ~AudioPipeline() { stop(); }
+
+    // Starts playing track (a WAV file) from startFrame into outputPath (a
+    // file, a FIFO or /dev/null). Returns false with errno if either cannot
+    // be opened, as WavReader::open() does.
+    bool start(const std::string& track, const std::string& outputPath,
+               const AudioPipelineConfig& pipelineConfig = AudioPipelineConfig(), uint64_t fromFrame = 0) {
+        stop();
+        current = new PreparedTrack();
+        double headSeconds = pipelineConfig.prefetch ? pipelineConfig.prefetchMillis / 1000.0 : 0.0;
+        if (!current->prepare(track, pipelineConfig.prefetch, headSeconds, fromFrame)) {
+            int saved = errno;
+            delete current;
+            current = NULL;
+            errno = saved;
+            return false;
+        }
+        output = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (output < 0) {
+            int saved = errno;
+            delete current;
+            current = NULL;
+            errno = saved;
+            return false;
+        }
+        config = pipelineConfig;
+        config.blockFrames = std::max<uint32_t>(config.blockFrames, 1);
+        config.speed = config.speed > 0 ? config.speed : 1.0;
+        sourcePcm = current->format();
+        outputPcm = sourcePcm;
+        outputPcm.sampleRate = config.outputRate > 0 ? config.outputRate : outputPcm.sampleRate;
+        unsigned channels = outputPcm.channels;
+        size_t blockCapacity = config.blockFrames;
+        if (outputPcm.sampleRate != sourcePcm.sampleRate) {
+            resampler.configure(sourcePcm.sampleRate, outputPcm.sampleRate, channels, config.blockFrames);
+            // The last block also takes what flush() returns
+            blockCapacity = resampler.maxOutputFrames(config.blockFrames) + resampler.maxFlushFrames();
+        } else {
+            resampler = PolyphaseResampler();
+        }
+        decoded.resize((size_t)config.blockFrames * channels);
+        samplesIn.resize((size_t)config.blockFrames * channels);
+        samplesOut.resize(blockCapacity * channels);
+        currentGain = config.gain;
+        targetGain.store(config.gain);
+        ring = new PcmRing(std::max<uint32_t>(config.ringBlocks, 1), (uint32_t)blockCapacity, channels);
+        ringCapacity = ring->capacity();
+        startFrame = current->tell();
+        resetCounters();
+        // Room for this track and a minute of queued ones
+        uint64_t latencyFrames = current->frames() - startFrame + 60 * (uint64_t)sourcePcm.sampleRate;
+        latencies.reserve((size_t)(latencyFrames / config.blockFrames + 2));
+        stopRequested.store(false);
+        done.store(false);
+        startNs = audioNowNs();
+        decoder = std::thread(&AudioPipeline::decodeLoop, this);
+        sink = std::thread(&AudioPipeline::sinkLoop, this);
+        if (config.prefetch) {
+            prefetcher = std::thread(&AudioPipeline::prefetchLoop, this);
+        }
+        return true;
+    }
+
+    // Plays path right after the tracks before it. Queue it before the one
+    // before it ends: once the decoder has read the last queued frame, the
+    // pipeline finishes. Tracks that cannot be opened, or whose rate or
+    // channels differ from the first track's, are skipped. False if the
+    // pipeline is not playing.
+    bool queueTrack(const std::string& path) {
+        if (done.load()) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queued.push_back(path);
+        }
+        pendingTracks.fetch_add(1, std::memory_order_release);
+        queueChanged.notify_all();
+        return true;
+    }
+
+    // Waits for the end of the last track. False if a read or write failed.
+    bool wait() {
+        if (sink.joinable()) {
+            sink.join();
+        }
+        {
+            // After a write error the decoder may be waiting for the ring
+            // or for the next track
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopRequested.store(true);
+        }
+        queueChanged.notify_all();
+        if (decoder.joinable()) {
+            decoder.join();
+        }
+        if (prefetcher.joinable()) {
+            prefetcher.join();
+        }
+        return error.load() == 0;
+    }
+
+    // Stops playback now; position() and track() say where
+    void stop() {
+        stopRequested.store(true);
+        wait();
+        if (output >= 0) {
+            ::close(output);
+            output = -1;
+        }
+        delete ring;
+        ring = NULL;
+        delete current;
+        current = NULL;
+        delete nextTrack.exchange(NULL);
+        freeRetired();
+        queued.clear();
+        pendingTracks.store(0);
+        done.store(true);
+    }
+
+    bool finished() const { return done.load(); }
+
+    // First source frame not yet written to the output, in track()
+    uint64_t position() const { return sourceWritten.load(std::memory_order_relaxed); }
+
+    // Of the last written block: 0 for the track passed to start(), 1 for
+    // the first queued one, and so on (skipped tracks count)
+    uint32_t track() const { return trackWritten.load(std::memory_order_relaxed); }
+
+    // Takes effect from the next block, ramped over that block. Any thread.
+    void setGain(float gain) { targetGain.store(gain, std::memory_order_relaxed); }
+    float gain() const { return targetGain.load(std::memory_order_relaxed); }
+
+    // Call after wait() or stop()
+    AudioPipelineStats stats() const {
+        AudioPipelineStats result;
+        memset(&result, 0, sizeof(result));
+        result.blocks = blocksWritten;
+        result.frames = framesWritten;
+        result.underruns = underruns;
+        result.underrunSeconds = underrunNs / 1e9;
+        result.decoderWaits = decoderWaits;
+        result.firstAudioSeconds = firstAudioNs > 0 ? (firstAudioNs - startNs) / 1e9 : 0.0;
+        // A block lasts as long as its source frames, whatever the output rate
+        result.latencyBoundSeconds =
+            (double)config.blockFrames * ringCapacity / (sourcePcm.sampleRate * config.speed);
+        result.error = error.load();
+        if (!latencies.empty()) {
+            std::vector<int64_t> sorted(latencies);
+            std::sort(sorted.begin(), sorted.end());
+            result.latencyP50Seconds = sorted[(sorted.size() - 1) / 2] / 1e9;
+            result.latencyP99Seconds = sorted[(size_t)((sorted.size() - 1) * 0.99)] / 1e9;
+            result.latencyMaxSeconds = sorted.back() / 1e9;
+        }
+        result.tracks = tracksPlayed;
+        result.skippedTracks = skippedTracks;
+        result.gaps = gaps;
+        result.switches = switches;
+        result.switchMeanSeconds = switches > 0 ? switchTotalNs / 1e9 / switches : 0.0;
+        result.switchMaxSeconds = switchMaxNs / 1e9;
+        result.switchMajorFaults = switchUsage.majorFaults;
+        result.switchMinorFaults = switchUsage.minorFaults;
+        result.switchInputBlocks = switchUsage.inputBlocks;
+        result.decoderMajorFaults = decoderUsage.majorFaults;
+        result.decoderInputBlocks = decoderUsage.inputBlocks;
+        return result;
+    }
+
+    // Of the first track, and of what is written to the output
+    const PcmFormat& format() const { return sourcePcm; }
+    const PcmFormat& outputFormat() const { return outputPcm; }
+};
+
+#endif // AUDIO_PIPELINE_H
@@ -0,0 +1,300 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include "shape.h"
+#include "payment_method.h"
+#include "employee.h"
+#include "vehicle.h"
+#include "object_arena.h"
+
+// Allocation cost of short-lived polymorphic objects.
+//
+// Every round creates N objects of ten classes (three shapes, three payment
+// methods, two employees, two vehicles) as polymorphism_example.cpp and
+// inheritance_example.cpp do, calls one virtual function on each, and frees
+// them all again, using:
+//   heap         new / delete through the base pointer
+//   arena        ObjectArena::create() + one release() per round
+//   pool         SizeClassPool::create() / destroy() through the base pointer
+//   pmr_pool     std::pmr::unsynchronized_pool_resource
+//   pmr_arena    std::pmr::monotonic_buffer_resource, released per round
+// Global operator new is counted, so the output shows heap allocations per
+// object (strings longer than the small-string buffer still allocate).
+//
+// Usage:
+//   ./bench_allocators [--objects 1000000] [--rounds 10] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+static size_t heapAllocationCount = 0;
+
+void* operator new(size_t size) {
+    heapAllocationCount++;
+    void* memory = malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+
+// The objects of one round, by base class
+struct ObjectSet {
+    std::vector<Shape*> shapes;
+    std::vector<PaymentMethod*> payments;
+    std::vector<Employee*> employees;
+    std::vector<Vehicle*> vehicles;
+
+    void clear() {
+        shapes.clear();
+        payments.clear();
+        employees.clear();
+        vehicles.clear();
+    }
+};
+
+struct HeapPolicy {
+    template <typename T, typename... Args>
+    T* create(Args&&... args) { return new T(std::forward<Args>(args)...); }
+
+    template <typename T>
+    void destroyAll(std::vector<T*>& objects) {
+        for (size_t i = 0; i < objects.size(); i++) {
+            delete objects[i];
+        }
+    }
+
+    void endRound() {}
+    size_t ownHeapAllocations() const { return 0; }
+};
+
+struct ArenaPolicy {
+    ObjectArena arena;
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) { return arena.create<T>(std::forward<Args>(args)...); }
+
+    template <typename T>
+    void destroyAll(std::vector<T*>&) {}
+
+    void endRound() { arena.release(); }
+    size_t ownHeapAllocations() const { return arena.heapAllocations(); }
+};
+
+struct PoolPolicy {
+    SizeClassPool pool;
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) { return pool.create<T>(std::forward<Args>(args)...); }
+
+    template <typename T>
+    void destroyAll(std::vector<T*>& objects) {
+        for (size_t i = 0; i < objects.size(); i++) {
+            pool.destroy(objects[i]);
+        }
+    }
+
+    void endRound() {}
+    size_t ownHeapAllocations() const { return pool.heapAllocations(); }
+};
+
+// Placement new on a memory_resource; sizes are remembered because
+// deallocate() needs them and a base pointer does not know its object's size
+struct PmrPolicy {
+    std::pmr::memory_resource* resource;
+    std::pmr::monotonic_buffer_resource* monotonic;
+    std::vector<std::pair<void*, size_t> > blocks;
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        void* memory = resource->allocate(sizeof(T), alignof(T));
+        blocks.push_back(std::make_pair(memory, sizeof(T)));
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void destroyAll(std::vector<T*>& objects) {
+        for (size_t i = 0; i < objects.size(); i++) {
+            objects[i]->~T();
+        }
+    }
+
+    void endRound() {
+        if (monotonic) {
+            monotonic->release();
+        } else {
+            for (size_t i = 0; i < blocks.size(); i++) {
+                resource->deallocate(blocks[i].first, blocks[i].second);
+            }
+        }
+        blocks.clear();
+    }
+
+    size_t ownHeapAllocations() const { return 0; }
+};
+
+template <typename Policy>
+static double runRound(Policy& policy, size_t count, ObjectSet& set) {
+    for (size_t i = 0; i < count; i++) {
+        double x = (double)(i % 97) + 1.0;
+        switch (i % 10) {
+        case 0: set.shapes.push_back(policy.template create<Circle>(x)); break;
+        case 1: set.shapes.push_back(policy.template create<Rectangle>(x, x + 1)); break;
+        case 2: set.shapes.push_back(policy.template create<Triangle>(x, x + 2)); break;
+        case 3: set.payments.push_back(policy.template create<CreditCardPayment>("4532-7891-2345-6789")); break;
+        case 4: set.payments.push_back(policy.template create<PayPalPayment>("user@example.com")); break;
+        case 5: set.payments.push_back(policy.template create<CryptoCurrencyPayment>("0xabc123def456")); break;
+        case 6: set.employees.push_back(policy.template create<Manager>("John Doe", (int)i, 100000, 20000, 5)); break;
+        case 7: set.employees.push_back(policy.template create<Developer>("Jane Smith", (int)i, 80000, "C++", 20)); break;
+        case 8: set.vehicles.push_back(policy.template create<ElectricCar>("Tesla", "Model 3", 2023, 40000, 75, 350)); break;
+        default: set.vehicles.push_back(policy.template create<LuxuryCar>("Mercedes", "S-Class", 2023, 90000, true, true)); break;
+        }
+    }
+
+    double checksum = 0.0;
+    for (size_t i = 0; i < set.shapes.size(); i++) {
+        checksum += set.shapes[i]->calculateArea();
+    }
+    for (size_t i = 0; i < set.payments.size(); i++) {
+        checksum += set.payments[i]->calculateFee(100.0);
+    }
+    for (size_t i = 0; i < set.employees.size(); i++) {
+        checksum += set.employees[i]->calculateSalary();
+    }
+    for (size_t i = 0; i < set.vehicles.size(); i++) {
+        checksum += set.vehicles[i]->calculatePrice();
+    }
+
+    policy.destroyAll(set.shapes);
+    policy.destroyAll(set.payments);
+    policy.destroyAll(set.employees);
+    policy.destroyAll(set.vehicles);
+    policy.endRound();
+    set.clear();
+    return checksum;
+}
+
+struct AllocResult {
+    std::string strategy;
+    double seconds;
+    double heapAllocsPerObject;
+    double checksum;
+};
+
+template <typename Policy>
+static AllocResult runStrategy(const char* name, Policy& policy, size_t count, size_t rounds) {
+    std::cerr << "Running " << name << "..." << std::endl;
+    ObjectSet set;
+    set.shapes.reserve(count);
+    set.payments.reserve(count);
+    set.employees.reserve(count);
+    set.vehicles.reserve(count);
+    // One untimed round, so pools and arenas start warm as in a long-running process
+    runRound(policy, count, set);
+
+    size_t allocationsBefore = heapAllocationCount + policy.ownHeapAllocations();
+    AllocResult result;
+    result.strategy = name;
+    result.checksum = 0.0;
+    Clock::time_point start = Clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        result.checksum += runRound(policy, count, set);
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    size_t allocations = heapAllocationCount + policy.ownHeapAllocations() - allocationsBefore;
+    result.heapAllocsPerObject = (double)allocations / (count * rounds);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 1000000;
+    size_t rounds = 10;
+    std::string format = "json";
+    const char* usage = " [--objects 1000000] [--rounds 10] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--objects") {
+            count = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--rounds") {
+            rounds = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (count == 0 || rounds == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    std::vector<AllocResult> results;
+    {
+        HeapPolicy heap;
+        results.push_back(runStrategy("heap", heap, count, rounds));
+    }
+    {
+        ArenaPolicy arena;
+        results.push_back(runStrategy("arena", arena, count, rounds));
+    }
+    {
+        PoolPolicy pool;
+        results.push_back(runStrategy("pool", pool, count, rounds));
+    }
+    {
+        std::pmr::unsynchronized_pool_resource resource;
+        PmrPolicy pmr = {&resource, NULL, std::vector<std::pair<void*, size_t> >()};
+        pmr.blocks.reserve(count);
+        results.push_back(runStrategy("pmr_pool", pmr, count, rounds));
+    }
+    {
+        std::pmr::monotonic_buffer_resource resource(1 << 20);
+        PmrPolicy pmr = {&resource, &resource, std::vector<std::pair<void*, size_t> >()};
+        pmr.blocks.reserve(count);
+        results.push_back(runStrategy("pmr_arena", pmr, count, rounds));
+    }
+
+    double baseline = results[0].seconds;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "strategy,objects,rounds,seconds,ns_per_object,speedup,heap_allocs_per_object,checksum\n";
+    } else {
+        std::cout << "{\n  \"objects\": " << count << ",\n  \"rounds\": " << rounds
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const AllocResult& r = results[i];
+        double nsPerObject = r.seconds * 1e9 / (count * rounds);
+        double speedup = r.seconds > 0 ? baseline / r.seconds : 0.0;
+        if (format == "csv") {
+            std::cout << r.strategy << "," << count << "," << rounds << "," << r.seconds << ","
+                      << nsPerObject << "," << speedup << "," << r.heapAllocsPerObject << ","
+                      << r.checksum << "\n";
+        } else {
+            std::cout << "    {\"strategy\": \"" << r.strategy << "\", \"seconds\": " << r.seconds
+                      << ", \"ns_per_object\": " << nsPerObject << ", \"speedup\": " << speedup
+                      << ", \"heap_allocs_per_object\": " << r.heapAllocsPerObject
+                      << ", \"checksum\": " << r.checksum << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <stdio.h>
+#include <unistd.h>
+#include "audio_pipeline.h"
+
+// Playback of a generated WAV file the way MusicPlayer::play() used to do
+// it (read the whole file into a std::string, pass it by value to the
+// "sound card", write it) against AudioPipeline with several block sizes
+// and ring depths, paced at --speed times real time. For each run:
+//   - first_audio_ms: play() to the first samples written
+//   - latency: a block decoded to the same block written (p50/p99/max),
+//     and the bound the ring puts on it
+//   - underruns: blocks that were due while the ring was empty. The
+//     "stalled" run makes the decoder sleep longer than the ring lasts
+//     every 200 blocks, so it must show them.
+//   - steady_allocs: heap allocations between start() returning and the
+//     end of the track (global operator new is counted)
+// The output file is compared with the samples of the WAV file.
+//
+// Usage:
+//   ./bench_audio_pipeline [--seconds 4] [--rate 48000] [--configs 256x4,1024x8,4096x4]
+//                          [--speed 1] [--file audio_bench.wav] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<size_t> heapAllocationCount(0);
+
+// Not inlined, so GCC does not pair malloc() and free() with the builtin
+// new and delete
+__attribute__((noinline)) void* operator new(size_t size) {
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* memory = malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept { free(memory); }
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept { free(memory); }
+
+struct PlaybackResult {
+    std::string method;
+    uint32_t blockFrames;
+    uint32_t ringBlocks;
+    double bufferKb;
+    AudioPipelineStats stats;
+    size_t steadyAllocations;
+    bool matches;
+};
+
+// The old MusicPlayer path, by value all the way
+static std::string decodeAudioFile(std::string filename) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    std::stringstream data;
+    data << in.rdbuf();
+    return data.str();
+}
+
+static bool sendToSoundCard(std::string audioData, const std::string& output, size_t headerBytes) {
+    FILE* file = fopen(output.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    size_t size = audioData.size() - headerBytes;
+    bool ok = fwrite(audioData.data() + headerBytes, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+static bool sameBytes(const std::string& path, const std::vector<int16_t>& samples) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::vector<int16_t> data(samples.size() + 1);
+    in.read(reinterpret_cast<char*>(&data[0]), data.size() * sizeof(int16_t));
+    data.resize((size_t)in.gcount() / sizeof(int16_t));
+    return data == samples;
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = 4.0;
+    uint32_t rate = 48000;
+    std::string configList = "256x4,1024x8,4096x4";
+    double speed = 1.0;
+    std::string path = "audio_bench.wav";
+    std::string format = "json";
+    const char* usage = " [--seconds 4] [--rate 48000] [--configs 256x4,1024x8,4096x4] [--speed 1]"
+                        " [--file audio_bench.wav] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--seconds") {
+            seconds = atof(argv[i + 1]);
+        } else if (arg == "--rate") {
+            rate = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--configs") {
+            configList = argv[i + 1];
+        } else if (arg == "--speed") {
+            speed = atof(argv[i + 1]);
+        } else if (arg == "--file") {
+            path = argv[i + 1];
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<AudioPipelineConfig> configs;
+    std::stringstream list(configList);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        AudioPipelineConfig config;
+        config.blockFrames = (uint32_t)strtoul(item.c_str(), NULL, 10);
+        size_t x = item.find('x');
+        config.ringBlocks = x == std::string::npos ? 0 : (uint32_t)strtoul(item.c_str() + x + 1, NULL, 10);
+        config.speed = speed;
+        if (config.blockFrames > 0 && config.ringBlocks > 0) {
+            configs.push_back(config);
+        }
+    }
+    if (seconds <= 0 || rate == 0 || speed <= 0 || configs.empty() || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+    // The first configuration again, with a decoder that falls behind
+    AudioPipelineConfig stalled = configs[0];
+    stalled.stallEveryBlocks = 200;
+    stalled.stallMicros = (uint32_t)(3e6 * stalled.blockFrames * stalled.ringBlocks / (rate * speed));
+
+    // A stereo 440 Hz tone
+    PcmFormat pcm = {rate, 2, 16};
+    std::vector<int16_t> samples((size_t)(seconds * rate) * 2);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (int16_t)(8000 * std::sin(2 * M_PI * 440 * (double)(i / 2) / rate));
+    }
+    std::cerr << "Writing " << seconds << " s of audio to " << path << "..." << std::endl;
+    if (!writeWavFile(path, pcm, &samples[0], samples.size() / 2)) {
+        perror(path.c_str());
+        return 1;
+    }
+    std::string output = path + ".out";
+
+    std::vector<PlaybackResult> results;
+    {
+        std::cerr << "Running serial..." << std::endl;
+        PlaybackResult result;
+        memset(&result.stats, 0, sizeof(result.stats));
+        result.method = "serial_whole_file";
+        result.blockFrames = (uint32_t)(samples.size() / 2);
+        result.ringBlocks = 1;
+        size_t allocationsBefore = heapAllocationCount.load();
+        Clock::time_point start = Clock::now();
+        std::string audio = decodeAudioFile(path);
+        result.stats.firstAudioSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.matches = sendToSoundCard(audio, output, 44);
+        result.steadyAllocations = heapAllocationCount.load() - allocationsBefore;
+        result.bufferKb = audio.size() * 2 / 1024.0;   // the string and its by-value copy
+        result.stats.blocks = 1;
+        result.stats.frames = samples.size() / 2;
+        result.matches = result.matches && sameBytes(output, samples);
+        results.push_back(result);
+    }
+
+    for (size_t c = 0; c <= configs.size(); c++) {
+        const AudioPipelineConfig& config = c < configs.size() ? configs[c] : stalled;
+        std::cerr << "Running pipeline " << config.blockFrames << "x" << config.ringBlocks
+                  << (c < configs.size() ? "" : " with decoder stalls") << "..." << std::endl;
+        PlaybackResult result;
+        result.method = c < configs.size() ? "pipeline" : "pipeline_stalled";
+        result.blockFrames = config.blockFrames;
+        result.ringBlocks = config.ringBlocks;
+        result.bufferKb = config.blockFrames * config.ringBlocks * pcm.frameBytes() / 1024.0;
+        AudioPipeline pipeline;
+        if (!pipeline.start(path, output, config)) {
+            perror("start");
+            return 1;
+        }
+        size_t allocationsBefore = heapAllocationCount.load();
+        bool ok = pipeline.wait();
+        result.steadyAllocations = heapAllocationCount.load() - allocationsBefore;
+        result.stats = pipeline.stats();
+        pipeline.stop();
+        result.matches = ok && sameBytes(output, samples);
+        results.push_back(result);
+    }
+    unlink(output.c_str());
+    unlink(path.c_str());
+
+    bool allMatch = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "method,block_frames,ring_blocks,buffer_kb,first_audio_ms,latency_p50_ms,latency_p99_ms,"
+                     "latency_max_ms,latency_bound_ms,underruns,underrun_ms,steady_allocs,matches\n";
+    } else {
+        std::cout << "{\n  \"seconds\": " << seconds << ",\n  \"rate\": " << rate << ",\n  \"speed\": " << speed
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const PlaybackResult& r = results[i];
+        const AudioPipelineStats& s = r.stats;
+        allMatch = allMatch && r.matches;
+        if (format == "csv") {
+            std::cout << r.method << "," << r.blockFrames << "," << r.ringBlocks << "," << r.bufferKb << ","
+                      << s.firstAudioSeconds * 1000 << "," << s.latencyP50Seconds * 1000 << ","
+                      << s.latencyP99Seconds * 1000 << "," << s.latencyMaxSeconds * 1000 << ","
+                      << s.latencyBoundSeconds * 1000 << "," << s.underruns << "," << s.underrunSeconds * 1000
+                      << "," << r.steadyAllocations << "," << (r.matches ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"block_frames\": " << r.blockFrames
+                      << ", \"ring_blocks\": " << r.ringBlocks << ", \"buffer_kb\": " << r.bufferKb
+                      << ", \"first_audio_ms\": " << s.firstAudioSeconds * 1000
+                      << ", \"latency_p50_ms\": " << s.latencyP50Seconds * 1000
+                      << ", \"latency_p99_ms\": " << s.latencyP99Seconds * 1000
+                      << ", \"latency_max_ms\": " << s.latencyMaxSeconds * 1000
+                      << ", \"latency_bound_ms\": " << s.latencyBoundSeconds * 1000
+                      << ", \"underruns\": " << s.underruns << ", \"underrun_ms\": " << s.underrunSeconds * 1000
+                      << ", \"steady_allocs\": " << r.steadyAllocations
+                      << ", \"matches\": " << (r.matches ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << "The played audio differs from the file" << std::endl;
+        return 1;
+    }
+    return 0;
+}
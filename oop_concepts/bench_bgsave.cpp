@@ -0,0 +1,258 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "durable_ledger.h"
+
+// Snapshotting a large ledger while writers keep going: inline vs. fork().
+//
+// A DurableLedger with --accounts balances gets durable transfers from
+// --writers threads the whole time. The benchmark measures a quiet period
+// (no snapshot), then one inline snapshot() (copy the balances under the
+// exclusive lock, then write them) and one startBackgroundSnapshot() (fork;
+// the child writes the frozen copy-on-write view). For each it reports how
+// long writers were blocked, how long the snapshot took, what the writers
+// got done meanwhile and their worst operation latency, plus the parent's
+// copy-on-write page faults for the fork. Every snapshot is reloaded and
+// checked (transfers never change the total).
+//
+// Usage:
+//   ./bench_bgsave [--dir bgsave_bench] [--accounts 4000000] [--writers 4]
+//                  [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct SnapshotResult {
+    std::string mode;
+    double pauseSeconds;
+    double totalSeconds;
+    uint64_t bytes;
+    long parentMinorFaults;
+    long childMinorFaults;
+    uint64_t writerOps;
+    double maxLatencyUs;
+    bool verified;
+};
+
+// Removes the ledger files left by an earlier run
+static void clearDirectory(const std::string& dir) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strncmp(entry->d_name, "wal-", 4) == 0 || strncmp(entry->d_name, "snapshot", 8) == 0) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(handle);
+}
+
+static inline uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// What the writers did since the last reset
+struct WriterMeter {
+    std::atomic<uint64_t> ops;
+    std::atomic<uint64_t> maxLatencyNs;
+
+    WriterMeter() : ops(0), maxLatencyNs(0) {}
+
+    void reset() {
+        ops.store(0);
+        maxLatencyNs.store(0);
+    }
+
+    void record(uint64_t nanoseconds) {
+        ops.fetch_add(1, std::memory_order_relaxed);
+        uint64_t seen = maxLatencyNs.load(std::memory_order_relaxed);
+        while (nanoseconds > seen &&
+               !maxLatencyNs.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+static bool verifySnapshot(const std::string& path, size_t accounts) {
+    AccountLedger copy(accounts);
+    uint64_t lsn = 0;
+    return loadLedgerSnapshot(path, copy, &lsn) && copy.size() == accounts &&
+           copy.totalCents() == 100000 * (int64_t)accounts;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = "bgsave_bench";
+    size_t accounts = 4000000;
+    unsigned writers = 4;
+    std::string format = "json";
+    const char* usage = " [--dir bgsave_bench] [--accounts 4000000] [--writers 4] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--dir") {
+            dir = argv[i + 1];
+        } else if (arg == "--accounts") {
+            accounts = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--writers") {
+            writers = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (accounts == 0 || writers == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    clearDirectory(dir);
+    std::vector<SnapshotResult> results;
+    bool failed = false;
+    {
+        DurableLedger ledger(accounts);
+        if (!ledger.open(dir)) {
+            perror("open");
+            return 1;
+        }
+        std::cerr << "Opening " << accounts << " accounts..." << std::endl;
+        if (ledger.openAccounts(accounts, 100000) < 0) {
+            perror("openAccounts");
+            return 1;
+        }
+
+        WriterMeter meter;
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < writers; t++) {
+            threads.push_back(std::thread([&, t]() {
+                uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+                while (!stop.load(std::memory_order_relaxed)) {
+                    uint64_t r = nextRandom(state);
+                    int64_t from = (int64_t)(r % accounts);
+                    int64_t to = (int64_t)(nextRandom(state) % accounts);
+                    Clock::time_point begin = Clock::now();
+                    ledger.transfer(from, to, (int64_t)((r >> 40) % 5000) + 1);
+                    meter.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     Clock::now() - begin).count());
+                }
+            }));
+        }
+
+        // Let the writers warm up before the first measurement
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::cerr << "Inline snapshot..." << std::endl;
+        SnapshotResult inlineResult = SnapshotResult();
+        inlineResult.mode = "inline";
+        meter.reset();
+        Clock::time_point start = Clock::now();
+        if (!ledger.snapshot(&inlineResult.pauseSeconds)) {
+            perror("snapshot");
+            failed = true;
+        }
+        inlineResult.totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        inlineResult.writerOps = meter.ops.load();
+        inlineResult.maxLatencyUs = meter.maxLatencyNs.load() / 1000.0;
+        inlineResult.bytes = sizeof(LedgerSnapshotHeader) + accounts * sizeof(int64_t);
+        inlineResult.verified = !failed && verifySnapshot(ledger.snapshotPath(), accounts);
+
+        SnapshotResult quiet = SnapshotResult();
+        quiet.mode = "none";
+        meter.reset();
+        std::this_thread::sleep_for(std::chrono::duration<double>(inlineResult.totalSeconds));
+        quiet.totalSeconds = inlineResult.totalSeconds;
+        quiet.writerOps = meter.ops.load();
+        quiet.maxLatencyUs = meter.maxLatencyNs.load() / 1000.0;
+        quiet.verified = true;
+
+        std::cerr << "Background (fork) snapshot..." << std::endl;
+        SnapshotResult forkResult = SnapshotResult();
+        forkResult.mode = "fork";
+        ForkSnapshotStats stats = ForkSnapshotStats();
+        meter.reset();
+        start = Clock::now();
+        if (!ledger.startBackgroundSnapshot(&forkResult.pauseSeconds) ||
+            !ledger.finishBackgroundSnapshot(&stats, true)) {
+            perror("background snapshot");
+            failed = true;
+        }
+        forkResult.totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        forkResult.writerOps = meter.ops.load();
+        forkResult.maxLatencyUs = meter.maxLatencyNs.load() / 1000.0;
+        forkResult.bytes = stats.bytes;
+        forkResult.parentMinorFaults = stats.parentMinorFaults;
+        forkResult.childMinorFaults = stats.childMinorFaults;
+        forkResult.verified = !failed && verifySnapshot(ledger.snapshotPath(), accounts);
+
+        stop.store(true);
+        for (unsigned t = 0; t < writers; t++) {
+            threads[t].join();
+        }
+        results.push_back(quiet);
+        results.push_back(inlineResult);
+        results.push_back(forkResult);
+    }
+    clearDirectory(dir);
+    rmdir(dir.c_str());
+    if (failed) {
+        return 1;
+    }
+
+    bool allVerified = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "mode,accounts,writers,pause_ms,total_ms,mb_per_sec,parent_minor_faults,"
+                     "child_minor_faults,writer_ops,writer_ops_per_sec,max_latency_us,verified\n";
+    } else {
+        std::cout << "{\n  \"accounts\": " << accounts << ",\n  \"writers\": " << writers
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const SnapshotResult& r = results[i];
+        double mbPerSec = r.totalSeconds > 0 ? r.bytes / r.totalSeconds / 1e6 : 0.0;
+        double opsPerSec = r.totalSeconds > 0 ? r.writerOps / r.totalSeconds : 0.0;
+        allVerified = allVerified && r.verified;
+        if (format == "csv") {
+            std::cout << r.mode << "," << accounts << "," << writers << "," << r.pauseSeconds * 1000
+                      << "," << r.totalSeconds * 1000 << "," << mbPerSec << ","
+                      << r.parentMinorFaults << "," << r.childMinorFaults << "," << r.writerOps << ","
+                      << opsPerSec << "," << r.maxLatencyUs << "," << (r.verified ? "true" : "false")
+                      << "\n";
+        } else {
+            std::cout << "    {\"mode\": \"" << r.mode << "\", \"pause_ms\": " << r.pauseSeconds * 1000
+                      << ", \"total_ms\": " << r.totalSeconds * 1000 << ", \"mb_per_sec\": " << mbPerSec
+                      << ", \"parent_minor_faults\": " << r.parentMinorFaults
+                      << ", \"child_minor_faults\": " << r.childMinorFaults
+                      << ", \"writer_ops\": " << r.writerOps << ", \"writer_ops_per_sec\": " << opsPerSec
+                      << ", \"max_latency_us\": " << r.maxLatencyUs
+                      << ", \"verified\": " << (r.verified ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allVerified) {
+        std::cerr << "A snapshot did not match the ledger" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,556 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <variant>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <typeindex>
+#include <typeinfo>
+#include "shape.h"
+#include "payment_method.h"
+#include "perf_counters.h"
+
+// What does a dispatch strategy cost in a hot loop?
+//
+// The Shape (area) and PaymentMethod (fee) workloads are run with each way
+// of picking the per-type code:
+//   virtual      std::vector<Base*> of heap objects, one virtual call each
+//                (polymorphism_example.cpp)
+//   type_sorted  the same pointers sorted by dynamic type, so the indirect
+//                branch is predictable
+//   variant      std::vector<std::variant<...>> of values + std::visit
+//   crtp         static polymorphism; objects are kept in one vector per
+//                type, so the order of the input does not matter
+//   switch       tagged structs + switch on an enum
+//   string_if    type names compared in an if/else chain, as in
+//                without_oop_problems.cpp
+// on homogeneous input (every element the same type) and shuffled input
+// (three types in random order). Reported per operation: time, branch
+// misses, L1 instruction cache misses and instructions per cycle, where the
+// CPU exposes those counters (see perf_counters.h).
+//
+// Usage:
+//   ./bench_dispatch [--count 1000000] [--iterations 10] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct Measurement {
+    std::string workload;
+    std::string input;
+    std::string strategy;
+    double nsPerOp;
+    bool haveBranchMisses;
+    double branchMissesPerOp;
+    bool haveICacheMisses;
+    double icacheMissesPerOp;
+    bool haveIpc;
+    double ipc;
+    double checksum;
+};
+
+// Runs op() iterations times and keeps the fastest run with its counters
+template <typename Operation>
+static Measurement measure(const char* strategy, size_t ops, size_t iterations,
+                           CpuCounters& counters, Operation op) {
+    Measurement best;
+    best.strategy = strategy;
+    best.nsPerOp = 1e30;
+    for (size_t i = 0; i < iterations; i++) {
+        counters.start();
+        Clock::time_point start = Clock::now();
+        double checksum = op();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        counters.stop();
+
+        double nsPerOp = seconds * 1e9 / ops;
+        if (nsPerOp < best.nsPerOp) {
+            best.nsPerOp = nsPerOp;
+            best.checksum = checksum;
+            best.haveBranchMisses = counters.available(CpuCounters::kBranchMisses);
+            best.branchMissesPerOp = (double)counters.read(CpuCounters::kBranchMisses) / ops;
+            best.haveICacheMisses = counters.available(CpuCounters::kICacheMisses);
+            best.icacheMissesPerOp = (double)counters.read(CpuCounters::kICacheMisses) / ops;
+            uint64_t cycles = counters.read(CpuCounters::kCycles);
+            best.haveIpc = counters.available(CpuCounters::kCycles) &&
+                           counters.available(CpuCounters::kInstructions) && cycles > 0;
+            best.ipc = cycles > 0 ? (double)counters.read(CpuCounters::kInstructions) / cycles : 0.0;
+        }
+    }
+    return best;
+}
+
+// ---------------------------------------------------------------------------
+// Value types for the variant, switch and string strategies
+
+struct CircleValue {
+    double radius;
+    double area() const { return kCircleAreaFactor * radius * radius; }
+};
+
+struct RectangleValue {
+    double width;
+    double height;
+    double area() const { return width * height; }
+};
+
+struct TriangleValue {
+    double base;
+    double height;
+    double area() const { return 0.5 * base * height; }
+};
+
+typedef std::variant<CircleValue, RectangleValue, TriangleValue> ShapeVariant;
+
+enum ShapeKind { kCircleKind, kRectangleKind, kTriangleKind };
+
+struct TaggedShape {
+    ShapeKind kind;
+    double a;
+    double b;
+};
+
+struct NamedShape {
+    std::string type;
+    double a;
+    double b;
+};
+
+// CRTP: the base class calls the derived implementation without a vtable
+template <typename Derived>
+class StaticShape {
+public:
+    double area() const { return static_cast<const Derived&>(*this).areaImpl(); }
+};
+
+class StaticCircle : public StaticShape<StaticCircle> {
+    double radius;
+public:
+    explicit StaticCircle(double r) : radius(r) {}
+    double areaImpl() const { return kCircleAreaFactor * radius * radius; }
+};
+
+class StaticRectangle : public StaticShape<StaticRectangle> {
+    double width;
+    double height;
+public:
+    StaticRectangle(double w, double h) : width(w), height(h) {}
+    double areaImpl() const { return width * height; }
+};
+
+class StaticTriangle : public StaticShape<StaticTriangle> {
+    double base;
+    double height;
+public:
+    StaticTriangle(double b, double h) : base(b), height(h) {}
+    double areaImpl() const { return 0.5 * base * height; }
+};
+
+template <typename Derived>
+static double sumStaticAreas(const std::vector<Derived>& shapes) {
+    double total = 0.0;
+    for (size_t i = 0; i < shapes.size(); i++) {
+        const StaticShape<Derived>& shape = shapes[i];
+        total += shape.area();
+    }
+    return total;
+}
+
+// Payment value types: same fields and fee rules as payment_method.h
+
+struct CardValue {
+    std::string cardNumber;
+    double fee(double amount) const { return amount * 0.029 + 0.30; }
+};
+
+struct PayPalValue {
+    std::string email;
+    double fee(double amount) const { return amount * 0.0349 + 0.49; }
+};
+
+struct CryptoValue {
+    std::string walletAddress;
+    double fee(double amount) const { return amount * 0.01 > 1.0 ? amount * 0.01 : 1.0; }
+};
+
+typedef std::variant<CardValue, PayPalValue, CryptoValue> PaymentVariant;
+
+struct TaggedPayment {
+    int kind;
+    std::string account;
+};
+
+struct NamedPayment {
+    std::string type;
+    std::string account;
+};
+
+template <typename Derived>
+class StaticPayment {
+public:
+    double fee(double amount) const { return static_cast<const Derived&>(*this).feeImpl(amount); }
+};
+
+class StaticCard : public StaticPayment<StaticCard> {
+    std::string cardNumber;
+public:
+    explicit StaticCard(const std::string& card) : cardNumber(card) {}
+    double feeImpl(double amount) const { return amount * 0.029 + 0.30; }
+};
+
+class StaticPayPal : public StaticPayment<StaticPayPal> {
+    std::string email;
+public:
+    explicit StaticPayPal(const std::string& e) : email(e) {}
+    double feeImpl(double amount) const { return amount * 0.0349 + 0.49; }
+};
+
+class StaticCrypto : public StaticPayment<StaticCrypto> {
+    std::string walletAddress;
+public:
+    explicit StaticCrypto(const std::string& wallet) : walletAddress(wallet) {}
+    double feeImpl(double amount) const { return amount * 0.01 > 1.0 ? amount * 0.01 : 1.0; }
+};
+
+// CRTP payments keep their amount next to the object, grouped by type
+template <typename Derived>
+static double sumStaticFees(const std::vector<std::pair<Derived, double> >& payments) {
+    double total = 0.0;
+    for (size_t i = 0; i < payments.size(); i++) {
+        const StaticPayment<Derived>& payment = payments[i].first;
+        total += payment.fee(payments[i].second);
+    }
+    return total;
+}
+
+// ---------------------------------------------------------------------------
+
+static std::vector<int> makeKinds(size_t count, bool shuffled, std::mt19937_64& random) {
+    std::vector<int> kinds(count, 0);
+    if (shuffled) {
+        std::uniform_int_distribution<int> kind(0, 2);
+        for (size_t i = 0; i < count; i++) {
+            kinds[i] = kind(random);
+        }
+    }
+    return kinds;
+}
+
+static void runShapes(const std::vector<int>& kinds, const std::string& input, size_t iterations,
+                      CpuCounters& counters, std::mt19937_64& random, std::vector<Measurement>& out) {
+    size_t count = kinds.size();
+    std::uniform_real_distribution<double> dimension(0.5, 10.0);
+    static const char* const kNames[] = {"circle", "rectangle", "triangle"};
+
+    std::vector<Shape*> objects;
+    std::vector<ShapeVariant> variants;
+    std::vector<TaggedShape> tagged;
+    std::vector<NamedShape> named;
+    std::vector<StaticCircle> staticCircles;
+    std::vector<StaticRectangle> staticRectangles;
+    std::vector<StaticTriangle> staticTriangles;
+    for (size_t i = 0; i < count; i++) {
+        double a = dimension(random);
+        double b = dimension(random);
+        TaggedShape t = {(ShapeKind)kinds[i], a, b};
+        tagged.push_back(t);
+        NamedShape n = {kNames[kinds[i]], a, b};
+        named.push_back(n);
+        if (kinds[i] == kCircleKind) {
+            objects.push_back(new Circle(a));
+            variants.push_back(CircleValue{a});
+            staticCircles.push_back(StaticCircle(a));
+        } else if (kinds[i] == kRectangleKind) {
+            objects.push_back(new Rectangle(a, b));
+            variants.push_back(RectangleValue{a, b});
+            staticRectangles.push_back(StaticRectangle(a, b));
+        } else {
+            objects.push_back(new Triangle(a, b));
+            variants.push_back(TriangleValue{a, b});
+            staticTriangles.push_back(StaticTriangle(a, b));
+        }
+    }
+    std::vector<Shape*> sorted(objects);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Shape* x, const Shape* y) {
+        return std::type_index(typeid(*x)) < std::type_index(typeid(*y));
+    });
+
+    std::vector<Measurement> results;
+    results.push_back(measure("virtual", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < objects.size(); i++) {
+            total += objects[i]->calculateArea();
+        }
+        return total;
+    }));
+    results.push_back(measure("type_sorted", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            total += sorted[i]->calculateArea();
+        }
+        return total;
+    }));
+    results.push_back(measure("variant", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < variants.size(); i++) {
+            total += std::visit([](const auto& shape) { return shape.area(); }, variants[i]);
+        }
+        return total;
+    }));
+    results.push_back(measure("crtp", count, iterations, counters, [&]() {
+        return sumStaticAreas(staticCircles) + sumStaticAreas(staticRectangles) +
+               sumStaticAreas(staticTriangles);
+    }));
+    results.push_back(measure("switch", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < tagged.size(); i++) {
+            const TaggedShape& shape = tagged[i];
+            switch (shape.kind) {
+            case kCircleKind:
+                total += kCircleAreaFactor * shape.a * shape.a;
+                break;
+            case kRectangleKind:
+                total += shape.a * shape.b;
+                break;
+            case kTriangleKind:
+                total += 0.5 * shape.a * shape.b;
+                break;
+            }
+        }
+        return total;
+    }));
+    results.push_back(measure("string_if", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < named.size(); i++) {
+            const NamedShape& shape = named[i];
+            if (shape.type == "circle") {
+                total += kCircleAreaFactor * shape.a * shape.a;
+            } else if (shape.type == "rectangle") {
+                total += shape.a * shape.b;
+            } else if (shape.type == "triangle") {
+                total += 0.5 * shape.a * shape.b;
+            }
+        }
+        return total;
+    }));
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        delete objects[i];
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].workload = "shape_area";
+        results[i].input = input;
+        out.push_back(results[i]);
+    }
+}
+
+static void runPayments(const std::vector<int>& kinds, const std::string& input, size_t iterations,
+                        CpuCounters& counters, std::mt19937_64& random, std::vector<Measurement>& out) {
+    size_t count = kinds.size();
+    std::uniform_real_distribution<double> amountDistribution(1.0, 500.0);
+    static const char* const kNames[] = {"credit_card", "paypal", "crypto"};
+
+    std::vector<double> amounts;
+    std::vector<PaymentMethod*> objects;
+    std::vector<PaymentVariant> variants;
+    std::vector<TaggedPayment> tagged;
+    std::vector<NamedPayment> named;
+    std::vector<std::pair<StaticCard, double> > staticCards;
+    std::vector<std::pair<StaticPayPal, double> > staticPayPals;
+    std::vector<std::pair<StaticCrypto, double> > staticCryptos;
+    for (size_t i = 0; i < count; i++) {
+        double amount = amountDistribution(random);
+        amounts.push_back(amount);
+        std::ostringstream account;
+        account << "acct-" << i << "-" << kNames[kinds[i]];
+        TaggedPayment t = {kinds[i], account.str()};
+        tagged.push_back(t);
+        NamedPayment n = {kNames[kinds[i]], account.str()};
+        named.push_back(n);
+        if (kinds[i] == 0) {
+            objects.push_back(new CreditCardPayment(account.str()));
+            variants.push_back(CardValue{account.str()});
+            staticCards.push_back(std::make_pair(StaticCard(account.str()), amount));
+        } else if (kinds[i] == 1) {
+            objects.push_back(new PayPalPayment(account.str()));
+            variants.push_back(PayPalValue{account.str()});
+            staticPayPals.push_back(std::make_pair(StaticPayPal(account.str()), amount));
+        } else {
+            objects.push_back(new CryptoCurrencyPayment(account.str()));
+            variants.push_back(CryptoValue{account.str()});
+            staticCryptos.push_back(std::make_pair(StaticCrypto(account.str()), amount));
+        }
+    }
+    // Sort (object, amount) pairs together so the amounts still match
+    std::vector<std::pair<PaymentMethod*, double> > sorted;
+    for (size_t i = 0; i < count; i++) {
+        sorted.push_back(std::make_pair(objects[i], amounts[i]));
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const std::pair<PaymentMethod*, double>& x, const std::pair<PaymentMethod*, double>& y) {
+                         return std::type_index(typeid(*x.first)) < std::type_index(typeid(*y.first));
+                     });
+
+    std::vector<Measurement> results;
+    results.push_back(measure("virtual", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < objects.size(); i++) {
+            total += objects[i]->calculateFee(amounts[i]);
+        }
+        return total;
+    }));
+    results.push_back(measure("type_sorted", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            total += sorted[i].first->calculateFee(sorted[i].second);
+        }
+        return total;
+    }));
+    results.push_back(measure("variant", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < variants.size(); i++) {
+            double amount = amounts[i];
+            total += std::visit([amount](const auto& payment) { return payment.fee(amount); }, variants[i]);
+        }
+        return total;
+    }));
+    results.push_back(measure("crtp", count, iterations, counters, [&]() {
+        return sumStaticFees(staticCards) + sumStaticFees(staticPayPals) + sumStaticFees(staticCryptos);
+    }));
+    results.push_back(measure("switch", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < tagged.size(); i++) {
+            double amount = amounts[i];
+            switch (tagged[i].kind) {
+            case 0:
+                total += amount * 0.029 + 0.30;
+                break;
+            case 1:
+                total += amount * 0.0349 + 0.49;
+                break;
+            default:
+                total += amount * 0.01 > 1.0 ? amount * 0.01 : 1.0;
+                break;
+            }
+        }
+        return total;
+    }));
+    results.push_back(measure("string_if", count, iterations, counters, [&]() {
+        double total = 0.0;
+        for (size_t i = 0; i < named.size(); i++) {
+            double amount = amounts[i];
+            const std::string& type = named[i].type;
+            if (type == "credit_card") {
+                total += amount * 0.029 + 0.30;
+            } else if (type == "paypal") {
+                total += amount * 0.0349 + 0.49;
+            } else if (type == "crypto") {
+                total += amount * 0.01 > 1.0 ? amount * 0.01 : 1.0;
+            }
+        }
+        return total;
+    }));
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        delete objects[i];
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].workload = "payment_fee";
+        results[i].input = input;
+        out.push_back(results[i]);
+    }
+}
+
+static void writeOptional(std::ostream& out, bool available, double value, bool json) {
+    if (available) {
+        out << value;
+    } else if (json) {
+        out << "null";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 1000000;
+    size_t iterations = 10;
+    std::string format = "json";
+    const char* usage = " [--count 1000000] [--iterations 10] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--count") {
+            count = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (count == 0 || iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    CpuCounters counters;
+    if (!counters.anyAvailable()) {
+        std::cerr << "No CPU counters available (perf_event_paranoid or VM); reporting time only"
+                  << std::endl;
+    }
+
+    std::mt19937_64 random(7);
+    std::vector<Measurement> results;
+    static const char* const kInputs[] = {"homogeneous", "shuffled"};
+    for (int input = 0; input < 2; input++) {
+        std::vector<int> kinds = makeKinds(count, input == 1, random);
+        std::cerr << "Running shape_area on " << kInputs[input] << " input..." << std::endl;
+        runShapes(kinds, kInputs[input], iterations, counters, random, results);
+        std::cerr << "Running payment_fee on " << kInputs[input] << " input..." << std::endl;
+        runPayments(kinds, kInputs[input], iterations, counters, random, results);
+    }
+
+    bool json = format != "csv";
+    std::cout << std::fixed << std::setprecision(3);
+    if (json) {
+        std::cout << "{\n  \"count\": " << count << ",\n  \"results\": [\n";
+    } else {
+        std::cout << "workload,input,strategy,ns_per_op,branch_misses_per_op,"
+                     "icache_misses_per_op,ipc,checksum\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const Measurement& m = results[i];
+        if (json) {
+            std::cout << "    {\"workload\": \"" << m.workload << "\", \"input\": \"" << m.input
+                      << "\", \"strategy\": \"" << m.strategy << "\", \"ns_per_op\": " << m.nsPerOp
+                      << ", \"branch_misses_per_op\": ";
+            writeOptional(std::cout, m.haveBranchMisses, m.branchMissesPerOp, true);
+            std::cout << ", \"icache_misses_per_op\": ";
+            writeOptional(std::cout, m.haveICacheMisses, m.icacheMissesPerOp, true);
+            std::cout << ", \"ipc\": ";
+            writeOptional(std::cout, m.haveIpc, m.ipc, true);
+            std::cout << ", \"checksum\": " << m.checksum << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        } else {
+            std::cout << m.workload << "," << m.input << "," << m.strategy << "," << m.nsPerOp << ",";
+            writeOptional(std::cout, m.haveBranchMisses, m.branchMissesPerOp, false);
+            std::cout << ",";
+            writeOptional(std::cout, m.haveICacheMisses, m.icacheMissesPerOp, false);
+            std::cout << ",";
+            writeOptional(std::cout, m.haveIpc, m.ipc, false);
+            std::cout << "," << m.checksum << "\n";
+        }
+    }
+    if (json) {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
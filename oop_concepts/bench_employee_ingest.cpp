@@ -0,0 +1,244 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include <unistd.h>
+#include "employee.h"
+#include "employee_ingest.h"
+
+// Startup time for loading an employee CSV file: the iostream way
+// (std::getline per line and field, std::stod, one new Employee/Manager/
+// Developer per row) against ingestEmployees() (mmap, chunks parsed in
+// parallel into a PayrollTable). The file is generated first and is in the
+// page cache for every method; each result is checked against the
+// baseline's payroll total.
+//
+// Usage:
+//   ./bench_employee_ingest [--rows 2000000] [--file employees_bench.csv] [--threads N]
+//                           [--iterations 3] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct IngestResult {
+    std::string method;
+    unsigned threads;
+    double bestSeconds;
+    EmployeeIngestStats stats;   // of the best run (zero for the baseline)
+    bool matches;
+};
+
+// Same role mix and amounts (whole cents) as bench_payroll
+static bool writeCsv(const std::string& path, size_t rows) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    static const char* const kLanguages[] = {"C++", "Rust", "Go", "Python"};
+    std::mt19937_64 random(42);
+    fputs("role,id,name,base_salary,extra,count\n", file);
+    for (size_t i = 0; i < rows; i++) {
+        unsigned salary = 3000000 + (unsigned)(random() % 17000001);
+        unsigned kind = (unsigned)(random() % 10);
+        if (kind == 0) {
+            unsigned bonus = (unsigned)(random() % 5000001);
+            fprintf(file, "manager,%zu,Employee %zu,%u.%02u,%u.%02u,%u\n", i, i, salary / 100, salary % 100,
+                    bonus / 100, bonus % 100, 1 + (unsigned)(random() % 40));
+        } else if (kind <= 3) {
+            fprintf(file, "developer,%zu,Employee %zu,%u.%02u,%s,%u\n", i, i, salary / 100, salary % 100,
+                    kLanguages[i % 4], (unsigned)(random() % 201));
+        } else {
+            fprintf(file, "employee,%zu,Employee %zu,%u.%02u\n", i, i, salary / 100, salary % 100);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+// The obvious way: stream, getline, stringstream, std::stod, new
+static bool loadWithIostreams(const std::string& path, std::vector<Employee*>& employees) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    std::getline(in, line);   // header
+    while (std::getline(in, line)) {
+        std::stringstream fields(line);
+        std::string role, id, name, base, extra, count;
+        std::getline(fields, role, ',');
+        std::getline(fields, id, ',');
+        std::getline(fields, name, ',');
+        std::getline(fields, base, ',');
+        std::getline(fields, extra, ',');
+        std::getline(fields, count, ',');
+        if (role == "manager") {
+            employees.push_back(new Manager(name, std::stoi(id), std::stod(base), std::stod(extra),
+                                            std::stoi(count)));
+        } else if (role == "developer") {
+            employees.push_back(new Developer(name, std::stoi(id), std::stod(base), extra, std::stoi(count)));
+        } else {
+            employees.push_back(new Employee(name, std::stoi(id), std::stod(base)));
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    size_t rows = 2000000;
+    std::string path = "employees_bench.csv";
+    unsigned threads = std::thread::hardware_concurrency();
+    size_t iterations = 3;
+    std::string format = "json";
+    const char* usage = " [--rows 2000000] [--file employees_bench.csv] [--threads N] [--iterations 3]"
+                        " [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--rows") {
+            rows = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--file") {
+            path = argv[i + 1];
+        } else if (arg == "--threads") {
+            threads = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (rows == 0 || iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    std::cerr << "Writing " << rows << " rows to " << path << "..." << std::endl;
+    if (!writeCsv(path, rows)) {
+        perror(path.c_str());
+        return 1;
+    }
+
+    std::vector<IngestResult> results;
+    std::cerr << "Running iostreams..." << std::endl;
+    IngestResult baseline = IngestResult();
+    baseline.method = "iostream_objects";
+    baseline.threads = 1;
+    baseline.bestSeconds = 1e30;
+    baseline.matches = true;
+    int64_t referenceCents = 0;
+    size_t referenceRows = 0;
+    std::string lastName;
+    for (size_t i = 0; i < iterations; i++) {
+        std::vector<Employee*> employees;
+        Clock::time_point start = Clock::now();
+        if (!loadWithIostreams(path, employees)) {
+            perror(path.c_str());
+            return 1;
+        }
+        baseline.bestSeconds =
+            std::min(baseline.bestSeconds, std::chrono::duration<double>(Clock::now() - start).count());
+        referenceCents = 0;
+        for (size_t e = 0; e < employees.size(); e++) {
+            referenceCents += payrollCents(employees[e]->calculateSalary());
+        }
+        referenceRows = employees.size();
+        lastName = employees.empty() ? "" : employees.back()->getName();
+        for (size_t e = 0; e < employees.size(); e++) {
+            delete employees[e];
+        }
+    }
+    results.push_back(baseline);
+
+    std::vector<unsigned> threadCounts(1, 1);
+    if (threads > 1) {
+        threadCounts.push_back(threads);
+    }
+    for (size_t c = 0; c < threadCounts.size(); c++) {
+        std::cerr << "Running mmap ingest with " << threadCounts[c] << " threads..." << std::endl;
+        IngestResult result = IngestResult();
+        result.method = "mmap_columns";
+        result.threads = threadCounts[c];
+        result.bestSeconds = 1e30;
+        result.matches = true;
+        for (size_t i = 0; i < iterations; i++) {
+            PayrollTable table;
+            EmployeeIngestStats stats;
+            Clock::time_point start = Clock::now();
+            if (!ingestEmployees(path, table, threadCounts[c], &stats)) {
+                perror("ingest");
+                return 1;
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds < result.bestSeconds) {
+                result.bestSeconds = seconds;
+                result.stats = stats;
+            }
+            // The last row of the file is the last row of its role
+            bool lastFound = false;
+            for (int role = 0; role < kPayrollRoles; role++) {
+                size_t n = table.count((PayrollRole)role);
+                lastFound = lastFound || (n > 0 && table.name((PayrollRole)role, n - 1) == lastName);
+            }
+            result.matches = result.matches && table.size() == referenceRows &&
+                             table.totalCents() == referenceCents && lastFound;
+        }
+        results.push_back(result);
+    }
+    unlink(path.c_str());
+
+    double bytes = results.size() > 1 ? (double)results[1].stats.bytes : 0.0;
+    double baseSeconds = results[0].bestSeconds;
+    bool allMatch = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "method,rows,threads,ms,gb_per_sec,speedup,map_ms,parse_ms,merge_ms,matches\n";
+    } else {
+        std::cout << "{\n  \"rows\": " << referenceRows << ",\n  \"bytes\": " << (uint64_t)bytes
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const IngestResult& r = results[i];
+        double gbPerSec = r.bestSeconds > 0 ? bytes / r.bestSeconds / 1e9 : 0.0;
+        double speedup = r.bestSeconds > 0 ? baseSeconds / r.bestSeconds : 0.0;
+        allMatch = allMatch && r.matches;
+        if (format == "csv") {
+            std::cout << r.method << "," << referenceRows << "," << r.threads << "," << r.bestSeconds * 1000
+                      << "," << gbPerSec << "," << speedup << "," << r.stats.mapSeconds * 1000 << ","
+                      << r.stats.parseSeconds * 1000 << "," << r.stats.mergeSeconds * 1000 << ","
+                      << (r.matches ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"threads\": " << r.threads
+                      << ", \"ms\": " << r.bestSeconds * 1000 << ", \"gb_per_sec\": " << gbPerSec
+                      << ", \"speedup\": " << speedup << ", \"map_ms\": " << r.stats.mapSeconds * 1000
+                      << ", \"parse_ms\": " << r.stats.parseSeconds * 1000
+                      << ", \"merge_ms\": " << r.stats.mergeSeconds * 1000
+                      << ", \"matches\": " << (r.matches ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << "The columnar ingest differs from the iostream baseline" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "audio_pipeline.h"
+
+// A playlist of --tracks generated WAV files played back to back through
+// AudioPipeline, with and without prefetching the next track. Before each
+// run the files are dropped from the page cache, so every track starts
+// cold, as it would after a reboot or on a large library. For each run:
+//   - switch_ms: the decoder reaching the end of a track to it publishing
+//     the first block of the next (mean and max)
+//   - switch faults and input: page faults and storage reads on the
+//     decoder thread during switches, and over the whole run
+//   - gaps: switches the sink reached with the ring empty, i.e. silence
+//     between tracks
+// The output file must be every track's samples back to back.
+//
+// Usage:
+//   ./bench_gapless [--tracks 4] [--seconds 2] [--rate 48000] [--block 256] [--ring 4]
+//                   [--prefetch-ms 500] [--speed 1] [--file gapless_bench] [--format json|csv]
+
+struct SwitchResult {
+    std::string method;
+    AudioPipelineStats stats;
+    bool matches;
+};
+
+// Writes dirty pages back and drops the file from the page cache
+static void dropFromCache(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static bool sameBytes(const std::string& path, const std::vector<int16_t>& samples) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::vector<int16_t> data(samples.size() + 1);
+    in.read(reinterpret_cast<char*>(&data[0]), data.size() * sizeof(int16_t));
+    data.resize((size_t)in.gcount() / sizeof(int16_t));
+    return data == samples;
+}
+
+int main(int argc, char* argv[]) {
+    size_t trackCount = 4;
+    double seconds = 2.0;
+    uint32_t rate = 48000;
+    uint32_t blockFrames = 256;
+    uint32_t ringBlocks = 4;
+    uint32_t prefetchMillis = 500;
+    double speed = 1.0;
+    std::string prefix = "gapless_bench";
+    std::string format = "json";
+    const char* usage = " [--tracks 4] [--seconds 2] [--rate 48000] [--block 256] [--ring 4] [--prefetch-ms 500]"
+                        " [--speed 1] [--file gapless_bench] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--tracks") {
+            trackCount = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--seconds") {
+            seconds = atof(argv[i + 1]);
+        } else if (arg == "--rate") {
+            rate = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--block") {
+            blockFrames = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--ring") {
+            ringBlocks = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--prefetch-ms") {
+            prefetchMillis = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--speed") {
+            speed = atof(argv[i + 1]);
+        } else if (arg == "--file") {
+            prefix = argv[i + 1];
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (trackCount < 2 || seconds <= 0 || rate == 0 || blockFrames == 0 || ringBlocks == 0 || speed <= 0 ||
+        (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    // Stereo tones a fifth apart, one per track; what the output must be
+    PcmFormat pcm = {rate, 2, 16};
+    size_t trackSamples = (size_t)(seconds * rate) * 2;
+    std::vector<int16_t> expected;
+    expected.reserve(trackSamples * trackCount);
+    std::vector<std::string> paths;
+    std::vector<int16_t> samples(trackSamples);
+    for (size_t t = 0; t < trackCount; t++) {
+        double frequency = 220 * std::pow(1.5, (double)(t % 4));
+        for (size_t i = 0; i < samples.size(); i++) {
+            samples[i] = (int16_t)(8000 * std::sin(2 * M_PI * frequency * (double)(i / 2) / rate));
+        }
+        paths.push_back(prefix + "_" + std::to_string(t) + ".wav");
+        std::cerr << "Writing " << paths.back() << "..." << std::endl;
+        if (!writeWavFile(paths.back(), pcm, &samples[0], samples.size() / 2)) {
+            perror(paths.back().c_str());
+            return 1;
+        }
+        expected.insert(expected.end(), samples.begin(), samples.end());
+    }
+    std::string output = prefix + ".out";
+
+    std::vector<SwitchResult> results;
+    for (int prefetch = 0; prefetch < 2; prefetch++) {
+        SwitchResult result;
+        result.method = prefetch ? "prefetch" : "no_prefetch";
+        std::cerr << "Running " << result.method << " on a cold page cache..." << std::endl;
+        for (size_t t = 0; t < paths.size(); t++) {
+            dropFromCache(paths[t]);
+        }
+        AudioPipelineConfig config;
+        config.blockFrames = blockFrames;
+        config.ringBlocks = ringBlocks;
+        config.speed = speed;
+        config.prefetch = prefetch != 0;
+        config.prefetchMillis = prefetchMillis;
+        AudioPipeline pipeline;
+        if (!pipeline.start(paths[0], output, config)) {
+            perror("start");
+            return 1;
+        }
+        for (size_t t = 1; t < paths.size(); t++) {
+            pipeline.queueTrack(paths[t]);
+        }
+        bool ok = pipeline.wait();
+        result.stats = pipeline.stats();
+        pipeline.stop();
+        result.matches = ok && result.stats.tracks == trackCount && sameBytes(output, expected);
+        results.push_back(result);
+    }
+    unlink(output.c_str());
+    for (size_t t = 0; t < paths.size(); t++) {
+        unlink(paths[t].c_str());
+    }
+
+    bool allMatch = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "method,tracks,switches,switch_mean_ms,switch_max_ms,switch_major_faults,switch_minor_faults,"
+                     "switch_input_kb,decoder_major_faults,decoder_input_kb,gaps,underruns,matches\n";
+    } else {
+        std::cout << "{\n  \"tracks\": " << trackCount << ",\n  \"seconds\": " << seconds << ",\n  \"rate\": " << rate
+                  << ",\n  \"block_frames\": " << blockFrames << ",\n  \"ring_blocks\": " << ringBlocks
+                  << ",\n  \"prefetch_ms\": " << prefetchMillis << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const SwitchResult& r = results[i];
+        const AudioPipelineStats& s = r.stats;
+        allMatch = allMatch && r.matches;
+        if (format == "csv") {
+            std::cout << r.method << "," << s.tracks << "," << s.switches << "," << s.switchMeanSeconds * 1000 << ","
+                      << s.switchMaxSeconds * 1000 << "," << s.switchMajorFaults << "," << s.switchMinorFaults << ","
+                      << s.switchInputBlocks / 2.0 << "," << s.decoderMajorFaults << ","
+                      << s.decoderInputBlocks / 2.0 << "," << s.gaps << "," << s.underruns << ","
+                      << (r.matches ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"tracks\": " << s.tracks
+                      << ", \"switches\": " << s.switches << ", \"switch_mean_ms\": " << s.switchMeanSeconds * 1000
+                      << ", \"switch_max_ms\": " << s.switchMaxSeconds * 1000
+                      << ", \"switch_major_faults\": " << s.switchMajorFaults
+                      << ", \"switch_minor_faults\": " << s.switchMinorFaults
+                      << ", \"switch_input_kb\": " << s.switchInputBlocks / 2.0
+                      << ", \"decoder_major_faults\": " << s.decoderMajorFaults
+                      << ", \"decoder_input_kb\": " << s.decoderInputBlocks / 2.0 << ", \"gaps\": " << s.gaps
+                      << ", \"underruns\": " << s.underruns << ", \"matches\": " << (r.matches ? "true" : "false")
+                      << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << "The played audio is not the playlist back to back" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include "account_ledger.h"
+
+// Ledger throughput as threads are added.
+//
+// Every run performs --ops random operations on --accounts accounts (70%
+// transfers, 15% deposits, 15% withdrawals), split evenly over T threads,
+// with:
+//   global_mutex  one std::mutex around a vector of balances
+//   sharded       AccountLedger: per-shard spinlocks, ordered two-shard
+//                 locking for transfers
+// and then checks that no money was created or lost: the final total must
+// equal the opening balances plus successful deposits minus successful
+// withdrawals.
+//
+// Usage:
+//   ./bench_ledger [--accounts 1000000] [--ops 4000000] [--threads 1,2,4,8,16,32,64]
+//                  [--shards 4096] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+static const int64_t kOpeningCents = 100000;
+
+// The BankAccount approach scaled up: correct, but every operation
+// serializes on one lock
+class GlobalLockLedger {
+private:
+    std::mutex mutex;
+    std::vector<int64_t> balances;
+
+public:
+    explicit GlobalLockLedger(size_t accounts) : balances(accounts, kOpeningCents) {}
+
+    bool deposit(int64_t account, int64_t cents) {
+        std::lock_guard<std::mutex> lock(mutex);
+        balances[account] += cents;
+        return true;
+    }
+
+    bool withdraw(int64_t account, int64_t cents) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (balances[account] < cents) {
+            return false;
+        }
+        balances[account] -= cents;
+        return true;
+    }
+
+    bool transfer(int64_t from, int64_t to, int64_t cents) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (balances[from] < cents) {
+            return false;
+        }
+        balances[from] -= cents;
+        balances[to] += cents;
+        return true;
+    }
+
+    int64_t totalCents() {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t total = 0;
+        for (size_t i = 0; i < balances.size(); i++) {
+            total += balances[i];
+        }
+        return total;
+    }
+};
+
+struct LedgerResult {
+    std::string strategy;
+    unsigned threads;
+    double seconds;
+    uint64_t failed;
+    bool consistent;
+};
+
+// xorshift64: cheap enough not to show up next to the ledger operation
+static inline uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template <typename Ledger>
+static LedgerResult runLedger(const char* name, Ledger& ledger, size_t accounts, size_t ops,
+                              unsigned threads) {
+    std::vector<int64_t> netDeposits(threads, 0);
+    std::vector<uint64_t> failures(threads, 0);
+    std::vector<std::thread> workers;
+
+    Clock::time_point start = Clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+            size_t count = ops * (t + 1) / threads - ops * t / threads;
+            int64_t net = 0;
+            uint64_t failed = 0;
+            for (size_t i = 0; i < count; i++) {
+                uint64_t r = nextRandom(state);
+                int64_t a = (int64_t)(r % accounts);
+                int64_t cents = (int64_t)((r >> 40) % 5000) + 1;
+                unsigned kind = (unsigned)((r >> 32) % 100);
+                if (kind < 70) {
+                    int64_t b = (int64_t)(nextRandom(state) % accounts);
+                    failed += !ledger.transfer(a, b, cents);
+                } else if (kind < 85) {
+                    if (ledger.deposit(a, cents)) {
+                        net += cents;
+                    } else {
+                        failed++;
+                    }
+                } else {
+                    if (ledger.withdraw(a, cents)) {
+                        net -= cents;
+                    } else {
+                        failed++;
+                    }
+                }
+            }
+            netDeposits[t] = net;
+            failures[t] = failed;
+        }));
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t].join();
+    }
+
+    LedgerResult result;
+    result.strategy = name;
+    result.threads = threads;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.failed = 0;
+    int64_t expected = kOpeningCents * (int64_t)accounts;
+    for (unsigned t = 0; t < threads; t++) {
+        expected += netDeposits[t];
+        result.failed += failures[t];
+    }
+    result.consistent = ledger.totalCents() == expected;
+    return result;
+}
+
+static std::vector<unsigned> parseThreadList(const std::string& list) {
+    std::vector<unsigned> threads;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        unsigned n = (unsigned)strtoul(item.c_str(), NULL, 10);
+        if (n > 0) {
+            threads.push_back(n);
+        }
+    }
+    return threads;
+}
+
+int main(int argc, char* argv[]) {
+    size_t accounts = 1000000;
+    size_t ops = 4000000;
+    size_t shards = AccountLedger::kDefaultShards;
+    std::vector<unsigned> threadCounts = parseThreadList("1,2,4,8,16,32,64");
+    std::string format = "json";
+    const char* usage = " [--accounts 1000000] [--ops 4000000] [--threads 1,2,4,8,16,32,64]"
+                        " [--shards 4096] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--accounts") {
+            accounts = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--ops") {
+            ops = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--threads") {
+            threadCounts = parseThreadList(argv[i + 1]);
+        } else if (arg == "--shards") {
+            shards = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (accounts == 0 || ops == 0 || shards == 0 || threadCounts.empty() ||
+        (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    std::vector<LedgerResult> results;
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        unsigned threads = threadCounts[i];
+        std::cerr << "Running global_mutex with " << threads << " threads..." << std::endl;
+        {
+            GlobalLockLedger ledger(accounts);
+            results.push_back(runLedger("global_mutex", ledger, accounts, ops, threads));
+        }
+        std::cerr << "Running sharded with " << threads << " threads..." << std::endl;
+        {
+            AccountLedger ledger(accounts, shards);
+            for (size_t a = 0; a < accounts; a++) {
+                ledger.openAccount(kOpeningCents);
+            }
+            results.push_back(runLedger("sharded", ledger, accounts, ops, threads));
+        }
+    }
+
+    bool allConsistent = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "strategy,threads,accounts,ops,seconds,mops_per_sec,failed_ops,consistent\n";
+    } else {
+        std::cout << "{\n  \"accounts\": " << accounts << ",\n  \"ops\": " << ops
+                  << ",\n  \"shards\": " << shards << ",\n  \"hardware_threads\": "
+                  << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const LedgerResult& r = results[i];
+        double mops = r.seconds > 0 ? ops / r.seconds / 1e6 : 0.0;
+        allConsistent = allConsistent && r.consistent;
+        if (format == "csv") {
+            std::cout << r.strategy << "," << r.threads << "," << accounts << "," << ops << ","
+                      << r.seconds << "," << mops << "," << r.failed << ","
+                      << (r.consistent ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"strategy\": \"" << r.strategy << "\", \"threads\": " << r.threads
+                      << ", \"seconds\": " << r.seconds << ", \"mops_per_sec\": " << mops
+                      << ", \"failed_ops\": " << r.failed << ", \"consistent\": "
+                      << (r.consistent ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allConsistent) {
+        std::cerr << "Ledger total does not match the operations performed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
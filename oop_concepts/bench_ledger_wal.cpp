@@ -0,0 +1,260 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "durable_ledger.h"
+
+// Durable ledger operations per second and commit latency by group size.
+//
+// For every --groups value (records per fsync; 1 = fsync every operation,
+// 0 = everything queued) a fresh ledger in --dir runs --ops deposits,
+// withdrawals and transfers from --threads threads, timing each call until
+// it is durable. The ledger is then closed and reopened to time recovery;
+// with --snapshot-every N it only replays the log written since the last
+// snapshot instead of the whole history.
+//
+// Usage:
+//   ./bench_ledger_wal [--dir ledger_wal_bench] [--accounts 100000] [--ops 20000]
+//                      [--threads 64] [--groups 1,8,64,0] [--snapshot-every 0]
+//                      [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct WalResult {
+    size_t group;
+    double seconds;
+    uint64_t syncs;
+    double p50Us;
+    double p99Us;
+    double recoverySeconds;
+    uint64_t replayed;
+    bool consistent;
+};
+
+static std::vector<size_t> parseList(const std::string& list) {
+    std::vector<size_t> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(strtoul(item.c_str(), NULL, 10));
+        }
+    }
+    return values;
+}
+
+// Removes the ledger files left by an earlier run
+static void clearDirectory(const std::string& dir) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strncmp(entry->d_name, "wal-", 4) == 0 || strncmp(entry->d_name, "snapshot", 8) == 0) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(handle);
+}
+
+static inline uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static double percentileUs(std::vector<uint32_t>& nanoseconds, double p) {
+    if (nanoseconds.empty()) {
+        return 0.0;
+    }
+    size_t rank = (size_t)(p * (nanoseconds.size() - 1));
+    std::nth_element(nanoseconds.begin(), nanoseconds.begin() + rank, nanoseconds.end());
+    return nanoseconds[rank] / 1000.0;
+}
+
+static bool runGroup(const std::string& dir, size_t accounts, size_t ops, unsigned threads,
+                     size_t group, uint64_t snapshotEvery, WalResult& result) {
+    clearDirectory(dir);
+    result.group = group;
+    int64_t expectedTotal = 0;
+    {
+        DurableLedger ledger(accounts);
+        if (!ledger.open(dir)) {
+            perror("open");
+            return false;
+        }
+        ledger.log().setMaxGroup(group);
+        ledger.setSnapshotInterval(snapshotEvery);
+        if (ledger.openAccounts(accounts, 100000) < 0) {
+            perror("openAccounts");
+            return false;
+        }
+
+        std::vector<std::vector<uint32_t> > latencies(threads);
+        std::vector<int64_t> netDeposits(threads, 0);
+        std::vector<std::thread> workers;
+        uint64_t syncsBefore = ledger.log().stats().syncs;
+        Clock::time_point start = Clock::now();
+        for (unsigned t = 0; t < threads; t++) {
+            workers.push_back(std::thread([&, t]() {
+                uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+                size_t count = ops * (t + 1) / threads - ops * t / threads;
+                latencies[t].reserve(count);
+                for (size_t i = 0; i < count; i++) {
+                    uint64_t r = nextRandom(state);
+                    int64_t a = (int64_t)(r % accounts);
+                    int64_t cents = (int64_t)((r >> 40) % 5000) + 1;
+                    unsigned kind = (unsigned)((r >> 32) % 100);
+                    Clock::time_point begin = Clock::now();
+                    if (kind < 70) {
+                        ledger.transfer(a, (int64_t)(nextRandom(state) % accounts), cents);
+                    } else if (kind < 85) {
+                        if (ledger.deposit(a, cents)) {
+                            netDeposits[t] += cents;
+                        }
+                    } else if (ledger.withdraw(a, cents)) {
+                        netDeposits[t] -= cents;
+                    }
+                    latencies[t].push_back((uint32_t)std::min<int64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count(),
+                        UINT32_MAX));
+                }
+            }));
+        }
+        for (unsigned t = 0; t < threads; t++) {
+            workers[t].join();
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.syncs = ledger.log().stats().syncs - syncsBefore;
+
+        std::vector<uint32_t> all;
+        expectedTotal = 100000 * (int64_t)accounts;
+        for (unsigned t = 0; t < threads; t++) {
+            all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+            expectedTotal += netDeposits[t];
+        }
+        result.p50Us = percentileUs(all, 0.50);
+        result.p99Us = percentileUs(all, 0.99);
+    }
+
+    // Reopen: snapshot (if any) plus replay of the log after it
+    DurableLedger recovered(accounts);
+    LedgerRecovery recovery;
+    Clock::time_point start = Clock::now();
+    if (!recovered.open(dir, &recovery)) {
+        perror("recover");
+        return false;
+    }
+    result.recoverySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.replayed = recovery.replayedRecords;
+    result.consistent = recovered.accounts().totalCents() == expectedTotal &&
+                        recovered.accounts().size() == accounts;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = "ledger_wal_bench";
+    size_t accounts = 100000;
+    size_t ops = 20000;
+    unsigned threads = 64;
+    std::vector<size_t> groups = parseList("1,8,64,0");
+    uint64_t snapshotEvery = 0;
+    std::string format = "json";
+    const char* usage = " [--dir ledger_wal_bench] [--accounts 100000] [--ops 20000] [--threads 64]"
+                        " [--groups 1,8,64,0] [--snapshot-every 0] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--dir") {
+            dir = argv[i + 1];
+        } else if (arg == "--accounts") {
+            accounts = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--ops") {
+            ops = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--threads") {
+            threads = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--groups") {
+            groups = parseList(argv[i + 1]);
+        } else if (arg == "--snapshot-every") {
+            snapshotEvery = strtoull(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (accounts == 0 || ops == 0 || threads == 0 || groups.empty() ||
+        (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    std::vector<WalResult> results;
+    for (size_t i = 0; i < groups.size(); i++) {
+        std::cerr << "Running group size " << groups[i] << " with " << threads << " threads..."
+                  << std::endl;
+        WalResult result;
+        if (!runGroup(dir, accounts, ops, threads, groups[i], snapshotEvery, result)) {
+            return 1;
+        }
+        results.push_back(result);
+    }
+    clearDirectory(dir);
+    rmdir(dir.c_str());
+
+    bool allConsistent = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "group,threads,ops,seconds,ops_per_sec,fsyncs,records_per_fsync,p50_us,p99_us,"
+                     "recovery_ms,replayed_records,consistent\n";
+    } else {
+        std::cout << "{\n  \"accounts\": " << accounts << ",\n  \"ops\": " << ops
+                  << ",\n  \"threads\": " << threads << ",\n  \"snapshot_every\": " << snapshotEvery
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const WalResult& r = results[i];
+        double rate = r.seconds > 0 ? ops / r.seconds : 0.0;
+        double perSync = r.syncs > 0 ? (double)ops / r.syncs : 0.0;
+        allConsistent = allConsistent && r.consistent;
+        if (format == "csv") {
+            std::cout << r.group << "," << threads << "," << ops << "," << r.seconds << "," << rate
+                      << "," << r.syncs << "," << perSync << "," << r.p50Us << "," << r.p99Us << ","
+                      << r.recoverySeconds * 1000 << "," << r.replayed << ","
+                      << (r.consistent ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"group\": " << r.group << ", \"seconds\": " << r.seconds
+                      << ", \"ops_per_sec\": " << rate << ", \"fsyncs\": " << r.syncs
+                      << ", \"records_per_fsync\": " << perSync << ", \"p50_us\": " << r.p50Us
+                      << ", \"p99_us\": " << r.p99Us << ", \"recovery_ms\": "
+                      << r.recoverySeconds * 1000 << ", \"replayed_records\": " << r.replayed
+                      << ", \"consistent\": " << (r.consistent ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allConsistent) {
+        std::cerr << "Recovered ledger does not match the operations performed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
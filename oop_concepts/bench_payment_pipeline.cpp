@@ -0,0 +1,227 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include "payment_method.h"
+#include "payment_pipeline.h"
+
+// Payments per second, one at a time vs. through PaymentPipeline.
+//
+//   per_call         one PaymentMethod built from its identifier string per
+//                    payment, fee computed, object deleted (the shape of
+//                    polymorphism_example.cpp without the printing)
+//   pipeline_batch1  PaymentPipeline with batches of one payment
+//   pipeline         PaymentPipeline with --batch payments per queue pop
+// The pipeline runs are fed by --producers threads; latency is measured
+// from submit() to the sink.
+//
+// Usage:
+//   ./bench_payment_pipeline [--payments 2000000] [--producers 2] [--workers 2]
+//                            [--batch 256] [--capacity 65536] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t kAccounts = 10000;
+
+struct PipelineResult {
+    std::string method;
+    double seconds;
+    double fees;
+    uint64_t processed;
+    uint64_t batches;
+    uint64_t blocked;
+    bool haveLatency;
+    PipelineLatency latency;
+};
+
+static std::string accountName(PaymentKind kind, size_t index) {
+    std::string number = std::to_string(1000000 + index);
+    switch (kind) {
+    case kPaymentCreditCard: return "4532-7891-" + number.substr(0, 4) + "-" + number.substr(3, 4);
+    case kPaymentPayPal: return "customer" + number + "@example.com";
+    default: return "0xabc123def456" + number;
+    }
+}
+
+static PipelineResult runPerCall(const std::vector<Payment>& payments,
+                                 const std::vector<std::string>& accounts) {
+    PipelineResult result;
+    result.method = "per_call";
+    result.fees = 0.0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < payments.size(); i++) {
+        const Payment& payment = payments[i];
+        PaymentMethod* method;
+        switch (payment.kind) {
+        case kPaymentCreditCard: method = new CreditCardPayment(accounts[payment.account]); break;
+        case kPaymentPayPal: method = new PayPalPayment(accounts[payment.account]); break;
+        default: method = new CryptoCurrencyPayment(accounts[payment.account]); break;
+        }
+        result.fees += method->calculateFee(payment.amount);
+        delete method;
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.processed = payments.size();
+    result.batches = payments.size();
+    result.blocked = 0;
+    result.haveLatency = false;
+    return result;
+}
+
+static PipelineResult runPipeline(const char* name, const std::vector<Payment>& payments,
+                                  const std::vector<std::string>& accounts, unsigned producers,
+                                  unsigned workers, size_t batch, size_t capacity) {
+    PaymentPipeline pipeline(workers, capacity, batch);
+    // Accounts are interned up front, as a long-running service would have them
+    for (size_t i = 0; i < accounts.size(); i++) {
+        pipeline.identifiers().intern(accounts[i]);
+    }
+    pipeline.start();
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; p++) {
+        threads.push_back(std::thread([&pipeline, &payments, p, producers]() {
+            size_t begin = payments.size() * p / producers;
+            size_t end = payments.size() * (p + 1) / producers;
+            for (size_t i = begin; i < end; i++) {
+                pipeline.submit(payments[i]);
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    pipeline.close();
+
+    PipelineResult result;
+    result.method = name;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    PipelineStats stats = pipeline.stats();
+    result.fees = stats.fees;
+    result.processed = stats.processed;
+    result.batches = stats.batches;
+    result.blocked = stats.blocked;
+    result.haveLatency = true;
+    result.latency = stats.latency;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 2000000;
+    unsigned producers = 2;
+    unsigned workers = 2;
+    size_t batch = PaymentPipeline::kDefaultBatchSize;
+    size_t capacity = PaymentPipeline::kDefaultCapacity;
+    std::string format = "json";
+    const char* usage = " [--payments 2000000] [--producers 2] [--workers 2] [--batch 256]"
+                        " [--capacity 65536] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--payments") {
+            count = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--producers") {
+            producers = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--workers") {
+            workers = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--batch") {
+            batch = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--capacity") {
+            capacity = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (count == 0 || producers == 0 || workers == 0 || batch == 0 || capacity == 0 ||
+        (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    // Account ids follow the interning order: kind * kAccounts + index
+    std::vector<std::string> accounts;
+    for (int k = 0; k < kPaymentKindCount; k++) {
+        for (size_t i = 0; i < kAccounts; i++) {
+            accounts.push_back(accountName((PaymentKind)k, i));
+        }
+    }
+
+    std::cerr << "Generating " << count << " payments..." << std::endl;
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<int> kindOf(0, kPaymentKindCount - 1);
+    std::uniform_int_distribution<size_t> accountOf(0, kAccounts - 1);
+    std::uniform_real_distribution<double> amountOf(1.0, 500.0);
+    std::vector<Payment> payments;
+    payments.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        PaymentKind kind = (PaymentKind)kindOf(random);
+        uint32_t account = (uint32_t)(kind * kAccounts + accountOf(random));
+        payments.push_back(Payment::make(i, kind, account, amountOf(random)));
+    }
+
+    std::vector<PipelineResult> results;
+    std::cerr << "Running per_call..." << std::endl;
+    results.push_back(runPerCall(payments, accounts));
+    std::cerr << "Running pipeline_batch1..." << std::endl;
+    results.push_back(runPipeline("pipeline_batch1", payments, accounts, producers, workers, 1,
+                                  capacity));
+    std::cerr << "Running pipeline..." << std::endl;
+    results.push_back(runPipeline("pipeline", payments, accounts, producers, workers, batch,
+                                  capacity));
+
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "method,payments,producers,workers,seconds,payments_per_sec,batches,"
+                     "blocked_submits,p50_us,p99_us,p999_us,total_fees\n";
+    } else {
+        std::cout << "{\n  \"payments\": " << count << ",\n  \"producers\": " << producers
+                  << ",\n  \"workers\": " << workers << ",\n  \"batch\": " << batch
+                  << ",\n  \"capacity\": " << capacity << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const PipelineResult& r = results[i];
+        double rate = r.seconds > 0 ? r.processed / r.seconds : 0.0;
+        if (format == "csv") {
+            std::cout << r.method << "," << r.processed << "," << producers << "," << workers << ","
+                      << r.seconds << "," << rate << "," << r.batches << "," << r.blocked << ",";
+            if (r.haveLatency) {
+                std::cout << r.latency.percentile(0.50) / 1000.0 << ","
+                          << r.latency.percentile(0.99) / 1000.0 << ","
+                          << r.latency.percentile(0.999) / 1000.0;
+            } else {
+                std::cout << ",,";
+            }
+            std::cout << "," << r.fees << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"processed\": " << r.processed
+                      << ", \"seconds\": " << r.seconds << ", \"payments_per_sec\": " << rate
+                      << ", \"batches\": " << r.batches << ", \"blocked_submits\": " << r.blocked;
+            if (r.haveLatency) {
+                std::cout << ", \"p50_us\": " << r.latency.percentile(0.50) / 1000.0
+                          << ", \"p99_us\": " << r.latency.percentile(0.99) / 1000.0
+                          << ", \"p999_us\": " << r.latency.percentile(0.999) / 1000.0;
+            } else {
+                std::cout << ", \"p50_us\": null, \"p99_us\": null, \"p999_us\": null";
+            }
+            std::cout << ", \"total_fees\": " << r.fees << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include "employee.h"
+#include "payroll_table.h"
+
+// Payroll over N random employees: std::vector<Employee*> with a virtual
+// calculateSalary() call per object (as in inheritance_example.cpp) against
+// PayrollTable's per-role columns, for the total, per-role summaries and the
+// top-k salaries. Every method's answer is compared with the virtual path's.
+//
+// Usage:
+//   ./bench_payroll [--employees 5000000] [--iterations 5] [--top 10] [--threads N]
+//                   [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct PayrollResult {
+    std::string method;
+    unsigned threads;
+    double bestSeconds;
+    bool matches;
+};
+
+// Everything one payroll run computes, so methods can be compared
+struct PayrollAnswer {
+    int64_t totalCents;
+    PayrollSummary roles[kPayrollRoles];
+    std::vector<std::pair<int, int64_t> > top;   // id, salary
+
+    PayrollAnswer() : totalCents(0) {}
+};
+
+template <typename Function>
+static double timeBest(size_t iterations, Function compute) {
+    double best = 1e30;
+    for (size_t i = 0; i < iterations; i++) {
+        Clock::time_point start = Clock::now();
+        compute();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+static bool sameSummaries(const PayrollSummary* a, const PayrollSummary* b) {
+    for (int role = 0; role < kPayrollRoles; role++) {
+        if (a[role].count != b[role].count || a[role].totalCents != b[role].totalCents ||
+            (a[role].count > 0 &&
+             (a[role].minCents != b[role].minCents || a[role].maxCents != b[role].maxCents))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void entriesToTop(const std::vector<PayrollEntry>& entries, PayrollAnswer& answer) {
+    answer.top.clear();
+    for (size_t i = 0; i < entries.size(); i++) {
+        answer.top.push_back(std::make_pair(entries[i].id, entries[i].salaryCents));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 5000000;
+    size_t iterations = 5;
+    size_t k = 10;
+    unsigned threads = std::thread::hardware_concurrency();
+    std::string format = "json";
+    const char* usage =
+        " [--employees 5000000] [--iterations 5] [--top 10] [--threads N] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--employees") {
+            count = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--top") {
+            k = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--threads") {
+            threads = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (count == 0 || iterations == 0 || k == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    // Same employees in both layouts: 60% staff, 10% managers, 30%
+    // developers, amounts in whole cents. The pointer vector is shuffled so
+    // the roles are interleaved.
+    std::cerr << "Creating " << count << " employees..." << std::endl;
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<int> salaryCents(3000000, 20000000);
+    std::uniform_int_distribution<int> bonusCents(0, 5000000);
+    std::uniform_int_distribution<int> teamSize(1, 40);
+    std::uniform_int_distribution<int> overtime(0, 200);
+    std::vector<Employee*> employees;
+    std::vector<PayrollRole> roleOf;   // by id, for the virtual per-role summary
+    employees.reserve(count);
+    roleOf.reserve(count);
+    PayrollTable table;
+    table.reserve(count * 6 / 10 + 1, count / 10 + 1, count * 3 / 10 + 1, count * 12);
+    for (size_t i = 0; i < count; i++) {
+        int id = (int)i;
+        std::string name = "Employee " + std::to_string(i);
+        double base = salaryCents(random) / 100.0;
+        unsigned kind = (unsigned)(random() % 10);
+        if (kind == 0) {
+            employees.push_back(new Manager(name, id, base, bonusCents(random) / 100.0, teamSize(random)));
+            roleOf.push_back(kPayrollManager);
+        } else if (kind <= 3) {
+            employees.push_back(new Developer(name, id, base, "C++", overtime(random)));
+            roleOf.push_back(kPayrollDeveloper);
+        } else {
+            employees.push_back(new Employee(name, id, base));
+            roleOf.push_back(kPayrollEmployee);
+        }
+        table.add(*employees.back());
+    }
+    std::shuffle(employees.begin(), employees.end(), random);
+
+    std::vector<PayrollResult> results;
+    PayrollAnswer reference;
+    PayrollAnswer answer;
+
+    std::cerr << "Running virtual dispatch..." << std::endl;
+    PayrollResult result;
+    result.method = "virtual_total";
+    result.threads = 1;
+    result.bestSeconds = timeBest(iterations, [&]() {
+        int64_t total = 0;
+        for (size_t i = 0; i < employees.size(); i++) {
+            total += payrollCents(employees[i]->calculateSalary());
+        }
+        reference.totalCents = total;
+    });
+    result.matches = true;
+    results.push_back(result);
+
+    result.method = "virtual_summary";
+    result.bestSeconds = timeBest(iterations, [&]() {
+        for (int role = 0; role < kPayrollRoles; role++) {
+            reference.roles[role] = PayrollSummary();
+        }
+        for (size_t i = 0; i < employees.size(); i++) {
+            int64_t salary = payrollCents(employees[i]->calculateSalary());
+            PayrollSummary& summary = reference.roles[roleOf[employees[i]->getId()]];
+            summary.count++;
+            summary.totalCents += salary;
+            summary.minCents = std::min(summary.minCents, salary);
+            summary.maxCents = std::max(summary.maxCents, salary);
+        }
+    });
+    results.push_back(result);
+
+    result.method = "virtual_topk";
+    result.bestSeconds = timeBest(iterations, [&]() {
+        std::vector<PayrollEntry> all(employees.size());
+        for (size_t i = 0; i < employees.size(); i++) {
+            all[i].id = employees[i]->getId();
+            all[i].role = roleOf[all[i].id];
+            all[i].row = i;
+            all[i].salaryCents = payrollCents(employees[i]->calculateSalary());
+        }
+        size_t keep = std::min(k, all.size());
+        std::partial_sort(all.begin(), all.begin() + keep, all.end(), payrollRanksBefore);
+        all.resize(keep);
+        entriesToTop(all, reference);
+    });
+    results.push_back(result);
+
+    static const SimdLevel kLevels[] = {kSimdScalar, kSimdAvx2};
+    static const char* const kLevelNames[] = {"scalar", "avx2"};
+    SimdLevel best = detectSimdLevel();
+    std::vector<PayrollEntry> top;
+    for (int l = 0; l < 2; l++) {
+        if (kLevels[l] > best) {
+            std::cerr << "Skipping " << kLevelNames[l] << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        table.setSimd(kLevels[l]);
+        std::string suffix = std::string("_") + kLevelNames[l];
+        std::cerr << "Running table" << suffix << "..." << std::endl;
+        result.threads = 1;
+        result.method = "table_total" + suffix;
+        result.bestSeconds = timeBest(iterations, [&]() { answer.totalCents = table.totalCents(); });
+        result.matches = answer.totalCents == reference.totalCents;
+        results.push_back(result);
+
+        result.method = "table_summary" + suffix;
+        result.bestSeconds = timeBest(iterations, [&]() { table.summarize(answer.roles, 1); });
+        result.matches = sameSummaries(answer.roles, reference.roles);
+        results.push_back(result);
+
+        result.method = "table_topk" + suffix;
+        result.bestSeconds = timeBest(iterations, [&]() { table.topK(k, top, 1); });
+        entriesToTop(top, answer);
+        result.matches = answer.top == reference.top;
+        results.push_back(result);
+    }
+
+    table.setSimd(best);
+    std::cerr << "Running the table with " << threads << " threads..." << std::endl;
+    result.threads = threads;
+    result.method = "table_summary_parallel";
+    result.bestSeconds = timeBest(iterations, [&]() { table.summarize(answer.roles, threads); });
+    result.matches = sameSummaries(answer.roles, reference.roles);
+    results.push_back(result);
+
+    result.method = "table_topk_parallel";
+    result.bestSeconds = timeBest(iterations, [&]() { table.topK(k, top, threads); });
+    entriesToTop(top, answer);
+    result.matches = answer.top == reference.top;
+    results.push_back(result);
+
+    for (size_t i = 0; i < employees.size(); i++) {
+        delete employees[i];
+    }
+
+    bool allMatch = true;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "method,employees,threads,ms,ns_per_employee,matches_virtual\n";
+    } else {
+        std::cout << "{\n  \"employees\": " << count << ",\n  \"top\": " << k
+                  << ",\n  \"total_cents\": " << reference.totalCents << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const PayrollResult& r = results[i];
+        double nsPerEmployee = r.bestSeconds * 1e9 / count;
+        allMatch = allMatch && r.matches;
+        if (format == "csv") {
+            std::cout << r.method << "," << count << "," << r.threads << "," << r.bestSeconds * 1000
+                      << "," << nsPerEmployee << "," << (r.matches ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"threads\": " << r.threads
+                      << ", \"ms\": " << r.bestSeconds * 1000 << ", \"ns_per_employee\": " << nsPerEmployee
+                      << ", \"matches_virtual\": " << (r.matches ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << "A columnar result differs from the virtual path" << std::endl;
+        return 1;
+    }
+    return 0;
+}
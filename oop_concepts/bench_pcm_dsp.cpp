@@ -0,0 +1,259 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include "pcm_dsp.h"
+
+// Throughput of each pcm_dsp.h kernel at each SIMD level this CPU
+// supports, in millions of samples per second (for mixing, output
+// samples; for resampling, input samples). Every level's output is
+// compared with the scalar kernel's: integer results must be identical,
+// float results may differ by rounding (max_error).
+//
+// Usage:
+//   ./bench_pcm_dsp [--samples 1048576] [--streams 8] [--iterations 20] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct KernelResult {
+    std::string kernel;
+    std::string simd;
+    double bestSeconds;
+    double samples;       // per run
+    double maxError;
+    bool matches;
+};
+
+template <typename Function>
+static double timeBest(size_t iterations, Function run) {
+    double best = 1e30;
+    for (size_t i = 0; i < iterations; i++) {
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+template <typename Sample>
+static double maxDifference(const std::vector<Sample>& a, const std::vector<Sample>& b) {
+    if (a.size() != b.size()) {
+        return HUGE_VAL;
+    }
+    double worst = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        worst = std::max(worst, std::fabs((double)a[i] - (double)b[i]));
+    }
+    return worst;
+}
+
+// Stereo resampling in 1024-frame blocks, as the audio pipeline does it
+static void resampleAll(PolyphaseResampler& resampler, const std::vector<float>& in, std::vector<float>& out) {
+    const size_t block = 1024;
+    out.resize(resampler.maxOutputFrames(in.size() / 2) * 2 + 4 * block);
+    resampler.reset();
+    size_t written = 0;
+    for (size_t f = 0; f < in.size() / 2; f += block) {
+        size_t frames = std::min(block, in.size() / 2 - f);
+        written += (size_t)resampler.process(&in[f * 2], frames, &out[written]) * 2;
+    }
+    written += resampler.flush(&out[written]) * 2;
+    out.resize(written);
+}
+
+int main(int argc, char* argv[]) {
+    size_t samples = 1 << 20;
+    size_t streams = 8;
+    size_t iterations = 20;
+    std::string format = "json";
+    const char* usage = " [--samples 1048576] [--streams 8] [--iterations 20] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--samples") {
+            samples = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--streams") {
+            streams = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    samples &= ~(size_t)1;   // whole stereo frames
+    if (samples == 0 || streams == 0 || iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    // Loud random streams, so mixing them saturates now and then
+    std::mt19937 random(42);
+    std::vector<std::vector<int16_t> > inputs(streams, std::vector<int16_t>(samples));
+    std::vector<const int16_t*> inputPointers(streams);
+    for (size_t s = 0; s < streams; s++) {
+        for (size_t i = 0; i < samples; i++) {
+            inputs[s][i] = (int16_t)(random() % 65536 - 32768);
+        }
+        inputPointers[s] = &inputs[s][0];
+    }
+    std::vector<float> floats(samples);
+    dsp_kernels::int16ToFloatScalar(&inputs[0][0], &floats[0], samples);
+    // A 1 kHz tone for the resamplers
+    std::vector<float> tone44(samples);
+    std::vector<float> tone48(samples);
+    for (size_t i = 0; i < samples; i++) {
+        tone44[i] = 0.5f * (float)sin(2 * M_PI * 1000 * (double)(i / 2) / 44100);
+        tone48[i] = 0.5f * (float)sin(2 * M_PI * 1000 * (double)(i / 2) / 48000);
+    }
+
+    static const SimdLevel kLevels[] = {kSimdScalar, kSimdSse41, kSimdAvx2};
+    static const char* const kLevelNames[] = {"scalar", "sse4.1", "avx2"};
+    SimdLevel best = detectSimdLevel();
+
+    std::vector<KernelResult> results;
+    // Scalar outputs, the reference for the other levels
+    std::vector<float> referenceFloats, referenceGain, reference48, reference44;
+    std::vector<int16_t> referenceShorts, referenceMix;
+    std::vector<float> floatOut(samples);
+    std::vector<int16_t> shortOut(samples);
+    std::vector<float> resampled;
+    PolyphaseResampler up;
+    PolyphaseResampler down;
+    up.configure(44100, 48000, 2, 1024);
+    down.configure(48000, 44100, 2, 1024);
+    std::string mixName = "mix_" + std::to_string(streams);
+
+    for (int l = 0; l < 3; l++) {
+        SimdLevel level = kLevels[l];
+        if (level > best) {
+            std::cerr << "Skipping " << kLevelNames[l] << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::cerr << "Running " << kLevelNames[l] << "..." << std::endl;
+        KernelResult result;
+        result.simd = kLevelNames[l];
+
+        result.kernel = "int16_to_float";
+        result.samples = (double)samples;
+        result.bestSeconds = timeBest(iterations, [&]() {
+            dsp_kernels::int16ToFloat(level, &inputs[0][0], &floatOut[0], samples);
+        });
+        if (l == 0) referenceFloats = floatOut;
+        result.maxError = maxDifference(floatOut, referenceFloats);
+        result.matches = result.maxError == 0.0;
+        results.push_back(result);
+
+        result.kernel = "float_to_int16";
+        result.bestSeconds = timeBest(iterations, [&]() {
+            dsp_kernels::floatToInt16(level, &floats[0], &shortOut[0], samples);
+        });
+        if (l == 0) referenceShorts = shortOut;
+        result.maxError = maxDifference(shortOut, referenceShorts);
+        result.matches = result.maxError == 0.0 && shortOut == inputs[0];
+        results.push_back(result);
+
+        // In place, so every run starts from a fresh copy (not timed)
+        result.kernel = "gain_ramp";
+        result.bestSeconds = 1e30;
+        for (size_t i = 0; i < iterations; i++) {
+            floatOut = floats;
+            Clock::time_point start = Clock::now();
+            dsp_kernels::gainRamp(level, &floatOut[0], samples / 2, 2, 1.0f, 0.25f);
+            result.bestSeconds =
+                std::min(result.bestSeconds, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+        if (l == 0) referenceGain = floatOut;
+        result.maxError = maxDifference(floatOut, referenceGain);
+        result.matches = result.maxError <= 1e-6;
+        results.push_back(result);
+
+        result.kernel = mixName;
+        result.bestSeconds = timeBest(iterations, [&]() {
+            dsp_kernels::mix(level, &inputPointers[0], streams, &shortOut[0], samples);
+        });
+        if (l == 0) referenceMix = shortOut;
+        result.maxError = maxDifference(shortOut, referenceMix);
+        result.matches = result.maxError == 0.0;
+        results.push_back(result);
+
+        result.kernel = "resample_44k_48k";
+        up.setSimd(level);
+        result.bestSeconds = timeBest(iterations, [&]() { resampleAll(up, tone44, resampled); });
+        if (l == 0) reference48 = resampled;
+        result.maxError = maxDifference(resampled, reference48);
+        result.matches = result.maxError <= 1e-5;
+        results.push_back(result);
+
+        result.kernel = "resample_48k_44k";
+        down.setSimd(level);
+        result.bestSeconds = timeBest(iterations, [&]() { resampleAll(down, tone48, resampled); });
+        if (l == 0) reference44 = resampled;
+        result.maxError = maxDifference(resampled, reference44);
+        result.matches = result.maxError <= 1e-5;
+        results.push_back(result);
+    }
+
+    // The resampled tone must still be a 1 kHz tone at the new rate: compare
+    // the middle of the output with the ideal one
+    double toneError = 0.0;
+    for (size_t i = samples / 4; i < samples / 2 && i < reference48.size(); i += 2) {
+        double ideal = 0.5 * sin(2 * M_PI * 1000 * ((double)(i / 2) - 16.0 * 48000 / 44100) / 48000);
+        toneError = std::max(toneError, std::fabs(reference48[i] - ideal));
+    }
+    bool toneMatches = toneError < 0.01;
+
+    bool allMatch = toneMatches;
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "kernel,simd,msamples_per_sec,speedup,max_error,matches\n";
+    } else {
+        std::cout << "{\n  \"samples\": " << samples << ",\n  \"streams\": " << streams
+                  << ",\n  \"resampled_tone_error\": " << std::setprecision(6) << toneError
+                  << std::setprecision(3) << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const KernelResult& r = results[i];
+        double rate = r.bestSeconds > 0 ? r.samples / r.bestSeconds / 1e6 : 0.0;
+        double scalarSeconds = r.bestSeconds;
+        for (size_t j = 0; j < results.size(); j++) {
+            if (results[j].kernel == r.kernel && results[j].simd == "scalar") {
+                scalarSeconds = results[j].bestSeconds;
+            }
+        }
+        double speedup = r.bestSeconds > 0 ? scalarSeconds / r.bestSeconds : 0.0;
+        allMatch = allMatch && r.matches;
+        if (format == "csv") {
+            std::cout << r.kernel << "," << r.simd << "," << rate << "," << speedup << "," << std::setprecision(6)
+                      << r.maxError << std::setprecision(3) << "," << (r.matches ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"kernel\": \"" << r.kernel << "\", \"simd\": \"" << r.simd
+                      << "\", \"msamples_per_sec\": " << rate << ", \"speedup\": " << speedup
+                      << ", \"max_error\": " << std::setprecision(6) << r.maxError << std::setprecision(3)
+                      << ", \"matches\": " << (r.matches ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << (toneMatches ? "A SIMD kernel differs from the scalar one"
+                                  : "The resampled tone is not a 1 kHz tone")
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
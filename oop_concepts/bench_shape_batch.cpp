@@ -0,0 +1,173 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include "shape.h"
+#include "shape_batch.h"
+
+// Total area of N random shapes: std::vector<Shape*> with a virtual
+// calculateArea() call per shape (as in polymorphism_example.cpp) against
+// ShapeBatch's per-type columns with scalar, SSE2 and AVX2 kernels, and the
+// multithreaded reduction.
+//
+// Usage:
+//   ./bench_shape_batch [--shapes 10000000] [--iterations 5] [--threads N] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct AreaResult {
+    std::string method;
+    double bestSeconds;
+    double totalArea;
+};
+
+template <typename Function>
+static AreaResult timeBest(const std::string& method, size_t iterations, Function compute) {
+    AreaResult result;
+    result.method = method;
+    result.bestSeconds = 1e30;
+    result.totalArea = 0.0;
+    for (size_t i = 0; i < iterations; i++) {
+        Clock::time_point start = Clock::now();
+        result.totalArea = compute();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.bestSeconds = std::min(result.bestSeconds, seconds);
+    }
+    return result;
+}
+
+static double virtualTotal(const std::vector<Shape*>& shapes) {
+    double total = 0.0;
+    for (size_t i = 0; i < shapes.size(); i++) {
+        total += shapes[i]->calculateArea();
+    }
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 10000000;
+    size_t iterations = 5;
+    unsigned threads = std::thread::hardware_concurrency();
+    std::string format = "json";
+    const char* usage = " [--shapes 10000000] [--iterations 5] [--threads N] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--shapes") {
+            count = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--threads") {
+            threads = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (count == 0 || iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    // Same random shapes in both layouts; the pointer vector is shuffled so
+    // the types are interleaved, as when shapes arrive in any order
+    std::cerr << "Creating " << count << " shapes..." << std::endl;
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> dimension(0.5, 10.0);
+    std::vector<Shape*> shapes;
+    shapes.reserve(count);
+    ShapeBatch batch;
+    batch.reserve(count / 3 + 1, count / 3 + 1, count / 3 + 1);
+    for (size_t i = 0; i < count; i++) {
+        double a = dimension(random);
+        double b = dimension(random);
+        switch (i % 3) {
+        case 0:
+            shapes.push_back(new Circle(a));
+            batch.addCircle(a);
+            break;
+        case 1:
+            shapes.push_back(new Rectangle(a, b));
+            batch.addRectangle(a, b);
+            break;
+        default:
+            shapes.push_back(new Triangle(a, b));
+            batch.addTriangle(a, b);
+            break;
+        }
+    }
+    std::shuffle(shapes.begin(), shapes.end(), random);
+
+    std::vector<AreaResult> results;
+    std::cerr << "Running virtual dispatch..." << std::endl;
+    results.push_back(timeBest("virtual", iterations, [&]() { return virtualTotal(shapes); }));
+
+    static const SimdLevel kLevels[] = {kSimdScalar, kSimdSse2, kSimdAvx2};
+    static const char* const kLevelNames[] = {"batch_scalar", "batch_sse2", "batch_avx2"};
+    SimdLevel best = detectSimdLevel();
+    for (int l = 0; l < 3; l++) {
+        if (kLevels[l] > best) {
+            std::cerr << "Skipping " << kLevelNames[l] << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::cerr << "Running " << kLevelNames[l] << "..." << std::endl;
+        batch.setSimd(kLevels[l]);
+        results.push_back(timeBest(kLevelNames[l], iterations, [&]() { return batch.totalArea(); }));
+    }
+
+    batch.setSimd(best);
+    std::cerr << "Running batch_parallel with " << threads << " threads..." << std::endl;
+    results.push_back(timeBest("batch_parallel", iterations,
+                               [&]() { return batch.totalAreaParallel(threads); }));
+
+    for (size_t i = 0; i < shapes.size(); i++) {
+        delete shapes[i];
+    }
+
+    double reference = results[0].totalArea;
+    double baseline = results[0].bestSeconds;
+    std::cout << std::setprecision(6);
+    if (format == "csv") {
+        std::cout << "method,shapes,threads,seconds,ns_per_shape,speedup,total_area,relative_error\n";
+    } else {
+        std::cout << "{\n  \"shapes\": " << count << ",\n  \"threads\": " << threads
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const AreaResult& r = results[i];
+        double nsPerShape = r.bestSeconds * 1e9 / count;
+        double speedup = r.bestSeconds > 0 ? baseline / r.bestSeconds : 0.0;
+        double error = reference != 0 ? std::fabs(r.totalArea - reference) / reference : 0.0;
+        unsigned used = r.method == "batch_parallel" ? threads : 1;
+        if (format == "csv") {
+            std::cout << r.method << "," << count << "," << used << "," << r.bestSeconds << ","
+                      << nsPerShape << "," << speedup << "," << r.totalArea << "," << error << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"threads\": " << used
+                      << ", \"seconds\": " << r.bestSeconds << ", \"ns_per_shape\": " << nsPerShape
+                      << ", \"speedup\": " << speedup << ", \"total_area\": " << r.totalArea
+                      << ", \"relative_error\": " << error << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "vehicle.h"
+#include "vehicle_catalog.h"
+
+// Cold start of a vehicle catalog: deserializing it into Vehicle/
+// ElectricCar/LuxuryCar objects (a std::string copy per brand and model,
+// one new per vehicle) against mapping it with VehicleCatalog and using the
+// views in place. Before every run the file is dropped from the page
+// cache, so "cold" includes reading from the disk. For each method:
+//   - start: until the catalog can answer a query
+//   - first_queries: 1000 random calculatePrice() lookups right after
+//   - scan: total calculatePrice() over all vehicles
+// The views' prices and displaySpecs() output are checked against the
+// objects'.
+//
+// Usage:
+//   ./bench_vehicle_catalog [--vehicles 2000000] [--file vehicles_bench.cat] [--iterations 3]
+//                           [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct CatalogResult {
+    std::string method;
+    double startSeconds;
+    double firstQueriesSeconds;
+    double scanSeconds;
+    double probePrice;   // sum over the first queries
+    double totalPrice;
+};
+
+// Writes dirty pages back and drops the file from the page cache
+static void dropFromCache(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// What a loader without in-place views has to do: copy every record into
+// a heap object, in section order
+static void loadObjects(const VehicleCatalog& catalog, std::vector<Vehicle*>& out) {
+    out.reserve(catalog.size());
+    for (size_t i = 0; i < catalog.count(kVehiclePlain); i++) {
+        VehicleView v = catalog.vehicle(i);
+        out.push_back(new Vehicle(v.brand().str(), v.model().str(), v.year(), v.basePrice()));
+    }
+    for (size_t i = 0; i < catalog.count(kVehicleElectric); i++) {
+        ElectricCarView v = catalog.electricCar(i);
+        out.push_back(new ElectricCar(v.brand().str(), v.model().str(), v.year(), v.basePrice(),
+                                      v.batteryCapacity(), v.range()));
+    }
+    for (size_t i = 0; i < catalog.count(kVehicleLuxury); i++) {
+        LuxuryCarView v = catalog.luxuryCar(i);
+        out.push_back(new LuxuryCar(v.brand().str(), v.model().str(), v.year(), v.basePrice(),
+                                    v.massageSeats(), v.autoPilot()));
+    }
+}
+
+// Price of vehicle i counting through the sections in order
+static double viewPrice(const VehicleCatalog& catalog, size_t i) {
+    if (i < catalog.count(kVehiclePlain)) {
+        return catalog.vehicle(i).calculatePrice();
+    }
+    i -= catalog.count(kVehiclePlain);
+    if (i < catalog.count(kVehicleElectric)) {
+        return catalog.electricCar(i).calculatePrice();
+    }
+    return catalog.luxuryCar(i - catalog.count(kVehicleElectric)).calculatePrice();
+}
+
+static double viewTotal(const VehicleCatalog& catalog) {
+    double total = 0.0;
+    for (size_t i = 0; i < catalog.count(kVehiclePlain); i++) {
+        total += catalog.vehicle(i).calculatePrice();
+    }
+    for (size_t i = 0; i < catalog.count(kVehicleElectric); i++) {
+        total += catalog.electricCar(i).calculatePrice();
+    }
+    for (size_t i = 0; i < catalog.count(kVehicleLuxury); i++) {
+        total += catalog.luxuryCar(i).calculatePrice();
+    }
+    return total;
+}
+
+// displaySpecs() of an object as text (the classes print to std::cout)
+static std::string objectSpecs(Vehicle* vehicle) {
+    std::ostringstream text;
+    std::streambuf* previous = std::cout.rdbuf(text.rdbuf());
+    vehicle->displaySpecs();
+    std::cout.rdbuf(previous);
+    return text.str();
+}
+
+template <typename View>
+static std::string viewSpecs(const View& view) {
+    std::ostringstream text;
+    view.displaySpecs(text);
+    return text.str();
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 2000000;
+    std::string path = "vehicles_bench.cat";
+    size_t iterations = 3;
+    std::string format = "json";
+    const char* usage = " [--vehicles 2000000] [--file vehicles_bench.cat] [--iterations 3] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--vehicles") {
+            count = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--file") {
+            path = argv[i + 1];
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (count == 0 || iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    // Half plain vehicles, a quarter each electric and luxury; 20 brands
+    // with 10 models each
+    std::cerr << "Writing " << count << " vehicles to " << path << "..." << std::endl;
+    {
+        std::mt19937_64 random(42);
+        VehicleCatalogWriter writer;
+        for (size_t i = 0; i < count; i++) {
+            unsigned brand = (unsigned)(random() % 20);
+            std::string brandName = "Brand " + std::to_string(brand);
+            std::string modelName = "Model " + std::to_string(brand * 10 + random() % 10);
+            int year = 2000 + (int)(random() % 25);
+            double price = 15000 + (double)(random() % 150000);
+            unsigned kind = (unsigned)(random() % 4);
+            if (kind == 0) {
+                writer.addElectricCar(brandName, modelName, year, price, 40 + (int)(random() % 80),
+                                      150 + (int)(random() % 250));
+            } else if (kind == 1) {
+                writer.addLuxuryCar(brandName, modelName, year, price, random() % 2 == 0, random() % 2 == 0);
+            } else {
+                writer.addVehicle(brandName, modelName, year, price);
+            }
+        }
+        if (!writer.write(path)) {
+            perror(path.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<size_t> probes;
+    std::mt19937_64 random(7);
+    for (int i = 0; i < 1000; i++) {
+        probes.push_back((size_t)(random() % count));
+    }
+
+    std::vector<CatalogResult> results;
+    bool matches = true;
+    uint64_t fileBytes = 0;
+    static const char* const kMethods[] = {"objects", "mapped", "mapped_populate"};
+    for (int m = 0; m < 3; m++) {
+        std::cerr << "Running " << kMethods[m] << "..." << std::endl;
+        CatalogResult best;
+        best.method = kMethods[m];
+        best.startSeconds = 1e30;
+        for (size_t iteration = 0; iteration < iterations; iteration++) {
+            dropFromCache(path);
+            CatalogResult result;
+            result.method = kMethods[m];
+            VehicleCatalog catalog;
+            std::vector<Vehicle*> objects;
+            Clock::time_point start = Clock::now();
+            if (!catalog.open(path, m == 2)) {
+                perror("open");
+                return 1;
+            }
+            if (m == 0) {
+                loadObjects(catalog, objects);
+                catalog.close();
+            }
+            result.startSeconds = seconds(start);
+            fileBytes = catalog.isOpen() ? catalog.fileSize() : fileBytes;
+
+            result.probePrice = 0.0;
+            start = Clock::now();
+            for (size_t p = 0; p < probes.size(); p++) {
+                result.probePrice +=
+                    m == 0 ? objects[probes[p]]->calculatePrice() : viewPrice(catalog, probes[p]);
+            }
+            result.firstQueriesSeconds = seconds(start);
+
+            start = Clock::now();
+            result.totalPrice = 0.0;
+            if (m == 0) {
+                for (size_t i = 0; i < objects.size(); i++) {
+                    result.totalPrice += objects[i]->calculatePrice();
+                }
+            } else {
+                result.totalPrice = viewTotal(catalog);
+            }
+            result.scanSeconds = seconds(start);
+
+            if (m == 0 && iteration == 0) {
+                // Same prices and displaySpecs() text from views and objects
+                VehicleCatalog check;
+                check.open(path);
+                for (size_t i = 0; i < objects.size(); i += 997) {
+                    matches = matches && objects[i]->calculatePrice() == viewPrice(check, i);
+                }
+                size_t plain = check.count(kVehiclePlain);
+                size_t electric = check.count(kVehicleElectric);
+                if (plain > 0) {
+                    matches = matches && objectSpecs(objects[0]) == viewSpecs(check.vehicle(0));
+                }
+                if (electric > 0) {
+                    matches = matches && objectSpecs(objects[plain]) == viewSpecs(check.electricCar(0));
+                }
+                if (check.count(kVehicleLuxury) > 0) {
+                    matches = matches && objectSpecs(objects[plain + electric]) == viewSpecs(check.luxuryCar(0));
+                }
+            }
+            for (size_t i = 0; i < objects.size(); i++) {
+                delete objects[i];
+            }
+            if (result.startSeconds < best.startSeconds) {
+                best = result;
+            }
+        }
+        results.push_back(best);
+    }
+    unlink(path.c_str());
+
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "method,vehicles,file_mb,start_ms,first_queries_us,scan_ms,speedup,matches\n";
+    } else {
+        std::cout << "{\n  \"vehicles\": " << count << ",\n  \"file_mb\": " << fileBytes / 1e6
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const CatalogResult& r = results[i];
+        bool same = matches && r.totalPrice == results[0].totalPrice &&
+                    r.probePrice == results[0].probePrice;
+        double speedup = r.startSeconds > 0 ? results[0].startSeconds / r.startSeconds : 0.0;
+        matches = matches && same;
+        if (format == "csv") {
+            std::cout << r.method << "," << count << "," << fileBytes / 1e6 << "," << r.startSeconds * 1000
+                      << "," << r.firstQueriesSeconds * 1e6 << "," << r.scanSeconds * 1000 << "," << speedup
+                      << "," << (same ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"start_ms\": " << r.startSeconds * 1000
+                      << ", \"first_queries_us\": " << r.firstQueriesSeconds * 1e6
+                      << ", \"scan_ms\": " << r.scanSeconds * 1000 << ", \"speedup\": " << speedup
+                      << ", \"matches\": " << (same ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!matches) {
+        std::cerr << "The catalog views differ from the objects" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include "vehicle.h"
+#include "vehicle_query.h"
+
+// Query latency over a vehicle inventory of each --rows size: a full scan
+// of std::vector<Vehicle*> (dynamic_cast, getters and a virtual
+// calculatePrice() per vehicle) against VehicleInventory's indexed plans.
+// Then --updates random attribute changes are applied incrementally and
+// every query is checked again against a scan of the updated columns.
+// The "updates" rows report the mean time per update in p50_us.
+//
+// Usage:
+//   ./bench_vehicle_query [--rows 1000000,10000000] [--repeats 11] [--updates 1000000]
+//                         [--format json|csv]
+//
+// 100M rows need about 20 GB for the objects and the inventory together.
+
+typedef std::chrono::steady_clock Clock;
+
+struct NamedQuery {
+    const char* name;
+    VehicleQuery query;
+};
+
+struct QueryResult {
+    size_t rows;
+    std::string query;
+    std::string method;
+    std::string plan;
+    double p50Us;
+    size_t examined;
+    size_t results;
+    bool matches;
+};
+
+static std::vector<size_t> parseList(const std::string& list) {
+    std::vector<size_t> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(strtoul(item.c_str(), NULL, 10));
+        }
+    }
+    return values;
+}
+
+template <typename Function>
+static double medianUs(size_t repeats, Function run) {
+    std::vector<double> samples;
+    for (size_t i = 0; i < repeats; i++) {
+        Clock::time_point start = Clock::now();
+        run();
+        samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// The same query the object-oriented way
+static void virtualScan(const std::vector<Vehicle*>& vehicles, const VehicleQuery& query,
+                        std::vector<uint32_t>& rows) {
+    rows.clear();
+    std::vector<double> prices(query.order == kOrderNone ? 0 : vehicles.size());
+    for (size_t i = 0; i < vehicles.size(); i++) {
+        Vehicle* vehicle = vehicles[i];
+        ElectricCar* electric = dynamic_cast<ElectricCar*>(vehicle);
+        LuxuryCar* luxury = electric ? NULL : dynamic_cast<LuxuryCar*>(vehicle);
+        int kind = electric ? kVehicleElectric : luxury ? kVehicleLuxury : kVehiclePlain;
+        if ((query.kind >= 0 && kind != query.kind) || (query.electricOnly() && !electric) ||
+            (query.luxuryOnly() && !luxury)) {
+            continue;
+        }
+        if (vehicle->getYear() < query.minYear || vehicle->getYear() > query.maxYear ||
+            (!query.brand.empty() && vehicle->getBrand() != query.brand)) {
+            continue;
+        }
+        double price = vehicle->calculatePrice();
+        if (price < query.minPrice || price > query.maxPrice) {
+            continue;
+        }
+        if (electric && (electric->getBatteryCapacity() < query.minBattery ||
+                         electric->getBatteryCapacity() > query.maxBattery ||
+                         electric->getRange() < query.minRange || electric->getRange() > query.maxRange)) {
+            continue;
+        }
+        if (luxury && ((query.autoPilot >= 0 && luxury->getAutoPilot() != (query.autoPilot == 1)) ||
+                       (query.massageSeats >= 0 && luxury->getMassageSeats() != (query.massageSeats == 1)))) {
+            continue;
+        }
+        if (query.order != kOrderNone) {
+            prices[i] = price;
+        }
+        rows.push_back((uint32_t)i);
+    }
+    if (query.order != kOrderNone) {
+        bool descending = query.order == kOrderPriceDescending;
+        std::sort(rows.begin(), rows.end(), [&](uint32_t a, uint32_t b) {
+            if (prices[a] != prices[b]) {
+                return descending ? prices[a] > prices[b] : prices[a] < prices[b];
+            }
+            return a < b;
+        });
+    }
+    if (query.maxResults > 0 && rows.size() > query.maxResults) {
+        rows.resize(query.maxResults);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes = parseList("1000000,10000000");
+    size_t repeats = 11;
+    size_t updates = 1000000;
+    std::string format = "json";
+    const char* usage = " [--rows 1000000,10000000] [--repeats 11] [--updates 1000000] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--rows") {
+            sizes = parseList(argv[i + 1]);
+        } else if (arg == "--repeats") {
+            repeats = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--updates") {
+            updates = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (sizes.empty() || repeats == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    NamedQuery queries[] = {
+        {"cheapest_long_range_electric",
+         VehicleQuery().whereKind(kVehicleElectric).whereRange(390, INT_MAX).orderBy(kOrderPriceAscending).limit(10)},
+        {"luxury_autopilot_under_40k",
+         VehicleQuery().whereKind(kVehicleLuxury).whereAutoPilot(true).wherePrice(0, 40000)},
+        {"priciest_recent_brand",
+         VehicleQuery().whereBrand("Brand 3").whereYear(2022, 2024).orderBy(kOrderPriceDescending).limit(20)},
+        {"cheapest_100kwh",
+         VehicleQuery().whereBatteryCapacity(100, 100).orderBy(kOrderPriceAscending).limit(50)},
+    };
+    const size_t queryCount = sizeof(queries) / sizeof(queries[0]);
+
+    std::vector<QueryResult> results;
+    bool allMatch = true;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        size_t count = sizes[s];
+        std::cerr << "Creating " << count << " vehicles..." << std::endl;
+        // Same mix as bench_vehicle_catalog: half plain, a quarter each
+        // electric and luxury, 20 brands with 10 models each
+        std::mt19937_64 random(42);
+        std::vector<Vehicle*> vehicles;
+        vehicles.reserve(count);
+        VehicleInventory inventory;
+        for (size_t i = 0; i < count; i++) {
+            unsigned brand = (unsigned)(random() % 20);
+            std::string brandName = "Brand " + std::to_string(brand);
+            std::string modelName = "Model " + std::to_string(brand * 10 + random() % 10);
+            int year = 2000 + (int)(random() % 25);
+            double price = 15000 + (double)(random() % 150000);
+            unsigned kind = (unsigned)(random() % 4);
+            if (kind == 0) {
+                vehicles.push_back(new ElectricCar(brandName, modelName, year, price, 40 + (int)(random() % 80),
+                                                   150 + (int)(random() % 250)));
+            } else if (kind == 1) {
+                vehicles.push_back(
+                    new LuxuryCar(brandName, modelName, year, price, random() % 2 == 0, random() % 2 == 0));
+            } else {
+                vehicles.push_back(new Vehicle(brandName, modelName, year, price));
+            }
+            inventory.add(*vehicles.back());
+        }
+
+        std::vector<uint32_t> expected;
+        std::vector<uint32_t> rows;
+        for (size_t q = 0; q < queryCount; q++) {
+            std::cerr << "Running " << queries[q].name << " on " << count << " rows..." << std::endl;
+            QueryResult result;
+            result.rows = count;
+            result.query = queries[q].name;
+            result.method = "virtual_scan";
+            result.plan = "scan";
+            result.p50Us = medianUs(std::min<size_t>(repeats, 3),
+                                    [&]() { virtualScan(vehicles, queries[q].query, expected); });
+            result.examined = count;
+            result.results = expected.size();
+            result.matches = true;
+            results.push_back(result);
+
+            VehicleQueryStats stats;
+            result.method = "inventory";
+            result.p50Us = medianUs(repeats, [&]() { inventory.run(queries[q].query, rows, &stats); });
+            result.plan = stats.plan;
+            result.examined = stats.examined;
+            result.results = rows.size();
+            result.matches = rows == expected;
+            allMatch = allMatch && result.matches;
+            results.push_back(result);
+        }
+        for (size_t i = 0; i < vehicles.size(); i++) {
+            delete vehicles[i];
+        }
+        vehicles.clear();
+
+        // Random changes: prices, ranges, batteries, years and options
+        std::cerr << "Applying " << updates << " updates..." << std::endl;
+        std::vector<uint32_t> targets(updates);
+        for (size_t u = 0; u < updates; u++) {
+            targets[u] = (uint32_t)(random() % count);
+        }
+        Clock::time_point start = Clock::now();
+        for (size_t u = 0; u < updates; u++) {
+            uint32_t row = targets[u];
+            switch (inventory.kind(row)) {
+            case kVehicleElectric:
+                if (u % 2 == 0) {
+                    inventory.setRange(row, 150 + (int)(u * 7919 % 250));
+                } else {
+                    inventory.setBatteryCapacity(row, 40 + (int)(u * 104729 % 80));
+                }
+                break;
+            case kVehicleLuxury:
+                inventory.setLuxuryOptions(row, u % 3 == 0, u % 2 == 0);
+                break;
+            default:
+                inventory.setYear(row, 2000 + (int)(u % 25));
+                break;
+            }
+            inventory.setBasePrice(row, 15000 + (double)(u * 2654435761ULL % 150000));
+        }
+        QueryResult update;
+        update.rows = count;
+        update.query = "updates";
+        update.method = "incremental";
+        update.plan = "";
+        update.p50Us = updates > 0 ? std::chrono::duration<double, std::micro>(Clock::now() - start).count() / updates
+                                   : 0.0;
+        update.examined = updates;
+        update.results = updates;
+        update.matches = true;
+        results.push_back(update);
+
+        for (size_t q = 0; q < queryCount; q++) {
+            VehicleQueryStats stats;
+            inventory.run(queries[q].query, expected, NULL, false);
+            QueryResult result;
+            result.rows = count;
+            result.query = queries[q].name;
+            result.method = "inventory_after_updates";
+            result.p50Us = medianUs(repeats, [&]() { inventory.run(queries[q].query, rows, &stats); });
+            result.plan = stats.plan;
+            result.examined = stats.examined;
+            result.results = rows.size();
+            result.matches = rows == expected;
+            allMatch = allMatch && result.matches;
+            results.push_back(result);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    if (format == "csv") {
+        std::cout << "rows,query,method,plan,p50_us,examined,results,matches\n";
+    } else {
+        std::cout << "{\n  \"repeats\": " << repeats << ",\n  \"updates\": " << updates
+                  << ",\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const QueryResult& r = results[i];
+        if (format == "csv") {
+            std::cout << r.rows << "," << r.query << "," << r.method << "," << r.plan << "," << r.p50Us << ","
+                      << r.examined << "," << r.results << "," << (r.matches ? "true" : "false") << "\n";
+        } else {
+            std::cout << "    {\"rows\": " << r.rows << ", \"query\": \"" << r.query << "\", \"method\": \""
+                      << r.method << "\", \"plan\": \"" << r.plan << "\", \"p50_us\": " << r.p50Us
+                      << ", \"examined\": " << r.examined << ", \"results\": " << r.results
+                      << ", \"matches\": " << (r.matches ? "true" : "false") << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << "An indexed query differs from the scan" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,613 @@
+#ifndef DURABLE_LEDGER_H
+#define DURABLE_LEDGER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "account_ledger.h"
+#include "fork_snapshot.h"
+#include "write_ahead_log.h"
+
+// AccountLedger that survives a crash.
+//
+// Every successful openAccount(), deposit(), withdraw() and transfer() is
+// appended to a WriteAheadLog and only returns once the record is on disk
+// (group commit shares the fsync between concurrent callers); if the log
+// fails, the call returns false and its change is taken back. Snapshots
+// write all balances to "snapshot.bin" together with the LSN they include,
+// after which the log segments before it are deleted. open() maps the
+// snapshot and replays only the log after it, so recovery time depends on
+// the snapshot interval, not on the age of the ledger.
+//
+//   DurableLedger ledger(1000000);
+//   LedgerRecovery recovery;
+//   if (!ledger.open("ledger_data", &recovery)) perror("open");
+//   int64_t alice = ledger.openAccount(toCents(100.00));
+//   ledger.deposit(alice, toCents(20.00));      // durable on return
+//   ledger.setSnapshotInterval(1000000);        // snapshot every 1M records
+//
+// startBackgroundSnapshot() does the same without copying the balances: it
+// fork()s a child that writes the frozen copy-on-write view of the ledger
+// while this process goes on (see fork_snapshot.h). Writers only wait for
+// the log to be committed up to the snapshot and for the fork() itself.
+//
+// Log records hold the effect of an operation that already succeeded, so
+// replay applies them without checks, and since they are sums their order
+// does not matter. Balances can be read by other threads a moment before
+// the operation is durable.
+
+enum LedgerRecordType {
+    kLedgerOpen = 1,      // args: first account, count, opening cents
+    kLedgerDeposit,       // args: account, -, cents
+    kLedgerWithdraw,      // args: account, -, cents
+    kLedgerTransfer       // args: from, to, cents
+};
+
+struct LedgerSnapshotHeader {
+    char magic[8];        // "LEDGSNP2"
+    uint64_t lsn;         // every log record up to here is included
+    uint64_t accounts;
+    uint32_t checksum;    // CRC32C of this header (checksum zero) and the balances
+    uint32_t reserved;
+};
+
+static_assert(sizeof(LedgerSnapshotHeader) == 32, "LedgerSnapshotHeader is an on-disk format");
+
+namespace ledger_snapshot {
+
+inline bool writeAll(int fd, const void* data, size_t size) {
+    const char* next = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, next, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        next += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Streams count balances, fetched in chunks by read(first, out, n), into
+// path: temporary file, fsync, rename, fsync of the directory. Uses no heap,
+// so it is safe in a child forked from a multithreaded process.
+template <typename ReadFunction>
+bool writeFile(const std::string& path, uint64_t lsn, size_t count, ReadFunction read,
+               uint64_t* bytes) {
+    char temporary[PATH_MAX];
+    char directory[PATH_MAX];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path.c_str());
+    snprintf(directory, sizeof(directory), "%s", path.c_str());
+    char* slash = strrchr(directory, '/');
+    if (slash) {
+        *(slash == directory ? slash + 1 : slash) = '\0';
+    } else {
+        snprintf(directory, sizeof(directory), ".");
+    }
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // The header goes in last, once the checksum is known
+    LedgerSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "LEDGSNP2", 8);
+    header.lsn = lsn;
+    header.accounts = count;
+    bool ok = lseek(fd, sizeof(header), SEEK_SET) == (off_t)sizeof(header);
+    uint32_t checksum = wal_checksum::crc32c(&header, sizeof(header));
+    int64_t chunk[8192];
+    for (size_t first = 0; ok && first < count;) {
+        size_t wanted = count - first < 8192 ? count - first : 8192;
+        size_t got = read(first, chunk, wanted);
+        if (got != wanted) {
+            errno = EIO;
+            ok = false;
+            break;
+        }
+        checksum = wal_checksum::crc32cExtend(checksum, chunk, got * sizeof(int64_t));
+        ok = writeAll(fd, chunk, got * sizeof(int64_t));
+        first += got;
+    }
+    if (ok) {
+        header.checksum = checksum;
+        ok = pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && fsync(fd) == 0;
+    }
+    int error = errno;
+    if (close(fd) != 0 && ok) {
+        error = errno;
+        ok = false;
+    }
+    if (!ok || rename(temporary, path.c_str()) != 0) {
+        error = ok ? errno : error;
+        unlink(temporary);
+        errno = error;
+        return false;
+    }
+    int dirFd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    if (bytes) {
+        *bytes = sizeof(header) + count * sizeof(int64_t);
+    }
+    return true;
+}
+
+} // namespace ledger_snapshot
+
+// Writes a snapshot of count balances to path atomically. Returns false
+// with errno on failure.
+inline bool writeLedgerSnapshot(const std::string& path, uint64_t lsn, const int64_t* balances,
+                                size_t count, uint64_t* bytes = NULL) {
+    return ledger_snapshot::writeFile(path, lsn, count,
+                                      [balances](size_t first, int64_t* out, size_t n) {
+                                          memcpy(out, balances + first, n * sizeof(int64_t));
+                                          return n;
+                                      }, bytes);
+}
+
+// Same, straight from a ledger nobody is changing (see readBalances())
+inline bool writeLedgerSnapshot(const std::string& path, uint64_t lsn, const AccountLedger& ledger,
+                                uint64_t* bytes = NULL) {
+    return ledger_snapshot::writeFile(path, lsn, ledger.size(),
+                                      [&ledger](size_t first, int64_t* out, size_t n) {
+                                          return ledger.readBalances(first, out, n);
+                                      }, bytes);
+}
+
+// Maps a snapshot and restores it into an empty ledger. A missing file is
+// not an error: *lsn is then 0. Returns false with errno (EINVAL for a
+// damaged file, header included).
+inline bool loadLedgerSnapshot(const std::string& path, AccountLedger& ledger, uint64_t* lsn) {
+    *lsn = 0;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(LedgerSnapshotHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = error;
+        return false;
+    }
+    const LedgerSnapshotHeader* header = static_cast<const LedgerSnapshotHeader*>(map);
+    const int64_t* balances = reinterpret_cast<const int64_t*>(header + 1);
+    // accounts is checked against the size before it is multiplied
+    bool ok = memcmp(header->magic, "LEDGSNP2", 8) == 0 &&
+              header->accounts == (size - sizeof(*header)) / sizeof(int64_t) &&
+              (size - sizeof(*header)) % sizeof(int64_t) == 0;
+    if (ok) {
+        LedgerSnapshotHeader unchecked = *header;
+        unchecked.checksum = 0;
+        uint32_t checksum = wal_checksum::crc32c(&unchecked, sizeof(unchecked));
+        checksum = wal_checksum::crc32cExtend(checksum, balances, (size_t)header->accounts * sizeof(int64_t));
+        ok = header->checksum == checksum;
+    }
+    error = EINVAL;
+    if (ok) {
+        ok = ledger.restore(balances, (size_t)header->accounts);
+        error = errno;
+        *lsn = header->lsn;
+    }
+    munmap(map, size);
+    errno = error;
+    return ok;
+}
+
+struct LedgerRecovery {
+    uint64_t snapshotLsn;
+    size_t snapshotAccounts;
+    uint64_t replayedRecords;
+    uint64_t lastLsn;
+    bool tornTail;
+    double snapshotSeconds;   // mapping and restoring the snapshot
+    double replaySeconds;     // reading the log after it
+};
+
+class DurableLedger {
+private:
+    AccountLedger ledger;
+    WriteAheadLog wal;
+    std::string directory;
+    // Operations hold it shared while they change the ledger and append
+    // their record; snapshots hold it exclusively while they copy the
+    // balances or fork, so a snapshot always matches a prefix of the log
+    pthread_rwlock_t stateLock;
+    std::mutex snapshotMutex;
+    std::atomic<uint64_t> snapshotInterval;
+    std::atomic<uint64_t> snapshotLsn;
+    std::atomic<bool> backgroundSnapshots;   // automatic snapshots fork
+    std::atomic<bool> backgroundRunning;
+    ForkSnapshot backgroundSave;             // guarded by snapshotMutex
+    uint64_t backgroundLsn;
+    bool opened;
+
+    DurableLedger(const DurableLedger&);
+    DurableLedger& operator=(const DurableLedger&);
+
+    bool applyRecord(const WalRecord& record) {
+        const int64_t* args = record.args;
+        switch (record.type) {
+        case kLedgerOpen:
+            while ((int64_t)ledger.size() < args[0] + args[1]) {
+                if (ledger.openAccount(0) < 0) {
+                    return false;
+                }
+            }
+            for (int64_t id = args[0]; id < args[0] + args[1]; id++) {
+                if (args[2] != 0 && !ledger.adjust(id, args[2])) {
+                    return false;
+                }
+            }
+            return true;
+        case kLedgerDeposit:
+            return ledger.adjust(args[0], args[2]);
+        case kLedgerWithdraw:
+            return ledger.adjust(args[0], -args[2]);
+        case kLedgerTransfer:
+            return ledger.adjust(args[0], -args[2]) && ledger.adjust(args[1], args[2]);
+        default:
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    // Takes stateLock for an update. Fails with the log's errno, before
+    // anything is applied, if the log no longer takes records.
+    bool lockForUpdate(bool exclusive) {
+        if (exclusive) {
+            pthread_rwlock_wrlock(&stateLock);
+        } else {
+            pthread_rwlock_rdlock(&stateLock);
+        }
+        if (!wal.writable()) {
+            int error = errno;
+            pthread_rwlock_unlock(&stateLock);
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
+    // Takes back an applied change whose record did not become durable, so
+    // a failed call leaves the balances as they were
+    void undo(int64_t account, int64_t delta) {
+        int error = errno;
+        ledger.adjust(account, delta);
+        errno = error;
+    }
+
+    // Appends the record of an operation that just succeeded and drops the
+    // shared lock; returns its LSN or 0
+    uint64_t logAndUnlock(uint32_t type, int64_t a, int64_t b, int64_t cents) {
+        uint64_t lsn = wal.append(type, a, b, cents);
+        int error = errno;
+        pthread_rwlock_unlock(&stateLock);
+        errno = error;
+        return lsn;
+    }
+
+    bool commit(uint64_t lsn) {
+        if (lsn == 0 || !wal.commit(lsn)) {
+            return false;
+        }
+        uint64_t interval = snapshotInterval.load(std::memory_order_relaxed);
+        uint64_t last = snapshotLsn.load(std::memory_order_relaxed);
+        bool due = interval > 0 && lsn > last && lsn - last >= interval;
+        if ((due || backgroundRunning.load(std::memory_order_relaxed)) && snapshotMutex.try_lock()) {
+            // This caller does the snapshot work; the others carry on
+            int error = errno;
+            if (backgroundSave.running()) {
+                finishBackgroundLocked(NULL, false);     // reap the child if it is done
+            } else if (due) {
+                if (backgroundSnapshots.load(std::memory_order_relaxed)) {
+                    startBackgroundLocked(NULL);
+                } else {
+                    snapshotLocked(NULL);
+                }
+            }
+            snapshotMutex.unlock();
+            errno = error;
+        }
+        return true;
+    }
+
+    bool snapshotLocked(double* pauseSeconds) {
+        if (backgroundSave.running() && !finishBackgroundLocked(NULL, true)) {
+            return false;
+        }
+        std::vector<int64_t> balances;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pthread_rwlock_wrlock(&stateLock);
+        uint64_t lsn = wal.lastSequence();
+        ledger.exportBalances(balances);
+        pthread_rwlock_unlock(&stateLock);
+        if (pauseSeconds) {
+            *pauseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // The log must reach the snapshot before older segments can go;
+        // what comes after it goes to a new segment
+        if (!wal.commit(lsn) || !wal.rotate()) {
+            return false;
+        }
+        if (!writeLedgerSnapshot(snapshotPath(), lsn, balances.empty() ? NULL : &balances[0], balances.size())) {
+            return false;
+        }
+        snapshotLsn.store(lsn, std::memory_order_relaxed);
+        return wal.dropThrough(lsn);
+    }
+
+    bool startBackgroundLocked(double* pauseSeconds) {
+        if (backgroundSave.running()) {
+            errno = EBUSY;
+            return false;
+        }
+        std::string path = snapshotPath();   // no allocation in the child
+        const AccountLedger& frozen = ledger;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pthread_rwlock_wrlock(&stateLock);
+        uint64_t lsn = wal.lastSequence();
+        // Holding the lock exclusively means no shard lock is taken at the
+        // fork, and the child's copy matches the log up to lsn. That log must
+        // be durable before the child can rename a snapshot of it into place.
+        bool ok = wal.commit(lsn) && wal.rotate() && backgroundSave.start([&frozen, &path, lsn](uint64_t* bytes) {
+            return writeLedgerSnapshot(path, lsn, frozen, bytes);
+        });
+        int error = errno;
+        pthread_rwlock_unlock(&stateLock);
+        if (pauseSeconds) {
+            *pauseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (!ok) {
+            errno = error;
+            return false;
+        }
+        backgroundLsn = lsn;
+        backgroundRunning.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool finishBackgroundLocked(ForkSnapshotStats* stats, bool wait) {
+        if (!backgroundSave.finish(stats, wait)) {
+            if (errno != EAGAIN) {
+                backgroundRunning.store(false, std::memory_order_relaxed);
+            }
+            return false;
+        }
+        backgroundRunning.store(false, std::memory_order_relaxed);
+        snapshotLsn.store(backgroundLsn, std::memory_order_relaxed);
+        return wal.dropThrough(backgroundLsn);
+    }
+
+public:
+    explicit DurableLedger(size_t capacity, size_t shards = AccountLedger::kDefaultShards)
+        : ledger(capacity, shards), snapshotInterval(0), snapshotLsn(0), backgroundSnapshots(false),
+          backgroundRunning(false), backgroundLsn(0), opened(false) {
+        pthread_rwlockattr_t attributes;
+        pthread_rwlockattr_init(&attributes);
+        // glibc prefers readers by default, which would starve snapshots
+        pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init(&stateLock, &attributes);
+        pthread_rwlockattr_destroy(&attributes);
+    }
+
+    ~DurableLedger() {
+        if (backgroundRunning.load(std::memory_order_relaxed)) {
+            finishBackgroundSnapshot(NULL, true);
+        }
+        wal.close();
+        pthread_rwlock_destroy(&stateLock);
+    }
+
+    // Recovers the ledger stored in dir (created if missing) and opens its
+    // log for appending. Returns false with errno on failure.
+    bool open(const std::string& dir, LedgerRecovery* recovery = NULL) {
+        if (opened) {
+            errno = EBUSY;
+            return false;
+        }
+        directory = dir;
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        uint64_t lsn = 0;
+        if (!loadLedgerSnapshot(snapshotPath(), ledger, &lsn)) {
+            return false;
+        }
+        size_t snapshotAccounts = ledger.size();
+        Clock::time_point loaded = Clock::now();
+        if (!wal.open(directory, lsn, [this](const WalRecord& record) { return applyRecord(record); })) {
+            return false;
+        }
+        snapshotLsn.store(lsn, std::memory_order_relaxed);
+        opened = true;
+        if (recovery) {
+            WalStats stats = wal.stats();
+            recovery->snapshotLsn = lsn;
+            recovery->snapshotAccounts = snapshotAccounts;
+            recovery->replayedRecords = stats.replayed;
+            recovery->lastLsn = wal.lastSequence();
+            recovery->tornTail = stats.tornTail;
+            recovery->snapshotSeconds = std::chrono::duration<double>(loaded - start).count();
+            recovery->replaySeconds = std::chrono::duration<double>(Clock::now() - loaded).count();
+        }
+        return true;
+    }
+
+    // Returns the id, or -1 with errno. If the log fails after the account
+    // was opened, its opening balance is taken back, but the id stays used.
+    int64_t openAccount(int64_t initialCents = 0) {
+        if (!lockForUpdate(false)) {
+            return -1;
+        }
+        int64_t id = ledger.openAccount(initialCents);
+        if (id < 0) {
+            int error = errno;
+            pthread_rwlock_unlock(&stateLock);
+            errno = error;
+            return -1;
+        }
+        if (!commit(logAndUnlock(kLedgerOpen, id, 1, initialCents))) {
+            undo(id, -initialCents);
+            return -1;
+        }
+        return id;
+    }
+
+    // Opens count accounts with consecutive ids as one log record; returns
+    // the first id, or -1 with errno
+    int64_t openAccounts(size_t count, int64_t initialCents = 0) {
+        if (count == 0 || initialCents < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        // Exclusive, so no other account gets an id inside the range
+        if (!lockForUpdate(true)) {
+            return -1;
+        }
+        if (ledger.size() + count > ledger.capacity()) {
+            pthread_rwlock_unlock(&stateLock);
+            errno = ENOSPC;
+            return -1;
+        }
+        int64_t first = (int64_t)ledger.size();
+        for (size_t i = 0; i < count; i++) {
+            ledger.openAccount(initialCents);
+        }
+        if (!commit(logAndUnlock(kLedgerOpen, first, (int64_t)count, initialCents))) {
+            for (size_t i = 0; initialCents != 0 && i < count; i++) {
+                undo(first + (int64_t)i, -initialCents);
+            }
+            return -1;
+        }
+        return first;
+    }
+
+    bool deposit(int64_t account, int64_t cents) {
+        if (!lockForUpdate(false)) {
+            return false;
+        }
+        if (!ledger.deposit(account, cents)) {
+            int error = errno;
+            pthread_rwlock_unlock(&stateLock);
+            errno = error;
+            return false;
+        }
+        if (!commit(logAndUnlock(kLedgerDeposit, account, 0, cents))) {
+            undo(account, -cents);
+            return false;
+        }
+        return true;
+    }
+
+    bool withdraw(int64_t account, int64_t cents) {
+        if (!lockForUpdate(false)) {
+            return false;
+        }
+        if (!ledger.withdraw(account, cents)) {
+            int error = errno;
+            pthread_rwlock_unlock(&stateLock);
+            errno = error;
+            return false;
+        }
+        if (!commit(logAndUnlock(kLedgerWithdraw, account, 0, cents))) {
+            undo(account, cents);
+            return false;
+        }
+        return true;
+    }
+
+    bool transfer(int64_t from, int64_t to, int64_t cents) {
+        if (!lockForUpdate(false)) {
+            return false;
+        }
+        if (!ledger.transfer(from, to, cents)) {
+            int error = errno;
+            pthread_rwlock_unlock(&stateLock);
+            errno = error;
+            return false;
+        }
+        if (!commit(logAndUnlock(kLedgerTransfer, from, to, cents))) {
+            undo(to, -cents);
+            undo(from, cents);
+            return false;
+        }
+        return true;
+    }
+
+    int64_t balance(int64_t account) const { return ledger.balance(account); }
+
+    // Writes a snapshot now and deletes the log it makes redundant.
+    // pauseSeconds receives how long operations were blocked (the copy).
+    bool snapshot(double* pauseSeconds = NULL) {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        return snapshotLocked(pauseSeconds);
+    }
+
+    // Forks a child to write a snapshot and returns at once. pauseSeconds
+    // receives how long operations were blocked (the fork). Returns false
+    // with errno, EBUSY if a background snapshot is still running.
+    bool startBackgroundSnapshot(double* pauseSeconds = NULL) {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        return startBackgroundLocked(pauseSeconds);
+    }
+
+    // Reaps the child; once it succeeded the snapshot counts and the log it
+    // covers is deleted. With wait false, returns false with errno EAGAIN
+    // while the child is still writing; EIO if the child failed.
+    bool finishBackgroundSnapshot(ForkSnapshotStats* stats = NULL, bool wait = true) {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        if (!backgroundSave.running()) {
+            errno = ECHILD;
+            return false;
+        }
+        return finishBackgroundLocked(stats, wait);
+    }
+
+    bool backgroundSnapshotRunning() const { return backgroundRunning.load(std::memory_order_relaxed); }
+
+    // Snapshot automatically after this many log records (0: never), in a
+    // forked child if background is set
+    void setSnapshotInterval(uint64_t records, bool background = false) {
+        backgroundSnapshots.store(background, std::memory_order_relaxed);
+        snapshotInterval.store(records, std::memory_order_relaxed);
+    }
+
+    uint64_t lastSnapshotLsn() const { return snapshotLsn.load(std::memory_order_relaxed); }
+
+    std::string snapshotPath() const { return directory + "/snapshot.bin"; }
+
+    AccountLedger& accounts() { return ledger; }
+    WriteAheadLog& log() { return wal; }
+};
+
+#endif // DURABLE_LEDGER_H
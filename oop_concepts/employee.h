@@ -0,0 +1,83 @@
+#ifndef EMPLOYEE_H
+#define EMPLOYEE_H
+
+#include <iostream>
+#include <string>
+
+// Employee hierarchy used by inheritance_example.cpp and the allocator
+// and payroll examples
+
+// Example 1: Employee Management System
+class Employee {
+protected:
+    std::string name;
+    int id;
+    double baseSalary;
+
+public:
+    Employee(std::string n, int i, double s) : 
+        name(n), id(i), baseSalary(s) {}
+
+    virtual ~Employee() {}
+
+    virtual double calculateSalary() {
+        return baseSalary;
+    }
+
+    virtual void displayInfo() {
+        std::cout << "Name: " << name << "\nID: " << id 
+                 << "\nBase Salary: " << baseSalary << std::endl;
+    }
+
+    const std::string& getName() const { return name; }
+    int getId() const { return id; }
+    double getBaseSalary() const { return baseSalary; }
+};
+
+class Manager : public Employee {
+private:
+    double bonus;
+    int teamSize;
+
+public:
+    Manager(std::string n, int i, double s, double b, int t) : 
+        Employee(n, i, s), bonus(b), teamSize(t) {}
+
+    double calculateSalary() override {
+        return baseSalary + bonus + (teamSize * 1000); // Extra per team member
+    }
+
+    void displayInfo() override {
+        Employee::displayInfo();
+        std::cout << "Team Size: " << teamSize 
+                 << "\nBonus: " << bonus << std::endl;
+    }
+
+    double getBonus() const { return bonus; }
+    int getTeamSize() const { return teamSize; }
+};
+
+class Developer : public Employee {
+private:
+    std::string programmingLanguage;
+    int overtimeHours;
+
+public:
+    Developer(std::string n, int i, double s, std::string lang, int ot) :
+        Employee(n, i, s), programmingLanguage(lang), overtimeHours(ot) {}
+
+    double calculateSalary() override {
+        return baseSalary + (overtimeHours * 100); // Overtime pay
+    }
+
+    void displayInfo() override {
+        Employee::displayInfo();
+        std::cout << "Programming Language: " << programmingLanguage 
+                 << "\nOvertime Hours: " << overtimeHours << std::endl;
+    }
+
+    const std::string& getProgrammingLanguage() const { return programmingLanguage; }
+    int getOvertimeHours() const { return overtimeHours; }
+};
+
+#endif // EMPLOYEE_H
@@ -0,0 +1,300 @@
+#ifndef EMPLOYEE_INGEST_H
+#define EMPLOYEE_INGEST_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "payroll_table.h"
+
+// Parallel loading of employee CSV files into a PayrollTable.
+//
+// One line per employee, in the fields of the employee.h constructors:
+//   employee,<id>,<name>,<base salary>
+//   manager,<id>,<name>,<base salary>,<bonus>,<team size>
+//   developer,<id>,<name>,<base salary>,<language>,<overtime hours>
+// Amounts have at most two decimals; names cannot contain commas. A first
+// line starting with "role," is a header and skipped.
+//
+// ingestEmployees() maps the file, cuts it into one chunk per thread at
+// line boundaries and parses the chunks in parallel, each into its own
+// PayrollTable, which are then appended in file order. The parser works on
+// the mapped bytes directly: no iostreams, no std::string per field, and
+// amounts go straight to integer cents without a double in between. Names
+// are copied once, into the table's shared name buffer.
+//
+//   PayrollTable payroll;
+//   EmployeeIngestStats stats;
+//   if (!ingestEmployees("employees.csv", payroll, 8, &stats)) {
+//       perror("ingest");                   // EINVAL: see stats.errorOffset
+//   }
+
+struct EmployeeIngestStats {
+    uint64_t bytes;
+    uint64_t rows;
+    unsigned chunks;
+    double mapSeconds;      // open + mmap
+    double parseSeconds;    // all chunks, wall time
+    double mergeSeconds;
+    uint64_t errorOffset;   // of the first bad line, if EINVAL
+};
+
+namespace employee_csv {
+
+// Field parsers; each advances p past what it consumed
+
+inline bool parseUnsigned(const char*& p, const char* end, uint64_t& value) {
+    const char* start = p;
+    value = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        value = value * 10 + (unsigned)(*p - '0');
+        p++;
+    }
+    return p > start && p - start <= 18;
+}
+
+// "12345", "12345.6" or "12345.67" as cents; false if it does not fit
+// in an int64_t
+inline bool parseCents(const char*& p, const char* end, int64_t& cents) {
+    uint64_t whole;
+    if (!parseUnsigned(p, end, whole) || whole > (uint64_t)(INT64_MAX - 99) / 100) {
+        return false;
+    }
+    uint64_t fraction = 0;
+    if (p < end && *p == '.') {
+        p++;
+        int digits = 0;
+        while (p < end && (unsigned)(*p - '0') < 10 && digits < 3) {
+            fraction = fraction * 10 + (unsigned)(*p - '0');
+            p++;
+            digits++;
+        }
+        if (digits == 0 || digits > 2) {
+            return false;
+        }
+        if (digits == 1) {
+            fraction *= 10;
+        }
+    }
+    cents = (int64_t)(whole * 100 + fraction);
+    return true;
+}
+
+// Field up to the next comma (or the end of the line)
+inline void parseText(const char*& p, const char* end, const char*& text, size_t& length) {
+    text = p;
+    while (p < end && *p != ',') {
+        p++;
+    }
+    length = (size_t)(p - text);
+}
+
+inline bool skip(const char*& p, const char* end, char separator) {
+    if (p < end && *p == separator) {
+        p++;
+        return true;
+    }
+    return false;
+}
+
+inline bool startsWith(const char* p, const char* end, const char* word, size_t length) {
+    return (size_t)(end - p) >= length && memcmp(p, word, length) == 0;
+}
+
+// One line without its newline (a trailing '\r' is allowed)
+inline bool parseLine(const char* p, const char* end, PayrollTable& table) {
+    if (end > p && end[-1] == '\r') {
+        end--;
+    }
+    PayrollRole role;
+    if (startsWith(p, end, "employee,", 9)) {
+        role = kPayrollEmployee;
+        p += 9;
+    } else if (startsWith(p, end, "manager,", 8)) {
+        role = kPayrollManager;
+        p += 8;
+    } else if (startsWith(p, end, "developer,", 10)) {
+        role = kPayrollDeveloper;
+        p += 10;
+    } else {
+        return false;
+    }
+    uint64_t id;
+    const char* name;
+    size_t nameLength;
+    int64_t base;
+    if (!parseUnsigned(p, end, id) || id > INT32_MAX || !skip(p, end, ',')) {
+        return false;
+    }
+    parseText(p, end, name, nameLength);
+    if (!skip(p, end, ',') || !parseCents(p, end, base)) {
+        return false;
+    }
+    int64_t bonus = 0;
+    uint64_t units = 0;
+    if (role == kPayrollManager) {
+        if (!skip(p, end, ',') || !parseCents(p, end, bonus) || !skip(p, end, ',') ||
+            !parseUnsigned(p, end, units)) {
+            return false;
+        }
+    } else if (role == kPayrollDeveloper) {
+        const char* language;
+        size_t languageLength;
+        if (!skip(p, end, ',')) {
+            return false;
+        }
+        parseText(p, end, language, languageLength);   // does not affect pay
+        if (!skip(p, end, ',') || !parseUnsigned(p, end, units)) {
+            return false;
+        }
+    }
+    if (p != end || units > INT32_MAX) {
+        return false;
+    }
+    table.addCents(role, (int)id, name, nameLength, base, bonus, (int32_t)units);
+    return true;
+}
+
+} // namespace employee_csv
+
+// Length of the header line at the start of a file, or 0
+inline size_t employeeCsvHeaderLength(const char* data, size_t size) {
+    if (!employee_csv::startsWith(data, data + size, "role,", 5)) {
+        return 0;
+    }
+    const char* newline = (const char*)memchr(data, '\n', size);
+    return newline ? (size_t)(newline - data) + 1 : size;
+}
+
+// Parses the lines in [begin, end), without a header, into table. Returns
+// false with errno EINVAL and the offset of the bad line (from begin) in
+// errorOffset.
+inline bool parseEmployeeCsv(const char* begin, const char* end, PayrollTable& table,
+                             uint64_t* errorOffset = NULL) {
+    const char* line = begin;
+    while (line < end) {
+        const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+        const char* lineEnd = newline ? newline : end;
+        if (lineEnd > line && !employee_csv::parseLine(line, lineEnd, table)) {
+            if (errorOffset) {
+                *errorOffset = (uint64_t)(line - begin);
+            }
+            errno = EINVAL;
+            return false;
+        }
+        line = lineEnd + 1;
+    }
+    return true;
+}
+
+// Loads path into table (appending to what it holds) with the given number
+// of threads. Returns false with errno; on EINVAL nothing is appended.
+inline bool ingestEmployees(const std::string& path, PayrollTable& table, unsigned threads,
+                            EmployeeIngestStats* stats = NULL) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    EmployeeIngestStats local = EmployeeIngestStats();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    size_t size = (size_t)info.st_size;
+    const char* data = NULL;
+    if (size > 0) {
+        // MAP_POPULATE faults the whole file in up front, in one go
+        void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        data = (const char*)mapped;
+        madvise(mapped, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    Clock::time_point mapped = Clock::now();
+
+    // Chunk t starts after the first newline at or past size * t / threads
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (size < (1 << 16)) {
+        threads = 1;   // not worth a thread
+    }
+    std::vector<size_t> bounds(threads + 1, size);
+    bounds[0] = size > 0 ? employeeCsvHeaderLength(data, size) : 0;
+    for (unsigned t = 1; t < threads; t++) {
+        size_t at = std::max(size / threads * t, bounds[0]);
+        const char* newline = (const char*)memchr(data + at, '\n', size - at);
+        bounds[t] = newline ? (size_t)(newline - data) + 1 : size;
+        if (bounds[t] < bounds[t - 1]) {
+            bounds[t] = bounds[t - 1];
+        }
+    }
+
+    std::vector<PayrollTable> parts(threads);
+    std::vector<char> ok(threads, 1);
+    std::vector<uint64_t> errorOffsets(threads, 0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            // Names are a good part of every line
+            parts[t].reserve(0, 0, 0, (bounds[t + 1] - bounds[t]) / 2);
+            ok[t] = parseEmployeeCsv(data + bounds[t], data + bounds[t + 1], parts[t], &errorOffsets[t]);
+            errorOffsets[t] += bounds[t];
+        }));
+    }
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t].join();
+    }
+    Clock::time_point parsed = Clock::now();
+    if (data) {
+        munmap((void*)data, size);
+    }
+
+    bool good = true;
+    for (unsigned t = 0; t < threads && good; t++) {
+        if (!ok[t]) {
+            good = false;
+            local.errorOffset = errorOffsets[t];
+        }
+    }
+    if (good) {
+        for (unsigned t = 0; t < threads; t++) {
+            local.rows += parts[t].size();
+            table.append(parts[t]);
+        }
+    }
+    local.bytes = size;
+    local.chunks = threads;
+    local.mapSeconds = std::chrono::duration<double>(mapped - start).count();
+    local.parseSeconds = std::chrono::duration<double>(parsed - mapped).count();
+    local.mergeSeconds = std::chrono::duration<double>(Clock::now() - parsed).count();
+    if (stats) {
+        *stats = local;
+    }
+    if (!good) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+#endif // EMPLOYEE_INGEST_H
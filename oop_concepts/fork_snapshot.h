@@ -0,0 +1,179 @@
+#ifndef FORK_SNAPSHOT_H
+#define FORK_SNAPSHOT_H
+
+#include <chrono>
+#include <functional>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Point-in-time snapshots of in-memory state, written by a fork()ed child
+// (like Redis BGSAVE).
+//
+// fork() gives the child a copy-on-write view of the whole address space as
+// it was at that instant. The child serializes that frozen view at its own
+// pace while the parent keeps changing its memory; only the pages the
+// parent writes to are actually copied, one page fault each.
+//
+//   ForkSnapshot save;
+//   lock();                                    // make the state consistent
+//   save.start([&](uint64_t* bytes) {          // runs in the child
+//       return writeEverything(path, bytes);
+//   });
+//   unlock();                                  // pause = lock() .. here
+//   ...
+//   ForkSnapshotStats stats;
+//   save.finish(&stats);                       // reap; stats.ok
+//
+// The child of a multithreaded process has only the forking thread, so the
+// write function must not take locks other threads could have held at the
+// fork, and should not allocate; build paths and buffers before start().
+// The child leaves with _exit(), running no destructors or atexit handlers.
+
+struct ForkSnapshotStats {
+    bool ok;                  // the write function returned true
+    int status;               // as from waitpid()
+    double forkSeconds;       // time the parent spent in fork()
+    double childSeconds;      // fork() until the child was reaped
+    uint64_t bytes;           // reported by the write function
+    long parentMinorFaults;   // parent page faults while the child ran (copy-on-write)
+    long childMinorFaults;
+    double childCpuSeconds;   // user + system
+};
+
+class ForkSnapshot {
+public:
+    // Runs in the child; returns success and the number of bytes written
+    typedef std::function<bool(uint64_t* bytes)> WriteFunction;
+
+private:
+    pid_t child;
+    int resultPipe;           // read end; the child sends its byte count
+    std::chrono::steady_clock::time_point started;
+    double forkSeconds;
+    long minorFaultsAtStart;
+
+    ForkSnapshot(const ForkSnapshot&);
+    ForkSnapshot& operator=(const ForkSnapshot&);
+
+    static long minorFaults() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_minflt;
+    }
+
+public:
+    ForkSnapshot() : child(-1), resultPipe(-1), forkSeconds(0.0), minorFaultsAtStart(0) {}
+
+    ~ForkSnapshot() {
+        if (child > 0) {
+            finish(NULL, true);
+        }
+    }
+
+    // Forks the child that calls write. Returns false with errno (EBUSY if
+    // a snapshot is still running).
+    bool start(const WriteFunction& write) {
+        if (child > 0) {
+            errno = EBUSY;
+            return false;
+        }
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            return false;
+        }
+        minorFaultsAtStart = minorFaults();
+        started = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid < 0) {
+            int error = errno;
+            close(fds[0]);
+            close(fds[1]);
+            errno = error;
+            return false;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            uint64_t bytes = 0;
+            bool ok = write(&bytes);
+            if (::write(fds[1], &bytes, sizeof(bytes)) != (ssize_t)sizeof(bytes)) {
+                ok = false;
+            }
+            _exit(ok ? 0 : 1);
+        }
+        forkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        close(fds[1]);
+        child = pid;
+        resultPipe = fds[0];
+        return true;
+    }
+
+    bool running() const { return child > 0; }
+
+    // Reaps the child. With wait false it returns false with errno EAGAIN
+    // while the child is still writing. Returns false with errno EIO if the
+    // snapshot failed, or with wait4()'s errno if the child could not be
+    // reaped; either way a new snapshot can then be started. stats
+    // (optional) is filled in either way.
+    bool finish(ForkSnapshotStats* stats, bool wait = true) {
+        if (child <= 0) {
+            errno = ECHILD;
+            return false;
+        }
+        int status = 0;
+        struct rusage usage;
+        pid_t reaped;
+        do {
+            reaped = wait4(child, &status, wait ? 0 : WNOHANG, &usage);
+        } while (reaped < 0 && errno == EINTR);
+        if (reaped == 0) {
+            errno = EAGAIN;
+            return false;
+        }
+        if (reaped < 0) {
+            // ECHILD: SIGCHLD is ignored or someone else reaped it. The
+            // result is lost, but the child is gone all the same.
+            int error = errno;
+            close(resultPipe);
+            resultPipe = -1;
+            child = -1;
+            if (stats) {
+                memset(stats, 0, sizeof(*stats));
+                stats->forkSeconds = forkSeconds;
+            }
+            errno = error;
+            return false;
+        }
+        uint64_t bytes = 0;
+        bool reported = read(resultPipe, &bytes, sizeof(bytes)) == (ssize_t)sizeof(bytes);
+        close(resultPipe);
+        resultPipe = -1;
+        child = -1;
+
+        bool ok = reported && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (stats) {
+            stats->ok = ok;
+            stats->status = status;
+            stats->forkSeconds = forkSeconds;
+            stats->childSeconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            stats->bytes = bytes;
+            stats->parentMinorFaults = minorFaults() - minorFaultsAtStart;
+            stats->childMinorFaults = usage.ru_minflt;
+            stats->childCpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                                     usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        }
+        if (!ok) {
+            errno = EIO;
+        }
+        return ok;
+    }
+};
+
+#endif // FORK_SNAPSHOT_H
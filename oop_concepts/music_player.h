@@ -0,0 +1,93 @@
+#ifndef MUSIC_PLAYER_H
+#define MUSIC_PLAYER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include "audio_pipeline.h"
+
+// Music player used by abstraction_example.cpp and the audio benchmarks
+class MusicPlayer {
+private:
+    std::vector<std::string> playlist;
+    int currentTrack;
+    bool isPlaying;
+    std::string output;            // where the sink writes: a file, a FIFO or /dev/null
+    AudioPipelineConfig config;    // outputRate set means resampling to the card's rate
+    AudioPipeline pipeline;        // decodes and plays on its own threads
+    uint64_t resumeFrame;
+
+    void initializeAudio() {
+        // Complex audio initialization code here
+        std::cout << "Audio system initialized\n";
+    }
+
+    MusicPlayer(const MusicPlayer&);
+    MusicPlayer& operator=(const MusicPlayer&);
+
+public:
+    explicit MusicPlayer(const std::string& outputPath = "/dev/null",
+                         const AudioPipelineConfig& pipelineConfig = AudioPipelineConfig())
+        : currentTrack(0), isPlaying(false), output(outputPath), config(pipelineConfig), resumeFrame(0) {
+        initializeAudio();
+    }
+
+    // Simple interface for users. Returns at once; the playlist plays in
+    // the background from where pause() left it, each track straight after
+    // the one before (prepared ahead unless config.prefetch is off).
+    bool play() {
+        if (playlist.empty()) {
+            return false;
+        }
+        if (!pipeline.start(playlist[currentTrack], output, config, resumeFrame)) {
+            std::cout << "Cannot play " << playlist[currentTrack] << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        for (size_t next = (size_t)currentTrack + 1; next < playlist.size(); next++) {
+            pipeline.queueTrack(playlist[next]);
+        }
+        isPlaying = true;
+        std::cout << "Now playing: " << playlist[currentTrack] << std::endl;
+        return true;
+    }
+
+    void pause() {
+        if (isPlaying) {
+            bool ended = pipeline.finished();
+            pipeline.stop();
+            currentTrack = ended ? 0 : currentTrack + (int)pipeline.track();
+            resumeFrame = ended ? 0 : pipeline.position();
+        }
+        isPlaying = false;
+        std::cout << "Music paused\n";
+    }
+
+    // Blocks until the last track has played to the end
+    bool waitForPlaylist() {
+        bool ok = pipeline.wait();
+        if (isPlaying) {
+            isPlaying = false;
+            currentTrack = 0;
+            resumeFrame = 0;
+        }
+        return ok;
+    }
+
+    // 0.0 is silent, 1.0 plays samples as they are; ramped, so it does
+    // not click
+    void setVolume(float volume) {
+        config.gain = volume;
+        pipeline.setGain(volume);
+    }
+
+    void addToPlaylist(const std::string& song) {
+        playlist.push_back(song);
+    }
+
+    // Of the current or last play()
+    AudioPipelineStats stats() const { return pipeline.stats(); }
+};
+
+#endif // MUSIC_PLAYER_H
@@ -0,0 +1,419 @@
+#ifndef OBJECT_ARENA_H
+#define OBJECT_ARENA_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define OBJECT_ARENA_PMR 1
+#endif
+#endif
+
+// Allocators for many small polymorphic objects (Shape, PaymentMethod,
+// Employee, Vehicle, ...) that replace one malloc()/free() pair per object.
+//
+// ObjectArena is a bump allocator: create<T>() places the object at the
+// next aligned address in a large chunk, and release() frees every object
+// at once by resetting the cursor. Chunks are kept for reuse, so after the
+// first round an arena makes no heap calls at all; the records of the
+// destructors release() has to run live in the chunks too.
+//
+// SizeClassPool hands out blocks from per-size free lists (16, 32, ... 256
+// bytes), so objects can also be destroyed one at a time, including through
+// a base-class pointer. Larger blocks come from malloc() and are kept on a
+// list, so releaseAll() frees them as well.
+//
+//   ObjectArena arena;
+//   std::vector<Shape*> shapes;
+//   shapes.push_back(arena.create<Circle>(5));
+//   ...
+//   arena.release();               // all shapes gone
+//
+// With C++17 both are also available as std::pmr::memory_resource
+// (ArenaResource, PoolResource) for pmr containers.
+//
+// Neither class is thread-safe; use one per thread.
+
+// Whether an arena may skip T's destructor on release(). True for trivially
+// destructible types; specialize it for classes whose destructor has no
+// effect even though it is virtual (e.g. shapes that only hold doubles), so
+// releasing them stays O(1).
+template <typename T>
+struct ArenaSkipsDestructor : std::is_trivially_destructible<T> {};
+
+class ObjectArena {
+public:
+    static const size_t kDefaultChunkSize = 256 * 1024;
+
+private:
+    // Allocated in the chunk next to its object; newest first
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+        Finalizer* next;
+    };
+
+    std::vector<char*> chunks;
+    std::vector<size_t> chunkSizes;
+    size_t currentChunk;
+    char* cursor;
+    char* limit;
+    size_t chunkSize;
+    size_t bytesUsed;
+    size_t chunkAllocations;
+    Finalizer* finalizers;
+
+    ObjectArena(const ObjectArena&);
+    ObjectArena& operator=(const ObjectArena&);
+
+    template <typename T>
+    static void destroyObject(void* object) {
+        static_cast<T*>(object)->~T();
+    }
+
+    // Moves to the next kept chunk big enough, or allocates a new one
+    bool nextChunk(size_t bytes, size_t alignment) {
+        size_t needed = bytes + alignment;
+        while (currentChunk + 1 < chunks.size()) {
+            currentChunk++;
+            if (chunkSizes[currentChunk] >= needed) {
+                cursor = chunks[currentChunk];
+                limit = cursor + chunkSizes[currentChunk];
+                return true;
+            }
+        }
+        size_t size = needed > chunkSize ? needed : chunkSize;
+        char* chunk = (char*)malloc(size);
+        if (!chunk) {
+            return false;
+        }
+        chunkAllocations++;
+        chunks.push_back(chunk);
+        chunkSizes.push_back(size);
+        currentChunk = chunks.size() - 1;
+        cursor = chunk;
+        limit = chunk + size;
+        return true;
+    }
+
+public:
+    explicit ObjectArena(size_t chunkBytes = kDefaultChunkSize)
+        : currentChunk(0), cursor(NULL), limit(NULL),
+          chunkSize(chunkBytes > 0 ? chunkBytes : kDefaultChunkSize),
+          bytesUsed(0), chunkAllocations(0), finalizers(NULL) {}
+
+    ~ObjectArena() {
+        release();
+        for (size_t i = 0; i < chunks.size(); i++) {
+            free(chunks[i]);
+        }
+    }
+
+    // Raw memory; returns NULL if a new chunk could not be allocated
+    void* allocate(size_t bytes, size_t alignment = alignof(max_align_t)) {
+        uintptr_t aligned = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (!cursor || aligned + bytes > (uintptr_t)limit) {
+            if (!nextChunk(bytes, alignment)) {
+                return NULL;
+            }
+            aligned = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        }
+        cursor = (char*)(aligned + bytes);
+        bytesUsed += bytes;
+        return (void*)aligned;
+    }
+
+    // Constructs a T in the arena; it lives until release(). Throws
+    // std::bad_alloc like new if no memory is left.
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        Finalizer* finalizer = NULL;
+        if (!ArenaSkipsDestructor<T>::value) {
+            finalizer = (Finalizer*)allocate(sizeof(Finalizer), alignof(Finalizer));
+            if (!finalizer) {
+                throw std::bad_alloc();
+            }
+        }
+        void* memory = allocate(sizeof(T), alignof(T));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if (finalizer) {
+            finalizer->destroy = &destroyObject<T>;
+            finalizer->object = object;
+            finalizer->next = finalizers;
+            finalizers = finalizer;
+        }
+        return object;
+    }
+
+    // Destroys every object created since the last release() and makes all
+    // chunks available again. Constant time apart from the destructors that
+    // ArenaSkipsDestructor does not let us skip.
+    void release() {
+        for (Finalizer* finalizer = finalizers; finalizer; finalizer = finalizer->next) {
+            finalizer->destroy(finalizer->object);
+        }
+        finalizers = NULL;
+        currentChunk = 0;
+        cursor = chunks.empty() ? NULL : chunks[0];
+        limit = chunks.empty() ? NULL : chunks[0] + chunkSizes[0];
+        bytesUsed = 0;
+    }
+
+    // Bytes handed out since the last release()
+    size_t used() const { return bytesUsed; }
+
+    // How often the arena itself called malloc()
+    size_t heapAllocations() const { return chunkAllocations; }
+};
+
+class SizeClassPool {
+public:
+    static const size_t kGranularity = 16;
+    static const size_t kClassCount = 16;          // 16 .. 256 bytes
+    static const size_t kMaxBlock = kGranularity * kClassCount;
+    static const size_t kSlabSize = 64 * 1024;
+
+private:
+    // Every block starts with this header, so deallocate() finds its class
+    // from the pointer alone; it keeps the payload 16-byte aligned
+    struct alignas(16) BlockHeader {
+        size_t sizeClass;  // kClassCount: too big, came from malloc()
+    };
+
+    // In front of the header of a block from malloc()
+    struct alignas(16) LargeBlock {
+        LargeBlock* prev;
+        LargeBlock* next;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* freeLists[kClassCount];
+    LargeBlock* largeBlocks;
+    std::vector<char*> slabs;
+    char* slabCursor;
+    char* slabLimit;
+    size_t slabAllocations;
+    size_t largeAllocations;
+
+    SizeClassPool(const SizeClassPool&);
+    SizeClassPool& operator=(const SizeClassPool&);
+
+    static size_t classOf(size_t bytes) {
+        return bytes == 0 ? 0 : (bytes - 1) / kGranularity;
+    }
+
+    // Start of the block holding object; for polymorphic types the object
+    // may be seen through a base-class pointer
+    template <typename T>
+    static void* mostDerived(T* object, std::true_type) { return dynamic_cast<void*>(object); }
+
+    template <typename T>
+    static void* mostDerived(T* object, std::false_type) { return object; }
+
+    void freeLargeBlocks() {
+        while (largeBlocks) {
+            LargeBlock* next = largeBlocks->next;
+            free(largeBlocks);
+            largeBlocks = next;
+        }
+    }
+
+    // Carves a new block of class c from the current slab
+    BlockHeader* carve(size_t c) {
+        size_t blockSize = sizeof(BlockHeader) + (c + 1) * kGranularity;
+        if (!slabCursor || slabCursor + blockSize > slabLimit) {
+            char* slab = (char*)malloc(kSlabSize);
+            if (!slab) {
+                return NULL;
+            }
+            slabAllocations++;
+            slabs.push_back(slab);
+            slabCursor = slab;
+            slabLimit = slab + kSlabSize;
+        }
+        BlockHeader* header = (BlockHeader*)slabCursor;
+        slabCursor += blockSize;
+        header->sizeClass = c;
+        return header;
+    }
+
+public:
+    SizeClassPool()
+        : largeBlocks(NULL), slabCursor(NULL), slabLimit(NULL), slabAllocations(0), largeAllocations(0) {
+        for (size_t c = 0; c < kClassCount; c++) {
+            freeLists[c] = NULL;
+        }
+    }
+
+    ~SizeClassPool() {
+        freeLargeBlocks();
+        for (size_t i = 0; i < slabs.size(); i++) {
+            free(slabs[i]);
+        }
+    }
+
+    // Returns a 16-byte aligned block, or NULL if out of memory. Blocks
+    // above kMaxBlock go straight to malloc().
+    void* allocate(size_t bytes) {
+        size_t c = classOf(bytes);
+        BlockHeader* header;
+        if (c >= kClassCount) {
+            LargeBlock* large = (LargeBlock*)malloc(sizeof(LargeBlock) + sizeof(BlockHeader) + bytes);
+            if (!large) {
+                return NULL;
+            }
+            largeAllocations++;
+            large->prev = NULL;
+            large->next = largeBlocks;
+            if (largeBlocks) {
+                largeBlocks->prev = large;
+            }
+            largeBlocks = large;
+            header = (BlockHeader*)(large + 1);
+            header->sizeClass = kClassCount;
+        } else if (freeLists[c]) {
+            FreeBlock* block = freeLists[c];
+            freeLists[c] = block->next;
+            header = (BlockHeader*)block - 1;
+        } else {
+            header = carve(c);
+            if (!header) {
+                return NULL;
+            }
+        }
+        return header + 1;
+    }
+
+    void deallocate(void* memory) {
+        if (!memory) {
+            return;
+        }
+        BlockHeader* header = (BlockHeader*)memory - 1;
+        if (header->sizeClass >= kClassCount) {
+            LargeBlock* large = (LargeBlock*)header - 1;
+            if (large->prev) {
+                large->prev->next = large->next;
+            } else {
+                largeBlocks = large->next;
+            }
+            if (large->next) {
+                large->next->prev = large->prev;
+            }
+            free(large);
+            return;
+        }
+        FreeBlock* block = (FreeBlock*)memory;
+        block->next = freeLists[header->sizeClass];
+        freeLists[header->sizeClass] = block;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(alignof(T) <= 16, "SizeClassPool blocks are 16-byte aligned");
+        void* memory = allocate(sizeof(T));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    // Destroys an object made by create(), also through a pointer to a
+    // polymorphic base class (its destructor must be virtual)
+    template <typename T>
+    void destroy(T* object) {
+        if (!object) {
+            return;
+        }
+        void* block = mostDerived(object, std::is_polymorphic<T>());
+        object->~T();
+        deallocate(block);
+    }
+
+    // Forgets every block at once; objects still alive are not destroyed
+    void releaseAll() {
+        for (size_t c = 0; c < kClassCount; c++) {
+            freeLists[c] = NULL;
+        }
+        freeLargeBlocks();
+        for (size_t i = 1; i < slabs.size(); i++) {
+            free(slabs[i]);
+        }
+        if (!slabs.empty()) {
+            slabs.resize(1);
+            slabCursor = slabs[0];
+            slabLimit = slabs[0] + kSlabSize;
+        }
+    }
+
+    // How often the pool itself called malloc()
+    size_t heapAllocations() const { return slabAllocations + largeAllocations; }
+};
+
+#ifdef OBJECT_ARENA_PMR
+
+// std::pmr view of an ObjectArena: deallocate() is a no-op, memory comes
+// back on arena.release()
+class ArenaResource : public std::pmr::memory_resource {
+private:
+    ObjectArena& arena;
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* memory = arena.allocate(bytes, alignment);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit ArenaResource(ObjectArena& target) : arena(target) {}
+};
+
+// std::pmr view of a SizeClassPool
+class PoolResource : public std::pmr::memory_resource {
+private:
+    SizeClassPool& pool;
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (alignment > 16) {
+            throw std::bad_alloc();
+        }
+        void* memory = pool.allocate(bytes);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    void do_deallocate(void* memory, size_t, size_t) override { pool.deallocate(memory); }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit PoolResource(SizeClassPool& target) : pool(target) {}
+};
+
+#endif // OBJECT_ARENA_PMR
+
+#endif // OBJECT_ARENA_H
@@ -0,0 +1,78 @@
+#ifndef PAYMENT_METHOD_H
+#define PAYMENT_METHOD_H
+
+#include <iostream>
+#include <string>
+
+// PaymentMethod hierarchy used by polymorphism_example.cpp and the
+// dispatch benchmarks
+
+// Runtime Polymorphism for Payment Methods
+class PaymentMethod {
+public:
+    virtual void process(double amount) = 0;
+    // Processing fee charged for a payment of amount
+    virtual double calculateFee(double amount) const = 0;
+    virtual ~PaymentMethod() {}
+};
+
+class CreditCardPayment : public PaymentMethod {
+private:
+    std::string cardNumber;
+
+public:
+    CreditCardPayment(std::string card) : cardNumber(card) {}
+
+    void process(double amount) override {
+        std::cout << "Processing Credit Card payment of $" << amount 
+                 << " using card ending with " 
+                 << cardNumber.substr(cardNumber.length() - 4) << std::endl;
+    }
+
+    double calculateFee(double amount) const override {
+        return amount * 0.029 + 0.30;
+    }
+
+    const std::string& getCardNumber() const { return cardNumber; }
+};
+
+class PayPalPayment : public PaymentMethod {
+private:
+    std::string email;
+
+public:
+    PayPalPayment(std::string e) : email(e) {}
+
+    void process(double amount) override {
+        std::cout << "Processing PayPal payment of $" << amount 
+                 << " using account " << email << std::endl;
+    }
+
+    double calculateFee(double amount) const override {
+        return amount * 0.0349 + 0.49;
+    }
+
+    const std::string& getEmail() const { return email; }
+};
+
+class CryptoCurrencyPayment : public PaymentMethod {
+private:
+    std::string walletAddress;
+
+public:
+    CryptoCurrencyPayment(std::string wallet) : walletAddress(wallet) {}
+
+    void process(double amount) override {
+        std::cout << "Processing Cryptocurrency payment of $" << amount 
+                 << " to wallet " << walletAddress << std::endl;
+    }
+
+    // Network fee: 1%, but at least $1
+    double calculateFee(double amount) const override {
+        return amount * 0.01 > 1.0 ? amount * 0.01 : 1.0;
+    }
+
+    const std::string& getWalletAddress() const { return walletAddress; }
+};
+
+#endif // PAYMENT_METHOD_H
@@ -0,0 +1,492 @@
+#ifndef PAYMENT_PIPELINE_H
+#define PAYMENT_PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "payment_method.h"
+
+// Batched, multithreaded payment processing (needs C++17).
+//
+// PaymentMethod::process() handles one payment at a time and
+// PaymentProcessor copies every identifier string per call. The pipeline
+// instead takes small fixed-size Payment records:
+//
+//   producers --submit()--> bounded MPMC queue --> worker threads
+//                                                  |  group by PaymentKind
+//                                                  |  price the whole batch
+//                                                  v
+//                                               sink(PaymentBatch)
+//
+// Account identifiers are interned once in an IdentifierTable, so a payment
+// carries a 32-bit id instead of a std::string. When the queue is full,
+// submit() blocks (backpressure) and trySubmit() fails; both are counted.
+// Every payment's submit-to-sink latency is recorded.
+//
+//   PaymentPipeline pipeline(4);
+//   pipeline.setSink([](const PaymentBatch& batch) { ... });
+//   pipeline.start();
+//   uint32_t account = pipeline.identifiers().intern("user@example.com");
+//   pipeline.submit(Payment::make(1, kPaymentPayPal, account, 150.0));
+//   pipeline.close();                   // drains the queue, joins the workers
+//   PipelineStats stats = pipeline.stats();
+
+enum PaymentKind {
+    kPaymentCreditCard,
+    kPaymentPayPal,
+    kPaymentCrypto,
+    kPaymentKindCount
+};
+
+inline const char* paymentKindName(PaymentKind kind) {
+    static const char* const kNames[] = {"credit_card", "paypal", "crypto"};
+    return kind < kPaymentKindCount ? kNames[kind] : "unknown";
+}
+
+inline int64_t pipelineNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Payment {
+    uint64_t id;
+    double amount;
+    uint32_t account;      // IdentifierTable id of the card, e-mail or wallet
+    PaymentKind kind;
+    int64_t submittedNs;   // set by submit()
+
+    static Payment make(uint64_t id, PaymentKind kind, uint32_t account, double amount) {
+        Payment payment = {id, amount, account, kind, 0};
+        return payment;
+    }
+};
+
+// Payments of one kind handed to the sink; fees[i] belongs to payments[i]
+struct PaymentBatch {
+    PaymentKind kind;
+    const Payment* payments;
+    const double* fees;
+    size_t count;
+};
+
+// Interns identifier strings: equal strings get the same id, and the views
+// returned by name() stay valid for the table's lifetime. Thread-safe.
+class IdentifierTable {
+private:
+    mutable std::mutex mutex;
+    std::deque<std::string> names;   // deque: elements never move
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    IdentifierTable(const IdentifierTable&);
+    IdentifierTable& operator=(const IdentifierTable&);
+
+public:
+    IdentifierTable() {}
+
+    uint32_t intern(std::string_view name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string_view, uint32_t>::const_iterator it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        names.emplace_back(name);
+        uint32_t id = (uint32_t)(names.size() - 1);
+        ids.emplace(std::string_view(names.back()), id);
+        return id;
+    }
+
+    // Empty for unknown ids
+    std::string_view name(uint32_t id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return id < names.size() ? std::string_view(names[id]) : std::string_view();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return names.size();
+    }
+};
+
+// Bounded multi-producer, multi-consumer queue. Consumers take up to a
+// whole batch per lock, so the lock is paid once per batch, not per item.
+template <typename T>
+class BoundedQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<T> slots;
+    size_t head;
+    size_t count;
+    size_t waitingConsumers;
+    size_t waitingProducers;
+    uint64_t blockedPushes;
+    bool closed;
+
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    void store(const T& item) {
+        size_t tail = head + count;
+        slots[tail < slots.size() ? tail : tail - slots.size()] = item;
+        count++;
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity)
+        : slots(capacity > 0 ? capacity : 1), head(0), count(0), waitingConsumers(0),
+          waitingProducers(0), blockedPushes(0), closed(false) {}
+
+    // Blocks while the queue is full; false once the queue is closed
+    bool push(const T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (count == slots.size() && !closed) {
+            blockedPushes++;
+            waitingProducers++;
+            notFull.wait(lock, [this]() { return count < slots.size() || closed; });
+            waitingProducers--;
+        }
+        if (closed) {
+            return false;
+        }
+        store(item);
+        if (waitingConsumers > 0) {
+            notEmpty.notify_one();
+        }
+        return true;
+    }
+
+    // False if the queue is full or closed
+    bool tryPush(const T& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || count == slots.size()) {
+            return false;
+        }
+        store(item);
+        if (waitingConsumers > 0) {
+            notEmpty.notify_one();
+        }
+        return true;
+    }
+
+    // Waits for at least one item and moves up to max into out. Returns 0
+    // only when the queue is closed and empty.
+    size_t popMany(T* out, size_t max) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (count == 0 && !closed) {
+            waitingConsumers++;
+            notEmpty.wait(lock, [this]() { return count > 0 || closed; });
+            waitingConsumers--;
+        }
+        size_t taken = count < max ? count : max;
+        for (size_t i = 0; i < taken; i++) {
+            out[i] = slots[head];
+            head = head + 1 < slots.size() ? head + 1 : 0;
+        }
+        count -= taken;
+        if (taken > 0 && waitingProducers > 0) {
+            notFull.notify_all();
+        }
+        return taken;
+    }
+
+    // Wakes everyone; pushes fail from now on, pops drain what is left
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    // How often push() had to wait for space
+    uint64_t blocked() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return blockedPushes;
+    }
+};
+
+// Submit-to-sink latencies, log-linear buckets with 4 sub-buckets per power
+// of two (at most 25% relative error)
+class PipelineLatency {
+public:
+    static const int kSubBucketBits = 2;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBuckets = 64 * kSubBuckets;
+
+private:
+    uint64_t counts[kBuckets];
+    uint64_t total;
+
+    static int bucketOf(uint64_t value) {
+        if (value < (uint64_t)kSubBuckets) {
+            return (int)value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int sub = (int)((value >> (msb - kSubBucketBits)) & (kSubBuckets - 1));
+        return (msb - kSubBucketBits + 1) * kSubBuckets + sub;
+    }
+
+    static uint64_t lowerBound(int bucket) {
+        if (bucket < kSubBuckets) {
+            return (uint64_t)bucket;
+        }
+        int msb = bucket / kSubBuckets + kSubBucketBits - 1;
+        return ((uint64_t)(kSubBuckets + bucket % kSubBuckets)) << (msb - kSubBucketBits);
+    }
+
+public:
+    PipelineLatency() : total(0) {
+        for (int i = 0; i < kBuckets; i++) {
+            counts[i] = 0;
+        }
+    }
+
+    void record(uint64_t nanoseconds) {
+        counts[bucketOf(nanoseconds)]++;
+        total++;
+    }
+
+    void merge(const PipelineLatency& other) {
+        for (int i = 0; i < kBuckets; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+    }
+
+    uint64_t count() const { return total; }
+
+    // Lower bound of the bucket holding the p-th fraction of the samples
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return lowerBound(i);
+            }
+        }
+        return lowerBound(kBuckets - 1);
+    }
+};
+
+struct PipelineStats {
+    uint64_t submitted;
+    uint64_t rejected;       // trySubmit() on a full queue
+    uint64_t blocked;        // submit() had to wait for space
+    uint64_t processed;
+    uint64_t batches;
+    double amount;
+    double fees;
+    PipelineLatency latency;
+};
+
+class PaymentPipeline {
+public:
+    typedef std::function<void(const PaymentBatch&)> BatchSink;
+
+    static const size_t kDefaultCapacity = 65536;
+    static const size_t kDefaultBatchSize = 256;
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;          // guards latency, read by stats()
+        PipelineLatency latency;
+    };
+
+    BoundedQueue<Payment> queue;
+    size_t batchSize;
+    unsigned workerCount;
+    BatchSink sink;
+    std::unique_ptr<PaymentMethod> pricing[kPaymentKindCount];
+    std::vector<std::unique_ptr<Worker> > workers;
+    IdentifierTable identifierTable;
+    std::atomic<uint64_t> submitted;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> batches;
+    std::mutex totalsMutex;
+    double amountTotal;
+    double feeTotal;
+    bool started;
+
+    PaymentPipeline(const PaymentPipeline&);
+    PaymentPipeline& operator=(const PaymentPipeline&);
+
+    void workerLoop(Worker& worker) {
+        std::vector<Payment> input(batchSize);
+        std::vector<Payment> byKind[kPaymentKindCount];
+        std::vector<double> fees;
+        for (int k = 0; k < kPaymentKindCount; k++) {
+            byKind[k].reserve(batchSize);
+        }
+        fees.reserve(batchSize);
+
+        size_t taken;
+        while ((taken = queue.popMany(&input[0], batchSize)) > 0) {
+            for (size_t i = 0; i < taken; i++) {
+                byKind[input[i].kind].push_back(input[i]);   // checked by submit()
+            }
+
+            double amount = 0.0, fee = 0.0;
+            uint64_t batchCount = 0;
+            for (int k = 0; k < kPaymentKindCount; k++) {
+                std::vector<Payment>& group = byKind[k];
+                if (group.empty()) {
+                    continue;
+                }
+                // Same method for the whole group, so this virtual call
+                // always goes to the same place and predicts perfectly
+                const PaymentMethod& method = *pricing[k];
+                fees.resize(group.size());
+                for (size_t i = 0; i < group.size(); i++) {
+                    fees[i] = method.calculateFee(group[i].amount);
+                    amount += group[i].amount;
+                    fee += fees[i];
+                }
+                if (sink) {
+                    PaymentBatch batch = {(PaymentKind)k, &group[0], &fees[0], group.size()};
+                    sink(batch);
+                }
+                batchCount++;
+            }
+
+            int64_t now = pipelineNowNs();
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                for (int k = 0; k < kPaymentKindCount; k++) {
+                    for (size_t i = 0; i < byKind[k].size(); i++) {
+                        int64_t waited = now - byKind[k][i].submittedNs;
+                        worker.latency.record(waited > 0 ? (uint64_t)waited : 0);
+                    }
+                    byKind[k].clear();
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(totalsMutex);
+                amountTotal += amount;
+                feeTotal += fee;
+            }
+            batches.fetch_add(batchCount, std::memory_order_relaxed);
+            processed.fetch_add(taken, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    explicit PaymentPipeline(unsigned threads, size_t capacity = kDefaultCapacity,
+                             size_t maxBatch = kDefaultBatchSize)
+        : queue(capacity), batchSize(maxBatch > 0 ? maxBatch : 1),
+          workerCount(threads > 0 ? threads : 1), submitted(0), rejected(0), processed(0),
+          batches(0), amountTotal(0.0), feeTotal(0.0), started(false) {
+        // Fees only depend on the method type, so one instance prices them all
+        pricing[kPaymentCreditCard].reset(new CreditCardPayment(""));
+        pricing[kPaymentPayPal].reset(new PayPalPayment(""));
+        pricing[kPaymentCrypto].reset(new CryptoCurrencyPayment(""));
+    }
+
+    ~PaymentPipeline() { close(); }
+
+    // Called from the worker threads, possibly concurrently; set before start()
+    void setSink(const BatchSink& batchSink) { sink = batchSink; }
+
+    IdentifierTable& identifiers() { return identifierTable; }
+
+    void start() {
+        if (started) {
+            return;
+        }
+        started = true;
+        for (unsigned i = 0; i < workerCount; i++) {
+            workers.push_back(std::unique_ptr<Worker>(new Worker()));
+            Worker* worker = workers.back().get();
+            worker->thread = std::thread([this, worker]() { workerLoop(*worker); });
+        }
+    }
+
+    // Blocks while the queue is full; false after close(), or with errno
+    // EINVAL for a kind that is not a PaymentKind
+    bool submit(Payment payment) {
+        if ((unsigned)payment.kind >= kPaymentKindCount) {
+            errno = EINVAL;
+            return false;
+        }
+        payment.submittedNs = pipelineNowNs();
+        if (!queue.push(payment)) {
+            return false;
+        }
+        submitted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Never blocks; false if the queue is full or closed, or with errno
+    // EINVAL for a kind that is not a PaymentKind
+    bool trySubmit(Payment payment) {
+        if ((unsigned)payment.kind >= kPaymentKindCount) {
+            errno = EINVAL;
+            return false;
+        }
+        payment.submittedNs = pipelineNowNs();
+        if (!queue.tryPush(payment)) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        submitted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Stops accepting payments, processes what is queued and joins the
+    // workers. Safe to call more than once.
+    void close() {
+        queue.close();
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i]->thread.joinable()) {
+                workers[i]->thread.join();
+            }
+        }
+    }
+
+    size_t queued() { return queue.size(); }
+
+    PipelineStats stats() {
+        PipelineStats result;
+        result.submitted = submitted.load(std::memory_order_relaxed);
+        result.rejected = rejected.load(std::memory_order_relaxed);
+        result.blocked = queue.blocked();
+        result.processed = processed.load(std::memory_order_relaxed);
+        result.batches = batches.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(totalsMutex);
+            result.amount = amountTotal;
+            result.fees = feeTotal;
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            std::lock_guard<std::mutex> lock(workers[i]->mutex);
+            result.latency.merge(workers[i]->latency);
+        }
+        return result;
+    }
+};
+
+#endif // PAYMENT_PIPELINE_H
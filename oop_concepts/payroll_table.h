@@ -0,0 +1,550 @@
+#ifndef PAYROLL_TABLE_H
+#define PAYROLL_TABLE_H
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "employee.h"
+#include "simd_level.h"
+
+// Columnar payroll for many Employee/Manager/Developer records.
+//
+// A std::vector<Employee*> costs a pointer chase and a virtual
+// calculateSalary() call per employee, and each object drags its name
+// string and, for managers and developers, extra fields into the cache.
+// PayrollTable keeps every role in its own columns instead: ids, base
+// salaries, bonuses (managers), team sizes or overtime hours, with all
+// names in one shared buffer that only top-k results ever touch.
+//
+// Money is kept in integer cents. Every salary formula is then
+//   base + bonus + units * rate
+// (rate 0 for employees, 1000.00 per team member, 100.00 per overtime hour)
+// and integer sums do not depend on the order of addition, so the SIMD
+// and multithreaded results match the virtual path to the cent:
+// sum(payrollCents(e->calculateSalary())) for amounts given in whole cents.
+//
+//   PayrollTable payroll;
+//   payroll.addManager(1, "John Doe", 100000, 20000, 5);
+//   payroll.addDeveloper(2, "Jane Smith", 80000, 20);
+//   int64_t total = payroll.totalCents();              // column sums
+//   PayrollSummary roles[kPayrollRoles];
+//   payroll.summarize(roles, 8);                       // per role, 8 threads
+//   std::vector<PayrollEntry> top;
+//   payroll.topK(10, top, 8);                          // highest salaries
+
+enum PayrollRole {
+    kPayrollEmployee,
+    kPayrollManager,
+    kPayrollDeveloper,
+    kPayrollRoles,
+};
+
+inline const char* payrollRoleName(PayrollRole role) {
+    switch (role) {
+    case kPayrollEmployee: return "employee";
+    case kPayrollManager: return "manager";
+    case kPayrollDeveloper: return "developer";
+    default: return "unknown";
+    }
+}
+
+inline int64_t payrollCents(double amount) { return (int64_t)llround(amount * 100.0); }
+
+// Aggregate over one role; minCents and maxCents mean nothing while count is 0
+struct PayrollSummary {
+    size_t count;
+    int64_t totalCents;
+    int64_t minCents;
+    int64_t maxCents;
+
+    PayrollSummary() : count(0), totalCents(0), minCents(INT64_MAX), maxCents(INT64_MIN) {}
+
+    void merge(const PayrollSummary& other) {
+        count += other.count;
+        totalCents += other.totalCents;
+        minCents = std::min(minCents, other.minCents);
+        maxCents = std::max(maxCents, other.maxCents);
+    }
+};
+
+struct PayrollEntry {
+    int id;
+    PayrollRole role;
+    size_t row;            // within the role's columns
+    int64_t salaryCents;
+};
+
+// Highest salary first; equal salaries by lower id, so top-k is deterministic
+inline bool payrollRanksBefore(const PayrollEntry& a, const PayrollEntry& b) {
+    if (a.salaryCents != b.salaryCents) {
+        return a.salaryCents > b.salaryCents;
+    }
+    return a.id < b.id;
+}
+
+namespace payroll_kernels {
+
+// Salary of row i is base[i] + bonus[i] + units[i] * rate; bonus and units
+// are NULL for roles without that column. There are scalar and AVX2
+// kernels: 64-bit integer lanes need AVX2, so kSimdSse2 runs the scalar ones.
+
+inline int64_t salaryAt(const int64_t* base, const int64_t* bonus, const int32_t* units, int64_t rate,
+                        size_t i) {
+    int64_t salary = base[i];
+    if (bonus) {
+        salary += bonus[i];
+    }
+    if (units) {
+        salary += units[i] * rate;
+    }
+    return salary;
+}
+
+inline void summarizeScalar(const int64_t* base, const int64_t* bonus, const int32_t* units,
+                            int64_t rate, size_t n, PayrollSummary& summary) {
+    int64_t total = 0;
+    int64_t low = summary.minCents;
+    int64_t high = summary.maxCents;
+    for (size_t i = 0; i < n; i++) {
+        int64_t salary = salaryAt(base, bonus, units, rate, i);
+        total += salary;
+        low = salary < low ? salary : low;
+        high = salary > high ? salary : high;
+    }
+    summary.count += n;
+    summary.totalCents += total;
+    summary.minCents = low;
+    summary.maxCents = high;
+}
+
+inline void salariesScalar(const int64_t* base, const int64_t* bonus, const int32_t* units,
+                           int64_t rate, size_t n, int64_t* out) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = salaryAt(base, bonus, units, rate, i);
+    }
+}
+
+inline int64_t sumScalar(const int64_t* values, size_t n) {
+    int64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += values[i];
+        s1 += values[i + 1];
+        s2 += values[i + 2];
+        s3 += values[i + 3];
+    }
+    for (; i < n; i++) {
+        s0 += values[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+inline int64_t sumScalar(const int32_t* values, size_t n) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+#ifdef SIMD_LEVEL_X86
+
+__attribute__((target("avx2")))
+inline __m256i salaryLanesAvx2(const int64_t* base, const int64_t* bonus, const int32_t* units,
+                               __m256i rate, size_t i) {
+    __m256i salary = _mm256_loadu_si256((const __m256i*)(base + i));
+    if (bonus) {
+        salary = _mm256_add_epi64(salary, _mm256_loadu_si256((const __m256i*)(bonus + i)));
+    }
+    if (units) {
+        // Sign-extend 4 counts to 64 bits; mul_epi32 multiplies the low halves
+        __m256i count = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(units + i)));
+        salary = _mm256_add_epi64(salary, _mm256_mul_epi32(count, rate));
+    }
+    return salary;
+}
+
+__attribute__((target("avx2")))
+inline int64_t horizontalSumAvx2(__m256i lanes) {
+    int64_t values[4];
+    _mm256_storeu_si256((__m256i*)values, lanes);
+    return (values[0] + values[1]) + (values[2] + values[3]);
+}
+
+__attribute__((target("avx2")))
+inline void summarizeAvx2(const int64_t* base, const int64_t* bonus, const int32_t* units,
+                          int64_t rate, size_t n, PayrollSummary& summary) {
+    __m256i factor = _mm256_set1_epi64x(rate);
+    __m256i total = _mm256_setzero_si256();
+    __m256i low = _mm256_set1_epi64x(summary.minCents);
+    __m256i high = _mm256_set1_epi64x(summary.maxCents);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i salary = salaryLanesAvx2(base, bonus, units, factor, i);
+        total = _mm256_add_epi64(total, salary);
+        // There is no 64-bit min/max before AVX-512: compare and blend
+        low = _mm256_blendv_epi8(low, salary, _mm256_cmpgt_epi64(low, salary));
+        high = _mm256_blendv_epi8(high, salary, _mm256_cmpgt_epi64(salary, high));
+    }
+    int64_t lows[4];
+    int64_t highs[4];
+    _mm256_storeu_si256((__m256i*)lows, low);
+    _mm256_storeu_si256((__m256i*)highs, high);
+    summary.count += i;
+    summary.totalCents += horizontalSumAvx2(total);
+    for (int lane = 0; lane < 4; lane++) {
+        summary.minCents = std::min(summary.minCents, lows[lane]);
+        summary.maxCents = std::max(summary.maxCents, highs[lane]);
+    }
+    summarizeScalar(base + i, bonus ? bonus + i : NULL, units ? units + i : NULL, rate, n - i, summary);
+}
+
+__attribute__((target("avx2")))
+inline void salariesAvx2(const int64_t* base, const int64_t* bonus, const int32_t* units,
+                         int64_t rate, size_t n, int64_t* out) {
+    __m256i factor = _mm256_set1_epi64x(rate);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_si256((__m256i*)(out + i), salaryLanesAvx2(base, bonus, units, factor, i));
+    }
+    for (; i < n; i++) {
+        out[i] = salaryAt(base, bonus, units, rate, i);
+    }
+}
+
+__attribute__((target("avx2")))
+inline int64_t sumAvx2(const int64_t* values, size_t n) {
+    __m256i s0 = _mm256_setzero_si256();
+    __m256i s1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_epi64(s0, _mm256_loadu_si256((const __m256i*)(values + i)));
+        s1 = _mm256_add_epi64(s1, _mm256_loadu_si256((const __m256i*)(values + i + 4)));
+    }
+    return horizontalSumAvx2(_mm256_add_epi64(s0, s1)) + sumScalar(values + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline int64_t sumAvx2(const int32_t* values, size_t n) {
+    __m256i s0 = _mm256_setzero_si256();
+    __m256i s1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_epi64(s0, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(values + i))));
+        s1 = _mm256_add_epi64(s1,
+                              _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(values + i + 4))));
+    }
+    return horizontalSumAvx2(_mm256_add_epi64(s0, s1)) + sumScalar(values + i, n - i);
+}
+
+#endif // SIMD_LEVEL_X86
+
+inline void summarize(SimdLevel level, const int64_t* base, const int64_t* bonus, const int32_t* units,
+                      int64_t rate, size_t n, PayrollSummary& summary) {
+#ifdef SIMD_LEVEL_X86
+    if (level == kSimdAvx2) {
+        summarizeAvx2(base, bonus, units, rate, n, summary);
+        return;
+    }
+#endif
+    (void)level;
+    summarizeScalar(base, bonus, units, rate, n, summary);
+}
+
+inline void salaries(SimdLevel level, const int64_t* base, const int64_t* bonus, const int32_t* units,
+                     int64_t rate, size_t n, int64_t* out) {
+#ifdef SIMD_LEVEL_X86
+    if (level == kSimdAvx2) {
+        salariesAvx2(base, bonus, units, rate, n, out);
+        return;
+    }
+#endif
+    (void)level;
+    salariesScalar(base, bonus, units, rate, n, out);
+}
+
+template <typename Value>
+inline int64_t sum(SimdLevel level, const Value* values, size_t n) {
+#ifdef SIMD_LEVEL_X86
+    if (level == kSimdAvx2) {
+        return sumAvx2(values, n);
+    }
+#endif
+    (void)level;
+    return sumScalar(values, n);
+}
+
+} // namespace payroll_kernels
+
+class PayrollTable {
+private:
+    // One group of columns per role; bonusCents is filled for managers
+    // only, units (team size or overtime hours) for managers and developers
+    struct Columns {
+        std::vector<int32_t> ids;
+        std::vector<int64_t> baseCents;
+        std::vector<int64_t> bonusCents;
+        std::vector<int32_t> units;
+        std::vector<uint64_t> nameStart;     // into names
+        std::vector<uint32_t> nameLength;
+        int64_t unitRate;                    // cents per unit
+
+        const int64_t* bonus() const { return bonusCents.empty() ? NULL : &bonusCents[0]; }
+        const int32_t* unitColumn() const { return units.empty() ? NULL : &units[0]; }
+    };
+
+    Columns roles[kPayrollRoles];
+    std::string names;
+    SimdLevel simdLevel;
+
+    static const size_t kChunk = 4096;   // salaries computed at a time for top-k
+
+    // Runs work(t) on threads threads (or inline for one) and joins them
+    template <typename Function>
+    static void runShares(unsigned threads, Function work) {
+        if (threads <= 1) {
+            work(0u);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.push_back(std::thread(work, t));
+        }
+        for (unsigned t = 0; t < threads; t++) {
+            workers[t].join();
+        }
+    }
+
+    void summarizeRange(PayrollRole role, size_t first, size_t last, PayrollSummary& summary) const {
+        if (last <= first) {
+            return;
+        }
+        const Columns& columns = roles[role];
+        const int64_t* bonus = columns.bonus();
+        const int32_t* units = columns.unitColumn();
+        payroll_kernels::summarize(simdLevel, &columns.baseCents[first], bonus ? bonus + first : NULL,
+                                   units ? units + first : NULL, columns.unitRate, last - first,
+                                   summary);
+    }
+
+    // Keeps the k best of rows [first, last) of role in heap, a heap whose
+    // top is the worst entry kept
+    void topKRange(PayrollRole role, size_t first, size_t last, size_t k,
+                   std::vector<PayrollEntry>& heap) const {
+        const Columns& columns = roles[role];
+        const int64_t* bonus = columns.bonus();
+        const int32_t* units = columns.unitColumn();
+        int64_t salaries[kChunk];
+        for (size_t start = first; start < last; start += kChunk) {
+            size_t n = last - start < kChunk ? last - start : kChunk;
+            payroll_kernels::salaries(simdLevel, &columns.baseCents[start], bonus ? bonus + start : NULL,
+                                      units ? units + start : NULL, columns.unitRate, n, salaries);
+            for (size_t i = 0; i < n; i++) {
+                if (heap.size() == k && salaries[i] < heap.front().salaryCents) {
+                    continue;   // the common case: not even close
+                }
+                PayrollEntry entry;
+                entry.id = columns.ids[start + i];
+                entry.role = role;
+                entry.row = start + i;
+                entry.salaryCents = salaries[i];
+                if (heap.size() < k) {
+                    heap.push_back(entry);
+                    std::push_heap(heap.begin(), heap.end(), payrollRanksBefore);
+                } else if (payrollRanksBefore(entry, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), payrollRanksBefore);
+                    heap.back() = entry;
+                    std::push_heap(heap.begin(), heap.end(), payrollRanksBefore);
+                }
+            }
+        }
+    }
+
+public:
+    PayrollTable() : simdLevel(detectSimdLevel()) {
+        roles[kPayrollEmployee].unitRate = 0;
+        roles[kPayrollManager].unitRate = payrollCents(1000);     // per team member
+        roles[kPayrollDeveloper].unitRate = payrollCents(100);    // per overtime hour
+    }
+
+    void reserve(size_t employees, size_t managers, size_t developers, size_t nameBytes = 0) {
+        size_t counts[kPayrollRoles] = {employees, managers, developers};
+        for (int role = 0; role < kPayrollRoles; role++) {
+            roles[role].ids.reserve(counts[role]);
+            roles[role].baseCents.reserve(counts[role]);
+            roles[role].nameStart.reserve(counts[role]);
+            roles[role].nameLength.reserve(counts[role]);
+        }
+        roles[kPayrollManager].bonusCents.reserve(managers);
+        roles[kPayrollManager].units.reserve(managers);
+        roles[kPayrollDeveloper].units.reserve(developers);
+        names.reserve(nameBytes);
+    }
+
+    // Adds a row with amounts already in cents, for parsers; the name need
+    // not be terminated. bonusCents only counts for managers, units (team
+    // size or overtime hours) for managers and developers.
+    void addCents(PayrollRole role, int id, const char* name, size_t nameLength, int64_t baseCents,
+                  int64_t bonusCents = 0, int32_t units = 0) {
+        Columns& columns = roles[role];
+        columns.ids.push_back(id);
+        columns.baseCents.push_back(baseCents);
+        if (role == kPayrollManager) {
+            columns.bonusCents.push_back(bonusCents);
+        }
+        if (role != kPayrollEmployee) {
+            columns.units.push_back(units);
+        }
+        columns.nameStart.push_back(names.size());
+        columns.nameLength.push_back((uint32_t)nameLength);
+        names.append(name, nameLength);
+    }
+
+    void addEmployee(int id, const std::string& name, double baseSalary) {
+        addCents(kPayrollEmployee, id, name.data(), name.size(), payrollCents(baseSalary));
+    }
+
+    void addManager(int id, const std::string& name, double baseSalary, double bonus, int teamSize) {
+        addCents(kPayrollManager, id, name.data(), name.size(), payrollCents(baseSalary),
+                 payrollCents(bonus), teamSize);
+    }
+
+    // The programming language does not affect pay and is not stored
+    void addDeveloper(int id, const std::string& name, double baseSalary, int overtimeHours) {
+        addCents(kPayrollDeveloper, id, name.data(), name.size(), payrollCents(baseSalary), 0,
+                 overtimeHours);
+    }
+
+    // Appends all rows of other, role by role, e.g. to merge tables that
+    // were filled by different threads
+    void append(const PayrollTable& other) {
+        uint64_t shift = names.size();
+        names += other.names;
+        for (int role = 0; role < kPayrollRoles; role++) {
+            Columns& columns = roles[role];
+            const Columns& more = other.roles[role];
+            columns.ids.insert(columns.ids.end(), more.ids.begin(), more.ids.end());
+            columns.baseCents.insert(columns.baseCents.end(), more.baseCents.begin(), more.baseCents.end());
+            columns.bonusCents.insert(columns.bonusCents.end(), more.bonusCents.begin(),
+                                      more.bonusCents.end());
+            columns.units.insert(columns.units.end(), more.units.begin(), more.units.end());
+            columns.nameLength.insert(columns.nameLength.end(), more.nameLength.begin(),
+                                      more.nameLength.end());
+            size_t first = columns.nameStart.size();
+            columns.nameStart.insert(columns.nameStart.end(), more.nameStart.begin(), more.nameStart.end());
+            for (size_t i = first; i < columns.nameStart.size(); i++) {
+                columns.nameStart[i] += shift;
+            }
+        }
+    }
+
+    // Copies an object of the employee.h hierarchy into its role's columns
+    void add(const Employee& employee) {
+        if (const Manager* manager = dynamic_cast<const Manager*>(&employee)) {
+            addManager(manager->getId(), manager->getName(), manager->getBaseSalary(),
+                       manager->getBonus(), manager->getTeamSize());
+        } else if (const Developer* developer = dynamic_cast<const Developer*>(&employee)) {
+            addDeveloper(developer->getId(), developer->getName(), developer->getBaseSalary(),
+                         developer->getOvertimeHours());
+        } else {
+            addEmployee(employee.getId(), employee.getName(), employee.getBaseSalary());
+        }
+    }
+
+    size_t count(PayrollRole role) const { return roles[role].ids.size(); }
+    size_t size() const { return count(kPayrollEmployee) + count(kPayrollManager) + count(kPayrollDeveloper); }
+
+    // Kernels default to the widest the CPU supports; a lower level can be
+    // forced for comparisons (a higher one than detected is ignored)
+    SimdLevel simd() const { return simdLevel; }
+
+    void setSimd(SimdLevel level) {
+        SimdLevel supported = detectSimdLevel();
+        simdLevel = level < supported ? level : supported;
+    }
+
+    int64_t salaryCents(PayrollRole role, size_t row) const {
+        const Columns& columns = roles[role];
+        return payroll_kernels::salaryAt(&columns.baseCents[0], columns.bonus(), columns.unitColumn(),
+                                         columns.unitRate, row);
+    }
+
+    std::string name(PayrollRole role, size_t row) const {
+        return names.substr(roles[role].nameStart[row], roles[role].nameLength[row]);
+    }
+
+    // Sum of all salaries from column sums: base + bonus + rate * units
+    // never needs a salary per row
+    int64_t totalCents() const {
+        int64_t total = 0;
+        for (int role = 0; role < kPayrollRoles; role++) {
+            const Columns& columns = roles[role];
+            if (columns.ids.empty()) {
+                continue;
+            }
+            total += payroll_kernels::sum(simdLevel, &columns.baseCents[0], columns.baseCents.size());
+            if (!columns.bonusCents.empty()) {
+                total += payroll_kernels::sum(simdLevel, &columns.bonusCents[0], columns.bonusCents.size());
+            }
+            if (!columns.units.empty()) {
+                total += columns.unitRate *
+                         payroll_kernels::sum(simdLevel, &columns.units[0], columns.units.size());
+            }
+        }
+        return total;
+    }
+
+    // Count, total, lowest and highest salary of every role. Each thread
+    // takes an equal share of every role; shares are merged in thread order.
+    void summarize(PayrollSummary out[kPayrollRoles], unsigned threads = 1) const {
+        if (threads == 0 || size() < 2 * threads) {
+            threads = 1;
+        }
+        std::vector<PayrollSummary> partial(threads * kPayrollRoles);
+        runShares(threads, [this, threads, &partial](unsigned t) {
+            for (int role = 0; role < kPayrollRoles; role++) {
+                size_t rows = count((PayrollRole)role);
+                summarizeRange((PayrollRole)role, rows * t / threads, rows * (t + 1) / threads,
+                               partial[t * kPayrollRoles + role]);
+            }
+        });
+        for (int role = 0; role < kPayrollRoles; role++) {
+            out[role] = PayrollSummary();
+            for (unsigned t = 0; t < threads; t++) {
+                out[role].merge(partial[t * kPayrollRoles + role]);
+            }
+        }
+    }
+
+    // The k highest salaries, best first (ties by lower id)
+    void topK(size_t k, std::vector<PayrollEntry>& out, unsigned threads = 1) const {
+        out.clear();
+        if (k == 0) {
+            return;
+        }
+        if (threads == 0 || size() < 2 * threads) {
+            threads = 1;
+        }
+        std::vector<std::vector<PayrollEntry> > heaps(threads);
+        runShares(threads, [this, threads, k, &heaps](unsigned t) {
+            heaps[t].reserve(k);
+            for (int role = 0; role < kPayrollRoles; role++) {
+                size_t rows = count((PayrollRole)role);
+                topKRange((PayrollRole)role, rows * t / threads, rows * (t + 1) / threads, k, heaps[t]);
+            }
+        });
+        for (unsigned t = 0; t < threads; t++) {
+            out.insert(out.end(), heaps[t].begin(), heaps[t].end());
+        }
+        std::sort(out.begin(), out.end(), payrollRanksBefore);
+        if (out.size() > k) {
+            out.resize(k);
+        }
+    }
+};
+
+#endif // PAYROLL_TABLE_H
@@ -0,0 +1,483 @@
+#ifndef PCM_DSP_H
+#define PCM_DSP_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include "simd_level.h"
+
+// Signal processing for the audio path (audio_pipeline.h):
+//   - int16 <-> float conversion (float samples are in [-1, 1))
+//   - gain with a linear ramp from one value to another, so volume changes
+//     do not click
+//   - mixing N int16 streams, summed in 32 bits and saturated once
+//   - PolyphaseResampler, e.g. 44.1 kHz <-> 48 kHz
+// Every kernel has a scalar version and SSE4.1 and AVX2 versions, chosen
+// at runtime with detectSimdLevel(). Float results may differ from the
+// scalar ones in the last bit (different summation order); the integer
+// ones are identical.
+
+namespace dsp_kernels {
+
+inline void int16ToFloatScalar(const int16_t* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = in[i] * (1.0f / 32768);
+    }
+}
+
+// Rounds to nearest even (the default mode, as cvtps2dq does) and saturates
+inline void floatToInt16Scalar(const float* in, int16_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float value = std::min(std::max(in[i] * 32768.0f, -32768.0f), 32767.0f);
+        out[i] = (int16_t)lrintf(value);
+    }
+}
+
+// Frame f of frames is scaled by start + (end - start) / frames * f
+inline void gainRampScalar(float* samples, size_t frames, unsigned channels, float start, float end,
+                           size_t from = 0) {
+    float step = frames > 0 ? (end - start) / frames : 0.0f;
+    for (size_t f = from; f < frames; f++) {
+        float gain = start + step * (float)f;
+        for (unsigned c = 0; c < channels; c++) {
+            samples[f * channels + c] *= gain;
+        }
+    }
+}
+
+inline void mixScalar(const int16_t* const* inputs, size_t streams, int16_t* out, size_t n, size_t from = 0) {
+    for (size_t i = from; i < n; i++) {
+        int32_t sum = 0;
+        for (size_t s = 0; s < streams; s++) {
+            sum += inputs[s][i];
+        }
+        out[i] = (int16_t)std::min(std::max(sum, (int32_t)-32768), (int32_t)32767);
+    }
+}
+
+inline float dotScalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#ifdef SIMD_LEVEL_X86
+
+__attribute__((target("sse4.1")))
+inline void int16ToFloatSse41(const int16_t* in, float* out, size_t n) {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i wide = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(wide), scale));
+    }
+    int16ToFloatScalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+inline void floatToInt16Sse41(const float* in, int16_t* out, size_t n) {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 low = _mm_set1_ps(-32768.0f);
+    const __m128 high = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), low), high);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), low), high);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    floatToInt16Scalar(in + i, out + i, n - i);
+}
+
+// Channel counts that divide the vector width; others run scalar
+__attribute__((target("sse4.1")))
+inline void gainRampSse41(float* samples, size_t frames, unsigned channels, float start, float end) {
+    if (channels == 0 || 4 % channels != 0) {
+        gainRampScalar(samples, frames, channels, start, end);
+        return;
+    }
+    float step = frames > 0 ? (end - start) / frames : 0.0f;
+    const __m128 startLanes = _mm_set1_ps(start);
+    const __m128 stepLanes = _mm_set1_ps(step);
+    // Frame of each lane relative to the first frame of the vector
+    __m128i frame = channels == 1 ? _mm_setr_epi32(0, 1, 2, 3)
+                  : channels == 2 ? _mm_setr_epi32(0, 0, 1, 1)
+                  : _mm_setzero_si128();
+    const __m128i advance = _mm_set1_epi32((int)(4 / channels));
+    size_t f = 0;
+    for (; f + 4 / channels <= frames; f += 4 / channels) {
+        __m128 gain = _mm_add_ps(startLanes, _mm_mul_ps(stepLanes, _mm_cvtepi32_ps(frame)));
+        float* p = samples + f * channels;
+        _mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), gain));
+        frame = _mm_add_epi32(frame, advance);
+    }
+    gainRampScalar(samples, frames, channels, start, end, f);
+}
+
+__attribute__((target("sse4.1")))
+inline void mixSse41(const int16_t* const* inputs, size_t streams, int16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i low = _mm_setzero_si128();
+        __m128i high = _mm_setzero_si128();
+        for (size_t s = 0; s < streams; s++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[s] + i));
+            low = _mm_add_epi32(low, _mm_cvtepi16_epi32(v));
+            high = _mm_add_epi32(high, _mm_cvtepi16_epi32(_mm_srli_si128(v, 8)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+    }
+    mixScalar(inputs, streams, out, n, i);
+}
+
+__attribute__((target("sse4.1")))
+inline float dotSse41(const float* a, const float* b, size_t n) {
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum) + dotScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline void int16ToFloatAvx2(const int16_t* in, float* out, size_t n) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i wide = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(wide), scale));
+    }
+    int16ToFloatScalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline void floatToInt16Avx2(const float* in, int16_t* out, size_t n) {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 low = _mm256_set1_ps(-32768.0f);
+    const __m256 high = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), low), high);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), low), high);
+        // packs works per 128-bit lane; put the quarters back in order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    floatToInt16Scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline void gainRampAvx2(float* samples, size_t frames, unsigned channels, float start, float end) {
+    if (channels == 0 || 8 % channels != 0) {
+        gainRampScalar(samples, frames, channels, start, end);
+        return;
+    }
+    float step = frames > 0 ? (end - start) / frames : 0.0f;
+    const __m256 startLanes = _mm256_set1_ps(start);
+    const __m256 stepLanes = _mm256_set1_ps(step);
+    int lanes[8];
+    for (int l = 0; l < 8; l++) {
+        lanes[l] = l / (int)channels;
+    }
+    __m256i frame = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+    const __m256i advance = _mm256_set1_epi32((int)(8 / channels));
+    size_t f = 0;
+    for (; f + 8 / channels <= frames; f += 8 / channels) {
+        __m256 gain = _mm256_add_ps(startLanes, _mm256_mul_ps(stepLanes, _mm256_cvtepi32_ps(frame)));
+        float* p = samples + f * channels;
+        _mm256_storeu_ps(p, _mm256_mul_ps(_mm256_loadu_ps(p), gain));
+        frame = _mm256_add_epi32(frame, advance);
+    }
+    gainRampScalar(samples, frames, channels, start, end, f);
+}
+
+__attribute__((target("avx2")))
+inline void mixAvx2(const int16_t* const* inputs, size_t streams, int16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i low = _mm256_setzero_si256();
+        __m256i high = _mm256_setzero_si256();
+        for (size_t s = 0; s < streams; s++) {
+            low = _mm256_add_epi32(low, _mm256_cvtepi16_epi32(
+                                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[s] + i))));
+            high = _mm256_add_epi32(high, _mm256_cvtepi16_epi32(
+                                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[s] + i + 8))));
+        }
+        __m256i packed = _mm256_packs_epi32(low, high);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    mixScalar(inputs, streams, out, n, i);
+}
+
+__attribute__((target("avx2,fma")))
+inline float dotAvx2(const float* a, const float* b, size_t n) {
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half) + dotScalar(a + i, b + i, n - i);
+}
+
+#endif // SIMD_LEVEL_X86
+
+inline void int16ToFloat(SimdLevel level, const int16_t* in, float* out, size_t n) {
+#ifdef SIMD_LEVEL_X86
+    if (level >= kSimdAvx2) {
+        int16ToFloatAvx2(in, out, n);
+        return;
+    }
+    if (level >= kSimdSse41) {
+        int16ToFloatSse41(in, out, n);
+        return;
+    }
+#endif
+    (void)level;
+    int16ToFloatScalar(in, out, n);
+}
+
+inline void floatToInt16(SimdLevel level, const float* in, int16_t* out, size_t n) {
+#ifdef SIMD_LEVEL_X86
+    if (level >= kSimdAvx2) {
+        floatToInt16Avx2(in, out, n);
+        return;
+    }
+    if (level >= kSimdSse41) {
+        floatToInt16Sse41(in, out, n);
+        return;
+    }
+#endif
+    (void)level;
+    floatToInt16Scalar(in, out, n);
+}
+
+inline void gainRamp(SimdLevel level, float* samples, size_t frames, unsigned channels, float start, float end) {
+#ifdef SIMD_LEVEL_X86
+    if (level >= kSimdAvx2) {
+        gainRampAvx2(samples, frames, channels, start, end);
+        return;
+    }
+    if (level >= kSimdSse41) {
+        gainRampSse41(samples, frames, channels, start, end);
+        return;
+    }
+#endif
+    (void)level;
+    gainRampScalar(samples, frames, channels, start, end);
+}
+
+inline void mix(SimdLevel level, const int16_t* const* inputs, size_t streams, int16_t* out, size_t n) {
+#ifdef SIMD_LEVEL_X86
+    if (level >= kSimdAvx2) {
+        mixAvx2(inputs, streams, out, n);
+        return;
+    }
+    if (level >= kSimdSse41) {
+        mixSse41(inputs, streams, out, n);
+        return;
+    }
+#endif
+    (void)level;
+    mixScalar(inputs, streams, out, n);
+}
+
+inline float dot(SimdLevel level, const float* a, const float* b, size_t n) {
+#ifdef SIMD_LEVEL_X86
+    if (level >= kSimdAvx2) {
+        return dotAvx2(a, b, n);
+    }
+    if (level >= kSimdSse41) {
+        return dotSse41(a, b, n);
+    }
+#endif
+    (void)level;
+    return dotScalar(a, b, n);
+}
+
+} // namespace dsp_kernels
+
+// Streaming sample-rate converter for interleaved float frames. The rate
+// ratio is reduced to up/down (44100 -> 48000 is 160/147) and a
+// windowed-sinc low-pass of up * taps coefficients is split into up
+// phases of taps each. Output frame n is the dot product of phase
+// (n * down) % up with the taps input frames ending at (n * down) / up,
+// so only the phase that is needed is computed, not the zero-stuffed
+// signal. Input is kept per channel (planar), which makes every dot
+// product one contiguous SIMD loop.
+//
+//   PolyphaseResampler resampler;
+//   resampler.configure(44100, 48000, 2, 1024);      // allocates here only
+//   std::vector<float> out(resampler.maxOutputFrames(1024) * 2);
+//   ssize_t frames = resampler.process(in, 1024, &out[0]);
+//
+// The output lags the input by taps / 2 input frames (the filter's delay).
+class PolyphaseResampler {
+public:
+    static const uint32_t kDefaultTaps = 32;
+
+private:
+    uint32_t up;
+    uint32_t down;
+    uint32_t taps;
+    unsigned channels;
+    size_t maxInput;
+    std::vector<float> coefficients;   // up phases of taps, each reversed
+    std::vector<float> history;        // per channel: taps - 1 + maxInput frames
+    uint64_t consumed;                 // input frames before this call
+    uint64_t produced;                 // output frames so far
+    SimdLevel simdLevel;
+
+    static uint32_t gcd(uint32_t a, uint32_t b) {
+        while (b != 0) {
+            uint32_t r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+
+    size_t stride() const { return taps - 1 + maxInput; }
+
+    // process() for in, or for frames of silence if in is NULL
+    size_t run(const float* in, size_t frames, float* out) {
+        size_t span = taps - 1;
+        for (unsigned c = 0; c < channels; c++) {
+            float* line = &history[c * stride() + span];
+            for (size_t f = 0; f < frames; f++) {
+                line[f] = in ? in[f * channels + c] : 0.0f;
+            }
+        }
+        uint64_t end = consumed + frames;
+        size_t count = 0;
+        for (;;) {
+            uint64_t position = produced * down;
+            uint64_t input = position / up;
+            if (input >= end) {
+                break;
+            }
+            const float* phase = &coefficients[(size_t)(position % up) * taps];
+            size_t offset = (size_t)(input - consumed);   // history index of input - span
+            for (unsigned c = 0; c < channels; c++) {
+                out[count * channels + c] = dsp_kernels::dot(simdLevel, phase, &history[c * stride() + offset], taps);
+            }
+            count++;
+            produced++;
+        }
+        // Keep the last span frames for the next call
+        for (unsigned c = 0; c < channels; c++) {
+            float* line = &history[c * stride()];
+            memmove(line, line + frames, span * sizeof(float));
+        }
+        consumed = end;
+        return count;
+    }
+
+public:
+    PolyphaseResampler()
+        : up(1), down(1), taps(1), channels(0), maxInput(0), consumed(0), produced(0),
+          simdLevel(detectSimdLevel()) {}
+
+    // Prepares a conversion from inRate to outRate for at most
+    // maxInputFrames per process() call. Returns false with EINVAL for
+    // zero rates, channels or taps.
+    bool configure(uint32_t inRate, uint32_t outRate, unsigned channelCount, size_t maxInputFrames,
+                   uint32_t tapsPerPhase = kDefaultTaps) {
+        if (inRate == 0 || outRate == 0 || channelCount == 0 || maxInputFrames == 0 || tapsPerPhase == 0) {
+            errno = EINVAL;
+            return false;
+        }
+        uint32_t divisor = gcd(inRate, outRate);
+        up = outRate / divisor;
+        down = inRate / divisor;
+        taps = tapsPerPhase;
+        channels = channelCount;
+        maxInput = maxInputFrames;
+
+        // Low-pass at 0.9 of the lower Nyquist frequency, in cycles per
+        // sample of the (virtual) up-sampled signal; Blackman window. The
+        // gain of up makes up for the zeros between up-sampled samples.
+        size_t length = (size_t)up * taps;
+        double cutoff = 0.45 / std::max(up, down);
+        double center = (length - 1) / 2.0;
+        coefficients.assign(length, 0.0f);
+        for (size_t j = 0; j < length; j++) {
+            double x = j - center;
+            double sinc = x == 0 ? 1.0 : sin(2 * M_PI * cutoff * x) / (M_PI * x) / (2 * cutoff);
+            double window = 0.42 - 0.5 * cos(2 * M_PI * j / (length - 1 > 0 ? length - 1 : 1)) +
+                            0.08 * cos(4 * M_PI * j / (length - 1 > 0 ? length - 1 : 1));
+            double h = 2 * cutoff * up * sinc * window;
+            // Tap k of phase p is h[p + k * up]; stored reversed
+            size_t phase = j % up;
+            size_t k = j / up;
+            coefficients[phase * taps + (taps - 1 - k)] = (float)h;
+        }
+        history.assign(channels * stride(), 0.0f);
+        consumed = 0;
+        produced = 0;
+        return true;
+    }
+
+    // Starts a new stream (silence before it)
+    void reset() {
+        std::fill(history.begin(), history.end(), 0.0f);
+        consumed = 0;
+        produced = 0;
+    }
+
+    bool passthrough() const { return up == down; }
+    uint32_t upFactor() const { return up; }
+    uint32_t downFactor() const { return down; }
+
+    // Most frames process() can return for inFrames frames
+    size_t maxOutputFrames(size_t inFrames) const { return (inFrames * up + down - 1) / down + 1; }
+
+    // Most frames flush() can return
+    size_t maxFlushFrames() const { return maxOutputFrames(taps / 2); }
+
+    SimdLevel simd() const { return simdLevel; }
+
+    void setSimd(SimdLevel level) {
+        SimdLevel supported = detectSimdLevel();
+        simdLevel = level < supported ? level : supported;
+    }
+
+    // Converts frames interleaved frames from in into out, which must hold
+    // maxOutputFrames(frames) frames. Returns the number of frames written,
+    // -1 with EINVAL if frames is more than configure() allowed.
+    ssize_t process(const float* in, size_t frames, float* out) {
+        if (frames > maxInput || channels == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        return (ssize_t)run(in, frames, out);
+    }
+
+    // Ends the stream: the filter lags taps / 2 input frames behind, so
+    // that much silence is fed through it to get the end of the input out.
+    // out must hold maxFlushFrames() frames. Returns the number of frames
+    // written; reset() before starting another stream.
+    size_t flush(float* out) {
+        size_t count = 0;
+        for (size_t left = channels > 0 ? taps / 2 : 0; left > 0;) {
+            size_t frames = std::min(left, maxInput);
+            count += run(NULL, frames, out + count * channels);
+            left -= frames;
+        }
+        return count;
+    }
+};
+
+#endif // PCM_DSP_H
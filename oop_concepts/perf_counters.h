@@ -0,0 +1,27 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include "../processes/perf_counter_group.h"
+
+// CPU counters for a region of this thread's code: cycles, instructions,
+// branch misses and L1 instruction cache misses, read as one
+// PerfCounterGroup.
+//
+//   CpuCounters counters;
+//   counters.start();
+//   hotLoop();
+//   counters.stop();
+//   if (counters.available(CpuCounters::kBranchMisses)) ...
+//
+// Only user-space events are counted, which perf_event_paranoid <= 2 allows
+// for our own process. Counters the CPU or a VM does not expose are simply
+// unavailable; read() returns 0 for them.
+
+class CpuCounters : public PerfCounterGroup {
+public:
+    CpuCounters() {
+        openForThread(1u << kCycles | 1u << kInstructions | 1u << kBranchMisses | 1u << kICacheMisses);
+    }
+};
+
+#endif // PERF_COUNTERS_H
@@ -1,66 +1,11 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include "shape.h"
+#include "payment_method.h"
 
-// Example 1: Shape Drawing System (Runtime Polymorphism)
-class Shape {
-public:
-    virtual void draw() const = 0;
-    virtual double calculateArea() const = 0;
-    virtual ~Shape() {}
-};
-
-class Circle : public Shape {
-private:
-    double radius;
-
-public:
-    Circle(double r) : radius(r) {}
-
-    void draw() const override {
-        std::cout << "Drawing a Circle with radius " << radius << std::endl;
-    }
-
-    double calculateArea() const override {
-        return 3.14159 * radius * radius;
-    }
-};
-
-class Rectangle : public Shape {
-private:
-    double width;
-    double height;
-
-public:
-    Rectangle(double w, double h) : width(w), height(h) {}
-
-    void draw() const override {
-        std::cout << "Drawing a Rectangle with width " << width 
-                 << " and height " << height << std::endl;
-    }
-
-    double calculateArea() const override {
-        return width * height;
-    }
-};
-
-class Triangle : public Shape {
-private:
-    double base;
-    double height;
-
-public:
-    Triangle(double b, double h) : base(b), height(h) {}
-
-    void draw() const override {
-        std::cout << "Drawing a Triangle with base " << base 
-                 << " and height " << height << std::endl;
-    }
-
-    double calculateArea() const override {
-        return 0.5 * base * height;
-    }
-};
+// Example 1: Shape Drawing System (Runtime Polymorphism) is in shape.h.
+// The PaymentMethod classes of Example 2 are in payment_method.h.
 
 // Example 2: Payment Processing System (Both Runtime and Compile-time Polymorphism)
 class PaymentProcessor {
@@ -70,64 +15,17 @@ public:
         std::cout << "Processing cash payment of $" << amount << std::endl;
     }
 
-    void processPayment(double amount, std::string creditCardNumber) {
+    void processPayment(double amount, const std::string& creditCardNumber) {
         std::cout << "Processing credit card payment of $" << amount 
                  << " with card " << creditCardNumber << std::endl;
     }
 
-    void processPayment(double amount, std::string bankName, std::string accountNumber) {
+    void processPayment(double amount, const std::string& bankName, const std::string& accountNumber) {
         std::cout << "Processing bank transfer of $" << amount 
                  << " from " << bankName << " account " << accountNumber << std::endl;
     }
 };
 
-// Runtime Polymorphism for Payment Methods
-class PaymentMethod {
-public:
-    virtual void process(double amount) = 0;
-    virtual ~PaymentMethod() {}
-};
-
-class CreditCardPayment : public PaymentMethod {
-private:
-    std::string cardNumber;
-
-public:
-    CreditCardPayment(std::string card) : cardNumber(card) {}
-
-    void process(double amount) override {
-        std::cout << "Processing Credit Card payment of $" << amount 
-                 << " using card ending with " 
-                 << cardNumber.substr(cardNumber.length() - 4) << std::endl;
-    }
-};
-
-class PayPalPayment : public PaymentMethod {
-private:
-    std::string email;
-
-public:
-    PayPalPayment(std::string e) : email(e) {}
-
-    void process(double amount) override {
-        std::cout << "Processing PayPal payment of $" << amount 
-                 << " using account " << email << std::endl;
-    }
-};
-
-class CryptoCurrencyPayment : public PaymentMethod {
-private:
-    std::string walletAddress;
-
-public:
-    CryptoCurrencyPayment(std::string wallet) : walletAddress(wallet) {}
-
-    void process(double amount) override {
-        std::cout << "Processing Cryptocurrency payment of $" << amount 
-                 << " to wallet " << walletAddress << std::endl;
-    }
-};
-
 int main() {
     // Testing Shape Drawing System
     std::vector<Shape*> shapes;
@@ -137,8 +35,8 @@ int main() {
 
     std::cout << "Shape Drawing System Demo:\n";
     for (const auto& shape : shapes) {
-        shape.draw();
-        std::cout << "Area: " << shape.calculateArea() << "\n\n";
+        shape->draw();
+        std::cout << "Area: " << shape->calculateArea() << "\n\n";
     }
 
     // Cleanup shapes
@@ -164,6 +62,7 @@ int main() {
     std::cout << "\nProcessing different payment methods:\n";
     for (const auto& method : paymentMethods) {
         method->process(150.0);
+        std::cout << "  Fee: $" << method->calculateFee(150.0) << std::endl;
     }
 
     // Cleanup payment methods
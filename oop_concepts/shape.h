@@ -0,0 +1,90 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <iostream>
+#include <type_traits>
+
+// Shape hierarchy used by polymorphism_example.cpp and the shape benchmarks
+
+// Factor in the circle area formula; ShapeBatch uses the same value so both
+// paths produce the same areas
+const double kCircleAreaFactor = 3.14159;
+
+// Example 1: Shape Drawing System (Runtime Polymorphism)
+class Shape {
+public:
+    virtual void draw() const = 0;
+    virtual double calculateArea() const = 0;
+    virtual ~Shape() {}
+};
+
+class Circle : public Shape {
+private:
+    double radius;
+
+public:
+    Circle(double r) : radius(r) {}
+
+    void draw() const override {
+        std::cout << "Drawing a Circle with radius " << radius << std::endl;
+    }
+
+    double calculateArea() const override {
+        return kCircleAreaFactor * radius * radius;
+    }
+
+    double getRadius() const { return radius; }
+};
+
+class Rectangle : public Shape {
+private:
+    double width;
+    double height;
+
+public:
+    Rectangle(double w, double h) : width(w), height(h) {}
+
+    void draw() const override {
+        std::cout << "Drawing a Rectangle with width " << width 
+                 << " and height " << height << std::endl;
+    }
+
+    double calculateArea() const override {
+        return width * height;
+    }
+
+    double getWidth() const { return width; }
+    double getHeight() const { return height; }
+};
+
+class Triangle : public Shape {
+private:
+    double base;
+    double height;
+
+public:
+    Triangle(double b, double h) : base(b), height(h) {}
+
+    void draw() const override {
+        std::cout << "Drawing a Triangle with base " << base 
+                 << " and height " << height << std::endl;
+    }
+
+    double calculateArea() const override {
+        return 0.5 * base * height;
+    }
+
+    double getBase() const { return base; }
+    double getHeight() const { return height; }
+};
+
+// Defined in object_arena.h. The shapes only hold doubles, so an arena may
+// skip their destructors; declared here so every user of the shapes sees it.
+template <typename T>
+struct ArenaSkipsDestructor;
+
+template <> struct ArenaSkipsDestructor<Circle> : std::true_type {};
+template <> struct ArenaSkipsDestructor<Rectangle> : std::true_type {};
+template <> struct ArenaSkipsDestructor<Triangle> : std::true_type {};
+
+#endif // SHAPE_H
@@ -0,0 +1,281 @@
+#ifndef SHAPE_BATCH_H
+#define SHAPE_BATCH_H
+
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include "shape.h"
+#include "simd_level.h"
+
+// Data-oriented storage for many shapes.
+//
+// A std::vector<Shape*> costs a pointer chase, a vtable load and an indirect
+// call per shape, and the objects are scattered over the heap. ShapeBatch
+// keeps each shape type in its own structure-of-arrays columns instead
+// (all circle radii together, all rectangle widths together, ...), so
+// computing areas is a straight loop over contiguous doubles that the CPU
+// can prefetch and run 2 (SSE2) or 4 (AVX2) lanes at a time.
+//
+//   ShapeBatch batch;
+//   batch.addCircle(5);
+//   batch.addRectangle(4, 6);
+//   double total = batch.totalArea();           // best kernel for this CPU
+//   double big = batch.totalAreaParallel(8);    // split across 8 threads
+//
+// Shapes are grouped by type, so areas() returns circles first, then
+// rectangles, then triangles, each in insertion order.
+
+namespace shape_kernels {
+
+// Each kernel returns scale * sum(a[i] * b[i]); the area kernels write
+// scale * a[i] * b[i] into out. Circles pass the radius column as a and b.
+
+inline double sumProductsScalar(const double* a, const double* b, size_t n, double scale) {
+    // Four accumulators, like the vector kernels, to hide the add latency
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++) {
+        s0 += a[i] * b[i];
+    }
+    return scale * ((s0 + s1) + (s2 + s3));
+}
+
+inline void productsScalar(const double* a, const double* b, size_t n, double scale, double* out) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = scale * a[i] * b[i];
+    }
+}
+
+#ifdef SIMD_LEVEL_X86
+
+// SSE2 is part of x86-64, so these need no runtime check there
+__attribute__((target("sse2")))
+inline double sumProductsSse2(const double* a, const double* b, size_t n, double scale) {
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    double sum = lanes[0] + lanes[1];
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return scale * sum;
+}
+
+__attribute__((target("sse2")))
+inline void productsSse2(const double* a, const double* b, size_t n, double scale, double* out) {
+    __m128d factor = _mm_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d product = _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+        _mm_storeu_pd(out + i, _mm_mul_pd(factor, product));
+    }
+    for (; i < n; i++) {
+        out[i] = scale * a[i] * b[i];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+inline double sumProductsAvx2(const double* a, const double* b, size_t n, double scale) {
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd();
+    __m256d s3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+        s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), s2);
+        s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), s3);
+    }
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+    }
+    __m256d total = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return scale * sum;
+}
+
+__attribute__((target("avx2,fma")))
+inline void productsAvx2(const double* a, const double* b, size_t n, double scale, double* out) {
+    __m256d factor = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d product = _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(factor, product));
+    }
+    for (; i < n; i++) {
+        out[i] = scale * a[i] * b[i];
+    }
+}
+
+#endif // SIMD_LEVEL_X86
+
+inline double sumProducts(SimdLevel level, const double* a, const double* b, size_t n, double scale) {
+#ifdef SIMD_LEVEL_X86
+    if (level == kSimdAvx2) {
+        return sumProductsAvx2(a, b, n, scale);
+    }
+    if (level >= kSimdSse2) {
+        return sumProductsSse2(a, b, n, scale);
+    }
+#endif
+    (void)level;
+    return sumProductsScalar(a, b, n, scale);
+}
+
+inline void products(SimdLevel level, const double* a, const double* b, size_t n, double scale,
+                     double* out) {
+#ifdef SIMD_LEVEL_X86
+    if (level == kSimdAvx2) {
+        productsAvx2(a, b, n, scale, out);
+        return;
+    }
+    if (level >= kSimdSse2) {
+        productsSse2(a, b, n, scale, out);
+        return;
+    }
+#endif
+    (void)level;
+    productsScalar(a, b, n, scale, out);
+}
+
+} // namespace shape_kernels
+
+class ShapeBatch {
+private:
+    // One column per field, one group of columns per shape type
+    std::vector<double> circleRadius;
+    std::vector<double> rectangleWidth;
+    std::vector<double> rectangleHeight;
+    std::vector<double> triangleBase;
+    std::vector<double> triangleHeight;
+    SimdLevel simdLevel;
+
+    // Total area of circles [c0, c1), rectangles [r0, r1), triangles [t0, t1)
+    double rangeArea(size_t c0, size_t c1, size_t r0, size_t r1, size_t t0, size_t t1) const {
+        double total = 0.0;
+        if (c1 > c0) {
+            total += shape_kernels::sumProducts(simdLevel, &circleRadius[c0], &circleRadius[c0],
+                                                c1 - c0, kCircleAreaFactor);
+        }
+        if (r1 > r0) {
+            total += shape_kernels::sumProducts(simdLevel, &rectangleWidth[r0], &rectangleHeight[r0],
+                                                r1 - r0, 1.0);
+        }
+        if (t1 > t0) {
+            total += shape_kernels::sumProducts(simdLevel, &triangleBase[t0], &triangleHeight[t0],
+                                                t1 - t0, 0.5);
+        }
+        return total;
+    }
+
+public:
+    ShapeBatch() : simdLevel(detectSimdLevel()) {}
+
+    void reserve(size_t circles, size_t rectangles, size_t triangles) {
+        circleRadius.reserve(circles);
+        rectangleWidth.reserve(rectangles);
+        rectangleHeight.reserve(rectangles);
+        triangleBase.reserve(triangles);
+        triangleHeight.reserve(triangles);
+    }
+
+    void addCircle(double radius) { circleRadius.push_back(radius); }
+
+    void addRectangle(double width, double height) {
+        rectangleWidth.push_back(width);
+        rectangleHeight.push_back(height);
+    }
+
+    void addTriangle(double base, double height) {
+        triangleBase.push_back(base);
+        triangleHeight.push_back(height);
+    }
+
+    size_t circleCount() const { return circleRadius.size(); }
+    size_t rectangleCount() const { return rectangleWidth.size(); }
+    size_t triangleCount() const { return triangleBase.size(); }
+    size_t size() const { return circleCount() + rectangleCount() + triangleCount(); }
+
+    // Kernels default to the widest the CPU supports; a lower level can be
+    // forced for comparisons (a higher one than detected is ignored)
+    SimdLevel simd() const { return simdLevel; }
+
+    void setSimd(SimdLevel level) {
+        SimdLevel supported = detectSimdLevel();
+        simdLevel = level < supported ? level : supported;
+    }
+
+    double totalArea() const {
+        return rangeArea(0, circleCount(), 0, rectangleCount(), 0, triangleCount());
+    }
+
+    // Each thread sums an equal share of every column; the partial sums are
+    // added in thread order, so the result does not depend on timing
+    double totalAreaParallel(unsigned threads) const {
+        if (threads <= 1 || size() < 2 * threads) {
+            return totalArea();
+        }
+        std::vector<double> partial(threads, 0.0);
+        std::vector<std::thread> workers;
+        size_t circles = circleCount();
+        size_t rectangles = rectangleCount();
+        size_t triangles = triangleCount();
+        for (unsigned t = 0; t < threads; t++) {
+            workers.push_back(std::thread([this, t, threads, circles, rectangles, triangles, &partial]() {
+                partial[t] = rangeArea(circles * t / threads, circles * (t + 1) / threads,
+                                       rectangles * t / threads, rectangles * (t + 1) / threads,
+                                       triangles * t / threads, triangles * (t + 1) / threads);
+            }));
+        }
+        double total = 0.0;
+        for (unsigned t = 0; t < threads; t++) {
+            workers[t].join();
+            total += partial[t];
+        }
+        return total;
+    }
+
+    // Writes every area into out (resized to size()): circles, then
+    // rectangles, then triangles
+    void areas(std::vector<double>& out) const {
+        out.resize(size());
+        if (out.empty()) {
+            return;
+        }
+        double* next = &out[0];
+        if (circleCount() > 0) {
+            shape_kernels::products(simdLevel, &circleRadius[0], &circleRadius[0], circleCount(),
+                                    kCircleAreaFactor, next);
+            next += circleCount();
+        }
+        if (rectangleCount() > 0) {
+            shape_kernels::products(simdLevel, &rectangleWidth[0], &rectangleHeight[0],
+                                    rectangleCount(), 1.0, next);
+            next += rectangleCount();
+        }
+        if (triangleCount() > 0) {
+            shape_kernels::products(simdLevel, &triangleBase[0], &triangleHeight[0], triangleCount(),
+                                    0.5, next);
+        }
+    }
+};
+
+#endif // SHAPE_BATCH_H
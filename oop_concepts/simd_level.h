@@ -0,0 +1,38 @@
+#ifndef SIMD_LEVEL_H
+#define SIMD_LEVEL_H
+
+// Instruction sets the batch kernels (shape_batch.h, payroll_table.h,
+// pcm_dsp.h) are compiled for. Kernels use __attribute__((target(...))), so
+// one binary runs everywhere and picks the widest level at runtime. Levels
+// are ordered: a kernel for a level also runs on every level above it.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_LEVEL_X86 1
+#endif
+
+enum SimdLevel {
+    kSimdScalar,
+    kSimdSse2,
+    kSimdSse41,
+    kSimdAvx2,
+};
+
+// Widest instruction set this CPU supports
+inline SimdLevel detectSimdLevel() {
+#ifdef SIMD_LEVEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return kSimdAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return kSimdSse41;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return kSimdSse2;
+    }
+#endif
+    return kSimdScalar;
+}
+
+#endif // SIMD_LEVEL_H
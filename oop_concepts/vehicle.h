@@ -0,0 +1,90 @@
+#ifndef VEHICLE_H
+#define VEHICLE_H
+
+#include <iostream>
+#include <string>
+
+// Vehicle hierarchy used by inheritance_example.cpp and the allocator
+// and catalog examples
+
+// Example 2: Vehicle Management System
+class Vehicle {
+protected:
+    std::string brand;
+    std::string model;
+    int year;
+    double basePrice;
+
+public:
+    Vehicle(std::string b, std::string m, int y, double p) :
+        brand(b), model(m), year(y), basePrice(p) {}
+
+    virtual ~Vehicle() {}
+
+    virtual double calculatePrice() {
+        return basePrice;
+    }
+
+    virtual void displaySpecs() {
+        std::cout << "Brand: " << brand << "\nModel: " << model
+                 << "\nYear: " << year << "\nBase Price: " << basePrice << std::endl;
+    }
+
+    const std::string& getBrand() const { return brand; }
+    const std::string& getModel() const { return model; }
+    int getYear() const { return year; }
+    double getBasePrice() const { return basePrice; }
+};
+
+class ElectricCar : public Vehicle {
+private:
+    int batteryCapacity;
+    int range;
+
+public:
+    ElectricCar(std::string b, std::string m, int y, double p, 
+                int bc, int r) :
+        Vehicle(b, m, y, p), batteryCapacity(bc), range(r) {}
+
+    double calculatePrice() override {
+        return basePrice + (batteryCapacity * 100); // Premium for battery size
+    }
+
+    void displaySpecs() override {
+        Vehicle::displaySpecs();
+        std::cout << "Battery Capacity: " << batteryCapacity << " kWh"
+                 << "\nRange: " << range << " miles" << std::endl;
+    }
+
+    int getBatteryCapacity() const { return batteryCapacity; }
+    int getRange() const { return range; }
+};
+
+class LuxuryCar : public Vehicle {
+private:
+    bool hasMassageSeats;
+    bool hasAutoPilot;
+
+public:
+    LuxuryCar(std::string b, std::string m, int y, double p,
+              bool ms, bool ap) :
+        Vehicle(b, m, y, p), hasMassageSeats(ms), hasAutoPilot(ap) {}
+
+    double calculatePrice() override {
+        double price = basePrice;
+        if (hasMassageSeats) price += 5000;
+        if (hasAutoPilot) price += 8000;
+        return price;
+    }
+
+    void displaySpecs() override {
+        Vehicle::displaySpecs();
+        std::cout << "Massage Seats: " << (hasMassageSeats ? "Yes" : "No")
+                 << "\nAutoPilot: " << (hasAutoPilot ? "Yes" : "No") << std::endl;
+    }
+
+    bool getMassageSeats() const { return hasMassageSeats; }
+    bool getAutoPilot() const { return hasAutoPilot; }
+};
+
+#endif // VEHICLE_H
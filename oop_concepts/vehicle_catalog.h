@@ -0,0 +1,462 @@
+#ifndef VEHICLE_CATALOG_H
+#define VEHICLE_CATALOG_H
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "vehicle.h"
+
+// Binary vehicle catalog that is used straight from an mmap().
+//
+// Building Vehicle objects means several std::string copies per vehicle,
+// so a large catalog costs millions of allocations before the first query.
+// A catalog file instead holds fixed-width records, one section per
+// subtype, and a string table in which every distinct brand and model is
+// stored once:
+//
+//   header (96 bytes) | Vehicle records | ElectricCar records
+//                     | LuxuryCar records | string table
+//
+// VehicleCatalog::open() maps the file and checks the header and section
+// bounds; nothing is read or converted per record, so opening takes the
+// same time for 1K vehicles as for 20M. Views (VehicleView, ElectricCarView,
+// LuxuryCarView) point into the mapping and have the calculatePrice() and
+// displaySpecs() of the classes in vehicle.h, with the same results.
+//
+//   VehicleCatalogWriter writer;
+//   writer.addElectricCar("Tesla", "Model 3", 2023, 40000, 75, 350);
+//   writer.write("vehicles.cat");
+//
+//   VehicleCatalog catalog;
+//   if (!catalog.open("vehicles.cat")) perror("open");
+//   ElectricCarView car = catalog.electricCar(0);
+//   double price = car.calculatePrice();
+//
+// Records are in host byte order (little-endian on every supported
+// target); the header's version changes whenever the layout does.
+
+enum VehicleKind {
+    kVehiclePlain,
+    kVehicleElectric,
+    kVehicleLuxury,
+    kVehicleKinds,
+};
+
+static const uint32_t kVehicleCatalogVersion = 1;
+
+struct VehicleCatalogHeader {
+    char magic[8];                          // "VEHCATLG"
+    uint32_t version;                       // kVehicleCatalogVersion
+    uint32_t headerSize;
+    uint64_t sectionOffset[kVehicleKinds];
+    uint64_t sectionCount[kVehicleKinds];
+    uint32_t recordSize[kVehicleKinds];
+    uint32_t reserved;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+// Strings are (offset, length) in the string table
+struct VehicleRecord {
+    uint32_t id;                            // order the vehicles were added in
+    int32_t year;
+    uint32_t brandOffset;
+    uint32_t brandLength;
+    uint32_t modelOffset;
+    uint32_t modelLength;
+    double basePrice;
+};
+
+struct ElectricCarRecord {
+    VehicleRecord vehicle;
+    int32_t batteryCapacity;
+    int32_t range;
+};
+
+struct LuxuryCarRecord {
+    VehicleRecord vehicle;
+    uint8_t massageSeats;
+    uint8_t autoPilot;
+    uint8_t reserved[6];
+};
+
+static_assert(sizeof(VehicleCatalogHeader) == 96, "VehicleCatalogHeader is an on-disk format");
+static_assert(sizeof(VehicleRecord) == 32, "VehicleRecord is an on-disk format");
+static_assert(sizeof(ElectricCarRecord) == 40, "ElectricCarRecord is an on-disk format");
+static_assert(sizeof(LuxuryCarRecord) == 40, "LuxuryCarRecord is an on-disk format");
+
+// Bytes in the mapped string table; not terminated
+struct CatalogString {
+    const char* data;
+    size_t size;
+
+    std::string str() const { return std::string(data, size); }
+
+    bool operator==(const CatalogString& other) const {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const CatalogString& text) {
+    return out.write(text.data, (std::streamsize)text.size);
+}
+
+class VehicleView {
+protected:
+    const VehicleRecord* record;
+    const char* strings;
+    uint64_t stringsSize;
+
+    // An out-of-range string reads as empty rather than past the mapping
+    CatalogString text(uint32_t offset, uint32_t length) const {
+        CatalogString result = {"", 0};
+        if ((uint64_t)offset + length <= stringsSize) {
+            result.data = strings + offset;
+            result.size = length;
+        }
+        return result;
+    }
+
+public:
+    VehicleView(const VehicleRecord* r, const char* s, uint64_t size)
+        : record(r), strings(s), stringsSize(size) {}
+
+    uint32_t id() const { return record->id; }
+    CatalogString brand() const { return text(record->brandOffset, record->brandLength); }
+    CatalogString model() const { return text(record->modelOffset, record->modelLength); }
+    int year() const { return record->year; }
+    double basePrice() const { return record->basePrice; }
+
+    double calculatePrice() const { return record->basePrice; }
+
+    void displaySpecs(std::ostream& out = std::cout) const {
+        out << "Brand: " << brand() << "\nModel: " << model()
+            << "\nYear: " << year() << "\nBase Price: " << basePrice() << std::endl;
+    }
+};
+
+class ElectricCarView : public VehicleView {
+private:
+    const ElectricCarRecord* electric;
+
+public:
+    ElectricCarView(const ElectricCarRecord* r, const char* s, uint64_t size)
+        : VehicleView(&r->vehicle, s, size), electric(r) {}
+
+    int batteryCapacity() const { return electric->batteryCapacity; }
+    int range() const { return electric->range; }
+
+    double calculatePrice() const { return basePrice() + (batteryCapacity() * 100); }
+
+    void displaySpecs(std::ostream& out = std::cout) const {
+        VehicleView::displaySpecs(out);
+        out << "Battery Capacity: " << batteryCapacity() << " kWh"
+            << "\nRange: " << range() << " miles" << std::endl;
+    }
+};
+
+class LuxuryCarView : public VehicleView {
+private:
+    const LuxuryCarRecord* luxury;
+
+public:
+    LuxuryCarView(const LuxuryCarRecord* r, const char* s, uint64_t size)
+        : VehicleView(&r->vehicle, s, size), luxury(r) {}
+
+    bool massageSeats() const { return luxury->massageSeats != 0; }
+    bool autoPilot() const { return luxury->autoPilot != 0; }
+
+    double calculatePrice() const {
+        double price = basePrice();
+        if (massageSeats()) price += 5000;
+        if (autoPilot()) price += 8000;
+        return price;
+    }
+
+    void displaySpecs(std::ostream& out = std::cout) const {
+        VehicleView::displaySpecs(out);
+        out << "Massage Seats: " << (massageSeats() ? "Yes" : "No")
+            << "\nAutoPilot: " << (autoPilot() ? "Yes" : "No") << std::endl;
+    }
+};
+
+class VehicleCatalog {
+private:
+    const char* base;
+    size_t mappedSize;
+    const VehicleCatalogHeader* header;
+
+    VehicleCatalog(const VehicleCatalog&);
+    VehicleCatalog& operator=(const VehicleCatalog&);
+
+    bool valid() const {
+        static const uint32_t kRecordSizes[kVehicleKinds] = {
+            sizeof(VehicleRecord), sizeof(ElectricCarRecord), sizeof(LuxuryCarRecord)};
+        if (memcmp(header->magic, "VEHCATLG", 8) != 0 || header->headerSize != sizeof(VehicleCatalogHeader)) {
+            return false;
+        }
+        for (int kind = 0; kind < kVehicleKinds; kind++) {
+            uint64_t offset = header->sectionOffset[kind];
+            uint64_t count = header->sectionCount[kind];
+            if (header->recordSize[kind] != kRecordSizes[kind] || offset % 8 != 0 || offset > mappedSize ||
+                count > (mappedSize - offset) / kRecordSizes[kind]) {
+                return false;
+            }
+        }
+        return header->stringsOffset <= mappedSize && header->stringsSize <= mappedSize - header->stringsOffset;
+    }
+
+    const char* strings() const { return base + header->stringsOffset; }
+
+    template <typename Record>
+    const Record* section(VehicleKind kind) const {
+        return reinterpret_cast<const Record*>(base + header->sectionOffset[kind]);
+    }
+
+public:
+    VehicleCatalog() : base(NULL), mappedSize(0), header(NULL) {}
+
+    ~VehicleCatalog() { close(); }
+
+    // Maps path read-only. Pages are read on first use, unless populate is
+    // set. Returns false with errno: EINVAL if this is not a catalog,
+    // ENOTSUP for a catalog of another version.
+    bool open(const std::string& path, bool populate = false) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            return false;
+        }
+        if ((size_t)info.st_size < sizeof(VehicleCatalogHeader)) {
+            ::close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0),
+                            fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            errno = error;
+            return false;
+        }
+        base = static_cast<const char*>(mapped);
+        mappedSize = (size_t)info.st_size;
+        header = reinterpret_cast<const VehicleCatalogHeader*>(base);
+        if (memcmp(header->magic, "VEHCATLG", 8) == 0 && header->version != kVehicleCatalogVersion) {
+            close();
+            errno = ENOTSUP;
+            return false;
+        }
+        if (!valid()) {
+            close();
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (base) {
+            munmap(const_cast<char*>(base), mappedSize);
+        }
+        base = NULL;
+        mappedSize = 0;
+        header = NULL;
+    }
+
+    bool isOpen() const { return base != NULL; }
+    size_t fileSize() const { return mappedSize; }
+
+    size_t count(VehicleKind kind) const { return header ? (size_t)header->sectionCount[kind] : 0; }
+    size_t size() const { return count(kVehiclePlain) + count(kVehicleElectric) + count(kVehicleLuxury); }
+
+    // The i-th record of each section; i must be below count(kind)
+    VehicleView vehicle(size_t i) const {
+        return VehicleView(section<VehicleRecord>(kVehiclePlain) + i, strings(), header->stringsSize);
+    }
+
+    ElectricCarView electricCar(size_t i) const {
+        return ElectricCarView(section<ElectricCarRecord>(kVehicleElectric) + i, strings(),
+                               header->stringsSize);
+    }
+
+    LuxuryCarView luxuryCar(size_t i) const {
+        return LuxuryCarView(section<LuxuryCarRecord>(kVehicleLuxury) + i, strings(), header->stringsSize);
+    }
+
+    // Whole sections, for scans
+    const VehicleRecord* vehicleRecords() const { return section<VehicleRecord>(kVehiclePlain); }
+    const ElectricCarRecord* electricCarRecords() const { return section<ElectricCarRecord>(kVehicleElectric); }
+    const LuxuryCarRecord* luxuryCarRecords() const { return section<LuxuryCarRecord>(kVehicleLuxury); }
+};
+
+// Collects vehicles in memory and writes them as a catalog file
+class VehicleCatalogWriter {
+private:
+    std::vector<VehicleRecord> vehicles;
+    std::vector<ElectricCarRecord> electricCars;
+    std::vector<LuxuryCarRecord> luxuryCars;
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> interned;   // text -> offset
+    uint32_t nextId;
+    bool tooLarge;                                        // string table over 4 GB
+
+    void intern(const std::string& text, uint32_t& offset, uint32_t& length) {
+        std::unordered_map<std::string, uint32_t>::const_iterator found = interned.find(text);
+        if (found != interned.end()) {
+            offset = found->second;
+        } else {
+            if (strings.size() + text.size() > UINT32_MAX) {
+                tooLarge = true;
+            }
+            offset = (uint32_t)strings.size();
+            strings += text;
+            interned.insert(std::make_pair(text, offset));
+        }
+        length = (uint32_t)text.size();
+    }
+
+    VehicleRecord record(const std::string& brand, const std::string& model, int year, double basePrice) {
+        VehicleRecord result = VehicleRecord();
+        result.id = nextId++;
+        result.year = year;
+        intern(brand, result.brandOffset, result.brandLength);
+        intern(model, result.modelOffset, result.modelLength);
+        result.basePrice = basePrice;
+        return result;
+    }
+
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const char* next = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(fd, next, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            next += written;
+            size -= (size_t)written;
+        }
+        return true;
+    }
+
+public:
+    VehicleCatalogWriter() : nextId(0), tooLarge(false) {}
+
+    // Each returns the vehicle's id
+    uint32_t addVehicle(const std::string& brand, const std::string& model, int year, double basePrice) {
+        vehicles.push_back(record(brand, model, year, basePrice));
+        return vehicles.back().id;
+    }
+
+    uint32_t addElectricCar(const std::string& brand, const std::string& model, int year, double basePrice,
+                            int batteryCapacity, int range) {
+        ElectricCarRecord car = ElectricCarRecord();
+        car.vehicle = record(brand, model, year, basePrice);
+        car.batteryCapacity = batteryCapacity;
+        car.range = range;
+        electricCars.push_back(car);
+        return car.vehicle.id;
+    }
+
+    uint32_t addLuxuryCar(const std::string& brand, const std::string& model, int year, double basePrice,
+                          bool massageSeats, bool autoPilot) {
+        LuxuryCarRecord car = LuxuryCarRecord();
+        car.vehicle = record(brand, model, year, basePrice);
+        car.massageSeats = massageSeats ? 1 : 0;
+        car.autoPilot = autoPilot ? 1 : 0;
+        luxuryCars.push_back(car);
+        return car.vehicle.id;
+    }
+
+    // Copies an object of the vehicle.h hierarchy
+    uint32_t add(const Vehicle& vehicle) {
+        if (const ElectricCar* car = dynamic_cast<const ElectricCar*>(&vehicle)) {
+            return addElectricCar(car->getBrand(), car->getModel(), car->getYear(), car->getBasePrice(),
+                                  car->getBatteryCapacity(), car->getRange());
+        }
+        if (const LuxuryCar* car = dynamic_cast<const LuxuryCar*>(&vehicle)) {
+            return addLuxuryCar(car->getBrand(), car->getModel(), car->getYear(), car->getBasePrice(),
+                                car->getMassageSeats(), car->getAutoPilot());
+        }
+        return addVehicle(vehicle.getBrand(), vehicle.getModel(), vehicle.getYear(), vehicle.getBasePrice());
+    }
+
+    size_t size() const { return vehicles.size() + electricCars.size() + luxuryCars.size(); }
+
+    // Writes path.tmp and renames it over path, so readers never map a
+    // half-written catalog. Returns false with errno (EFBIG if the string
+    // table outgrew 32-bit offsets).
+    bool write(const std::string& path) const {
+        if (tooLarge) {
+            errno = EFBIG;
+            return false;
+        }
+        VehicleCatalogHeader header = VehicleCatalogHeader();
+        memcpy(header.magic, "VEHCATLG", 8);
+        header.version = kVehicleCatalogVersion;
+        header.headerSize = sizeof(header);
+        header.recordSize[kVehiclePlain] = sizeof(VehicleRecord);
+        header.recordSize[kVehicleElectric] = sizeof(ElectricCarRecord);
+        header.recordSize[kVehicleLuxury] = sizeof(LuxuryCarRecord);
+        header.sectionCount[kVehiclePlain] = vehicles.size();
+        header.sectionCount[kVehicleElectric] = electricCars.size();
+        header.sectionCount[kVehicleLuxury] = luxuryCars.size();
+        // Record sizes are multiples of 8, so every section stays aligned
+        header.sectionOffset[kVehiclePlain] = sizeof(header);
+        header.sectionOffset[kVehicleElectric] =
+            header.sectionOffset[kVehiclePlain] + vehicles.size() * sizeof(VehicleRecord);
+        header.sectionOffset[kVehicleLuxury] =
+            header.sectionOffset[kVehicleElectric] + electricCars.size() * sizeof(ElectricCarRecord);
+        header.stringsOffset = header.sectionOffset[kVehicleLuxury] + luxuryCars.size() * sizeof(LuxuryCarRecord);
+        header.stringsSize = strings.size();
+
+        std::string temporary = path + ".tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = writeAll(fd, &header, sizeof(header)) &&
+                  (vehicles.empty() || writeAll(fd, &vehicles[0], vehicles.size() * sizeof(VehicleRecord))) &&
+                  (electricCars.empty() ||
+                   writeAll(fd, &electricCars[0], electricCars.size() * sizeof(ElectricCarRecord))) &&
+                  (luxuryCars.empty() || writeAll(fd, &luxuryCars[0], luxuryCars.size() * sizeof(LuxuryCarRecord))) &&
+                  writeAll(fd, strings.data(), strings.size());
+        int error = errno;
+        if (::close(fd) != 0 && ok) {
+            error = errno;
+            ok = false;
+        }
+        if (ok && rename(temporary.c_str(), path.c_str()) != 0) {
+            error = errno;
+            ok = false;
+        }
+        if (!ok) {
+            unlink(temporary.c_str());
+            errno = error;
+        }
+        return ok;
+    }
+};
+
+#endif // VEHICLE_CATALOG_H
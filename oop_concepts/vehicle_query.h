@@ -0,0 +1,587 @@
+#ifndef VEHICLE_QUERY_H
+#define VEHICLE_QUERY_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vehicle.h"
+#include "vehicle_catalog.h"
+
+// Filter / sort / top-k queries over a large, changing vehicle inventory.
+//
+// "The 10 cheapest ElectricCars with range over 300" over std::vector<
+// Vehicle*> is a full scan with a dynamic_cast and a virtual
+// calculatePrice() per vehicle. VehicleInventory keeps the vehicles in
+// columns instead, with
+//   - a materialized price column, recomputed only when one of the
+//     vehicle's inputs changes
+//   - bucketed secondary indexes on kind, year, brand, battery capacity,
+//     range and price, updated in O(1) per changed attribute: a vehicle
+//     moves from one bucket to another, nothing is rebuilt
+// A query estimates how many rows each usable index would hand it and
+// either scans the smallest candidate set, or (for a price-ordered top-k)
+// walks the price index in order and stops after k matches, whichever
+// looks cheaper. Every candidate is checked against the full predicate, so
+// indexes only ever narrow the search.
+//
+//   VehicleInventory inventory;
+//   inventory.add(tesla);
+//   std::vector<uint32_t> rows;
+//   inventory.run(VehicleQuery().whereKind(kVehicleElectric).whereRange(301, INT_MAX)
+//                     .orderBy(kOrderPriceAscending).limit(10), rows);
+//   inventory.setRange(rows[0], 280);         // indexes and price follow
+
+enum VehicleOrder {
+    kOrderNone,
+    kOrderPriceAscending,
+    kOrderPriceDescending,
+};
+
+// Row ids grouped into buckets of width consecutive keys; keys below base
+// or past the last bucket share the first or last bucket. A row can be
+// moved between buckets in O(1) (swap with the bucket's last row).
+class BucketIndex {
+private:
+    static const uint32_t kNoBucket = UINT32_MAX;
+
+    std::vector<std::vector<uint32_t> > buckets;
+    std::vector<uint32_t> bucketOf;   // by row
+    std::vector<uint32_t> slotOf;     // position in the bucket, by row
+    int64_t base;
+    int64_t width;
+    size_t maxBuckets;
+    size_t entries;
+
+public:
+    BucketIndex(int64_t keyBase, int64_t keyWidth, size_t bucketLimit = 1 << 16)
+        : base(keyBase), width(keyWidth > 0 ? keyWidth : 1), maxBuckets(bucketLimit), entries(0) {}
+
+    size_t bucketFor(int64_t key) const {
+        if (key <= base) {
+            return 0;
+        }
+        uint64_t bucket = (uint64_t)(key - base) / (uint64_t)width;
+        return bucket < maxBuckets ? (size_t)bucket : maxBuckets - 1;
+    }
+
+    void insert(uint32_t row, int64_t key) {
+        if (row >= bucketOf.size()) {
+            bucketOf.resize(row + 1, static_cast<uint32_t>(kNoBucket));
+            slotOf.resize(row + 1, 0);
+        }
+        if (bucketOf[row] != kNoBucket) {
+            erase(row);
+        }
+        size_t bucket = bucketFor(key);
+        if (bucket >= buckets.size()) {
+            buckets.resize(bucket + 1);
+        }
+        bucketOf[row] = (uint32_t)bucket;
+        slotOf[row] = (uint32_t)buckets[bucket].size();
+        buckets[bucket].push_back(row);
+        entries++;
+    }
+
+    void erase(uint32_t row) {
+        if (row >= bucketOf.size() || bucketOf[row] == kNoBucket) {
+            return;
+        }
+        std::vector<uint32_t>& bucket = buckets[bucketOf[row]];
+        uint32_t last = bucket.back();
+        bucket[slotOf[row]] = last;
+        slotOf[last] = slotOf[row];
+        bucket.pop_back();
+        bucketOf[row] = kNoBucket;
+        entries--;
+    }
+
+    // Moves row only if its bucket changes
+    void update(uint32_t row, int64_t key) {
+        if (row < bucketOf.size() && bucketOf[row] != kNoBucket && bucketOf[row] == bucketFor(key)) {
+            return;
+        }
+        insert(row, key);
+    }
+
+    size_t size() const { return entries; }
+
+    // Rows in the buckets that overlap [low, high]
+    size_t count(int64_t low, int64_t high) const {
+        if (buckets.empty() || low > high) {
+            return 0;
+        }
+        size_t last = std::min(bucketFor(high), buckets.size() - 1);
+        size_t total = 0;
+        for (size_t b = bucketFor(low); b <= last; b++) {
+            total += buckets[b].size();
+        }
+        return total;
+    }
+
+    // Calls visit(bucket) for the buckets overlapping [low, high], in key
+    // order (or reverse), until it returns false
+    template <typename Visit>
+    void scan(int64_t low, int64_t high, bool descending, Visit visit) const {
+        if (buckets.empty() || low > high) {
+            return;
+        }
+        size_t first = bucketFor(low);
+        size_t last = std::min(bucketFor(high), buckets.size() - 1);
+        if (first > last) {
+            return;
+        }
+        for (size_t i = 0; i <= last - first; i++) {
+            const std::vector<uint32_t>& bucket = buckets[descending ? last - i : first + i];
+            if (!bucket.empty() && !visit(bucket)) {
+                return;
+            }
+        }
+    }
+};
+
+// Conjunction of predicates plus ordering; unset predicates match all
+struct VehicleQuery {
+    int kind;                    // VehicleKind or -1
+    int minYear, maxYear;
+    std::string brand;           // empty: any
+    int minBattery, maxBattery;  // kWh; electric cars only
+    int minRange, maxRange;      // miles; electric cars only
+    double minPrice, maxPrice;
+    int autoPilot;               // -1 any, 0 or 1; luxury cars only
+    int massageSeats;
+    VehicleOrder order;
+    size_t maxResults;           // 0: all
+
+    VehicleQuery()
+        : kind(-1), minYear(INT_MIN), maxYear(INT_MAX), minBattery(INT_MIN), maxBattery(INT_MAX),
+          minRange(INT_MIN), maxRange(INT_MAX), minPrice(-HUGE_VAL), maxPrice(HUGE_VAL), autoPilot(-1),
+          massageSeats(-1), order(kOrderNone), maxResults(0) {}
+
+    VehicleQuery& whereKind(VehicleKind k) { kind = k; return *this; }
+    VehicleQuery& whereYear(int low, int high) { minYear = low; maxYear = high; return *this; }
+    VehicleQuery& whereBrand(const std::string& name) { brand = name; return *this; }
+    VehicleQuery& whereBatteryCapacity(int low, int high) { minBattery = low; maxBattery = high; return *this; }
+    VehicleQuery& whereRange(int low, int high) { minRange = low; maxRange = high; return *this; }
+    VehicleQuery& wherePrice(double low, double high) { minPrice = low; maxPrice = high; return *this; }
+    VehicleQuery& whereAutoPilot(bool value) { autoPilot = value ? 1 : 0; return *this; }
+    VehicleQuery& whereMassageSeats(bool value) { massageSeats = value ? 1 : 0; return *this; }
+    VehicleQuery& orderBy(VehicleOrder value) { order = value; return *this; }
+    VehicleQuery& limit(size_t count) { maxResults = count; return *this; }
+
+    bool electricOnly() const {
+        return minBattery != INT_MIN || maxBattery != INT_MAX || minRange != INT_MIN || maxRange != INT_MAX;
+    }
+
+    bool luxuryOnly() const { return autoPilot >= 0 || massageSeats >= 0; }
+};
+
+struct VehicleQueryStats {
+    const char* plan;     // "scan", "index:<column>" or "price_walk"
+    size_t estimated;     // candidates the plan expected
+    size_t examined;      // rows checked against the predicate
+    size_t matched;       // before the limit
+};
+
+class VehicleInventory {
+private:
+    enum Option {
+        kMassageSeats = 1,
+        kAutoPilot = 2,
+    };
+
+    // Columns, by row id
+    std::vector<uint8_t> kinds;
+    std::vector<uint8_t> alive;
+    std::vector<int32_t> years;
+    std::vector<uint32_t> brands;
+    std::vector<uint32_t> models;
+    std::vector<double> basePrices;
+    std::vector<int32_t> batteryCapacities;   // electric only
+    std::vector<int32_t> ranges;              // electric only
+    std::vector<uint8_t> options;             // luxury only
+    std::vector<double> prices;               // materialized calculatePrice()
+    size_t liveRows;
+
+    // Every distinct brand and model once
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> nameIds;
+
+    BucketIndex kindIndex;
+    BucketIndex yearIndex;
+    BucketIndex brandIndex;
+    BucketIndex batteryIndex;
+    BucketIndex rangeIndex;
+    BucketIndex priceIndex;   // $1000 buckets
+
+    VehicleInventory(const VehicleInventory&);
+    VehicleInventory& operator=(const VehicleInventory&);
+
+    uint32_t intern(const std::string& name) {
+        std::unordered_map<std::string, uint32_t>::const_iterator found = nameIds.find(name);
+        if (found != nameIds.end()) {
+            return found->second;
+        }
+        uint32_t id = (uint32_t)names.size();
+        names.push_back(name);
+        nameIds.insert(std::make_pair(name, id));
+        return id;
+    }
+
+    // The formulas of vehicle.h
+    double computePrice(uint32_t row) const {
+        double price = basePrices[row];
+        if (kinds[row] == kVehicleElectric) {
+            price += batteryCapacities[row] * 100;
+        } else if (kinds[row] == kVehicleLuxury) {
+            if (options[row] & kMassageSeats) price += 5000;
+            if (options[row] & kAutoPilot) price += 8000;
+        }
+        return price;
+    }
+
+    static int64_t priceKey(double price) { return (int64_t)floor(price); }
+
+    void refreshPrice(uint32_t row) {
+        prices[row] = computePrice(row);
+        priceIndex.update(row, priceKey(prices[row]));
+    }
+
+    uint32_t addRow(VehicleKind kind, const std::string& brand, const std::string& model, int year,
+                    double basePrice, int batteryCapacity, int range, uint8_t optionBits) {
+        uint32_t row = (uint32_t)kinds.size();
+        kinds.push_back((uint8_t)kind);
+        alive.push_back(1);
+        years.push_back(year);
+        brands.push_back(intern(brand));
+        models.push_back(intern(model));
+        basePrices.push_back(basePrice);
+        batteryCapacities.push_back(batteryCapacity);
+        ranges.push_back(range);
+        options.push_back(optionBits);
+        prices.push_back(0.0);
+        liveRows++;
+        kindIndex.insert(row, kind);
+        yearIndex.insert(row, year);
+        brandIndex.insert(row, brands[row]);
+        if (kind == kVehicleElectric) {
+            batteryIndex.insert(row, batteryCapacity);
+            rangeIndex.insert(row, range);
+        }
+        refreshPrice(row);
+        return row;
+    }
+
+    bool live(uint32_t row) const { return row < kinds.size() && alive[row]; }
+
+    // Returns false with errno ENOENT for an unknown or removed row, EINVAL
+    // if it is not of the kind the attribute belongs to
+    bool check(uint32_t row, int kind) const {
+        if (!live(row)) {
+            errno = ENOENT;
+            return false;
+        }
+        if (kind >= 0 && kinds[row] != kind) {
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    bool matches(uint32_t row, const VehicleQuery& query, int64_t brand) const {
+        if (!alive[row]) {
+            return false;
+        }
+        int kind = kinds[row];
+        if ((query.kind >= 0 && kind != query.kind) || (query.electricOnly() && kind != kVehicleElectric) ||
+            (query.luxuryOnly() && kind != kVehicleLuxury)) {
+            return false;
+        }
+        if (years[row] < query.minYear || years[row] > query.maxYear || (brand >= 0 && brands[row] != brand) ||
+            prices[row] < query.minPrice || prices[row] > query.maxPrice) {
+            return false;
+        }
+        if (kind == kVehicleElectric &&
+            (batteryCapacities[row] < query.minBattery || batteryCapacities[row] > query.maxBattery ||
+             ranges[row] < query.minRange || ranges[row] > query.maxRange)) {
+            return false;
+        }
+        if (kind == kVehicleLuxury &&
+            ((query.autoPilot >= 0 && ((options[row] & kAutoPilot) != 0) != (query.autoPilot == 1)) ||
+             (query.massageSeats >= 0 && ((options[row] & kMassageSeats) != 0) != (query.massageSeats == 1)))) {
+            return false;
+        }
+        return true;
+    }
+
+    bool ranksBefore(uint32_t a, uint32_t b, VehicleOrder order) const {
+        if (prices[a] != prices[b]) {
+            return order == kOrderPriceDescending ? prices[a] > prices[b] : prices[a] < prices[b];
+        }
+        return a < b;
+    }
+
+    void sortRows(std::vector<uint32_t>& rows, VehicleOrder order, size_t limit) const {
+        if (order == kOrderNone) {
+            if (limit > 0 && rows.size() > limit) {
+                rows.resize(limit);
+            }
+            return;
+        }
+        struct Compare {
+            const VehicleInventory* inventory;
+            VehicleOrder order;
+            bool operator()(uint32_t a, uint32_t b) const { return inventory->ranksBefore(a, b, order); }
+        } compare = {this, order};
+        if (limit > 0 && rows.size() > limit) {
+            std::partial_sort(rows.begin(), rows.begin() + limit, rows.end(), compare);
+            rows.resize(limit);
+        } else {
+            std::sort(rows.begin(), rows.end(), compare);
+        }
+    }
+
+public:
+    VehicleInventory()
+        : liveRows(0), kindIndex(0, 1), yearIndex(1900, 1, 512), brandIndex(0, 1), batteryIndex(0, 1, 4096),
+          rangeIndex(0, 1, 4096), priceIndex(0, 1000) {}
+
+    uint32_t addVehicle(const std::string& brand, const std::string& model, int year, double basePrice) {
+        return addRow(kVehiclePlain, brand, model, year, basePrice, 0, 0, 0);
+    }
+
+    uint32_t addElectricCar(const std::string& brand, const std::string& model, int year, double basePrice,
+                            int batteryCapacity, int range) {
+        return addRow(kVehicleElectric, brand, model, year, basePrice, batteryCapacity, range, 0);
+    }
+
+    uint32_t addLuxuryCar(const std::string& brand, const std::string& model, int year, double basePrice,
+                          bool massageSeats, bool autoPilot) {
+        return addRow(kVehicleLuxury, brand, model, year, basePrice, 0, 0,
+                      (uint8_t)((massageSeats ? kMassageSeats : 0) | (autoPilot ? kAutoPilot : 0)));
+    }
+
+    // Copies an object of the vehicle.h hierarchy; returns its row id
+    uint32_t add(const Vehicle& vehicle) {
+        if (const ElectricCar* car = dynamic_cast<const ElectricCar*>(&vehicle)) {
+            return addElectricCar(car->getBrand(), car->getModel(), car->getYear(), car->getBasePrice(),
+                                  car->getBatteryCapacity(), car->getRange());
+        }
+        if (const LuxuryCar* car = dynamic_cast<const LuxuryCar*>(&vehicle)) {
+            return addLuxuryCar(car->getBrand(), car->getModel(), car->getYear(), car->getBasePrice(),
+                                car->getMassageSeats(), car->getAutoPilot());
+        }
+        return addVehicle(vehicle.getBrand(), vehicle.getModel(), vehicle.getYear(), vehicle.getBasePrice());
+    }
+
+    // Copies every vehicle of a mapped catalog
+    void addCatalog(const VehicleCatalog& catalog) {
+        for (size_t i = 0; i < catalog.count(kVehiclePlain); i++) {
+            VehicleView v = catalog.vehicle(i);
+            addVehicle(v.brand().str(), v.model().str(), v.year(), v.basePrice());
+        }
+        for (size_t i = 0; i < catalog.count(kVehicleElectric); i++) {
+            ElectricCarView v = catalog.electricCar(i);
+            addElectricCar(v.brand().str(), v.model().str(), v.year(), v.basePrice(), v.batteryCapacity(),
+                           v.range());
+        }
+        for (size_t i = 0; i < catalog.count(kVehicleLuxury); i++) {
+            LuxuryCarView v = catalog.luxuryCar(i);
+            addLuxuryCar(v.brand().str(), v.model().str(), v.year(), v.basePrice(), v.massageSeats(),
+                         v.autoPilot());
+        }
+    }
+
+    // Attribute changes: the price and the affected indexes are updated in
+    // place. Each returns false with errno ENOENT or EINVAL (see check()).
+    bool setBasePrice(uint32_t row, double basePrice) {
+        if (!check(row, -1)) return false;
+        basePrices[row] = basePrice;
+        refreshPrice(row);
+        return true;
+    }
+
+    bool setYear(uint32_t row, int year) {
+        if (!check(row, -1)) return false;
+        years[row] = year;
+        yearIndex.update(row, year);
+        return true;
+    }
+
+    bool setBrand(uint32_t row, const std::string& brand) {
+        if (!check(row, -1)) return false;
+        brands[row] = intern(brand);
+        brandIndex.update(row, brands[row]);
+        return true;
+    }
+
+    bool setBatteryCapacity(uint32_t row, int batteryCapacity) {
+        if (!check(row, kVehicleElectric)) return false;
+        batteryCapacities[row] = batteryCapacity;
+        batteryIndex.update(row, batteryCapacity);
+        refreshPrice(row);
+        return true;
+    }
+
+    bool setRange(uint32_t row, int range) {
+        if (!check(row, kVehicleElectric)) return false;
+        ranges[row] = range;
+        rangeIndex.update(row, range);
+        return true;
+    }
+
+    bool setLuxuryOptions(uint32_t row, bool massageSeats, bool autoPilot) {
+        if (!check(row, kVehicleLuxury)) return false;
+        options[row] = (uint8_t)((massageSeats ? kMassageSeats : 0) | (autoPilot ? kAutoPilot : 0));
+        refreshPrice(row);
+        return true;
+    }
+
+    bool remove(uint32_t row) {
+        if (!check(row, -1)) return false;
+        alive[row] = 0;
+        liveRows--;
+        kindIndex.erase(row);
+        yearIndex.erase(row);
+        brandIndex.erase(row);
+        batteryIndex.erase(row);
+        rangeIndex.erase(row);
+        priceIndex.erase(row);
+        return true;
+    }
+
+    size_t size() const { return liveRows; }
+    size_t rowCount() const { return kinds.size(); }   // including removed rows
+
+    bool isLive(uint32_t row) const { return live(row); }
+    VehicleKind kind(uint32_t row) const { return (VehicleKind)kinds[row]; }
+    double price(uint32_t row) const { return prices[row]; }
+    int year(uint32_t row) const { return years[row]; }
+    const std::string& brand(uint32_t row) const { return names[brands[row]]; }
+    const std::string& model(uint32_t row) const { return names[models[row]]; }
+    int batteryCapacity(uint32_t row) const { return batteryCapacities[row]; }
+    int range(uint32_t row) const { return ranges[row]; }
+
+    // Runs query into rows (row ids, in the requested order). With
+    // useIndexes false it always scans every row, for comparisons.
+    void run(const VehicleQuery& query, std::vector<uint32_t>& rows, VehicleQueryStats* stats = NULL,
+             bool useIndexes = true) const {
+        rows.clear();
+        VehicleQueryStats local = {"scan", kinds.size(), 0, 0};
+        int64_t brand = -1;
+        if (!query.brand.empty()) {
+            std::unordered_map<std::string, uint32_t>::const_iterator found = nameIds.find(query.brand);
+            if (found == nameIds.end()) {
+                local.estimated = 0;
+                if (stats) *stats = local;
+                return;   // no such brand
+            }
+            brand = found->second;
+        }
+
+        // Candidates each usable index would hand over
+        const BucketIndex* best = NULL;
+        int64_t bestLow = 0;
+        int64_t bestHigh = 0;
+        double selectivity = 1.0;
+        size_t total = std::max<size_t>(liveRows, 1);
+        struct Candidate {
+            const BucketIndex* index;
+            const char* plan;
+            int64_t low;
+            int64_t high;
+            bool used;
+        } candidates[] = {
+            {&kindIndex, "index:kind", query.kind, query.kind, query.kind >= 0},
+            {&yearIndex, "index:year", query.minYear, query.maxYear,
+             query.minYear != INT_MIN || query.maxYear != INT_MAX},
+            {&brandIndex, "index:brand", brand, brand, brand >= 0},
+            {&batteryIndex, "index:battery", query.minBattery, query.maxBattery,
+             query.minBattery != INT_MIN || query.maxBattery != INT_MAX},
+            {&rangeIndex, "index:range", query.minRange, query.maxRange,
+             query.minRange != INT_MIN || query.maxRange != INT_MAX},
+            {&priceIndex, "index:price", priceKey(std::max(query.minPrice, -9e18)),
+             priceKey(std::min(query.maxPrice, 9e18)), query.minPrice > -HUGE_VAL || query.maxPrice < HUGE_VAL},
+        };
+        for (size_t c = 0; useIndexes && c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+            if (!candidates[c].used) {
+                continue;
+            }
+            size_t count = candidates[c].index->count(candidates[c].low, candidates[c].high);
+            selectivity *= (double)count / total;   // assumes independent columns
+            if (count < local.estimated) {
+                local.estimated = count;
+                local.plan = candidates[c].plan;
+                best = candidates[c].index;
+                bestLow = candidates[c].low;
+                bestHigh = candidates[c].high;
+            }
+        }
+
+        // A price-ordered top-k can instead walk the price buckets in order
+        // and stop at k matches: about k / selectivity rows if price were
+        // independent of the other columns. It is not (an electric car's
+        // price includes its battery), so the walk has to win by a margin.
+        bool descending = query.order == kOrderPriceDescending;
+        if (useIndexes && query.order != kOrderNone && query.maxResults > 0) {
+            double walk = selectivity > 0 ? query.maxResults / selectivity : HUGE_VAL;
+            if (walk * 8 < local.estimated) {
+                local.plan = "price_walk";
+                local.estimated = (size_t)walk;
+                std::vector<uint32_t> bucketRows;
+                priceIndex.scan(priceKey(std::max(query.minPrice, -9e18)), priceKey(std::min(query.maxPrice, 9e18)),
+                                descending, [&](const std::vector<uint32_t>& bucket) {
+                    bucketRows.clear();
+                    for (size_t i = 0; i < bucket.size(); i++) {
+                        if (matches(bucket[i], query, brand)) {
+                            bucketRows.push_back(bucket[i]);
+                        }
+                    }
+                    local.examined += bucket.size();
+                    local.matched += bucketRows.size();
+                    // Buckets are ordered, rows within one are not
+                    sortRows(bucketRows, query.order, 0);
+                    rows.insert(rows.end(), bucketRows.begin(), bucketRows.end());
+                    return rows.size() < query.maxResults;
+                });
+                if (rows.size() > query.maxResults) {
+                    rows.resize(query.maxResults);
+                }
+                if (stats) *stats = local;
+                return;
+            }
+        }
+
+        if (best) {
+            best->scan(bestLow, bestHigh, false, [&](const std::vector<uint32_t>& bucket) {
+                for (size_t i = 0; i < bucket.size(); i++) {
+                    if (matches(bucket[i], query, brand)) {
+                        rows.push_back(bucket[i]);
+                    }
+                }
+                local.examined += bucket.size();
+                return true;
+            });
+            if (query.order == kOrderNone) {
+                std::sort(rows.begin(), rows.end());   // same order as a scan
+            }
+        } else {
+            for (uint32_t row = 0; row < kinds.size(); row++) {
+                if (matches(row, query, brand)) {
+                    rows.push_back(row);
+                }
+            }
+            local.examined = kinds.size();
+        }
+        local.matched = rows.size();
+        sortRows(rows, query.order, query.maxResults);
+        if (stats) *stats = local;
+    }
+};
+
+#endif // VEHICLE_QUERY_H
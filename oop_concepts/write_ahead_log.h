@@ -0,0 +1,554 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define WAL_CRC32C_X86 1
+#endif
+
+// Append-only, checksummed log with group commit.
+//
+// Records are fixed 40-byte structs with a gap-free sequence number (LSN)
+// and a CRC32C, written to segment files "wal-<first LSN>.log" in a
+// directory. Durability is on commit():
+//
+//   WriteAheadLog log;
+//   log.open("data", 0, replayFunction);       // replays what is there
+//   uint64_t lsn = log.append(kDeposit, account, 0, cents);
+//   log.commit(lsn);                           // on disk when this returns
+//
+// Group commit: commit() calls from many threads share one write() +
+// fdatasync(). The first waiter becomes the leader and flushes everything
+// appended so far (at most setMaxGroup() records); the others wait for it,
+// and whoever still isn't covered leads the next flush. With 64 writers
+// one fsync acknowledges dozens of records instead of one.
+//
+// Replay mmap()s the segments. A crash can only tear the end of the last
+// segment: a bad record there with nothing valid after it is that tear,
+// and is truncated. A bad record anywhere else is corruption of committed
+// data, and open() fails with EIO without changing any file.
+//
+// Taking a snapshot calls rotate(), so the records after it start a new
+// segment; once the snapshot is durable, dropThrough() deletes the
+// segments it covers, and recovery reads only the log since the last
+// snapshot.
+//
+// Failing calls return false (append(): 0) and set errno. After a failed
+// write or fsync the log stays failed: the state on disk is unknown.
+
+// CRC32C (Castagnoli), with the SSE4.2 instruction where the CPU has it
+namespace wal_checksum {
+
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78u : 0);
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+inline uint32_t crc32cTable(uint32_t crc, const unsigned char* data, size_t size) {
+    static const Crc32cTable table;
+    for (size_t i = 0; i < size; i++) {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef WAL_CRC32C_X86
+
+__attribute__((target("sse4.2")))
+inline uint32_t crc32cSse42(uint32_t crc, const unsigned char* data, size_t size) {
+    uint64_t wide = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t)wide;
+    for (; size > 0; size--, data++) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+inline bool haveSse42() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+#endif // WAL_CRC32C_X86
+
+// CRC32C of the data that came before (crc) followed by data, so large
+// inputs can be checksummed in pieces
+inline uint32_t crc32cExtend(uint32_t crc, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+#ifdef WAL_CRC32C_X86
+    static const bool hardware = haveSse42();
+    if (hardware) {
+        return ~crc32cSse42(~crc, bytes, size);
+    }
+#endif
+    return ~crc32cTable(~crc, bytes, size);
+}
+
+inline uint32_t crc32c(const void* data, size_t size) { return crc32cExtend(0, data, size); }
+
+} // namespace wal_checksum
+
+struct WalRecord {
+    uint64_t lsn;       // 1, 2, 3, ... without gaps
+    uint32_t type;      // meaning is up to the user of the log
+    uint32_t checksum;  // CRC32C of the record with this field zero
+    int64_t args[3];
+};
+
+static_assert(sizeof(WalRecord) == 40, "WalRecord is an on-disk format");
+
+inline uint32_t walChecksum(WalRecord record) {
+    record.checksum = 0;
+    return wal_checksum::crc32c(&record, sizeof(record));
+}
+
+struct WalStats {
+    uint64_t records;    // appended since open()
+    uint64_t syncs;      // fdatasync() calls
+    uint64_t segments;   // segment files started since open()
+    uint64_t replayed;   // records passed to the replay function by open()
+    bool tornTail;       // open() truncated a partly written tail
+};
+
+class WriteAheadLog {
+public:
+    typedef std::function<bool(const WalRecord&)> ReplayFunction;
+
+    static const uint64_t kDefaultSegmentRecords = 1 << 20;   // 40 MB
+
+private:
+    std::string directory;
+    int fd;
+    uint64_t segmentLimit;
+    uint64_t segmentRecords;
+    size_t maxGroup;
+
+    std::mutex mutex;
+    std::condition_variable flushed;
+    std::vector<WalRecord> pending;   // appended, not yet written
+    std::vector<WalRecord> batch;     // being written by the leader
+    uint64_t lastLsn;
+    uint64_t durableLsn;
+    bool flushing;
+    int failure;
+    WalStats counters;
+
+    WriteAheadLog(const WriteAheadLog&);
+    WriteAheadLog& operator=(const WriteAheadLog&);
+
+    std::string segmentPath(uint64_t firstLsn) const {
+        char name[64];
+        snprintf(name, sizeof(name), "/wal-%020llu.log", (unsigned long long)firstLsn);
+        return directory + name;
+    }
+
+    // First LSNs of the segments in the directory, in order
+    bool listSegments(std::vector<uint64_t>& firsts) const {
+        firsts.clear();
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) {
+            return false;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            unsigned long long first;
+            char tail[8];
+            if (sscanf(entry->d_name, "wal-%20llu.%4s", &first, tail) == 2 &&
+                strcmp(tail, "log") == 0) {
+                firsts.push_back(first);
+            }
+        }
+        closedir(dir);
+        std::sort(firsts.begin(), firsts.end());
+        return true;
+    }
+
+    void syncDirectory() const {
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            ::close(dirFd);
+        }
+    }
+
+    // Returns 0 or an errno value. The caller counts the segment in
+    // counters under the mutex.
+    int startSegment(uint64_t firstLsn) {
+        int newFd = ::open(segmentPath(firstLsn).c_str(),
+                           O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (newFd < 0) {
+            return errno;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = newFd;
+        segmentRecords = 0;
+        syncDirectory();
+        return 0;
+    }
+
+    // Replays the records of one segment above lastLsn. A bad record in the
+    // last segment with no valid record after it is a torn tail: the
+    // segment is truncated there and *torn set. Any other bad record is
+    // EIO. Returns 0 or an errno value.
+    int replaySegment(uint64_t firstLsn, bool lastSegment, const ReplayFunction& replay, bool* torn) {
+        std::string path = segmentPath(firstLsn);
+        int segmentFd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (segmentFd < 0) {
+            return errno;
+        }
+        struct stat info;
+        if (fstat(segmentFd, &info) != 0) {
+            int error = errno;
+            ::close(segmentFd);
+            return error;
+        }
+        size_t size = (size_t)info.st_size;
+        size_t count = size / sizeof(WalRecord);
+        size_t valid = 0;
+        int error = 0;
+        if (count > 0) {
+            void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, segmentFd, 0);
+            if (map == MAP_FAILED) {
+                error = errno;
+                ::close(segmentFd);
+                return error;
+            }
+            madvise(map, size, MADV_SEQUENTIAL);
+            const WalRecord* records = static_cast<const WalRecord*>(map);
+            uint64_t expected = firstLsn;
+            for (; valid < count; valid++, expected++) {
+                if (records[valid].lsn != expected || records[valid].checksum != walChecksum(records[valid])) {
+                    break;
+                }
+            }
+            // A tear leaves nothing intact behind it
+            bool tail = lastSegment;
+            for (size_t i = valid + 1; tail && i < count; i++) {
+                tail = records[i].checksum != walChecksum(records[i]);
+            }
+            if (valid < count && !tail) {
+                error = EIO;
+            }
+            for (size_t i = 0; error == 0 && i < valid; i++) {
+                const WalRecord& record = records[i];
+                if (record.lsn <= lastLsn) {
+                    continue;   // covered by the snapshot
+                }
+                errno = 0;
+                if (!replay(record)) {
+                    error = errno ? errno : EIO;
+                    break;
+                }
+                counters.replayed++;
+                lastLsn = record.lsn;
+            }
+            munmap(map, size);
+        }
+        if (error == 0 && valid * sizeof(WalRecord) != size && !lastSegment) {
+            error = EIO;   // a partial record before the end of the log
+        }
+        if (error == 0 && valid * sizeof(WalRecord) != size) {
+            *torn = true;
+            if (ftruncate(segmentFd, (off_t)(valid * sizeof(WalRecord))) != 0) {
+                error = errno;
+            } else {
+                fdatasync(segmentFd);
+            }
+        }
+        ::close(segmentFd);
+        return error;
+    }
+
+    // Writes and syncs batch; returns 0 or an errno value. Only the leader
+    // calls this, so it owns fd without holding the mutex. *newSegment is
+    // set if it had to start a segment.
+    int writeBatch(bool* newSegment) {
+        if (segmentRecords >= segmentLimit) {
+            int error = startSegment(batch[0].lsn);
+            if (error) {
+                return error;
+            }
+            *newSegment = true;
+        }
+        const char* data = reinterpret_cast<const char*>(&batch[0]);
+        size_t left = batch.size() * sizeof(WalRecord);
+        while (left > 0) {
+            ssize_t written = write(fd, data, left);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            data += written;
+            left -= (size_t)written;
+        }
+        if (fdatasync(fd) != 0) {
+            return errno;
+        }
+        segmentRecords += batch.size();
+        return 0;
+    }
+
+public:
+    WriteAheadLog()
+        : fd(-1), segmentLimit(kDefaultSegmentRecords), segmentRecords(0), maxGroup(0),
+          lastLsn(0), durableLsn(0), flushing(false), failure(0) {
+        memset(&counters, 0, sizeof(counters));
+    }
+
+    ~WriteAheadLog() { close(); }
+
+    // Opens (and creates) dir, passes every record with an LSN above
+    // afterLsn to replay in order, truncates a torn tail and starts a new
+    // segment for appends at the LSN after the last record, or after
+    // afterLsn if a snapshot is ahead of the log. replay returning false
+    // aborts with its errno; a corrupt record or a gap in the LSNs fails
+    // with EIO, and then no file is changed.
+    bool open(const std::string& dir, uint64_t afterLsn, const ReplayFunction& replay) {
+        if (fd >= 0) {
+            errno = EBUSY;
+            return false;
+        }
+        directory = dir;
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        std::vector<uint64_t> firsts;
+        if (!listSegments(firsts)) {
+            return false;
+        }
+        memset(&counters, 0, sizeof(counters));
+        lastLsn = afterLsn;
+
+        // Skip segments that the next one shows to be entirely <= afterLsn
+        size_t start = 0;
+        while (start + 1 < firsts.size() && firsts[start + 1] <= afterLsn + 1) {
+            start++;
+        }
+        if (start < firsts.size() && firsts[start] > afterLsn + 1) {
+            errno = EIO;   // records between the snapshot and the log are missing
+            return false;
+        }
+        for (size_t i = start; i < firsts.size(); i++) {
+            if (firsts[i] > lastLsn + 1) {
+                errno = EIO;   // the previous segment ends early
+                return false;
+            }
+            bool torn = false;
+            int error = replaySegment(firsts[i], i + 1 == firsts.size(), replay, &torn);
+            if (error) {
+                errno = error;
+                return false;
+            }
+            counters.tornTail = counters.tornTail || torn;
+        }
+
+        durableLsn = lastLsn;
+        int error = startSegment(lastLsn + 1);
+        if (error) {
+            errno = error;
+            return false;
+        }
+        counters.segments++;
+        return true;
+    }
+
+    // Queues a record and returns its LSN (0 with errno if the log is not
+    // open or has failed). Not durable before commit().
+    uint64_t append(uint32_t type, int64_t a, int64_t b, int64_t c) {
+        WalRecord record;
+        record.type = type;
+        record.args[0] = a;
+        record.args[1] = b;
+        record.args[2] = c;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0 || failure) {
+            errno = failure ? failure : EBADF;
+            return 0;
+        }
+        record.lsn = ++lastLsn;
+        record.checksum = walChecksum(record);
+        pending.push_back(record);
+        counters.records++;
+        return record.lsn;
+    }
+
+    // Waits until every record up to lsn is on disk, flushing a group of
+    // records itself if no other thread is doing so
+    bool commit(uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (lsn > lastLsn) {
+            errno = EINVAL;
+            return false;
+        }
+        while (durableLsn < lsn) {
+            if (failure) {
+                errno = failure;
+                return false;
+            }
+            if (flushing || pending.empty()) {
+                flushed.wait(lock);
+                continue;
+            }
+            flushing = true;
+            size_t take = pending.size();
+            if (maxGroup > 0 && take > maxGroup) {
+                take = maxGroup;
+            }
+            batch.assign(pending.begin(), pending.begin() + take);
+            pending.erase(pending.begin(), pending.begin() + take);
+            lock.unlock();
+            bool newSegment = false;
+            int error = writeBatch(&newSegment);
+            lock.lock();
+            flushing = false;
+            if (newSegment) {
+                counters.segments++;
+            }
+            if (error) {
+                failure = error;
+            } else {
+                durableLsn = batch.back().lsn;
+                counters.syncs++;
+            }
+            flushed.notify_all();
+        }
+        return true;
+    }
+
+    bool sync() {
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lsn = lastLsn;
+        }
+        return commit(lsn);
+    }
+
+    // Starts a new segment for the records not yet written, so that the
+    // current one ends here (nothing happens if it is empty)
+    bool rotate() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (flushing) {
+            flushed.wait(lock);   // the leader owns fd until it is done
+        }
+        if (fd < 0 || failure) {
+            errno = failure ? failure : EBADF;
+            return false;
+        }
+        if (segmentRecords == 0) {
+            return true;
+        }
+        int error = startSegment(pending.empty() ? lastLsn + 1 : pending.front().lsn);
+        if (error) {
+            failure = error;
+            errno = error;
+            return false;
+        }
+        counters.segments++;
+        return true;
+    }
+
+    // Deletes segments holding only records <= lsn; the newest segment is
+    // always kept
+    bool dropThrough(uint64_t lsn) {
+        std::vector<uint64_t> firsts;
+        if (!listSegments(firsts)) {
+            return false;
+        }
+        for (size_t i = 0; i + 1 < firsts.size() && firsts[i + 1] <= lsn + 1; i++) {
+            if (unlink(segmentPath(firsts[i]).c_str()) != 0 && errno != ENOENT) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Flushes what is queued and closes the segment
+    void close() {
+        if (fd < 0) {
+            return;
+        }
+        sync();
+        std::lock_guard<std::mutex> lock(mutex);
+        ::close(fd);
+        fd = -1;
+    }
+
+    // Records per flush: 1 syncs every record on its own, 0 (the default)
+    // takes everything that is queued
+    void setMaxGroup(size_t records) {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxGroup = records;
+    }
+
+    // Records per segment file before a new one is started
+    void setSegmentRecords(uint64_t records) {
+        std::lock_guard<std::mutex> lock(mutex);
+        segmentLimit = records > 0 ? records : 1;
+    }
+
+    // False with the log's errno if append() would fail: not open, or
+    // failed
+    bool writable() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0 || failure) {
+            errno = failure ? failure : EBADF;
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t lastSequence() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lastLsn;
+    }
+
+    uint64_t durableSequence() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return durableLsn;
+    }
+
+    WalStats stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    const std::string& path() const { return directory; }
+};
+
+#endif // WRITE_AHEAD_LOG_H
@@ -0,0 +1,178 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string.h>
+#include "batch_spawn.h"
+
+// xargs -P style batch runner built on posix_spawn (see batch_spawn.h).
+//
+// With a command after "--", every input line is appended to it as one
+// argument:
+//   find . -name '*.png' | ./batch_spawn -P 8 -- optipng -quiet
+// Without one, every input line is a whole command, split on whitespace:
+//   ./batch_spawn -P 16 --commands jobs.txt --output-dir logs
+//
+// Options:
+//   -P N               jobs to run in parallel (default: number of CPUs)
+//   --commands FILE    read input lines from FILE instead of stdin
+//   --output-dir DIR   write job i's stdout/stderr to DIR/i.out and DIR/i.err
+//   --timeout MS       kill jobs that run longer than MS milliseconds
+//   --pgroup           start every job in its own process group
+//   --json             print the summary as JSON on stdout
+//
+// Exit status is 0 if every job succeeded and 123 otherwise, like xargs.
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [-P N] [--commands FILE] [--output-dir DIR]"
+              << " [--timeout MS] [--pgroup] [--json] [-- command [args...]]" << std::endl;
+}
+
+static std::vector<std::string> splitWords(const std::string& line) {
+    std::vector<std::string> words;
+    std::istringstream stream(line);
+    std::string word;
+    while (stream >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+int main(int argc, char* argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t parallelism = cpus > 0 ? (size_t)cpus : 1;
+    std::string commandsFile;
+    std::string outputDir;
+    int timeoutMs = 0;
+    bool processGroup = false;
+    bool json = false;
+    std::vector<std::string> baseCommand;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--") {
+            for (int j = i + 1; j < argc; j++) {
+                baseCommand.push_back(argv[j]);
+            }
+            break;
+        } else if (arg == "--pgroup") {
+            processGroup = true;
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (i + 1 < argc && arg == "-P") {
+            parallelism = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && arg == "--commands") {
+            commandsFile = argv[++i];
+        } else if (i + 1 < argc && arg == "--output-dir") {
+            outputDir = argv[++i];
+        } else if (i + 1 < argc && arg == "--timeout") {
+            timeoutMs = atoi(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (parallelism == 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream file;
+    if (!commandsFile.empty()) {
+        file.open(commandsFile.c_str());
+        if (!file) {
+            std::cerr << "Cannot open " << commandsFile << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+    std::istream& input = commandsFile.empty() ? std::cin : file;
+
+    // Every running job holds a pidfd and possibly two output files
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < parallelism * 3 + 64) {
+        limit.rlim_cur = limit.rlim_max < parallelism * 3 + 64 ? limit.rlim_max : parallelism * 3 + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    size_t jobNumber = 0;
+    BatchSpawner::JobSource source = [&](BatchJob& job) {
+        std::string line;
+        while (std::getline(input, line)) {
+            if (baseCommand.empty()) {
+                job.argv = splitWords(line);
+            } else if (!line.empty()) {
+                job.argv = baseCommand;
+                job.argv.push_back(line);
+            } else {
+                continue;
+            }
+            if (job.argv.empty()) {
+                continue;
+            }
+            if (!outputDir.empty()) {
+                std::ostringstream prefix;
+                prefix << outputDir << "/" << jobNumber;
+                job.stdoutPath = prefix.str() + ".out";
+                job.stderrPath = prefix.str() + ".err";
+            }
+            job.timeoutMs = timeoutMs;
+            jobNumber++;
+            return true;
+        }
+        return false;
+    };
+
+    BatchSpawner spawner(parallelism);
+    spawner.setOwnProcessGroup(processGroup);
+    spawner.setJobCallback([](const BatchJob& job, const ChildExit& result) {
+        if (result.pid < 0) {
+            std::cerr << job.argv[0] << ": " << strerror(result.launchError) << std::endl;
+        } else if (result.waitError) {
+            std::cerr << job.argv[0] << ": waitid: " << strerror(result.waitError) << std::endl;
+        } else if (result.timedOut) {
+            std::cerr << job.argv[0] << ": killed after timeout" << std::endl;
+        } else if (WIFSIGNALED(result.status)) {
+            std::cerr << job.argv[0] << ": terminated by signal " << WTERMSIG(result.status) << std::endl;
+        }
+    });
+
+    BatchStats stats;
+    if (!spawner.run(source, stats)) {
+        std::cerr << "Could not start supervisor: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::cerr << std::fixed << std::setprecision(2)
+              << stats.jobs << " jobs in " << stats.seconds << " s ("
+              << stats.jobsPerSec << " jobs/s, " << parallelism << " parallel): "
+              << stats.succeeded << " succeeded, " << stats.failed << " failed, "
+              << stats.timedOut << " timed out, " << stats.launchErrors << " not started; "
+              << "latency p50 " << stats.latencyP50Ms << " ms, p99 "
+              << stats.latencyP99Ms << " ms; CPU user " << stats.userSeconds
+              << " s, sys " << stats.systemSeconds << " s" << std::endl;
+    if (json) {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "{\"jobs\": " << stats.jobs << ", \"parallelism\": " << parallelism
+                  << ", \"succeeded\": " << stats.succeeded << ", \"failed\": " << stats.failed
+                  << ", \"timed_out\": " << stats.timedOut
+                  << ", \"launch_errors\": " << stats.launchErrors
+                  << ", \"seconds\": " << stats.seconds
+                  << ", \"jobs_per_sec\": " << stats.jobsPerSec
+                  << ", \"latency_p50_ms\": " << stats.latencyP50Ms
+                  << ", \"latency_p99_ms\": " << stats.latencyP99Ms
+                  << ", \"latency_max_ms\": " << stats.latencyMaxMs
+                  << ", \"user_sec\": " << stats.userSeconds
+                  << ", \"sys_sec\": " << stats.systemSeconds << "}" << std::endl;
+    }
+
+    return stats.jobs == stats.succeeded ? 0 : 123;
+}
@@ -0,0 +1,208 @@
+#ifndef BATCH_SPAWN_H
+#define BATCH_SPAWN_H
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "child_supervisor.h"
+
+// Runs a stream of commands with N-way parallelism, like "xargs -P N".
+//
+// Each job is started with posix_spawnp():
+//   - posix_spawn_file_actions redirect stdin from /dev/null and, if asked,
+//     stdout/stderr into per-job files
+//   - posix_spawnattr resets the signal mask and all signal dispositions,
+//     and can put every job into its own process group
+// Jobs are pulled from a source callback only when a slot is about to free
+// up, so millions of jobs never sit in memory at once. Scheduling, reaping
+// and timeouts are done by ChildSupervisor (pidfd + epoll): a slow job only
+// occupies its own slot while fast jobs keep flowing through the others.
+
+struct BatchJob {
+    std::vector<std::string> argv;
+    std::string stdoutPath;  // empty: inherit
+    std::string stderrPath;  // empty: inherit
+    int timeoutMs;           // 0: no timeout
+
+    BatchJob() : timeoutMs(0) {}
+};
+
+struct BatchStats {
+    size_t jobs;
+    size_t succeeded;
+    size_t failed;
+    size_t timedOut;
+    size_t launchErrors;
+    double seconds;
+    double jobsPerSec;
+    double latencyP50Ms;
+    double latencyP99Ms;
+    double latencyMaxMs;
+    double userSeconds;    // CPU time of all jobs, from their rusage
+    double systemSeconds;
+};
+
+class BatchSpawner {
+public:
+    // Fills job and returns true, or returns false when the input is exhausted
+    typedef std::function<bool(BatchJob& job)> JobSource;
+    // Called for every finished job, e.g. to print failures
+    typedef std::function<void(const BatchJob& job, const ChildExit& result)> JobCallback;
+
+private:
+    size_t parallelism;
+    bool ownProcessGroup;
+    JobCallback onJobDone;
+
+    BatchSpawner(const BatchSpawner&);
+    BatchSpawner& operator=(const BatchSpawner&);
+
+    pid_t spawnJob(const BatchJob& job) {
+        if (job.argv.empty()) {
+            errno = EINVAL;
+            return -1;
+        }
+        std::vector<char*> args;
+        for (size_t i = 0; i < job.argv.size(); i++) {
+            args.push_back((char*)job.argv[i].c_str());
+        }
+        args.push_back(NULL);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        if (!job.stdoutPath.empty()) {
+            posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, job.stdoutPath.c_str(),
+                                             O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (!job.stderrPath.empty()) {
+            if (job.stderrPath == job.stdoutPath) {
+                posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+            } else {
+                posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, job.stderrPath.c_str(),
+                                                 O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            }
+        }
+
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+        sigset_t mask;
+        sigemptyset(&mask);
+        posix_spawnattr_setsigmask(&attr, &mask);
+        sigset_t defaults;
+        sigfillset(&defaults);
+        posix_spawnattr_setsigdefault(&attr, &defaults);
+        if (ownProcessGroup) {
+            flags |= POSIX_SPAWN_SETPGROUP;
+            posix_spawnattr_setpgroup(&attr, 0);
+        }
+        posix_spawnattr_setflags(&attr, flags);
+
+        pid_t pid;
+        int rc = posix_spawnp(&pid, args[0], &actions, &attr, &args[0], environ);
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        if (rc != 0) {
+            errno = rc;
+            return -1;
+        }
+        return pid;
+    }
+
+    static double percentileMs(std::vector<double>& seconds, double p) {
+        if (seconds.empty()) {
+            return 0.0;
+        }
+        size_t index = (size_t)(p * (seconds.size() - 1) + 0.5);
+        std::nth_element(seconds.begin(), seconds.begin() + index, seconds.end());
+        return seconds[index] * 1000.0;
+    }
+
+public:
+    explicit BatchSpawner(size_t jobs)
+        : parallelism(jobs > 0 ? jobs : 1), ownProcessGroup(false) {}
+
+    // Put each job into a new process group, so terminal signals and
+    // group-wide kill() calls aimed at us do not hit it (and vice versa)
+    void setOwnProcessGroup(bool enabled) { ownProcessGroup = enabled; }
+
+    void setJobCallback(JobCallback callback) { onJobDone = callback; }
+
+    // Runs every job from source to completion. Returns false with errno
+    // set if the supervisor could not be created or could not wait for the
+    // jobs.
+    bool run(JobSource source, BatchStats& stats) {
+        ChildSupervisor supervisor(parallelism);
+        if (!supervisor.valid()) {
+            return false;
+        }
+
+        stats = BatchStats();
+        std::vector<double> latencies;
+        bool exhausted = false;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (;;) {
+            // Keep the queue just deep enough to refill every free slot
+            while (!exhausted && supervisor.pendingCount() < parallelism) {
+                BatchJob job;
+                if (!source(job)) {
+                    exhausted = true;
+                    break;
+                }
+                stats.jobs++;
+                BatchSpawner* self = this;
+                supervisor.submit(
+                    [self, job](int*) { return self->spawnJob(job); },
+                    [self, job, &stats, &latencies](const ChildExit& result) {
+                        if (result.pid < 0) {
+                            stats.launchErrors++;
+                        } else if (result.timedOut) {
+                            stats.timedOut++;
+                        } else if (WIFEXITED(result.status) && WEXITSTATUS(result.status) == 0) {
+                            stats.succeeded++;
+                        } else {
+                            stats.failed++;
+                        }
+                        if (result.pid > 0) {
+                            latencies.push_back(result.wallSeconds);
+                            stats.userSeconds += result.usage.ru_utime.tv_sec +
+                                                 result.usage.ru_utime.tv_usec / 1e6;
+                            stats.systemSeconds += result.usage.ru_stime.tv_sec +
+                                                   result.usage.ru_stime.tv_usec / 1e6;
+                        }
+                        if (self->onJobDone) {
+                            self->onJobDone(job, result);
+                        }
+                    },
+                    job.timeoutMs);
+            }
+
+            int busy = supervisor.runOnce(-1);
+            if (busy < 0) {
+                return false;
+            }
+            if (!busy && exhausted) {
+                break;
+            }
+        }
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.jobsPerSec = stats.seconds > 0 ? stats.jobs / stats.seconds : 0.0;
+        stats.latencyP50Ms = percentileMs(latencies, 0.50);
+        stats.latencyP99Ms = percentileMs(latencies, 0.99);
+        stats.latencyMaxMs = latencies.empty() ? 0.0 :
+            *std::max_element(latencies.begin(), latencies.end()) * 1000.0;
+        return true;
+    }
+};
+
+#endif // BATCH_SPAWN_H
@@ -0,0 +1,188 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "output_capture.h"
+
+// Output-capture throughput benchmark: popen() + stdio with the 128-byte
+// buffer of popen_example.cpp against the OutputCapture paths in output_capture.h.
+//
+// The child is "head -c <bytes> /dev/zero", so the benchmark measures how
+// fast the parent can drain a pipe, not how fast the child can compute.
+//
+// Usage:
+//   ./bench_capture [--mb 256] [--iterations 5] [--format json|csv]
+
+extern char **environ;
+
+typedef std::chrono::steady_clock Clock;
+
+struct CaptureResult {
+    std::string method;
+    size_t bytes;
+    double seconds;
+};
+
+static std::string byteCount(size_t bytes) {
+    std::ostringstream stream;
+    stream << bytes;
+    return stream.str();
+}
+
+// Baseline: shell + stdio with a 128-byte buffer, as in popen_example.cpp
+static size_t capturePopen(size_t bytes, std::string& output) {
+    std::string command = "head -c " + byteCount(bytes) + " /dev/zero";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        return 0;
+    }
+    std::array<char, 128> buffer;
+    // fread(), not fgets(): the zero bytes would hide where a line ends
+    size_t got;
+    while ((got = fread(buffer.data(), 1, buffer.size(), pipe)) > 0) {
+        output.append(buffer.data(), got);
+    }
+    pclose(pipe);
+    return output.size();
+}
+
+static bool startHead(OutputCapture& capture, size_t bytes) {
+    std::string count = byteCount(bytes);
+    char* args[] = {(char*)"head", (char*)"-c", (char*)count.c_str(), (char*)"/dev/zero", NULL};
+    return capture.start(args, environ);
+}
+
+// Contiguous buffer
+static size_t captureBuffer(size_t bytes, std::string& output) {
+    OutputCapture capture;
+    if (!startHead(capture, bytes) || !capture.readAll(output)) {
+        return 0;
+    }
+    capture.finish();
+    return output.size();
+}
+
+// Chunk stream, consumed without copying
+static size_t captureChunks(size_t bytes, std::string&) {
+    OutputCapture capture;
+    size_t total = 0;
+    if (!startHead(capture, bytes)) {
+        return 0;
+    }
+    capture.readChunks([&total](const char*, size_t size) { total += size; });
+    capture.finish();
+    return total;
+}
+
+// splice() into a memfd, never touching the data in user space
+static size_t captureSpliceMemfd(size_t bytes, std::string&) {
+    int memfd = memfd_create("bench_capture", MFD_CLOEXEC);
+    if (memfd < 0) {
+        return 0;
+    }
+    OutputCapture capture;
+    long long total = 0;
+    if (startHead(capture, bytes)) {
+        total = capture.forwardTo(memfd);
+        capture.finish();
+    }
+    close(memfd);
+    return total > 0 ? (size_t)total : 0;
+}
+
+struct CaptureMethod {
+    const char* name;
+    size_t (*capture)(size_t, std::string&);
+};
+
+static const CaptureMethod kMethods[] = {
+    {"popen_fread", capturePopen},
+    {"capture_buffer", captureBuffer},
+    {"capture_chunks", captureChunks},
+    {"splice_memfd", captureSpliceMemfd},
+};
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = 256;
+    size_t iterations = 5;
+    std::string format = "json";
+    const char* usage = " [--mb 256] [--iterations 5] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--mb") {
+            megabytes = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (megabytes == 0 || iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
+    size_t bytes = megabytes * 1024 * 1024;
+    std::vector<CaptureResult> results;
+    for (size_t m = 0; m < sizeof(kMethods) / sizeof(kMethods[0]); m++) {
+        std::cerr << "Running " << kMethods[m].name << "..." << std::endl;
+        CaptureResult result;
+        result.method = kMethods[m].name;
+        result.bytes = 0;
+        result.seconds = 0.0;
+        for (size_t i = 0; i < iterations; i++) {
+            std::string output;
+            Clock::time_point start = Clock::now();
+            size_t captured = kMethods[m].capture(bytes, output);
+            result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            result.bytes += captured;
+            if (captured < bytes - bytes % 127) {
+                std::cerr << kMethods[m].name << " captured only " << captured
+                          << " bytes: " << strerror(errno) << std::endl;
+            }
+        }
+        results.push_back(result);
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    if (format == "csv") {
+        std::cout << "method,bytes,seconds,mb_per_sec\n";
+    } else {
+        std::cout << "{\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const CaptureResult& r = results[i];
+        double mbPerSec = r.seconds > 0 ? r.bytes / (1024.0 * 1024.0) / r.seconds : 0.0;
+        if (format == "csv") {
+            std::cout << r.method << "," << r.bytes << "," << r.seconds << "," << mbPerSec << "\n";
+        } else {
+            std::cout << "    {\"method\": \"" << r.method << "\", \"bytes\": " << r.bytes
+                      << ", \"seconds\": " << r.seconds << ", \"mb_per_sec\": " << mbPerSec
+                      << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "fork_safe_memory.h"
+
+// fork() latency against the size of a large cache held by the parent,
+// for each ForkSafeRegion policy (fork_safe_memory.h).
+//
+// For every cache size the parent maps and touches a region, then calls
+// forkLite() repeatedly; the child exits right away. An inherited cache
+// makes fork() copy its page tables (less with huge pages); an excluded one
+// keeps fork() flat.
+//
+// Usage:
+//   ./bench_fork_memory [--cache-mb 64,256,1024] [--iterations 50]
+//                       [--policies inherit,inherit_huge,exclude,wipe] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct PolicyConfig {
+    const char* name;
+    ForkPolicy policy;
+    bool hugePages;
+};
+
+static const PolicyConfig kPolicies[] = {
+    {"inherit", kForkInherit, false},
+    {"inherit_huge", kForkInherit, true},
+    {"exclude", kForkExclude, false},
+    {"wipe", kForkWipe, false},
+};
+
+struct ForkResult {
+    std::string policy;
+    std::string hugePages;
+    size_t cacheMb;
+    size_t excludedBytes;
+    double forkP50Us;
+    double forkP99Us;
+    double roundtripP50Us;
+    double roundtripP99Us;
+};
+
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static const char* hugePageName(HugePageMode mode) {
+    return mode == kHugePagesExplicit ? "hugetlb" :
+           mode == kHugePagesTransparent ? "thp" : "none";
+}
+
+static bool measure(const PolicyConfig& config, size_t cacheMb, size_t iterations, ForkResult& result) {
+    ForkSafeRegion cache(cacheMb * 1024 * 1024, config.policy, config.hugePages);
+    if (!cache.valid()) {
+        return false;
+    }
+    // Fault every page in, as a filled cache would be
+    memset(cache.data(), 0x5A, cache.size());
+
+    std::vector<double> forkUs;
+    std::vector<double> roundtripUs;
+    ForkLiteReport report;
+    for (size_t i = 0; i < iterations; i++) {
+        Clock::time_point start = Clock::now();
+        pid_t pid = forkLite(&report);
+        if (pid < 0) {
+            return false;
+        }
+        if (pid == 0) {
+            _exit(0);
+        }
+        waitpid(pid, NULL, 0);
+        forkUs.push_back(report.forkMicros);
+        roundtripUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+
+    result.policy = config.name;
+    result.hugePages = hugePageName(cache.hugePages());
+    result.cacheMb = cacheMb;
+    result.excludedBytes = report.excludedBytes;
+    result.forkP50Us = percentile(forkUs, 0.50);
+    result.forkP99Us = percentile(forkUs, 0.99);
+    result.roundtripP50Us = percentile(roundtripUs, 0.50);
+    result.roundtripP99Us = percentile(roundtripUs, 0.99);
+    return true;
+}
+
+static std::vector<std::string> splitList(const char* list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> cacheSizes = splitList("64,256,1024");
+    std::vector<std::string> policyNames;
+    size_t iterations = 50;
+    std::string format = "json";
+    const char* usage = " [--cache-mb 64,256,1024] [--iterations 50]"
+                        " [--policies inherit,inherit_huge,exclude,wipe] [--format json|csv]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--cache-mb") {
+            cacheSizes = splitList(argv[i + 1]);
+        } else if (arg == "--iterations") {
+            iterations = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--policies") {
+            policyNames = splitList(argv[i + 1]);
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+    if (iterations == 0 || (format != "json" && format != "csv")) {
+        std::cerr << "Usage: " << argv[0] << " [--iterations N] [--format json|csv]" << std::endl;
+        return 1;
+    }
+
+    std::vector<ForkResult> results;
+    for (size_t s = 0; s < cacheSizes.size(); s++) {
+        size_t cacheMb = strtoul(cacheSizes[s].c_str(), NULL, 10);
+        for (size_t p = 0; p < sizeof(kPolicies) / sizeof(kPolicies[0]); p++) {
+            const PolicyConfig& config = kPolicies[p];
+            if (!policyNames.empty() &&
+                std::find(policyNames.begin(), policyNames.end(), config.name) == policyNames.end()) {
+                continue;
+            }
+            std::cerr << "Forking with a " << cacheMb << " MB " << config.name << " cache..." << std::endl;
+            ForkResult result;
+            if (!measure(config, cacheMb, iterations, result)) {
+                std::cerr << "Could not set up " << config.name << " cache of " << cacheMb
+                          << " MB: " << strerror(errno) << std::endl;
+                continue;
+            }
+            results.push_back(result);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    if (format == "csv") {
+        std::cout << "policy,huge_pages,cache_mb,excluded_bytes,fork_p50_us,fork_p99_us,"
+                     "roundtrip_p50_us,roundtrip_p99_us\n";
+    } else {
+        std::cout << "{\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const ForkResult& r = results[i];
+        if (format == "csv") {
+            std::cout << r.policy << "," << r.hugePages << "," << r.cacheMb << "," << r.excludedBytes
+                      << "," << r.forkP50Us << "," << r.forkP99Us << "," << r.roundtripP50Us << ","
+                      << r.roundtripP99Us << "\n";
+        } else {
+            std::cout << "    {\"policy\": \"" << r.policy << "\", \"huge_pages\": \"" << r.hugePages
+                      << "\", \"cache_mb\": " << r.cacheMb << ", \"excluded_bytes\": " << r.excludedBytes
+                      << ", \"fork_p50_us\": " << r.forkP50Us << ", \"fork_p99_us\": " << r.forkP99Us
+                      << ", \"roundtrip_p50_us\": " << r.roundtripP50Us
+                      << ", \"roundtrip_p99_us\": " << r.roundtripP99Us << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
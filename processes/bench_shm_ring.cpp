@@ -0,0 +1,363 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "shm_ring.h"
+#include "spawn_stats.h"
+
+// Parent <-> forked child transfer benchmark: ShmRing (shm_ring.h) against
+// a pipe.
+//
+// Throughput: P forked producers send fixed-size records to the parent as
+// fast as they can. Pipe producers write() each record (atomic up to
+// PIPE_BUF) and the parent read()s 64 KB at a time.
+// Latency: the parent and one child bounce a record back and forth over two
+// rings / two pipes; the round-trip times go into a LatencyHistogram.
+//
+// Usage:
+//   ./bench_shm_ring [--messages 1000000] [--size 64] [--producers 1,4]
+//                    [--roundtrips 20000] [--format json|csv]
+
+typedef std::chrono::steady_clock Clock;
+
+struct TransferResult {
+    std::string transport;
+    size_t producers;
+    size_t messages;
+    double seconds;
+    double rttP50Us;
+    double rttP99Us;
+};
+
+static bool waitForChildren(const std::vector<pid_t>& pids) {
+    bool ok = true;
+    for (size_t i = 0; i < pids.size(); i++) {
+        int status;
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Returns the number of records the parent received, or 0 on error
+static size_t throughputRing(size_t messages, size_t size, size_t producers) {
+    ShmRing ring(4096, size, (unsigned)producers);
+    if (!ring.valid()) {
+        return 0;
+    }
+
+    std::vector<pid_t> pids;
+    for (size_t p = 0; p < producers; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            return 0;
+        }
+        if (pid == 0) {
+            std::vector<char> record(size, 'r');
+            size_t count = messages / producers + (p < messages % producers ? 1 : 0);
+            for (size_t i = 0; i < count; i++) {
+                memcpy(&record[0], &i, size < sizeof(i) ? size : sizeof(i));
+                if (!ring.push(&record[0], size)) {
+                    _exit(1);
+                }
+            }
+            ring.closeProducer();
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+
+    std::vector<char> buffer(size);
+    size_t received = 0;
+    while (ring.pop(&buffer[0], size) >= 0) {
+        received++;
+    }
+    if (errno != EPIPE || !waitForChildren(pids)) {
+        return 0;
+    }
+    return received;
+}
+
+static size_t throughputPipe(size_t messages, size_t size, size_t producers) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return 0;
+    }
+
+    std::vector<pid_t> pids;
+    for (size_t p = 0; p < producers; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            return 0;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            std::vector<char> record(size, 'r');
+            size_t count = messages / producers + (p < messages % producers ? 1 : 0);
+            for (size_t i = 0; i < count; i++) {
+                memcpy(&record[0], &i, size < sizeof(i) ? size : sizeof(i));
+                if (!writeAll(fds[1], &record[0], size)) {
+                    _exit(1);
+                }
+            }
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    close(fds[1]);
+
+    std::vector<char> buffer(64 * 1024);
+    size_t bytes = 0;
+    for (;;) {
+        ssize_t n = read(fds[0], &buffer[0], buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        bytes += (size_t)n;
+    }
+    close(fds[0]);
+    if (!waitForChildren(pids)) {
+        return 0;
+    }
+    return bytes / size;
+}
+
+// Round trips parent -> child -> parent, one record in flight at a time
+static bool latencyRing(size_t roundtrips, size_t size, LatencyHistogram& histogram) {
+    ShmRing request(2, size, 1);
+    ShmRing reply(2, size, 1);
+    if (!request.valid() || !reply.valid()) {
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        std::vector<char> record(size);
+        while (request.pop(&record[0], size) >= 0) {
+            if (!reply.push(&record[0], size)) {
+                _exit(1);
+            }
+        }
+        _exit(errno == EPIPE ? 0 : 1);
+    }
+
+    std::vector<char> record(size, 'l');
+    bool ok = true;
+    for (size_t i = 0; i < roundtrips && ok; i++) {
+        Clock::time_point start = Clock::now();
+        ok = request.push(&record[0], size) && reply.pop(&record[0], size) >= 0;
+        histogram.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count());
+    }
+    request.closeProducer();
+    return waitForChildren(std::vector<pid_t>(1, pid)) && ok;
+}
+
+static bool latencyPipe(size_t roundtrips, size_t size, LatencyHistogram& histogram) {
+    int toChild[2];
+    int toParent[2];
+    if (pipe(toChild) < 0) {
+        return false;
+    }
+    if (pipe(toParent) < 0) {
+        close(toChild[0]);
+        close(toChild[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        close(toChild[1]);
+        close(toParent[0]);
+        std::vector<char> record(size);
+        while (readAll(toChild[0], &record[0], size)) {
+            if (!writeAll(toParent[1], &record[0], size)) {
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+    close(toChild[0]);
+    close(toParent[1]);
+
+    std::vector<char> record(size, 'l');
+    bool ok = true;
+    for (size_t i = 0; i < roundtrips && ok; i++) {
+        Clock::time_point start = Clock::now();
+        ok = writeAll(toChild[1], &record[0], size) && readAll(toParent[0], &record[0], size);
+        histogram.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count());
+    }
+    close(toChild[1]);
+    close(toParent[0]);
+    return waitForChildren(std::vector<pid_t>(1, pid)) && ok;
+}
+
+struct Transport {
+    const char* name;
+    size_t (*throughput)(size_t messages, size_t size, size_t producers);
+    bool (*latency)(size_t roundtrips, size_t size, LatencyHistogram& histogram);
+};
+
+static const Transport kTransports[] = {
+    {"shm_ring", throughputRing, latencyRing},
+    {"pipe", throughputPipe, latencyPipe},
+};
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--messages 1000000] [--size 64] [--producers 1,4]"
+                 " [--roundtrips 20000] [--format json|csv]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t messages = 1000000;
+    size_t size = 64;
+    size_t roundtrips = 20000;
+    std::vector<size_t> producerCounts;
+    std::string format = "json";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--messages") {
+            messages = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--size") {
+            size = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--roundtrips") {
+            roundtrips = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--producers") {
+            std::stringstream list(argv[i + 1]);
+            std::string count;
+            while (std::getline(list, count, ',')) {
+                producerCounts.push_back(strtoul(count.c_str(), NULL, 10));
+            }
+        } else if (arg == "--format") {
+            format = argv[i + 1];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (producerCounts.empty()) {
+        producerCounts.push_back(1);
+        producerCounts.push_back(4);
+    }
+    // Larger pipe writes are no longer atomic, so records could interleave
+    if (messages == 0 || size == 0 || size > PIPE_BUF || roundtrips == 0 ||
+        (format != "json" && format != "csv")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<TransferResult> results;
+    for (size_t t = 0; t < sizeof(kTransports) / sizeof(kTransports[0]); t++) {
+        std::cerr << "Measuring " << kTransports[t].name << " round trips..." << std::endl;
+        LatencyHistogram histogram;
+        if (!kTransports[t].latency(roundtrips, size, histogram)) {
+            std::cerr << kTransports[t].name << " latency run failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        for (size_t p = 0; p < producerCounts.size(); p++) {
+            size_t producers = producerCounts[p] > 0 ? producerCounts[p] : 1;
+            std::cerr << "Measuring " << kTransports[t].name << " with " << producers
+                      << " producer(s)..." << std::endl;
+            TransferResult result;
+            result.transport = kTransports[t].name;
+            result.producers = producers;
+            Clock::time_point start = Clock::now();
+            result.messages = kTransports[t].throughput(messages, size, producers);
+            result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            result.rttP50Us = histogram.percentile(0.50) / 1000.0;
+            result.rttP99Us = histogram.percentile(0.99) / 1000.0;
+            if (result.messages != messages) {
+                std::cerr << kTransports[t].name << " delivered " << result.messages << " of "
+                          << messages << " records" << std::endl;
+                return 1;
+            }
+            results.push_back(result);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    if (format == "csv") {
+        std::cout << "transport,producers,message_bytes,messages,seconds,msgs_per_sec,"
+                     "mb_per_sec,rtt_p50_us,rtt_p99_us\n";
+    } else {
+        std::cout << "{\n  \"results\": [\n";
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const TransferResult& r = results[i];
+        double perSec = r.seconds > 0 ? r.messages / r.seconds : 0.0;
+        double mbPerSec = perSec * size / (1024.0 * 1024.0);
+        if (format == "csv") {
+            std::cout << r.transport << "," << r.producers << "," << size << "," << r.messages << ","
+                      << r.seconds << "," << perSec << "," << mbPerSec << "," << r.rttP50Us << ","
+                      << r.rttP99Us << "\n";
+        } else {
+            std::cout << "    {\"transport\": \"" << r.transport << "\", \"producers\": " << r.producers
+                      << ", \"message_bytes\": " << size << ", \"messages\": " << r.messages
+                      << ", \"seconds\": " << r.seconds << ", \"msgs_per_sec\": " << perSec
+                      << ", \"mb_per_sec\": " << mbPerSec << ", \"rtt_p50_us\": " << r.rttP50Us
+                      << ", \"rtt_p99_us\": " << r.rttP99Us << "}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+    if (format != "csv") {
+        std::cout << "  ]\n}\n";
+    }
+
+    return 0;
+}
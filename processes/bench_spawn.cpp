@@ -0,0 +1,455 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "clone_launcher.h"
+#include "command_executor.h"
+#include "fork_server.h"
+
+// Spawn-latency benchmark covering every process creation method in this
+// directory. Each method launches the same tiny program (/bin/true) and waits
+// for it, so the numbers only differ by how expensive the launch path is.
+//
+// The parent's resident set is grown in steps (--rss-mb) by touching an
+// anonymous "ballast" mapping. fork() has to copy the page tables of all of
+// it, while vfork()/posix_spawn()/clone(CLONE_VM) do not, which makes the
+// copy-on-write cost visible as RSS grows. The fork_server method is started
+// before the ballast exists, so it forks from a small address space.
+//
+// Usage:
+//   ./bench_spawn [--iterations N] [--warmup N] [--rss-mb 10,100,1000]
+//                 [--methods fork_exec,vfork,...] [--format json|csv]
+
+extern char **environ;
+
+static const char* kProgram = "/bin/true";
+
+typedef std::chrono::steady_clock Clock;
+
+// Timing of a single launch, in microseconds
+struct SpawnSample {
+    double launchUs;     // time until the launching call returned in the parent
+    double roundTripUs;  // time until the child was reaped
+};
+
+static double elapsedUs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static bool reapChild(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// fork() + exec(), as in fork_exec.cpp
+static bool spawnForkExec(SpawnSample& sample) {
+    char* args[] = {(char*)kProgram, NULL};
+    Clock::time_point start = Clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        execve(kProgram, args, environ);
+        _exit(127);
+    }
+    sample.launchUs = elapsedUs(start, Clock::now());
+    bool ok = reapChild(pid);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    return ok;
+}
+
+// vfork() + exec(), as in vfork_example.cpp
+static bool spawnVfork(SpawnSample& sample) {
+    char* args[] = {(char*)kProgram, NULL};
+    Clock::time_point start = Clock::now();
+    pid_t pid = vfork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        execve(kProgram, args, environ);
+        _exit(127);
+    }
+    sample.launchUs = elapsedUs(start, Clock::now());
+    bool ok = reapChild(pid);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    return ok;
+}
+
+// posix_spawn(), as in posix_spawn_example.cpp
+static bool spawnPosixSpawn(SpawnSample& sample) {
+    char* args[] = {(char*)kProgram, NULL};
+    Clock::time_point start = Clock::now();
+    pid_t pid;
+    if (posix_spawn(&pid, kProgram, NULL, NULL, args, environ) != 0) {
+        return false;
+    }
+    sample.launchUs = elapsedUs(start, Clock::now());
+    bool ok = reapChild(pid);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    return ok;
+}
+
+// system(), as in system_example.cpp. Launch and wait are a single call.
+static bool spawnSystem(SpawnSample& sample) {
+    Clock::time_point start = Clock::now();
+    int status = system(kProgram);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    sample.launchUs = sample.roundTripUs;
+    return status == 0;
+}
+
+// system() replacement from command_executor.h: same command string, but
+// parsed here and spawned without /bin/sh
+static bool spawnExecutor(SpawnSample& sample) {
+    Clock::time_point start = Clock::now();
+    int status = executeCommand(kProgram);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    sample.launchUs = sample.roundTripUs;
+    return status == 0;
+}
+
+// popen(), as in popen_example.cpp
+static bool spawnPopen(SpawnSample& sample) {
+    Clock::time_point start = Clock::now();
+    FILE* pipe = popen(kProgram, "r");
+    if (!pipe) {
+        return false;
+    }
+    sample.launchUs = elapsedUs(start, Clock::now());
+    char buffer[128];
+    while (fread(buffer, 1, sizeof(buffer), pipe) > 0) {
+    }
+    int status = pclose(pipe);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    return status == 0;
+}
+
+// Real clone(CLONE_VM | CLONE_VFORK) through clone_launcher.h
+static CloneLauncher* cloneLauncher = NULL;
+
+static bool spawnClone(SpawnSample& sample) {
+    char* args[] = {(char*)kProgram, NULL};
+    Clock::time_point start = Clock::now();
+    pid_t pid = cloneLauncher->launch(kProgram, args, environ);
+    if (pid < 0) {
+        return false;
+    }
+    sample.launchUs = elapsedUs(start, Clock::now());
+    bool ok = reapChild(pid);
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    return ok;
+}
+
+// Launch through a fork server started before the ballast was allocated
+static ForkServer* forkServer = NULL;
+
+static bool spawnForkServer(SpawnSample& sample) {
+    char* args[] = {(char*)kProgram, NULL};
+    Clock::time_point start = Clock::now();
+    pid_t pid = forkServer->launch(args, environ);
+    if (pid < 0) {
+        return false;
+    }
+    sample.launchUs = elapsedUs(start, Clock::now());
+    int status;
+    bool ok = forkServer->wait(pid, &status) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    sample.roundTripUs = elapsedUs(start, Clock::now());
+    return ok;
+}
+
+struct SpawnMethod {
+    const char* name;
+    bool (*spawn)(SpawnSample&);
+};
+
+static const SpawnMethod kMethods[] = {
+    {"fork_exec", spawnForkExec},
+    {"vfork", spawnVfork},
+    {"posix_spawn", spawnPosixSpawn},
+    {"system", spawnSystem},
+    {"executor", spawnExecutor},
+    {"popen", spawnPopen},
+    {"clone", spawnClone},
+    {"fork_server", spawnForkServer},
+};
+
+// Aggregated result of one method at one RSS level
+struct BenchResult {
+    std::string method;
+    size_t ballastMb;
+    double rssMb;
+    size_t iterations;
+    size_t failures;
+    double spawnsPerSec;
+    double launchP50Us;
+    double launchP99Us;
+    double roundTripP50Us;
+    double roundTripP99Us;
+    double roundTripMaxUs;
+};
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+// Resident set size of this process in MB, read from /proc/self/statm
+static double currentRssMb() {
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0.0;
+    }
+    long pages = 0, resident = 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return (double)resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+// Anonymous memory touched page by page so it is resident and fully mapped
+class Ballast {
+private:
+    void* region;
+    size_t size;
+
+public:
+    Ballast() : region(NULL), size(0) {}
+    ~Ballast() { release(); }
+
+    bool resize(size_t megabytes) {
+        release();
+        if (megabytes == 0) {
+            return true;
+        }
+        size = megabytes * 1024 * 1024;
+        region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            region = NULL;
+            size = 0;
+            return false;
+        }
+        memset(region, 0xA5, size);
+        return true;
+    }
+
+    void release() {
+        if (region) {
+            munmap(region, size);
+            region = NULL;
+            size = 0;
+        }
+    }
+};
+
+static BenchResult runMethod(const SpawnMethod& method, size_t ballastMb,
+                             size_t iterations, size_t warmup) {
+    SpawnSample sample;
+    for (size_t i = 0; i < warmup; i++) {
+        method.spawn(sample);
+    }
+
+    std::vector<double> launch, roundTrip;
+    launch.reserve(iterations);
+    roundTrip.reserve(iterations);
+
+    BenchResult result;
+    result.method = method.name;
+    result.ballastMb = ballastMb;
+    result.rssMb = currentRssMb();
+    result.iterations = iterations;
+    result.failures = 0;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        if (!method.spawn(sample)) {
+            result.failures++;
+            continue;
+        }
+        launch.push_back(sample.launchUs);
+        roundTrip.push_back(sample.roundTripUs);
+    }
+    double totalUs = elapsedUs(start, Clock::now());
+
+    result.spawnsPerSec = totalUs > 0 ? iterations * 1e6 / totalUs : 0.0;
+    result.launchP50Us = percentile(launch, 0.50);
+    result.launchP99Us = percentile(launch, 0.99);
+    result.roundTripP50Us = percentile(roundTrip, 0.50);
+    result.roundTripP99Us = percentile(roundTrip, 0.99);
+    result.roundTripMaxUs = roundTrip.empty() ? 0.0 :
+        *std::max_element(roundTrip.begin(), roundTrip.end());
+    return result;
+}
+
+static void printCsv(const std::vector<BenchResult>& results) {
+    std::cout << "method,ballast_mb,rss_mb,iterations,failures,spawns_per_sec,"
+              << "launch_p50_us,launch_p99_us,roundtrip_p50_us,roundtrip_p99_us,"
+              << "roundtrip_max_us\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        std::cout << r.method << "," << r.ballastMb << "," << r.rssMb << ","
+                  << r.iterations << "," << r.failures << "," << r.spawnsPerSec << ","
+                  << r.launchP50Us << "," << r.launchP99Us << ","
+                  << r.roundTripP50Us << "," << r.roundTripP99Us << ","
+                  << r.roundTripMaxUs << "\n";
+    }
+}
+
+static void printJson(const std::vector<BenchResult>& results) {
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "{\n  \"program\": \"" << kProgram << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        std::cout << "    {\"method\": \"" << r.method << "\""
+                  << ", \"ballast_mb\": " << r.ballastMb
+                  << ", \"rss_mb\": " << r.rssMb
+                  << ", \"iterations\": " << r.iterations
+                  << ", \"failures\": " << r.failures
+                  << ", \"spawns_per_sec\": " << r.spawnsPerSec
+                  << ", \"launch_p50_us\": " << r.launchP50Us
+                  << ", \"launch_p99_us\": " << r.launchP99Us
+                  << ", \"roundtrip_p50_us\": " << r.roundTripP50Us
+                  << ", \"roundtrip_p99_us\": " << r.roundTripP99Us
+                  << ", \"roundtrip_max_us\": " << r.roundTripMaxUs << "}"
+                  << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}\n";
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--iterations N] [--warmup N]"
+              << " [--rss-mb 10,100,1000] [--methods m1,m2,...] [--format json|csv]\n"
+              << "Methods:";
+    for (size_t i = 0; i < sizeof(kMethods) / sizeof(kMethods[0]); i++) {
+        std::cerr << " " << kMethods[i].name;
+    }
+    std::cerr << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = 200;
+    size_t warmup = 10;
+    std::vector<std::string> rssLevels = splitList("10,100,1000");
+    std::vector<std::string> methodNames;
+    std::string format = "json";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--iterations") {
+            iterations = strtoul(value.c_str(), NULL, 10);
+        } else if (arg == "--warmup") {
+            warmup = strtoul(value.c_str(), NULL, 10);
+        } else if (arg == "--rss-mb") {
+            rssLevels = splitList(value);
+        } else if (arg == "--methods") {
+            methodNames = splitList(value);
+        } else if (arg == "--format") {
+            format = value;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (iterations == 0 || (format != "json" && format != "csv")) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<const SpawnMethod*> methods;
+    for (size_t i = 0; i < sizeof(kMethods) / sizeof(kMethods[0]); i++) {
+        if (methodNames.empty() ||
+            std::find(methodNames.begin(), methodNames.end(), kMethods[i].name) != methodNames.end()) {
+            methods.push_back(&kMethods[i]);
+        }
+    }
+    if (methods.empty()) {
+        std::cerr << "No known method selected" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    CloneLauncher launcher;
+    if (!launcher.valid()) {
+        std::cerr << "Could not allocate clone stack: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    cloneLauncher = &launcher;
+
+    // The fork server must be forked while we are still small
+    ForkServer server;
+    if (!server.start()) {
+        std::cerr << "Could not start fork server: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    forkServer = &server;
+
+    std::vector<BenchResult> results;
+    Ballast ballast;
+    for (size_t level = 0; level < rssLevels.size(); level++) {
+        size_t ballastMb = strtoul(rssLevels[level].c_str(), NULL, 10);
+        if (!ballast.resize(ballastMb)) {
+            std::cerr << "Could not allocate " << ballastMb << " MB of ballast: "
+                      << strerror(errno) << std::endl;
+            continue;
+        }
+        for (size_t m = 0; m < methods.size(); m++) {
+            std::cerr << "Running " << methods[m]->name << " with "
+                      << ballastMb << " MB ballast..." << std::endl;
+            results.push_back(runMethod(*methods[m], ballastMb, iterations, warmup));
+        }
+    }
+
+    if (format == "csv") {
+        printCsv(results);
+    } else {
+        printJson(results);
+    }
+
+    return 0;
+}
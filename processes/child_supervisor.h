@@ -0,0 +1,338 @@
+#ifndef CHILD_SUPERVISOR_H
+#define CHILD_SUPERVISOR_H
+
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <chrono>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "clone_launcher.h"
+
+extern char **environ;
+
+// Event-driven supervisor for many concurrent children, on a single thread.
+//
+// Every child is tracked through a pidfd registered with epoll. A pidfd
+// becomes readable when its process exits, and waitid(P_PIDFD) reaps exactly
+// that child, so there is no SIGCHLD handler, no waitpid(-1) race and no
+// thread per child. On top of that the supervisor
+//   - queues jobs beyond maxConcurrent and starts them as slots free up,
+//   - kills children that outlive their timeout (pidfd_send_signal), and
+//   - calls a completion callback with the exit status and rusage of each job.
+//
+//   ChildSupervisor supervisor(512);
+//   supervisor.submitCommand(args, onExit, 1000);
+//   supervisor.run();
+//
+// Each running child holds one fd, so RLIMIT_NOFILE must be above
+// maxConcurrent. Nothing else in the process may reap these children
+// (e.g. waitpid(-1)), or their exit status is lost and the job reports
+// ECHILD in waitError.
+
+// How a supervised job ended
+struct ChildExit {
+    uint64_t id;
+    pid_t pid;           // -1 if the launch failed
+    int status;          // waitpid()-style status, -1 if waitError is set
+    int launchError;     // errno of a failed launch, 0 otherwise
+    int waitError;       // errno of a failed waitid(); the child's fate is unknown
+    bool timedOut;       // killed by the supervisor after its timeout
+    double wallSeconds;  // launch to reap
+    struct rusage usage; // resources used by the child (zero if not started)
+};
+
+class ChildSupervisor {
+public:
+    // Starts a child and returns its PID, or -1 with errno set. It may store
+    // a pidfd for the child in *pidfd; otherwise one is opened with pidfd_open().
+    typedef std::function<pid_t(int* pidfd)> LaunchFunction;
+    typedef std::function<void(const ChildExit&)> ExitCallback;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t kLaunchBatch = 64;
+
+    struct Job {
+        uint64_t id;
+        LaunchFunction launch;
+        ExitCallback onExit;
+        int timeoutMs;
+    };
+
+    struct Running {
+        pid_t pid;
+        int pidfd;
+        bool timedOut;
+        Clock::time_point started;
+        Clock::time_point deadline;
+        ExitCallback onExit;
+    };
+
+    // (deadline, id); entries for children that are already gone are skipped
+    typedef std::pair<Clock::time_point, uint64_t> Deadline;
+
+    int epfd;
+    size_t maxConcurrent;
+    uint64_t nextId;
+    std::deque<Job> pending;
+    std::unordered_map<uint64_t, Running> running;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> > deadlines;
+    std::vector<struct epoll_event> events;
+    CloneLauncher launcher;
+
+    ChildSupervisor(const ChildSupervisor&);
+    ChildSupervisor& operator=(const ChildSupervisor&);
+
+    void startJob(Job& job) {
+        Clock::time_point now = Clock::now();
+        int pidfd = -1;
+        pid_t pid = job.launch(&pidfd);
+        if (pid > 0 && pidfd < 0) {
+            pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+            if (pidfd < 0) {
+                // Cannot supervise it; do not leave it running unobserved
+                int error = errno;
+                kill(pid, SIGKILL);
+                waitpid(pid, NULL, 0);
+                errno = error;
+                pid = -1;
+            }
+        }
+
+        if (pid > 0) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = job.id;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, pidfd, &event) < 0) {
+                int error = errno;
+                syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0);
+                waitForPidfd(pidfd, NULL);
+                close(pidfd);
+                errno = error;
+                pid = -1;
+            }
+        }
+
+        if (pid <= 0) {
+            ChildExit result;
+            result.id = job.id;
+            result.pid = -1;
+            result.status = 0;
+            result.launchError = errno;
+            result.waitError = 0;
+            result.timedOut = false;
+            result.wallSeconds = 0.0;
+            memset(&result.usage, 0, sizeof(result.usage));
+            if (job.onExit) {
+                job.onExit(result);
+            }
+            return;
+        }
+
+        Running child;
+        child.pid = pid;
+        child.pidfd = pidfd;
+        child.timedOut = false;
+        child.started = now;
+        child.deadline = Clock::time_point::max();
+        child.onExit = job.onExit;
+        if (job.timeoutMs > 0) {
+            child.deadline = now + std::chrono::milliseconds(job.timeoutMs);
+            deadlines.push(Deadline(child.deadline, job.id));
+        }
+        running[job.id] = child;
+    }
+
+    // Starts at most kLaunchBatch jobs, so exits and timeouts keep being
+    // serviced while a large backlog is being launched
+    void startPending() {
+        for (size_t started = 0; started < kLaunchBatch && !pending.empty() &&
+             running.size() < maxConcurrent; started++) {
+            Job job = pending.front();
+            pending.pop_front();
+            startJob(job);
+        }
+    }
+
+    void reap(uint64_t id) {
+        std::unordered_map<uint64_t, Running>::iterator it = running.find(id);
+        if (it == running.end()) {
+            return;
+        }
+
+        // The raw waitid() system call also reports the child's rusage
+        siginfo_t info;
+        info.si_pid = 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        long rc;
+        do {
+            rc = syscall(SYS_waitid, P_PIDFD, it->second.pidfd, &info, WEXITED | WNOHANG, &usage);
+        } while (rc < 0 && errno == EINTR);
+        if (rc == 0 && info.si_pid == 0) {
+            return;  // not exited yet
+        }
+
+        ChildExit result;
+        result.id = id;
+        result.pid = it->second.pid;
+        // Any other waitid() failure (e.g. ECHILD after someone else reaped
+        // the child) must not look like a clean exit
+        result.status = rc == 0 ? statusFromSiginfo(info) : -1;
+        result.launchError = 0;
+        result.waitError = rc == 0 ? 0 : errno;
+        result.timedOut = it->second.timedOut;
+        result.wallSeconds = std::chrono::duration<double>(Clock::now() - it->second.started).count();
+        result.usage = usage;
+
+        epoll_ctl(epfd, EPOLL_CTL_DEL, it->second.pidfd, NULL);
+        close(it->second.pidfd);
+        ExitCallback onExit = it->second.onExit;
+        running.erase(it);
+
+        // The callback may submit more work, so it runs after all bookkeeping
+        if (onExit) {
+            onExit(result);
+        }
+    }
+
+    void expireDeadlines(Clock::time_point now) {
+        while (!deadlines.empty() && deadlines.top().first <= now) {
+            uint64_t id = deadlines.top().second;
+            deadlines.pop();
+            std::unordered_map<uint64_t, Running>::iterator it = running.find(id);
+            if (it != running.end() && !it->second.timedOut) {
+                it->second.timedOut = true;
+                syscall(SYS_pidfd_send_signal, it->second.pidfd, SIGKILL, NULL, 0);
+            }
+        }
+    }
+
+    // Milliseconds until the next deadline, capped by maxWaitMs (-1 = none)
+    int nextTimeout(int maxWaitMs) {
+        // Drop deadlines of children that already exited
+        while (!deadlines.empty() && running.find(deadlines.top().second) == running.end()) {
+            deadlines.pop();
+        }
+        if (deadlines.empty()) {
+            return maxWaitMs;
+        }
+        Clock::duration left = deadlines.top().first - Clock::now();
+        long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1;
+        if (ms < 0) {
+            ms = 0;
+        }
+        if (maxWaitMs >= 0 && ms > maxWaitMs) {
+            ms = maxWaitMs;
+        }
+        return (int)ms;
+    }
+
+public:
+    explicit ChildSupervisor(size_t concurrency)
+        : epfd(epoll_create1(EPOLL_CLOEXEC)),
+          maxConcurrent(concurrency > 0 ? concurrency : 1),
+          nextId(1),
+          events(1024) {}
+
+    ~ChildSupervisor() {
+        // Do not leave supervised children behind
+        for (std::unordered_map<uint64_t, Running>::iterator it = running.begin();
+             it != running.end(); ++it) {
+            syscall(SYS_pidfd_send_signal, it->second.pidfd, SIGKILL, NULL, 0);
+            waitForPidfd(it->second.pidfd, NULL);
+            close(it->second.pidfd);
+        }
+        if (epfd >= 0) {
+            close(epfd);
+        }
+    }
+
+    // False if the epoll instance could not be created
+    bool valid() const { return epfd >= 0; }
+
+    size_t runningCount() const { return running.size(); }
+
+    size_t pendingCount() const { return pending.size(); }
+
+    // Queues a job and returns its id. timeoutMs <= 0 means no timeout.
+    // onExit is called from run()/runOnce() once the child has been reaped
+    // (or right away if the launch fails).
+    uint64_t submit(LaunchFunction launch, ExitCallback onExit, int timeoutMs = 0) {
+        Job job;
+        job.id = nextId++;
+        job.launch = launch;
+        job.onExit = onExit;
+        job.timeoutMs = timeoutMs;
+        pending.push_back(job);
+        return job.id;
+    }
+
+    // Queues argv (argv[0] is an absolute path) to be started with the
+    // supervisor's CloneLauncher
+    uint64_t submitCommand(const std::vector<std::string>& argv, ExitCallback onExit,
+                           int timeoutMs = 0) {
+        CloneLauncher* cloneLauncher = &launcher;
+        LaunchFunction launch = [cloneLauncher, argv](int* pidfd) -> pid_t {
+            std::vector<char*> args;
+            for (size_t i = 0; i < argv.size(); i++) {
+                args.push_back((char*)argv[i].c_str());
+            }
+            args.push_back(NULL);
+            if (argv.empty()) {
+                errno = EINVAL;
+                return -1;
+            }
+            return cloneLauncher->launch(args[0], &args[0], environ, pidfd);
+        };
+        return submit(launch, onExit, timeoutMs);
+    }
+
+    // Starts queued jobs, waits up to maxWaitMs (-1 = until something
+    // happens) for exits and timeouts, and dispatches callbacks. Returns 1
+    // while there is still work running or queued, 0 once there is none,
+    // and -1 with errno if waiting failed (the children keep running).
+    int runOnce(int maxWaitMs = -1) {
+        startPending();
+        if (running.empty()) {
+            return pending.empty() ? 0 : 1;
+        }
+
+        // Don't block while more jobs could be started right away
+        int timeout = !pending.empty() && running.size() < maxConcurrent ? 0 : nextTimeout(maxWaitMs);
+        int n = epoll_wait(epfd, &events[0], (int)events.size(), timeout);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            reap(events[i].data.u64);
+        }
+
+        expireDeadlines(Clock::now());
+        return running.empty() && pending.empty() ? 0 : 1;
+    }
+
+    // Runs until every submitted job has finished. Returns false with errno
+    // if waiting for the children failed.
+    bool run() {
+        int state;
+        while ((state = runOnce(-1)) > 0) {
+        }
+        return state == 0;
+    }
+};
+
+#endif // CHILD_SUPERVISOR_H
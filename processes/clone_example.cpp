@@ -3,55 +3,53 @@
 #include <sys/wait.h>
 #include <string.h>
 #include <signal.h>
+#include "clone_launcher.h"
 
-// Note: This is a simplified example since the actual clone() system call
-// is Linux-specific and not available on macOS. This example simulates
-// the concept using fork() instead.
-
-// Function to be executed by the child process
-static int childFunc(void* arg) {
-    std::cout << "Child process is running with PID: " << getpid() << std::endl;
-    std::cout << "Child's parent PID: " << getppid() << std::endl;
-    
-    // Execute some command
-    char* args[] = {(char*)"ls", (char*)"-la", NULL};
-    execvp("ls", args);
-    
-    // If exec fails, we'll reach here
-    std::cerr << "Exec failed: " << strerror(errno) << std::endl;
-    return 1;
-}
+// Launches "ls -la" with the real Linux clone() system call (see
+// clone_launcher.h). The child shares our address space (CLONE_VM) on a
+// small dedicated stack until it calls exec(), and we get a pidfd for it
+// (CLONE_PIDFD) which we wait on instead of the PID.
+
+extern char **environ;
 
 int main() {
     std::cout << "Parent process started with PID: " << getpid() << std::endl;
-    std::cout << "NOTE: This is a simulated clone() example using fork() since clone() is Linux-specific" << std::endl;
-    
-    // Create child process using fork() instead of clone()
-    pid_t pid = fork();
-    
-    if (pid == -1) {
-        std::cerr << "fork failed: " << strerror(errno) << std::endl;
+
+    CloneLauncher launcher;
+    if (!launcher.valid()) {
+        std::cerr << "Could not allocate child stack: " << strerror(errno) << std::endl;
         return 1;
     }
-    
-    if (pid == 0) {
-        // Child process
-        return childFunc(NULL);
+
+    // Create child process using clone(CLONE_VM | CLONE_VFORK | CLONE_PIDFD)
+    char* args[] = {(char*)"/bin/ls", (char*)"-la", NULL};
+    int pidfd = -1;
+    pid_t pid = launcher.launch(args[0], args, environ, &pidfd);
+
+    if (pid == -1) {
+        std::cerr << "clone failed: " << strerror(errno) << std::endl;
+        return 1;
     }
-    
+
     // Parent process
-    std::cout << "Parent created child with PID: " << pid << std::endl;
+    std::cout << "Parent created child with PID: " << pid
+              << " (pidfd " << pidfd << ")" << std::endl;
     std::cout << "Parent is waiting for child to complete..." << std::endl;
-    
-    // Wait for child to complete
+
+    // Wait for child to complete through its pidfd
     int status;
-    waitpid(pid, &status, 0);
-    
+    if (waitForPidfd(pidfd, &status) < 0) {
+        std::cerr << "waitid failed: " << strerror(errno) << std::endl;
+        close(pidfd);
+        return 1;
+    }
+    close(pidfd);
+
     if (WIFEXITED(status)) {
         std::cout << "Child process exited with status: " << WEXITSTATUS(status) << std::endl;
     }
-    
+
     std::cout << "Parent process terminating" << std::endl;
-    
+
     return 0;
 }
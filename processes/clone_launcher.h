@@ -0,0 +1,243 @@
+#ifndef CLONE_LAUNCHER_H
+#define CLONE_LAUNCHER_H
+
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// Process launcher built on the Linux clone() system call.
+//
+// The child is created with CLONE_VM | CLONE_VFORK: it borrows the parent's
+// address space and runs on a small dedicated stack until it calls exec(),
+// so no page tables are copied no matter how large the parent is. This is
+// the same trick glibc uses inside posix_spawn(), but here the caller keeps
+// full control over the clone flags (namespaces) and the child's fds.
+//
+// With CLONE_PIDFD the kernel also hands back a pidfd for the child, which
+// can be polled and waited on without racing against PID reuse.
+//
+// A launcher owns one child stack, so it must not be used from two threads
+// at the same time. Use one launcher per thread instead.
+
+// One step of fd setup done in the child before exec
+struct CloneFdAction {
+    int fd;
+    int targetFd;  // -1 means close(fd), otherwise dup2(fd, targetFd)
+};
+
+class CloneLauncher {
+public:
+    static const size_t kDefaultStackSize = 64 * 1024;
+
+private:
+    // Shared between parent and child (CLONE_VM), so the child can report
+    // an exec() failure back through childErrno
+    struct LaunchContext {
+        const char* path;
+        char* const* argv;
+        char* const* envp;
+        const CloneFdAction* fdActions;
+        size_t fdActionCount;
+        sigset_t parentMask;
+        int childErrno;
+    };
+
+    char* stack;
+    size_t stackSize;
+    int extraFlags;
+    std::vector<CloneFdAction> fdActions;
+
+    // Runs in the child on the dedicated stack. Only async-signal-safe calls
+    // are allowed here: the child shares every byte of memory with the parent.
+    static int childMain(void* arg) {
+        LaunchContext* ctx = (LaunchContext*)arg;
+
+        // Signal handlers belong to the parent and would run on shared memory
+        for (int sig = 1; sig < NSIG; sig++) {
+            struct sigaction action;
+            if (sigaction(sig, NULL, &action) == 0 && action.sa_handler != SIG_IGN &&
+                action.sa_handler != SIG_DFL) {
+                action.sa_handler = SIG_DFL;
+                action.sa_flags = 0;
+                sigaction(sig, &action, NULL);
+            }
+        }
+
+        for (size_t i = 0; i < ctx->fdActionCount; i++) {
+            const CloneFdAction& action = ctx->fdActions[i];
+            int rc;
+            if (action.targetFd < 0) {
+                rc = close(action.fd);
+            } else if (action.fd == action.targetFd) {
+                // dup2() onto itself would keep FD_CLOEXEC set
+                int flags = fcntl(action.fd, F_GETFD);
+                rc = flags < 0 ? -1 : fcntl(action.fd, F_SETFD, flags & ~FD_CLOEXEC);
+            } else {
+                rc = dup2(action.fd, action.targetFd);
+            }
+            if (rc < 0) {
+                ctx->childErrno = errno;
+                _exit(127);
+            }
+        }
+
+        sigprocmask(SIG_SETMASK, &ctx->parentMask, NULL);
+        execve(ctx->path, ctx->argv, ctx->envp);
+        ctx->childErrno = errno;
+        _exit(127);
+    }
+
+    CloneLauncher(const CloneLauncher&);
+    CloneLauncher& operator=(const CloneLauncher&);
+
+public:
+    explicit CloneLauncher(size_t size = kDefaultStackSize)
+        : stack(NULL), stackSize(size), extraFlags(0) {
+        void* region = mmap(NULL, stackSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (region != MAP_FAILED) {
+            stack = (char*)region;
+        }
+    }
+
+    ~CloneLauncher() {
+        if (stack) {
+            munmap(stack, stackSize);
+        }
+    }
+
+    // False if the child stack could not be allocated
+    bool valid() const { return stack != NULL; }
+
+    // Additional clone flags, e.g. CLONE_NEWNS | CLONE_NEWUTS for namespaces
+    void setExtraFlags(int flags) { extraFlags = flags; }
+
+    // Make fd available as targetFd in the child (like posix_spawn_file_actions_adddup2)
+    void addDup2(int fd, int targetFd) {
+        CloneFdAction action = {fd, targetFd};
+        fdActions.push_back(action);
+    }
+
+    // Close fd in the child before exec
+    void addClose(int fd) {
+        CloneFdAction action = {fd, -1};
+        fdActions.push_back(action);
+    }
+
+    void clearFdActions() { fdActions.clear(); }
+
+    // Launches path with the given argv/envp and returns the child's PID, or
+    // -1 with errno set. When pidfd is not NULL it receives a pidfd for the
+    // child (close-on-exec), which the caller must close; if the kernel can
+    // give none (ENOSYS before 5.3), the child is killed and reaped and the
+    // launch fails, so *pidfd is always valid on success.
+    pid_t launch(const char* path, char* const argv[], char* const envp[],
+                 int* pidfd = NULL) {
+        if (!stack) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        LaunchContext ctx;
+        ctx.path = path;
+        ctx.argv = argv;
+        ctx.envp = envp;
+        ctx.fdActions = fdActions.empty() ? NULL : &fdActions[0];
+        ctx.fdActionCount = fdActions.size();
+        ctx.childErrno = 0;
+
+        // Keep the parent's signal handlers from running in the child before
+        // it has reset them
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &ctx.parentMask);
+
+        int flags = CLONE_VM | CLONE_VFORK | SIGCHLD | extraFlags;
+        int childPidfd = -1;
+        if (pidfd) {
+            flags |= CLONE_PIDFD;
+        }
+        pid_t pid = clone(childMain, stack + stackSize, flags, &ctx, &childPidfd);
+        if (pid < 0 && errno == EINVAL && pidfd) {
+            // Kernel that rejects CLONE_PIDFD: launch without it
+            pid = clone(childMain, stack + stackSize, flags & ~CLONE_PIDFD, &ctx);
+        }
+        int pidfdErrno = 0;
+        if (pid > 0 && pidfd && childPidfd < 0) {
+            // No pidfd from clone(): the flag was rejected, or silently
+            // ignored by a kernel older than 5.2. Open it by PID, which is
+            // safe because nobody but us reaps the child.
+            childPidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+            pidfdErrno = childPidfd < 0 ? errno : 0;
+        }
+        int savedErrno = errno;
+        pthread_sigmask(SIG_SETMASK, &ctx.parentMask, NULL);
+
+        if (pid < 0) {
+            errno = savedErrno;
+            return -1;
+        }
+
+        // CLONE_VFORK: the child has already exec'd or exited at this point
+        if (ctx.childErrno != 0) {
+            waitpid(pid, NULL, 0);
+            if (childPidfd >= 0) {
+                close(childPidfd);
+            }
+            errno = ctx.childErrno;
+            return -1;
+        }
+
+        if (pidfdErrno != 0) {
+            // Nothing could wait on it without racing PID reuse
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            errno = pidfdErrno;
+            return -1;
+        }
+
+        if (pidfd) {
+            *pidfd = childPidfd;
+        }
+        return pid;
+    }
+};
+
+// Converts the siginfo filled in by waitid() into a waitpid()-style status,
+// so WIFEXITED()/WEXITSTATUS()/WTERMSIG() work on it
+inline int statusFromSiginfo(const siginfo_t& info) {
+    if (info.si_code == CLD_EXITED) {
+        return (info.si_status & 0xff) << 8;
+    }
+    int status = info.si_status & 0x7f;
+    if (info.si_code == CLD_DUMPED) {
+        status |= 0x80;
+    }
+    return status;
+}
+
+// Waits for the child behind pidfd and stores its waitpid()-style status.
+// Returns 0 on success, or -1 with errno set.
+inline int waitForPidfd(int pidfd, int* status) {
+    siginfo_t info;
+    info.si_pid = 0;
+    int rc;
+    do {
+        rc = waitid((idtype_t)P_PIDFD, (id_t)pidfd, &info, WEXITED);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0) {
+        return -1;
+    }
+    if (status) {
+        *status = statusFromSiginfo(info);
+    }
+    return 0;
+}
+
+#endif // CLONE_LAUNCHER_H
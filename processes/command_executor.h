@@ -0,0 +1,412 @@
+#ifndef COMMAND_EXECUTOR_H
+#define COMMAND_EXECUTOR_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Runs command strings like system(), without starting /bin/sh for simple
+// commands.
+//
+// system("ls -la") creates two processes: /bin/sh, which parses the string,
+// and ls, which the shell forks and execs. Most command strings need none of
+// the shell's features, so parseSimpleCommand() tokenizes them itself:
+//   - words separated by blanks, with '...' and "..." quoting and backslash
+//     escapes
+//   - leading NAME=value environment assignments
+//   - redirections: < file, > file, >> file, N> file, N>> file, N>&M
+// Such commands are started directly with posix_spawnp(). Anything that
+// needs a real shell (pipes, lists, $ expansion, globs, ~, builtins like cd,
+// keywords like if) is detected and handed to "/bin/sh -c" instead.
+//
+// Unlike system(), executeCommand() does not block SIGCHLD or ignore
+// SIGINT/SIGQUIT while it waits.
+
+extern char **environ;
+
+struct CommandRedirection {
+    int fd;
+    std::string path;  // file to open, if dupFrom < 0
+    int flags;
+    int dupFrom;       // >= 0: dup2(dupFrom, fd)
+};
+
+struct ParsedCommand {
+    std::vector<std::string> argv;
+    std::vector<std::string> env;  // NAME=value assignments
+    std::vector<CommandRedirection> redirections;
+};
+
+// Reads one word starting at i, up to a blank or an unquoted '<'/'>'.
+// Returns false if the word uses shell syntax we do not handle.
+// equalsPos is the index of the first '=' in word if everything before it
+// was unquoted, otherwise std::string::npos.
+inline bool readCommandWord(const std::string& command, size_t& i, std::string& word,
+                            bool& quoted, size_t& equalsPos) {
+    word.clear();
+    quoted = false;
+    equalsPos = std::string::npos;
+    bool plainPrefix = true;
+
+    while (i < command.size()) {
+        char c = command[i];
+        if (c == ' ' || c == '\t' || c == '<' || c == '>') {
+            break;
+        }
+        if (c == '\n' || c == '|' || c == '&' || c == ';' || c == '(' || c == ')' ||
+            c == '$' || c == '`' || c == '*' || c == '?' || c == '[' || c == '{' || c == '}') {
+            return false;
+        }
+        if (word.empty() && !quoted && (c == '~' || c == '#' || c == '!')) {
+            return false;
+        }
+        // The shell also expands a tilde after the '=' of an assignment and
+        // after each ':' in its value
+        if (c == '~' && i > 0 && (command[i - 1] == '=' || command[i - 1] == ':')) {
+            return false;
+        }
+
+        if (c == '\'') {
+            size_t end = command.find('\'', i + 1);
+            if (end == std::string::npos) {
+                return false;
+            }
+            word.append(command, i + 1, end - i - 1);
+            i = end + 1;
+            quoted = true;
+            plainPrefix = false;
+        } else if (c == '"') {
+            i++;
+            for (;;) {
+                if (i >= command.size()) {
+                    return false;
+                }
+                char d = command[i];
+                if (d == '"') {
+                    i++;
+                    break;
+                }
+                if (d == '$' || d == '`') {
+                    return false;
+                }
+                if (d == '\\' && i + 1 < command.size() &&
+                    (command[i + 1] == '"' || command[i + 1] == '\\' ||
+                     command[i + 1] == '$' || command[i + 1] == '`')) {
+                    word += command[i + 1];
+                    i += 2;
+                } else if (d == '\\' && i + 1 < command.size() && command[i + 1] == '\n') {
+                    i += 2;
+                } else {
+                    word += d;
+                    i++;
+                }
+            }
+            quoted = true;
+            plainPrefix = false;
+        } else if (c == '\\') {
+            if (i + 1 >= command.size()) {
+                return false;
+            }
+            if (command[i + 1] != '\n') {
+                word += command[i + 1];
+            }
+            i += 2;
+            quoted = true;
+            plainPrefix = false;
+        } else {
+            if (c == '=' && plainPrefix && equalsPos == std::string::npos) {
+                equalsPos = word.size();
+            }
+            word += c;
+            i++;
+        }
+    }
+    return true;
+}
+
+// Commands that only exist inside the shell, or change its parsing, and
+// builtins (echo, printf) whose behaviour differs from the binaries in PATH
+inline bool isShellOnlyWord(const std::string& word) {
+    static const char* const kWords[] = {
+        "if", "then", "else", "elif", "fi", "case", "esac", "for", "while", "until",
+        "do", "done", "function", "select", "time", "cd", "export", "set", "unset",
+        "alias", "unalias", "source", ".", "exec", "exit", "eval", "read", "ulimit",
+        "umask", "wait", "trap", "shift", "return", "break", "continue", "local",
+        "readonly", "declare", "typeset", "hash", "command", "builtin", "jobs",
+        "fg", "bg", "getopts", "let", ":", "type", "times", "shopt", "pushd", "popd",
+        "echo", "printf",
+    };
+    for (size_t i = 0; i < sizeof(kWords) / sizeof(kWords[0]); i++) {
+        if (word == kWords[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool isAssignment(const std::string& word, size_t equalsPos) {
+    if (equalsPos == std::string::npos || equalsPos == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < equalsPos; i++) {
+        char c = word[i];
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        if (!letter && !(i > 0 && c >= '0' && c <= '9')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parses a redirection operator at command[i] for descriptor fd (-1: the
+// operator's default) and its target. Returns false if it needs the shell.
+inline bool readRedirection(const std::string& command, size_t& i, int fd,
+                            CommandRedirection& redirection) {
+    redirection.dupFrom = -1;
+    if (command[i] == '<') {
+        i++;
+        if (i < command.size() && (command[i] == '<' || command[i] == '&' || command[i] == '>')) {
+            return false;  // here-documents, <&, <>
+        }
+        redirection.fd = fd >= 0 ? fd : STDIN_FILENO;
+        redirection.flags = O_RDONLY;
+    } else {
+        i++;
+        redirection.fd = fd >= 0 ? fd : STDOUT_FILENO;
+        redirection.flags = O_WRONLY | O_CREAT | O_TRUNC;
+        if (i < command.size() && command[i] == '>') {
+            redirection.flags = O_WRONLY | O_CREAT | O_APPEND;
+            i++;
+        } else if (i < command.size() && command[i] == '|') {
+            i++;
+        } else if (i < command.size() && command[i] == '&') {
+            // N>&M
+            i++;
+            size_t start = i;
+            int from = 0;
+            while (i < command.size() && command[i] >= '0' && command[i] <= '9') {
+                from = from * 10 + (command[i] - '0');
+                i++;
+            }
+            if (i == start || (i < command.size() && command[i] != ' ' && command[i] != '\t')) {
+                return false;
+            }
+            redirection.dupFrom = from;
+            return true;
+        }
+    }
+
+    while (i < command.size() && (command[i] == ' ' || command[i] == '\t')) {
+        i++;
+    }
+    bool quoted;
+    size_t equalsPos;
+    if (i >= command.size() || command[i] == '<' || command[i] == '>' ||
+        !readCommandWord(command, i, redirection.path, quoted, equalsPos) ||
+        redirection.path.empty()) {
+        return false;
+    }
+    return true;
+}
+
+// Splits a simple command string into argv, environment assignments and
+// redirections. Returns false if the command needs a real shell.
+inline bool parseSimpleCommand(const std::string& command, ParsedCommand& parsed) {
+    parsed.argv.clear();
+    parsed.env.clear();
+    parsed.redirections.clear();
+
+    size_t i = 0;
+    for (;;) {
+        while (i < command.size() && (command[i] == ' ' || command[i] == '\t')) {
+            i++;
+        }
+        if (i >= command.size()) {
+            break;
+        }
+
+        CommandRedirection redirection;
+        if (command[i] == '<' || command[i] == '>') {
+            if (!readRedirection(command, i, -1, redirection)) {
+                return false;
+            }
+            parsed.redirections.push_back(redirection);
+            continue;
+        }
+
+        std::string word;
+        bool quoted;
+        size_t equalsPos;
+        if (!readCommandWord(command, i, word, quoted, equalsPos)) {
+            return false;
+        }
+
+        // "2>file": a bare number right before a redirection names the fd
+        if (i < command.size() && (command[i] == '<' || command[i] == '>') && !quoted &&
+            !word.empty() && word.size() < 4 &&
+            word.find_first_not_of("0123456789") == std::string::npos) {
+            if (!readRedirection(command, i, atoi(word.c_str()), redirection)) {
+                return false;
+            }
+            parsed.redirections.push_back(redirection);
+            continue;
+        }
+
+        if (parsed.argv.empty() && isAssignment(word, equalsPos)) {
+            parsed.env.push_back(word);
+        } else {
+            if (parsed.argv.empty() && isShellOnlyWord(word)) {
+                return false;
+            }
+            parsed.argv.push_back(word);
+        }
+    }
+    return !parsed.argv.empty();
+}
+
+// The fd of this process that child fd refers to after the redirections in
+// targets (child fd, fd here), latest last
+inline int redirectedFd(const std::vector<std::pair<int, int> >& targets, int fd) {
+    for (size_t i = targets.size(); i > 0; i--) {
+        if (targets[i - 1].first == fd) {
+            return targets[i - 1].second;
+        }
+    }
+    return fd;
+}
+
+// Spawns a parsed command and waits for it. Returns a waitpid() status like
+// system(): exit code 127 if the program was not found, 126 if it could not
+// be executed, 2 if a redirection target could not be opened (as /bin/sh
+// does), or -1 if no process was created.
+inline int runParsedCommand(const ParsedCommand& parsed) {
+    std::vector<char*> args;
+    for (size_t i = 0; i < parsed.argv.size(); i++) {
+        args.push_back((char*)parsed.argv[i].c_str());
+    }
+    args.push_back(NULL);
+
+    // Assignments override inherited variables of the same name
+    std::vector<char*> env;
+    char** envp = environ;
+    if (!parsed.env.empty()) {
+        for (char** var = environ; *var; var++) {
+            bool overridden = false;
+            for (size_t j = 0; j < parsed.env.size() && !overridden; j++) {
+                size_t length = parsed.env[j].find('=') + 1;
+                overridden = strncmp(*var, parsed.env[j].c_str(), length) == 0;
+            }
+            if (!overridden) {
+                env.push_back(*var);
+            }
+        }
+        for (size_t j = 0; j < parsed.env.size(); j++) {
+            env.push_back((char*)parsed.env[j].c_str());
+        }
+        env.push_back(NULL);
+        envp = &env[0];
+    }
+
+    // Files are opened here, in order, like the shell does before exec, so
+    // a target that cannot be opened is reported on the command's stderr as
+    // redirected so far, and the command does not run. They are moved above
+    // every fd the command redirects, so no dup2() in the child clobbers them.
+    int firstFree = 10;
+    for (size_t i = 0; i < parsed.redirections.size(); i++) {
+        firstFree = parsed.redirections[i].fd >= firstFree ? parsed.redirections[i].fd + 1 : firstFree;
+    }
+    std::vector<std::pair<int, int> > targets;
+    std::vector<int> opened;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    int openError = 0;
+    size_t i = 0;
+    for (; i < parsed.redirections.size(); i++) {
+        const CommandRedirection& r = parsed.redirections[i];
+        int source = r.dupFrom;
+        if (source >= 0) {
+            targets.push_back(std::make_pair(r.fd, redirectedFd(targets, source)));
+        } else {
+            int fd = open(r.path.c_str(), r.flags | O_CLOEXEC, 0666);
+            source = fd >= 0 ? fcntl(fd, F_DUPFD_CLOEXEC, firstFree) : -1;
+            if (source < 0) {
+                openError = errno;
+                if (fd >= 0) {
+                    close(fd);
+                }
+                break;
+            }
+            close(fd);
+            opened.push_back(source);
+            targets.push_back(std::make_pair(r.fd, source));
+        }
+        posix_spawn_file_actions_adddup2(&actions, source, r.fd);
+    }
+
+    pid_t pid;
+    int rc = 0;
+    if (openError != 0) {
+        dprintf(redirectedFd(targets, STDERR_FILENO), "%s: %s\n", parsed.redirections[i].path.c_str(),
+                strerror(openError));
+    } else {
+        rc = posix_spawnp(&pid, args[0], &actions, NULL, &args[0], envp);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    for (size_t j = 0; j < opened.size(); j++) {
+        close(opened[j]);
+    }
+    if (openError != 0) {
+        return 2 << 8;
+    }
+    if (rc == ENOENT || rc == ENOTDIR) {
+        return 127 << 8;
+    }
+    if (rc == EACCES || rc == ENOEXEC || rc == EISDIR) {
+        return 126 << 8;
+    }
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return status;
+}
+
+// Runs command like system(command): directly if it is a simple command,
+// through "/bin/sh -c" otherwise. usedShell, if given, tells which path ran.
+inline int executeCommand(const std::string& command, bool* usedShell = NULL) {
+    ParsedCommand parsed;
+    if (parseSimpleCommand(command, parsed)) {
+        if (usedShell) {
+            *usedShell = false;
+        }
+        return runParsedCommand(parsed);
+    }
+
+    if (usedShell) {
+        *usedShell = true;
+    }
+    parsed.argv.clear();
+    parsed.env.clear();
+    parsed.redirections.clear();
+    parsed.argv.push_back("/bin/sh");
+    parsed.argv.push_back("-c");
+    parsed.argv.push_back(command);
+    return runParsedCommand(parsed);
+}
+
+#endif // COMMAND_EXECUTOR_H
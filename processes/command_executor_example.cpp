@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "command_executor.h"
+
+// Runs command strings like system_example.cpp, but through
+// executeCommand() (command_executor.h): simple commands are parsed here and
+// spawned directly, only real shell syntax goes through /bin/sh.
+
+static double runTimed(const std::string& command, int& status, bool& usedShell) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    status = executeCommand(command, &usedShell);
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    std::cout << "Parent process started with PID: " << getpid() << std::endl;
+
+    const char* commands[] = {
+        "ls -la",
+        "GREETING='hello world' printenv GREETING",
+        "/bin/echo \"quoted \\\"words\\\"\" > /tmp/command_executor_example.txt",
+        "cat < /tmp/command_executor_example.txt",
+        "ls /nonexistent 2>/dev/null",
+        "ls | wc -l",
+        "echo $HOME",
+    };
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        std::cout << "\n$ " << commands[i] << std::endl;
+        int status;
+        bool usedShell;
+        double us = runTimed(commands[i], status, usedShell);
+        std::cout << "-> " << (usedShell ? "via /bin/sh" : "spawned directly")
+                  << ", status " << (WIFEXITED(status) ? WEXITSTATUS(status) : -1)
+                  << ", " << us << " us" << std::endl;
+    }
+    unlink("/tmp/command_executor_example.txt");
+
+    // Latency per call against system()
+    const int calls = 200;
+    double systemUs = 0, executorUs = 0;
+    for (int i = 0; i < calls; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int ignored = system("true > /dev/null");
+        (void)ignored;
+        systemUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        int status;
+        bool usedShell;
+        executorUs += runTimed("true > /dev/null", status, usedShell);
+    }
+    std::cout << "\nAverage over " << calls << " calls of \"true > /dev/null\":"
+              << "\nsystem():          " << systemUs / calls << " us"
+              << "\nexecuteCommand():  " << executorUs / calls << " us" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+#ifndef FORK_MAP_REDUCE_H
+#define FORK_MAP_REDUCE_H
+
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include <chrono>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "child_supervisor.h"
+
+// Parallel map-reduce over an in-memory dataset using forked workers.
+//
+// fork() gives every worker the parent's memory through copy-on-write, so a
+// dataset built before run() is shared by all workers without being copied
+// or serialized: each worker only reads its slice. The worker's partial
+// result is written into a MAP_SHARED array (one slot per slice) and the
+// parent reduces the slots in slice order once every worker has exited.
+//
+// Because each slice runs in its own process, a crash (SIGSEGV, abort(),
+// non-zero exit) or a hang only loses that slice: it is started again in a
+// fresh child, up to maxAttempts times. This makes it a safe way to run
+// legacy, non-thread-safe code on several cores.
+//
+//   ForkMapReduce<Stats> job(4);
+//   Stats total = Stats();
+//   job.run(data.size(),
+//           [&](size_t begin, size_t end) { return summarize(data, begin, end); },
+//           [](Stats& total, const Stats& part) { merge(total, part); },
+//           total);
+//
+// Result must be trivially copyable: it is copied between processes
+// byte by byte. Workers are created with fork() from the calling thread, so
+// the map function must not depend on locks held by other threads.
+
+struct MapReduceStats {
+    size_t slices;
+    size_t launches;     // workers forked, including retries
+    size_t crashes;      // workers that died from a signal or exited non-zero
+    size_t timeouts;     // workers killed after timeoutMs
+    size_t failedSlices; // slices still failing after maxAttempts
+    double seconds;
+};
+
+template <typename Result>
+class ForkMapReduce {
+    static_assert(std::is_trivially_copyable<Result>::value,
+                  "ForkMapReduce results are copied between processes");
+
+public:
+    typedef std::function<Result(size_t begin, size_t end)> MapFunction;
+    typedef std::function<void(Result& total, const Result& partial)> ReduceFunction;
+
+private:
+    // One per slice, in shared memory. The parent reads it only after
+    // reaping the worker, so no atomics are needed. A slot only counts if
+    // its worker also exited cleanly.
+    struct Slot {
+        int done;
+        Result value;
+    };
+
+    size_t workers;
+    size_t slicesPerWorker;
+    int maxAttempts;
+    int timeoutMs;
+    MapReduceStats lastStats;
+
+    ForkMapReduce(const ForkMapReduce&);
+    ForkMapReduce& operator=(const ForkMapReduce&);
+
+public:
+    explicit ForkMapReduce(size_t workerCount)
+        : workers(workerCount > 0 ? workerCount : 1),
+          slicesPerWorker(1),
+          maxAttempts(3),
+          timeoutMs(0),
+          lastStats() {}
+
+    // More slices than workers balance uneven work and make a retry cheaper
+    void setSlicesPerWorker(size_t count) { slicesPerWorker = count > 0 ? count : 1; }
+
+    // How often a slice is tried before run() gives up on it
+    void setMaxAttempts(int attempts) { maxAttempts = attempts > 0 ? attempts : 1; }
+
+    // Kill and retry a worker that runs longer than this (0: no limit)
+    void setTimeoutMs(int milliseconds) { timeoutMs = milliseconds; }
+
+    const MapReduceStats& stats() const { return lastStats; }
+
+    // Maps [0, items) in slices across forked workers and reduces the
+    // partial results into total, in slice order. Returns false with errno
+    // set if a slice failed maxAttempts times (EIO), waiting for the workers
+    // failed or the shared result area could not be created; total then
+    // holds only the slices that succeeded.
+    bool run(size_t items, MapFunction map, ReduceFunction reduce, Result& total) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        lastStats = MapReduceStats();
+
+        size_t slices = workers * slicesPerWorker;
+        if (slices > items) {
+            slices = items > 0 ? items : 1;
+        }
+        lastStats.slices = slices;
+
+        size_t bytes = slices * sizeof(Slot);
+        void* region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            return false;
+        }
+        Slot* results = (Slot*)region;
+
+        ChildSupervisor supervisor(workers);
+        if (!supervisor.valid()) {
+            int error = errno;
+            munmap(region, bytes);
+            errno = error;
+            return false;
+        }
+
+        std::vector<int> attempts(slices, 0);
+        // Set by the parent from the worker's exit, not by the worker: one
+        // killed on timeout may already have set done
+        std::vector<char> succeeded(slices, 0);
+        MapReduceStats& stats = lastStats;
+        int limit = maxAttempts;
+        int timeout = timeoutMs;
+
+        // Each slice is a fork()ed child; its exit callback retries it
+        std::function<void(size_t)> submitSlice;
+        submitSlice = [&](size_t slice) {
+            size_t begin = items * slice / slices;
+            size_t end = items * (slice + 1) / slices;
+            attempts[slice]++;
+            supervisor.submit(
+                [&, slice, begin, end](int*) -> pid_t {
+                    results[slice].done = 0;
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        results[slice].value = map(begin, end);
+                        results[slice].done = 1;
+                        _exit(0);  // no atexit handlers or stdio flushes of the parent's state
+                    }
+                    if (pid > 0) {
+                        stats.launches++;
+                    }
+                    return pid;
+                },
+                [&, slice](const ChildExit& exit) {
+                    bool ok = exit.pid > 0 && !exit.timedOut && WIFEXITED(exit.status) &&
+                              WEXITSTATUS(exit.status) == 0 && results[slice].done;
+                    if (ok) {
+                        succeeded[slice] = 1;
+                        return;
+                    }
+                    if (exit.timedOut) {
+                        stats.timeouts++;
+                    } else if (exit.pid > 0) {
+                        stats.crashes++;
+                    }
+                    if (attempts[slice] < limit) {
+                        submitSlice(slice);
+                    } else {
+                        stats.failedSlices++;
+                    }
+                },
+                timeout);
+        };
+
+        for (size_t slice = 0; slice < slices; slice++) {
+            submitSlice(slice);
+        }
+        bool waited = supervisor.run();
+        int waitError = errno;
+
+        for (size_t slice = 0; slice < slices; slice++) {
+            if (succeeded[slice]) {
+                reduce(total, results[slice].value);
+            }
+        }
+        munmap(region, bytes);
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!waited) {
+            errno = waitError;
+            return false;
+        }
+        if (stats.failedSlices > 0) {
+            errno = EIO;
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif // FORK_MAP_REDUCE_H
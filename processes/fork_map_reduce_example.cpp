@@ -0,0 +1,141 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fork_map_reduce.h"
+
+// Summarizes a large in-memory dataset with forked workers (fork_map_reduce.h).
+// The workers read the parent's vector through copy-on-write, so it is never
+// copied. One worker is made to crash on its first attempt to show that the
+// slice is simply run again.
+//
+// Usage:
+//   ./fork_map_reduce_example [--items 50000000] [--workers 4]
+
+struct Summary {
+    long long count;
+    long long sum;
+    uint32_t min;
+    uint32_t max;
+    long long buckets[8];  // value distribution by top 3 bits
+};
+
+static Summary emptySummary() {
+    Summary summary;
+    memset(&summary, 0, sizeof(summary));
+    summary.min = UINT32_MAX;
+    return summary;
+}
+
+static Summary summarize(const std::vector<uint32_t>& data, size_t begin, size_t end) {
+    Summary summary = emptySummary();
+    for (size_t i = begin; i < end; i++) {
+        uint32_t value = data[i];
+        summary.count++;
+        summary.sum += value;
+        summary.min = value < summary.min ? value : summary.min;
+        summary.max = value > summary.max ? value : summary.max;
+        summary.buckets[value >> 29]++;
+    }
+    return summary;
+}
+
+static void merge(Summary& total, const Summary& part) {
+    total.count += part.count;
+    total.sum += part.sum;
+    total.min = part.min < total.min ? part.min : total.min;
+    total.max = part.max > total.max ? part.max : total.max;
+    for (int b = 0; b < 8; b++) {
+        total.buckets[b] += part.buckets[b];
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t items = 50000000;
+    size_t workers = 4;
+    const char* usage = " [--items 50000000] [--workers 4]";
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+        if (arg == "--items") {
+            items = strtoul(argv[i + 1], NULL, 10);
+        } else if (arg == "--workers") {
+            workers = strtoul(argv[i + 1], NULL, 10);
+        } else {
+            std::cerr << "Usage: " << argv[0] << usage << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Building " << items << " values ("
+              << items * sizeof(uint32_t) / (1024 * 1024) << " MB)..." << std::endl;
+    std::vector<uint32_t> data(items);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < items; i++) {
+        state = state * 1664525u + 1013904223u;
+        data[i] = state;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Summary serial = summarize(data, 0, data.size());
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Shared flag, so only the first attempt of the crashing slice crashes
+    int* crashed = (int*)mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (crashed == MAP_FAILED) {
+        std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    *crashed = 0;
+    size_t crashIndex = items / 2;
+
+    ForkMapReduce<Summary> job(workers);
+    job.setSlicesPerWorker(4);
+    job.setMaxAttempts(3);
+    Summary total = emptySummary();
+    bool ok = job.run(
+        data.size(),
+        [&](size_t begin, size_t end) {
+            if (begin <= crashIndex && crashIndex < end && !*crashed) {
+                *crashed = 1;
+                raise(SIGSEGV);  // stands in for a bug in legacy code
+            }
+            return summarize(data, begin, end);
+        },
+        merge, total);
+    if (!ok) {
+        std::cerr << "Map-reduce failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    const MapReduceStats& stats = job.stats();
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "count=" << total.count << " sum=" << total.sum << " min=" << total.min
+              << " max=" << total.max << std::endl;
+    std::cout << "Buckets:";
+    for (int b = 0; b < 8; b++) {
+        std::cout << " " << total.buckets[b];
+    }
+    std::cout << std::endl;
+    std::cout << "Matches single-process result: "
+              << (total.sum == serial.sum && total.count == serial.count ? "yes" : "NO") << std::endl;
+    std::cout << "Slices: " << stats.slices << ", workers forked: " << stats.launches
+              << ", crashes retried: " << stats.crashes << std::endl;
+    std::cout << "Single process: " << serialSeconds << " s, " << workers
+              << " workers: " << stats.seconds << " s" << std::endl;
+
+    munmap(crashed, sizeof(int));
+    return 0;
+}
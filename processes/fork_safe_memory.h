@@ -0,0 +1,192 @@
+#ifndef FORK_SAFE_MEMORY_H
+#define FORK_SAFE_MEMORY_H
+
+#include <mutex>
+#include <set>
+#include <chrono>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Large buffers that do not make fork() slower.
+//
+// fork() copies the page tables of every private mapping, so its cost grows
+// with the parent's resident memory (see bench_spawn), and every page the
+// parent writes afterwards takes a copy-on-write fault. Big caches rarely
+// need to be visible in the child, so ForkSafeRegion lets a buffer opt out:
+//   - kForkExclude  (MADV_DONTFORK): the range is not mapped in the child at
+//                   all; fork() skips it entirely
+//   - kForkWipe     (MADV_WIPEONFORK): the child gets the range as fresh
+//                   zero pages, e.g. for per-process scratch space
+//   - kForkInherit: normal copy-on-write behaviour
+// Optionally the region is backed by huge pages (explicit MAP_HUGETLB pages
+// if the system has them reserved, otherwise transparent huge pages via
+// MADV_HUGEPAGE): one 2 MB entry replaces 512 page-table entries, which
+// shrinks the tables fork() has to copy for inherited regions. kForkWipe
+// regions only get transparent huge pages, as the kernel refuses
+// MADV_WIPEONFORK on MAP_HUGETLB mappings.
+//
+// Live regions are tracked, so forkLite() can report how many bytes each
+// fork() left out.
+//
+// A child must never touch a kForkExclude region: it is unmapped there.
+
+enum ForkPolicy {
+    kForkInherit,
+    kForkExclude,
+    kForkWipe,
+};
+
+enum HugePageMode {
+    kHugePagesNone,
+    kHugePagesExplicit,     // MAP_HUGETLB
+    kHugePagesTransparent,  // MADV_HUGEPAGE
+};
+
+// Bytes in live ForkSafeRegions, by policy
+struct ForkMemoryUsage {
+    size_t inheritedBytes;
+    size_t excludedBytes;
+    size_t wipedBytes;
+};
+
+class ForkSafeRegion {
+public:
+    static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+private:
+    void* region;
+    size_t length;
+    ForkPolicy forkPolicy;
+    HugePageMode hugeMode;
+
+    struct Registry {
+        std::mutex lock;
+        std::set<const ForkSafeRegion*> regions;
+    };
+
+    static Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    ForkSafeRegion(const ForkSafeRegion&);
+    ForkSafeRegion& operator=(const ForkSafeRegion&);
+
+    void* map(bool hugePages, bool explicitHugePages) {
+        if (hugePages && explicitHugePages) {
+            length = (length + kHugePageSize - 1) & ~(kHugePageSize - 1);
+            void* pages = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (pages != MAP_FAILED) {
+                hugeMode = kHugePagesExplicit;
+                return pages;
+            }
+        }
+        void* pages = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        // Transparent huge pages are only a hint; keep going without them
+        if (pages != MAP_FAILED && hugePages && madvise(pages, length, MADV_HUGEPAGE) == 0) {
+            hugeMode = kHugePagesTransparent;
+        }
+        return pages;
+    }
+
+public:
+    // Maps bytes of zeroed memory with the given fork policy. Check valid()
+    // afterwards; errno tells why it failed.
+    ForkSafeRegion(size_t bytes, ForkPolicy policy, bool hugePages = false)
+        : region(MAP_FAILED), length(bytes), forkPolicy(policy), hugeMode(kHugePagesNone) {
+        if (bytes == 0) {
+            errno = EINVAL;
+            return;
+        }
+        region = map(hugePages, policy != kForkWipe);
+        if (region == MAP_FAILED) {
+            return;
+        }
+
+        int advice = policy == kForkExclude ? MADV_DONTFORK :
+                     policy == kForkWipe ? MADV_WIPEONFORK : 0;
+        if (advice != 0 && madvise(region, length, advice) < 0) {
+            int error = errno;
+            munmap(region, length);
+            region = MAP_FAILED;
+            errno = error;
+            return;
+        }
+
+        Registry& live = registry();
+        std::lock_guard<std::mutex> guard(live.lock);
+        live.regions.insert(this);
+    }
+
+    ~ForkSafeRegion() {
+        if (region != MAP_FAILED) {
+            {
+                Registry& live = registry();
+                std::lock_guard<std::mutex> guard(live.lock);
+                live.regions.erase(this);
+            }
+            munmap(region, length);
+        }
+    }
+
+    // False if the mapping or the madvise() call failed
+    bool valid() const { return region != MAP_FAILED; }
+
+    void* data() const { return valid() ? region : NULL; }
+
+    // Mapped size; rounded up to kHugePageSize for explicit huge pages
+    size_t size() const { return valid() ? length : 0; }
+
+    ForkPolicy policy() const { return forkPolicy; }
+
+    HugePageMode hugePages() const { return hugeMode; }
+
+    // Sums up the live regions of this process
+    static ForkMemoryUsage usage() {
+        ForkMemoryUsage total = {0, 0, 0};
+        Registry& live = registry();
+        std::lock_guard<std::mutex> guard(live.lock);
+        for (std::set<const ForkSafeRegion*>::const_iterator it = live.regions.begin();
+             it != live.regions.end(); ++it) {
+            size_t bytes = (*it)->length;
+            if ((*it)->forkPolicy == kForkExclude) {
+                total.excludedBytes += bytes;
+            } else if ((*it)->forkPolicy == kForkWipe) {
+                total.wipedBytes += bytes;
+            } else {
+                total.inheritedBytes += bytes;
+            }
+        }
+        return total;
+    }
+};
+
+// What a forkLite() call saved
+struct ForkLiteReport {
+    size_t excludedBytes;   // kForkExclude regions not mapped in the child
+    size_t wipedBytes;      // kForkWipe regions the child sees zeroed
+    size_t inheritedBytes;  // kForkInherit regions shared copy-on-write
+    double forkMicros;      // time spent in fork() in the parent
+};
+
+// fork() that reports how much of the process's ForkSafeRegion memory the
+// child did not inherit. Returns like fork(); report is filled in the parent
+// (and in the child, without forkMicros).
+inline pid_t forkLite(ForkLiteReport* report = NULL) {
+    ForkMemoryUsage usage = ForkSafeRegion::usage();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (report) {
+        report->excludedBytes = usage.excludedBytes;
+        report->wipedBytes = usage.wipedBytes;
+        report->inheritedBytes = usage.inheritedBytes;
+        report->forkMicros = pid == 0 ? 0.0 :
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    return pid;
+}
+
+#endif // FORK_SAFE_MEMORY_H
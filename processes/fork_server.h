@@ -0,0 +1,449 @@
+#ifndef FORK_SERVER_H
+#define FORK_SERVER_H
+
+#include <map>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// Pre-forked "zygote" process that launches children on our behalf.
+//
+// start() forks a small template process once, while the caller is still
+// small. Launch requests (argv, envp and up to kMaxFds file descriptors) are
+// sent to it over a Unix domain socket, the fds travelling as SCM_RIGHTS
+// ancillary data. The server fork()s the child from its own tiny address
+// space, so launch latency no longer depends on how large the caller has
+// grown since.
+//
+// Children belong to the server, so it reaps them and sends their exit
+// status back. wait() on the client collects it.
+//
+// Protocol (SOCK_SEQPACKET, one request or reply per message):
+//   client -> server: ForkServerRequest + NUL-separated argv then envp strings
+//   server -> client: ForkServerReply (kLaunched with pid or errno,
+//                     kExited with the waitpid() status)
+//
+// A ForkServer is not thread-safe; give each thread its own server.
+
+struct ForkServerRequest {
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t payloadSize;
+};
+
+struct ForkServerReply {
+    int32_t type;
+    int32_t pid;
+    int32_t value;  // errno for kLaunched (0 on success), status for kExited
+};
+
+class ForkServer {
+public:
+    static const int kLaunched = 1;
+    static const int kExited = 2;
+    static const size_t kMaxPayload = 60 * 1024;
+    static const size_t kMaxStrings = 4096;
+    static const int kMaxFds = 16;
+
+private:
+    int sock;
+    pid_t serverPid;
+    std::map<pid_t, int> finished;  // exit statuses that arrived before wait()
+    std::vector<char> message;      // request being sent
+
+    ForkServer(const ForkServer&);
+    ForkServer& operator=(const ForkServer&);
+
+    static ssize_t sendWithFds(int fd, const void* data, size_t size,
+                               const int* fds, int fdCount) {
+        struct iovec iov;
+        iov.iov_base = (void*)data;
+        iov.iov_len = size;
+
+        char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (fdCount > 0) {
+            memset(control, 0, sizeof(control));
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+            memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fdCount);
+        }
+
+        ssize_t rc;
+        do {
+            rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        } while (rc < 0 && errno == EINTR);
+        return rc;
+    }
+
+    static ssize_t receiveWithFds(int fd, void* data, size_t size,
+                                  int* fds, int* fdCount) {
+        struct iovec iov;
+        iov.iov_base = data;
+        iov.iov_len = size;
+
+        char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t rc;
+        do {
+            rc = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        } while (rc < 0 && errno == EINTR);
+
+        *fdCount = 0;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+                *fdCount = count;
+            }
+        }
+        return rc;
+    }
+
+    // Child of the server: install the passed fds as 0..fdCount-1 and exec
+    static void execChild(char* const argv[], char* const envp[], const int* fds,
+                          int fdCount, int errorPipe, const sigset_t& mask) {
+        int moved[kMaxFds];
+        // errorPipe too: a dup2() onto 0..fdCount-1 must not replace it
+        int errorFd = fcntl(errorPipe, F_DUPFD_CLOEXEC, kMaxFds);
+        if (errorFd < 0) {
+            goto fail;
+        }
+        close(errorPipe);
+        errorPipe = errorFd;
+        for (int i = 0; i < fdCount; i++) {
+            // Move out of the way first so dup2() below cannot clobber a source
+            moved[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, kMaxFds);
+            if (moved[i] < 0) {
+                goto fail;
+            }
+        }
+        for (int i = 0; i < fdCount; i++) {
+            if (dup2(moved[i], i) < 0) {
+                goto fail;
+            }
+        }
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        execve(argv[0], argv, envp);
+    fail:
+        int error = errno;
+        ssize_t ignored = write(errorPipe, &error, sizeof(error));
+        (void)ignored;
+        _exit(127);
+    }
+
+    static bool sendReply(int fd, int type, pid_t pid, int value) {
+        ForkServerReply reply;
+        reply.type = type;
+        reply.pid = pid;
+        reply.value = value;
+        return sendWithFds(fd, &reply, sizeof(reply), NULL, 0) == (ssize_t)sizeof(reply);
+    }
+
+    static void handleRequest(int fd, const char* message, size_t size,
+                              const int* fds, int fdCount, const sigset_t& mask) {
+        static char* strings[kMaxStrings + 2];
+
+        ForkServerRequest request;
+        if (size < sizeof(request)) {
+            sendReply(fd, kLaunched, -1, EINVAL);
+            return;
+        }
+        memcpy(&request, message, sizeof(request));
+        const char* payload = message + sizeof(request);
+        size_t payloadSize = size - sizeof(request);
+        if (request.argc == 0 || request.argc + request.envc > kMaxStrings ||
+            request.payloadSize != payloadSize ||
+            (payloadSize > 0 && payload[payloadSize - 1] != '\0')) {
+            sendReply(fd, kLaunched, -1, EINVAL);
+            return;
+        }
+
+        // Split the payload into argv (NULL) envp (NULL)
+        size_t count = 0, offset = 0;
+        while (offset < payloadSize && count < request.argc + request.envc) {
+            strings[count + (count >= request.argc ? 1 : 0)] = (char*)payload + offset;
+            offset += strlen(payload + offset) + 1;
+            count++;
+        }
+        if (count != request.argc + request.envc) {
+            sendReply(fd, kLaunched, -1, EINVAL);
+            return;
+        }
+        strings[request.argc] = NULL;
+        strings[request.argc + request.envc + 1] = NULL;
+        char** argv = strings;
+        char** envp = strings + request.argc + 1;
+
+        int errorPipe[2];
+        if (pipe2(errorPipe, O_CLOEXEC) < 0) {
+            sendReply(fd, kLaunched, -1, errno);
+            return;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(errorPipe[0]);
+            execChild(argv, envp, fds, fdCount, errorPipe[1], mask);
+        }
+        int error = pid < 0 ? errno : 0;
+        close(errorPipe[1]);
+
+        // The pipe closes on a successful exec, or carries errno on failure
+        if (pid > 0) {
+            ssize_t n;
+            do {
+                n = read(errorPipe[0], &error, sizeof(error));
+            } while (n < 0 && errno == EINTR);
+            if (n != (ssize_t)sizeof(error)) {
+                error = 0;
+            } else {
+                // Failed exec: reap it here so no exit notification follows
+                waitpid(pid, NULL, 0);
+            }
+        }
+        close(errorPipe[0]);
+
+        sendReply(fd, kLaunched, error == 0 ? pid : -1, error);
+    }
+
+    static void serve(int fd) {
+        static char message[sizeof(ForkServerRequest) + kMaxPayload];
+
+        // Drop every descriptor inherited from the client except stdio and
+        // our socket, or the server would keep the client's pipes open. The
+        // socket stays close-on-exec, or every launched program would get it
+        // as fd 3 (and could send requests, and hold the server open).
+        if (fd != 3) {
+            if (dup3(fd, 3, O_CLOEXEC) < 0) {
+                _exit(1);
+            }
+            fd = 3;
+        } else if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            _exit(1);
+        }
+        if (syscall(SYS_close_range, 4, ~0U, 0) < 0) {
+            for (long i = 4; i < sysconf(_SC_OPEN_MAX); i++) {
+                close(i);
+            }
+        }
+
+        sigset_t childMask, oldMask;
+        sigemptyset(&childMask);
+        sigaddset(&childMask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+        int sigfd = signalfd(-1, &childMask, SFD_CLOEXEC);
+        if (sigfd < 0) {
+            _exit(1);
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = sigfd;
+        fds[1].events = POLLIN;
+
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                struct signalfd_siginfo info;
+                while (read(sigfd, &info, sizeof(info)) < 0 && errno == EINTR) {
+                }
+                int status;
+                pid_t pid;
+                while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                    if (!sendReply(fd, kExited, pid, status)) {
+                        _exit(0);
+                    }
+                }
+            }
+
+            if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                int passed[kMaxFds];
+                int passedCount;
+                ssize_t size = receiveWithFds(fd, message, sizeof(message), passed, &passedCount);
+                if (size <= 0) {
+                    break;  // client went away
+                }
+                handleRequest(fd, message, size, passed, passedCount, oldMask);
+                for (int i = 0; i < passedCount; i++) {
+                    close(passed[i]);
+                }
+            }
+        }
+        _exit(0);
+    }
+
+    // Reads one reply, stashing exit notifications for wait()
+    bool readReply(ForkServerReply& reply) {
+        int fds[kMaxFds];
+        int fdCount;
+        ssize_t size = receiveWithFds(sock, &reply, sizeof(reply), fds, &fdCount);
+        for (int i = 0; i < fdCount; i++) {
+            close(fds[i]);
+        }
+        if (size != (ssize_t)sizeof(reply)) {
+            if (size >= 0) {
+                errno = EPIPE;
+            }
+            return false;
+        }
+        if (reply.type == kExited) {
+            finished[reply.pid] = reply.value;
+        }
+        return true;
+    }
+
+public:
+    ForkServer() : sock(-1), serverPid(-1), message(sizeof(ForkServerRequest) + kMaxPayload) {}
+
+    ~ForkServer() { stop(); }
+
+    // Forks the server process. Call this early, before the caller's address
+    // space grows, since the server starts out as a copy of it.
+    bool start() {
+        if (sock >= 0) {
+            return true;
+        }
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0) {
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            int error = errno;
+            close(pair[0]);
+            close(pair[1]);
+            errno = error;
+            return false;
+        }
+        if (pid == 0) {
+            close(pair[0]);
+            serve(pair[1]);
+        }
+        close(pair[1]);
+        sock = pair[0];
+        serverPid = pid;
+        return true;
+    }
+
+    // Closes the connection; the server exits once it sees EOF. Children that
+    // are still running are left alone.
+    void stop() {
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+            waitpid(serverPid, NULL, 0);
+            serverPid = -1;
+        }
+        finished.clear();
+    }
+
+    bool running() const { return sock >= 0; }
+
+    pid_t pid() const { return serverPid; }
+
+    // Launches argv[0] (an absolute path) with envp. fds, if given, become
+    // the child's descriptors 0..fdCount-1; otherwise the child inherits the
+    // server's stdio. Returns the child's PID, or -1 with errno set
+    // (including the child's exec() errno).
+    pid_t launch(char* const argv[], char* const envp[],
+                 const int* fds = NULL, int fdCount = 0) {
+        if (sock < 0 || !argv || !argv[0] || fdCount < 0 || fdCount > kMaxFds) {
+            errno = sock < 0 ? ENOTCONN : EINVAL;
+            return -1;
+        }
+
+        ForkServerRequest request;
+        request.argc = 0;
+        request.envc = 0;
+        size_t offset = sizeof(request);
+        for (int pass = 0; pass < 2; pass++) {
+            char* const* list = pass == 0 ? argv : envp;
+            for (size_t i = 0; list && list[i]; i++) {
+                size_t length = strlen(list[i]) + 1;
+                if (offset + length > message.size() ||
+                    request.argc + request.envc >= kMaxStrings) {
+                    errno = E2BIG;
+                    return -1;
+                }
+                memcpy(&message[offset], list[i], length);
+                offset += length;
+                if (pass == 0) {
+                    request.argc++;
+                } else {
+                    request.envc++;
+                }
+            }
+        }
+        request.payloadSize = offset - sizeof(request);
+        memcpy(&message[0], &request, sizeof(request));
+
+        if (sendWithFds(sock, &message[0], offset, fds, fdCount) < 0) {
+            return -1;
+        }
+
+        ForkServerReply reply;
+        do {
+            if (!readReply(reply)) {
+                return -1;
+            }
+        } while (reply.type != kLaunched);
+
+        if (reply.value != 0) {
+            errno = reply.value;
+            return -1;
+        }
+        return reply.pid;
+    }
+
+    // Blocks until the child pid (launched by this server) exits and stores
+    // its waitpid()-style status. Returns false with errno set on failure.
+    bool wait(pid_t pid, int* status) {
+        for (;;) {
+            std::map<pid_t, int>::iterator it = finished.find(pid);
+            if (it != finished.end()) {
+                if (status) {
+                    *status = it->second;
+                }
+                finished.erase(it);
+                return true;
+            }
+            ForkServerReply reply;
+            if (!readReply(reply)) {
+                return false;
+            }
+        }
+    }
+};
+
+#endif // FORK_SERVER_H
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <string.h>
+#include "fork_server.h"
+
+// Fork server ("zygote") example, building on basic_fork.cpp.
+//
+// The server is forked right at startup while this process is still small.
+// Afterwards the parent grows to several hundred MB, but every launch is still
+// a fork() of the tiny server, not of us. The child's stdout is a pipe we
+// pass to the server over the Unix socket (SCM_RIGHTS).
+
+extern char **environ;
+
+int main() {
+    std::cout << "Parent process started with PID: " << getpid() << std::endl;
+
+    ForkServer server;
+    if (!server.start()) {
+        std::cerr << "Fork server failed to start: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout << "Fork server running with PID: " << server.pid() << std::endl;
+
+    // Parent grows large after the server was forked
+    const size_t cacheSize = 512 * 1024 * 1024;
+    void* cache = mmap(NULL, cacheSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) {
+        std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    memset(cache, 1, cacheSize);
+    std::cout << "Parent now holds a " << (cacheSize >> 20) << " MB cache" << std::endl;
+
+    const char* commands[][3] = {
+        {"/bin/echo", "Hello from a fork server child", NULL},
+        {"/bin/uname", "-sr", NULL},
+        {"/bin/ls", "/nonexistent", NULL},
+    };
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        int pipeFds[2];
+        if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+            std::cerr << "pipe failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        // Child gets our stdin, the pipe as stdout, and our stderr
+        int childFds[3] = {STDIN_FILENO, pipeFds[1], STDERR_FILENO};
+        pid_t pid = server.launch((char* const*)commands[i], environ, childFds, 3);
+        close(pipeFds[1]);
+        if (pid < 0) {
+            std::cerr << "Launch of " << commands[i][0] << " failed: " << strerror(errno) << std::endl;
+            close(pipeFds[0]);
+            continue;
+        }
+        std::cout << "Fork server created child with PID: " << pid << std::endl;
+
+        std::string output;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(pipeFds[0], buffer, sizeof(buffer))) > 0) {
+            output.append(buffer, n);
+        }
+        close(pipeFds[0]);
+
+        int status;
+        if (!server.wait(pid, &status)) {
+            std::cerr << "wait failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        if (!output.empty()) {
+            std::cout << "Child output: " << output;
+        }
+        if (WIFEXITED(status)) {
+            std::cout << "Child process exited with status: " << WEXITSTATUS(status) << std::endl;
+        }
+    }
+
+    munmap(cache, cacheSize);
+    server.stop();
+    std::cout << "Parent process terminating" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+#ifndef OUTPUT_CAPTURE_H
+#define OUTPUT_CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Captures the stdout of a child process at high throughput.
+//
+// Unlike popen(), the command is not handed to /bin/sh: argv is spawned
+// directly with posix_spawnp(). The child writes into a pipe2() pipe whose
+// capacity is raised with F_SETPIPE_SZ, and the parent drains it either
+//   - into one contiguous buffer (readAll),
+//   - as a stream of large chunks (readChunks), or
+//   - zero-copy into a file or memfd with splice(), optionally duplicating
+//     the data into a second pipe with tee() (forwardTo).
+//
+//   OutputCapture capture;
+//   capture.start(argv, environ);
+//   std::string output;
+//   capture.readAll(output);
+//   int status = capture.finish();
+
+class OutputCapture {
+public:
+    static const size_t kDefaultPipeSize = 1024 * 1024;
+    static const size_t kChunkSize = 256 * 1024;
+
+private:
+    pid_t pid;
+    int readFd;
+    size_t pipeSize;
+    std::vector<char> chunk;
+
+    OutputCapture(const OutputCapture&);
+    OutputCapture& operator=(const OutputCapture&);
+
+    // Largest pipe size an unprivileged process may ask for
+    static size_t maxPipeSize() {
+        FILE* file = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (!file) {
+            return kDefaultPipeSize;
+        }
+        unsigned long size = 0;
+        if (fscanf(file, "%lu", &size) != 1) {
+            size = kDefaultPipeSize;
+        }
+        fclose(file);
+        return size;
+    }
+
+public:
+    OutputCapture() : pid(-1), readFd(-1), pipeSize(0) {}
+
+    ~OutputCapture() {
+        if (pid > 0) {
+            finish();
+        }
+    }
+
+    // Spawns argv (searched in PATH) with stdout connected to the capture
+    // pipe. With captureStderr, stderr goes into the same pipe. Returns false
+    // with errno set on failure.
+    bool start(char* const argv[], char* const envp[], bool captureStderr = false,
+               size_t requestedPipeSize = kDefaultPipeSize) {
+        if (pid > 0) {
+            errno = EBUSY;
+            return false;
+        }
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            return false;
+        }
+
+        // Fewer, larger reads: best effort, the default 64 KB still works
+        size_t limit = maxPipeSize();
+        size_t size = requestedPipeSize < limit ? requestedPipeSize : limit;
+        int actual = fcntl(fds[0], F_SETPIPE_SZ, (int)size);
+        if (actual < 0) {
+            actual = fcntl(fds[0], F_GETPIPE_SZ);
+        }
+        pipeSize = actual > 0 ? (size_t)actual : 0;
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        if (captureStderr) {
+            posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+        }
+
+        int rc = posix_spawnp(&pid, argv[0], &actions, NULL, argv, envp);
+        posix_spawn_file_actions_destroy(&actions);
+        close(fds[1]);
+        if (rc != 0) {
+            close(fds[0]);
+            pid = -1;
+            errno = rc;
+            return false;
+        }
+        readFd = fds[0];
+        return true;
+    }
+
+    // Read end of the capture pipe, e.g. for poll()/epoll
+    int fd() const { return readFd; }
+
+    pid_t childPid() const { return pid; }
+
+    // Capacity of the capture pipe after F_SETPIPE_SZ
+    size_t capacity() const { return pipeSize; }
+
+    // Appends everything the child writes to output. Returns false with errno
+    // set on a read error.
+    bool readAll(std::string& output) {
+        size_t step = pipeSize > 0 ? pipeSize : kChunkSize;
+        size_t used = output.size();
+        for (;;) {
+            // Grow geometrically so the buffer is resized O(log n) times
+            if (output.size() - used < step) {
+                output.resize(used + step > 2 * output.size() ? used + step : 2 * output.size());
+            }
+            ssize_t n = read(readFd, &output[used], output.size() - used);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                output.resize(used);
+                return false;
+            }
+            if (n == 0) {
+                output.resize(used);
+                return true;
+            }
+            used += n;
+        }
+    }
+
+    // Calls onChunk(const char* data, size_t size) for each read of up to
+    // kChunkSize bytes. The data is only valid during the call.
+    template <typename Callback>
+    bool readChunks(Callback onChunk) {
+        chunk.resize(kChunkSize);
+        for (;;) {
+            ssize_t n = read(readFd, &chunk[0], chunk.size());
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (n == 0) {
+                return true;
+            }
+            onChunk((const char*)&chunk[0], (size_t)n);
+        }
+    }
+
+    // Moves the child's output into fd (a file, memfd or pipe) with splice(),
+    // without copying it through user space. If teePipe is a pipe write end,
+    // the same data is also duplicated into it with tee(); someone must drain
+    // that pipe or forwarding stalls once it is full. Returns the number of
+    // bytes forwarded, or -1 with errno set.
+    long long forwardTo(int fd, int teePipe = -1) {
+        size_t step = pipeSize > 0 ? pipeSize : kChunkSize;
+        long long total = 0;
+        for (;;) {
+            ssize_t available = (ssize_t)step;
+            if (teePipe >= 0) {
+                // tee() blocks until data is there; its result bounds the splice
+                available = tee(readFd, teePipe, step, 0);
+                if (available < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return -1;
+                }
+                if (available == 0) {
+                    return total;
+                }
+            }
+
+            ssize_t remaining = available;
+            while (remaining > 0) {
+                ssize_t n = splice(readFd, NULL, fd, NULL, remaining, SPLICE_F_MOVE);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return -1;
+                }
+                if (n == 0) {
+                    return total;
+                }
+                total += n;
+                if (teePipe < 0) {
+                    break;  // no bound to honour: go read some more
+                }
+                remaining -= n;
+            }
+        }
+    }
+
+    // Closes the pipe, reaps the child and returns its waitpid() status, or
+    // -1 with errno set
+    int finish() {
+        if (readFd >= 0) {
+            close(readFd);
+            readFd = -1;
+        }
+        if (pid <= 0) {
+            errno = ECHILD;
+            return -1;
+        }
+        int status;
+        pid_t rc;
+        do {
+            rc = waitpid(pid, &status, 0);
+        } while (rc < 0 && errno == EINTR);
+        pid = -1;
+        return rc < 0 ? -1 : status;
+    }
+};
+
+// Runs argv to completion and stores its stdout in output. Returns the
+// waitpid() status, or -1 with errno set.
+inline int captureOutput(char* const argv[], char* const envp[], std::string& output) {
+    OutputCapture capture;
+    if (!capture.start(argv, envp)) {
+        return -1;
+    }
+    if (!capture.readAll(output)) {
+        int error = errno;
+        capture.finish();
+        errno = error;
+        return -1;
+    }
+    return capture.finish();
+}
+
+#endif // OUTPUT_CAPTURE_H
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <string.h>
+#include "output_capture.h"
+
+// Captures command output without popen(): no /bin/sh, a large pipe, and
+// splice() to move output into a memfd without copying it (output_capture.h).
+
+extern char **environ;
+
+int main() {
+    std::cout << "Parent process started with PID: " << getpid() << std::endl;
+
+    // 1. Whole output as one contiguous buffer
+    char* lsArgs[] = {(char*)"ls", (char*)"-la", NULL};
+    std::string output;
+    int status = captureOutput(lsArgs, environ, output);
+    if (status < 0) {
+        std::cerr << "Capture failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::cout << "\nCommand output:" << std::endl;
+    std::cout << "------------------------------" << std::endl;
+    std::cout << output;
+    std::cout << "------------------------------" << std::endl;
+    std::cout << "Command exited with status: " << WEXITSTATUS(status) << std::endl;
+
+    // 2. Zero-copy forwarding into a memfd
+    int memfd = memfd_create("capture", MFD_CLOEXEC);
+    if (memfd < 0) {
+        std::cerr << "memfd_create failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    OutputCapture capture;
+    char* seqArgs[] = {(char*)"seq", (char*)"1", (char*)"100000", NULL};
+    if (!capture.start(seqArgs, environ)) {
+        std::cerr << "Spawn failed: " << strerror(errno) << std::endl;
+        close(memfd);
+        return 1;
+    }
+    std::cout << "\nPipe capacity: " << capture.capacity() << " bytes" << std::endl;
+
+    long long forwarded = capture.forwardTo(memfd);
+    status = capture.finish();
+
+    struct stat info;
+    fstat(memfd, &info);
+    std::cout << "Spliced " << forwarded << " bytes into memfd (size "
+              << info.st_size << "), child exited with status "
+              << WEXITSTATUS(status) << std::endl;
+    close(memfd);
+
+    return 0;
+}
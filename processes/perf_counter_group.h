@@ -0,0 +1,173 @@
+#ifndef PERF_COUNTER_GROUP_H
+#define PERF_COUNTER_GROUP_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+// Hardware/software counters, opened as one perf_event_open() group: the
+// kernel schedules (and multiplexes) them together, so ratios such as IPC
+// come from the same window, and one read() returns all of them.
+//
+// openForChild() counts the next child, inherited and enabled at its
+// exec(); openForThread() counts the calling thread's user-space code
+// between start() and stop(). Counters the kernel, the CPU or the
+// permissions do not allow stay closed.
+
+class PerfCounterGroup {
+public:
+    enum Counter {
+        kCycles,
+        kInstructions,
+        kPageFaults,
+        kBranchMisses,
+        kICacheMisses,  // L1 instruction cache read misses
+        kCounterCount
+    };
+
+private:
+    int fds[kCounterCount];
+    int leader;                        // first counter opened; -1 if none
+    Counter order[kCounterCount];      // open counters, in group read order
+    int opened;
+    uint64_t values[kCounterCount];    // from the last readAll()
+
+    static void setEvent(struct perf_event_attr& attr, Counter counter) {
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (counter) {
+        case kCycles:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case kInstructions:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case kPageFaults:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+            break;
+        case kBranchMisses:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1I | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        }
+    }
+
+    int openCounter(Counter counter, bool child, bool& userOnly) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        setEvent(attr, counter);
+        attr.read_format = PERF_FORMAT_GROUP;
+        // Members follow the leader's enable state
+        attr.disabled = leader < 0;
+        attr.inherit = child;
+        attr.enable_on_exec = child && leader < 0;
+        attr.exclude_kernel = userOnly;
+        attr.exclude_hv = userOnly;
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0 && !userOnly && (errno == EACCES || errno == EPERM)) {
+            // perf_event_paranoid may still allow user-space-only counting
+            userOnly = true;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+        }
+        return fd;
+    }
+
+    bool openGroup(unsigned counters, bool child) {
+        close();
+        bool userOnly = !child;
+        for (int i = 0; i < kCounterCount; i++) {
+            if (counters & (1u << i)) {
+                fds[i] = openCounter((Counter)i, child, userOnly);
+                if (fds[i] >= 0) {
+                    leader = leader < 0 ? fds[i] : leader;
+                    order[opened++] = (Counter)i;
+                }
+            }
+        }
+        return leader >= 0;
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&);
+    PerfCounterGroup& operator=(const PerfCounterGroup&);
+
+public:
+    PerfCounterGroup() : leader(-1), opened(0) {
+        for (int i = 0; i < kCounterCount; i++) {
+            fds[i] = -1;
+            values[i] = 0;
+        }
+    }
+
+    ~PerfCounterGroup() { close(); }
+
+    // Opens counters (a mask of 1 << Counter) for the next child; returns
+    // true if at least one is available
+    bool openForChild(unsigned counters) { return openGroup(counters, true); }
+
+    // Opens counters for the calling thread, counted between start() and
+    // stop(); returns true if at least one is available
+    bool openForThread(unsigned counters) { return openGroup(counters, false); }
+
+    void close() {
+        for (int i = 0; i < kCounterCount; i++) {
+            if (fds[i] >= 0) {
+                ::close(fds[i]);
+                fds[i] = -1;
+            }
+            values[i] = 0;
+        }
+        leader = -1;
+        opened = 0;
+    }
+
+    bool available(Counter counter) const { return fds[counter] >= 0; }
+
+    bool anyAvailable() const { return leader >= 0; }
+
+    // Resets and enables the whole group
+    void start() {
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    // Disables the group and reads it
+    void stop() {
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            readAll();
+        }
+    }
+
+    // Reads every counter at once: after stop(), or once the child has been
+    // reaped. False if the group could not be read.
+    bool readAll() {
+        uint64_t buffer[1 + kCounterCount];
+        ssize_t size = leader >= 0 ? ::read(leader, buffer, sizeof(buffer)) : -1;
+        if (size < (ssize_t)sizeof(uint64_t) || buffer[0] != (uint64_t)opened ||
+            size < (ssize_t)((1 + opened) * sizeof(uint64_t))) {
+            return false;
+        }
+        for (int i = 0; i < opened; i++) {
+            values[order[i]] = buffer[1 + i];
+        }
+        return true;
+    }
+
+    // Value as of the last readAll() (or stop()), or 0 if unavailable
+    uint64_t read(Counter counter) const { return values[counter]; }
+};
+
+#endif // PERF_COUNTER_GROUP_H
@@ -0,0 +1,343 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <new>
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+// Lock-free message ring in shared memory, for streaming results from
+// forked children back to their parent.
+//
+// The ring lives in a MAP_SHARED | MAP_ANONYMOUS mapping created before
+// fork(), so parent and children see the same memory. It is a bounded
+// multi-producer queue of fixed-size slots (Dmitry Vyukov's sequence-number
+// design): each slot carries a sequence counter that tells producers when it
+// is free and the consumer when it is filled, so a push or pop is one CAS and
+// a memcpy - no system call. With a single producer the CAS never retries.
+//
+// Only a side that has to wait makes a system call. Waiting uses futexes on
+// words inside the mapping (shared, not FUTEX_PRIVATE). A sleeper sets the
+// low bit of the word first; the other side only calls FUTEX_WAKE when it
+// finds that bit set, and clears it, so a burst of pushes wakes a sleeping
+// consumer once rather than once per message.
+//
+//   ShmRing ring(1024, 128, workers);    // before fork()
+//   // child:  ring.push(&result, sizeof(result)); ring.closeProducer(); _exit(0);
+//   // parent: while ((n = ring.pop(buffer, sizeof(buffer))) >= 0) { ... }
+//
+// pop() fails with EPIPE once the ring is empty and every producer has
+// called closeProducer(). A producer that dies without closing (or in the
+// middle of a push) is not detected by the ring; use pop() with a timeout
+// and check the children with waitpid()/pidfds.
+
+class ShmRing {
+private:
+    static const size_t kCacheLine = 64;
+
+    struct Header {
+        // Producer and consumer positions live on separate cache lines
+        alignas(kCacheLine) std::atomic<uint64_t> enqueuePos;
+        alignas(kCacheLine) std::atomic<uint64_t> dequeuePos;
+        // Futex words; bit 0 set means someone sleeps on it
+        alignas(kCacheLine) std::atomic<uint32_t> dataSignal;   // consumers waiting for data
+        std::atomic<uint32_t> spaceSignal;                      // producers waiting for space
+        std::atomic<uint32_t> producers;                        // not yet closed
+        uint32_t capacity;
+        uint32_t slotSize;
+    };
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        uint32_t length;
+        char data[1];  // slotSize bytes in the mapping
+    };
+
+    void* region;
+    size_t regionSize;
+    Header* header;
+    size_t slotStride;
+    uint64_t mask;
+
+    ShmRing(const ShmRing&);
+    ShmRing& operator=(const ShmRing&);
+
+    Slot* slotAt(uint64_t position) const {
+        char* base = (char*)region + sizeof(Header);
+        return (Slot*)(base + (position & mask) * slotStride);
+    }
+
+    static long futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs) {
+        struct timespec timeout;
+        struct timespec* timeoutPtr = NULL;
+        if (timeoutMs >= 0) {
+            timeout.tv_sec = timeoutMs / 1000;
+            timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            timeoutPtr = &timeout;
+        }
+        return syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, timeoutPtr, NULL, 0);
+    }
+
+    static void futexWakeAll(std::atomic<uint32_t>* word) {
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+
+    // Wakes everyone sleeping on signal. The fence orders our slot update
+    // before the check of the sleeping bit, pairing with the fetch_or in
+    // waitFor(); only the caller that clears the bit makes the system call.
+    static void notify(std::atomic<uint32_t>& signal) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t value = signal.load(std::memory_order_relaxed);
+        if ((value & 1) != 0 &&
+            signal.compare_exchange_strong(value, (value + 2) & ~1u, std::memory_order_release)) {
+            futexWakeAll(&signal);
+        }
+    }
+
+    // Sleeps on signal until notify() or the deadline, unless ready() turns
+    // true after announcing the sleep. Returns false once the deadline passed.
+    template <typename Ready>
+    static bool waitFor(std::atomic<uint32_t>& signal, const struct timespec* deadline, Ready ready) {
+        uint32_t value = signal.fetch_or(1, std::memory_order_seq_cst) | 1;
+        if (ready()) {
+            return true;
+        }
+        int wait = remainingMs(deadline);
+        if (wait == 0) {
+            return false;
+        }
+        futexWait(&signal, value, wait);
+        return true;
+    }
+
+    // Milliseconds left until deadline, or -1 for "no deadline"
+    static int remainingMs(const struct timespec* deadline) {
+        if (!deadline) {
+            return -1;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long ms = (deadline->tv_sec - now.tv_sec) * 1000LL +
+                       (deadline->tv_nsec - now.tv_nsec) / 1000000LL;
+        return ms > 0 ? (int)ms : 0;
+    }
+
+    static struct timespec* makeDeadline(int timeoutMs, struct timespec& storage) {
+        if (timeoutMs < 0) {
+            return NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &storage);
+        storage.tv_sec += timeoutMs / 1000;
+        storage.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (storage.tv_nsec >= 1000000000L) {
+            storage.tv_sec++;
+            storage.tv_nsec -= 1000000000L;
+        }
+        return &storage;
+    }
+
+public:
+    // capacity is rounded up to a power of two; slotSize is the largest
+    // message in bytes; producers is how many closeProducer() calls end the
+    // stream (0: the stream never ends)
+    ShmRing(size_t capacity, size_t slotSize, unsigned producers = 1)
+        : region(MAP_FAILED), regionSize(0), header(NULL), slotStride(0), mask(0) {
+        size_t slots = 2;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        slotStride = (offsetof(Slot, data) + slotSize + kCacheLine - 1) & ~(kCacheLine - 1);
+        regionSize = sizeof(Header) + slots * slotStride;
+        region = mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            return;
+        }
+
+        header = new (region) Header();
+        header->enqueuePos.store(0);
+        header->dequeuePos.store(0);
+        header->dataSignal.store(0);
+        header->spaceSignal.store(0);
+        header->producers.store(producers);
+        header->capacity = (uint32_t)slots;
+        header->slotSize = (uint32_t)slotSize;
+        mask = slots - 1;
+        for (uint64_t i = 0; i < slots; i++) {
+            Slot* slot = slotAt(i);
+            new (&slot->sequence) std::atomic<uint64_t>(i);
+            slot->length = 0;
+        }
+    }
+
+    // Unmaps this process's view; other processes keep theirs
+    ~ShmRing() {
+        if (region != MAP_FAILED) {
+            munmap(region, regionSize);
+        }
+    }
+
+    // False if the shared mapping could not be created
+    bool valid() const { return region != MAP_FAILED; }
+
+    size_t capacity() const { return header ? header->capacity : 0; }
+
+    size_t slotSize() const { return header ? header->slotSize : 0; }
+
+    // Copies a message into the ring without blocking. Returns false with
+    // errno EAGAIN if the ring is full, EMSGSIZE if length > slotSize().
+    bool tryPush(const void* data, size_t length) {
+        if (length > header->slotSize) {
+            errno = EMSGSIZE;
+            return false;
+        }
+        uint64_t position = header->enqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = slotAt(position);
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)position;
+            if (diff == 0) {
+                if (header->enqueuePos.compare_exchange_weak(position, position + 1,
+                                                             std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                errno = EAGAIN;
+                return false;
+            } else {
+                position = header->enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        memcpy(slot->data, data, length);
+        slot->length = (uint32_t)length;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        notify(header->dataSignal);
+        return true;
+    }
+
+    // Copies the oldest message into buffer without blocking and returns its
+    // length. Returns -1 with errno EAGAIN if the ring is empty, EPIPE if it
+    // is empty and all producers have closed, EMSGSIZE if the message does
+    // not fit into bufferSize (it stays in the ring).
+    ssize_t tryPop(void* buffer, size_t bufferSize) {
+        uint64_t position = header->dequeuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = slotAt(position);
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)(position + 1);
+            if (diff == 0) {
+                if (slot->length > bufferSize) {
+                    errno = EMSGSIZE;
+                    return -1;
+                }
+                if (header->dequeuePos.compare_exchange_weak(position, position + 1,
+                                                             std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Check for a push that landed after the close, then report EOF
+                bool closed = header->producers.load(std::memory_order_acquire) == 0 &&
+                              slotAt(position)->sequence.load(std::memory_order_acquire) != position + 1;
+                errno = closed ? EPIPE : EAGAIN;
+                return -1;
+            } else {
+                position = header->dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        size_t length = slot->length;
+        memcpy(buffer, slot->data, length);
+        slot->sequence.store(position + mask + 1, std::memory_order_release);
+        notify(header->spaceSignal);
+        return (ssize_t)length;
+    }
+
+    // Like tryPush(), but waits up to timeoutMs (-1: forever) for free space.
+    // Fails with ETIMEDOUT when the time is up.
+    bool push(const void* data, size_t length, int timeoutMs = -1) {
+        struct timespec storage;
+        struct timespec* deadline = makeDeadline(timeoutMs, storage);
+        bool pushed = false;
+        for (;;) {
+            if (pushed || tryPush(data, length)) {
+                return true;
+            }
+            if (errno != EAGAIN) {
+                return false;
+            }
+            // Announce the sleep, then re-check, so a pop between the two is not missed
+            ShmRing* self = this;
+            if (!waitFor(header->spaceSignal, deadline, [self, data, length, &pushed]() {
+                    pushed = self->tryPush(data, length);
+                    return pushed || errno != EAGAIN;
+                })) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+        }
+    }
+
+    // Like tryPop(), but waits up to timeoutMs (-1: forever) for a message.
+    // Fails with ETIMEDOUT when the time is up.
+    ssize_t pop(void* buffer, size_t bufferSize, int timeoutMs = -1) {
+        struct timespec storage;
+        struct timespec* deadline = makeDeadline(timeoutMs, storage);
+        for (;;) {
+            ssize_t length = tryPop(buffer, bufferSize);
+            if (length >= 0 || errno != EAGAIN) {
+                return length;
+            }
+            ShmRing* self = this;
+            bool done = false;
+            if (!waitFor(header->dataSignal, deadline, [self, buffer, bufferSize, &length, &done]() {
+                    length = self->tryPop(buffer, bufferSize);
+                    done = length >= 0 || errno != EAGAIN;
+                    return done;
+                })) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            if (done) {
+                return length;
+            }
+        }
+    }
+
+    // Typed helpers for trivially copyable structs
+    template <typename T>
+    bool pushValue(const T& value, int timeoutMs = -1) {
+        return push(&value, sizeof(T), timeoutMs);
+    }
+
+    template <typename T>
+    bool popValue(T& value, int timeoutMs = -1) {
+        ssize_t length = pop(&value, sizeof(T), timeoutMs);
+        if (length >= 0 && (size_t)length != sizeof(T)) {
+            errno = EBADMSG;
+            return false;
+        }
+        return length >= 0;
+    }
+
+    // Called by each producer when it has nothing more to send; the last
+    // one wakes the consumer so pop() can report EPIPE
+    void closeProducer() {
+        if (header->producers.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            header->dataSignal.fetch_add(2, std::memory_order_release);
+            futexWakeAll(&header->dataSignal);
+        }
+    }
+};
+
+#endif // SHM_RING_H
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "shm_ring.h"
+
+// Forked workers stream structured results to the parent through a
+// shared-memory ring (shm_ring.h) instead of printing text to a shared
+// stdout as in basic_fork.cpp.
+
+struct WorkerResult {
+    int worker;
+    pid_t pid;
+    long long rangeStart;
+    long long rangeEnd;
+    long long primes;
+};
+
+static bool isPrime(long long n) {
+    if (n < 2) {
+        return false;
+    }
+    for (long long d = 2; d * d <= n; d++) {
+        if (n % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    const int kWorkers = 4;
+    const long long kChunk = 25000;
+    const int kChunksPerWorker = 4;
+
+    // Must exist before fork() so every child shares the same pages
+    ShmRing ring(64, sizeof(WorkerResult), kWorkers);
+    if (!ring.valid()) {
+        std::cerr << "Could not map shared ring: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::vector<pid_t> workers;
+    for (int w = 0; w < kWorkers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        if (pid == 0) {
+            // Child: count primes in its chunks and report each one
+            for (int c = 0; c < kChunksPerWorker; c++) {
+                WorkerResult result;
+                result.worker = w;
+                result.pid = getpid();
+                result.rangeStart = (long long)(c * kWorkers + w) * kChunk;
+                result.rangeEnd = result.rangeStart + kChunk;
+                result.primes = 0;
+                for (long long n = result.rangeStart; n < result.rangeEnd; n++) {
+                    result.primes += isPrime(n) ? 1 : 0;
+                }
+                ring.pushValue(result);
+            }
+            ring.closeProducer();
+            _exit(0);
+        }
+        workers.push_back(pid);
+    }
+
+    // Parent: results arrive as they are produced, in any order
+    long long totalPrimes = 0;
+    int received = 0;
+    WorkerResult result;
+    while (ring.popValue(result, 5000)) {
+        std::cout << "Worker " << result.worker << " (PID " << result.pid << "): "
+                  << result.primes << " primes in [" << result.rangeStart << ", "
+                  << result.rangeEnd << ")" << std::endl;
+        totalPrimes += result.primes;
+        received++;
+    }
+    if (errno != EPIPE) {
+        std::cerr << "Ring stopped early: " << strerror(errno) << std::endl;
+    }
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        waitpid(workers[i], NULL, 0);
+    }
+
+    std::cout << "Received " << received << " results, " << totalPrimes << " primes below "
+              << kWorkers * kChunksPerWorker * kChunk << std::endl;
+    return 0;
+}
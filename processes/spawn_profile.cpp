@@ -0,0 +1,231 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "clone_launcher.h"
+#include "command_executor.h"
+#include "fork_server.h"
+#include "spawn_stats.h"
+
+// Per-child resource accounting for every launch path in this directory.
+//
+// Each method launches the same command repeatedly through SpawnProfiler
+// (spawn_stats.h), which records spawn-to-exec and exec-to-exit latency
+// histograms, wait4() rusage and, with --perf, perf_event_open() counters
+// of the child. The result is one JSON document on stdout.
+//
+// The fork_server method's children belong to the server, which is started
+// first, so their rusage and perf counters are not visible here; only the
+// latency and exit status are.
+//
+// Usage:
+//   ./spawn_profile [--iterations N] [--methods m1,m2,...] [--perf] [-- command args...]
+// The default command is /bin/true.
+
+extern char **environ;
+
+static std::vector<char*> commandArgs;  // NULL-terminated argv of the command
+static std::string commandPath;          // argv[0] resolved through PATH
+static std::string commandLine;          // shell-quoted, for system()/popen()
+static std::vector<char*> serverArgs;   // commandArgs with commandPath as argv[0]
+static CloneLauncher* cloneLauncher = NULL;
+static ForkServer* forkServer = NULL;
+
+static std::string resolveInPath(const std::string& program) {
+    if (program.find('/') != std::string::npos) {
+        return program;
+    }
+    const char* path = getenv("PATH");
+    std::stringstream dirs(path ? path : "/usr/bin:/bin");
+    std::string dir;
+    while (std::getline(dirs, dir, ':')) {
+        std::string candidate = (dir.empty() ? "." : dir) + "/" + program;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+    }
+    return program;
+}
+
+static std::string shellQuote(const std::string& word) {
+    std::string quoted = "'";
+    for (size_t i = 0; i < word.size(); i++) {
+        if (word[i] == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += word[i];
+        }
+    }
+    return quoted + "'";
+}
+
+static pid_t launchForkExec(int*) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execve(commandPath.c_str(), &commandArgs[0], environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launchVfork(int*) {
+    pid_t pid = vfork();
+    if (pid == 0) {
+        execve(commandPath.c_str(), &commandArgs[0], environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launchPosixSpawn(int*) {
+    pid_t pid;
+    int rc = posix_spawn(&pid, commandPath.c_str(), NULL, NULL, &commandArgs[0], environ);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+static pid_t launchClone(int*) {
+    return cloneLauncher->launch(commandPath.c_str(), &commandArgs[0], environ);
+}
+
+// The next four reap the child themselves and pass on its status
+static pid_t launchSystem(int* status) {
+    *status = system(commandLine.c_str());
+    return *status == -1 ? -1 : 0;
+}
+
+static pid_t launchExecutor(int* status) {
+    *status = executeCommand(commandLine);
+    return *status == -1 ? -1 : 0;
+}
+
+static pid_t launchPopen(int* status) {
+    FILE* pipe = popen(commandLine.c_str(), "r");
+    if (!pipe) {
+        return -1;
+    }
+    char buffer[4096];
+    while (fread(buffer, 1, sizeof(buffer), pipe) > 0) {
+    }
+    *status = pclose(pipe);
+    return *status == -1 ? -1 : 0;
+}
+
+static pid_t launchForkServer(int* status) {
+    pid_t pid = forkServer->launch(&serverArgs[0], environ);
+    if (pid < 0) {
+        return -1;
+    }
+    return forkServer->wait(pid, status) ? 0 : -1;
+}
+
+struct ProfiledMethod {
+    const char* name;
+    pid_t (*launch)(int* status);
+    bool ownChild;   // the child is ours, so perf counters can follow it
+};
+
+static const ProfiledMethod kMethods[] = {
+    {"fork_exec", launchForkExec, true},
+    {"vfork", launchVfork, true},
+    {"posix_spawn", launchPosixSpawn, true},
+    {"clone", launchClone, true},
+    {"system", launchSystem, true},
+    {"executor", launchExecutor, true},
+    {"popen", launchPopen, true},
+    {"fork_server", launchForkServer, false},
+};
+
+int main(int argc, char* argv[]) {
+    // The fork server must be forked while we are still small
+    ForkServer server;
+    if (!server.start()) {
+        std::cerr << "Could not start fork server: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    forkServer = &server;
+
+    size_t iterations = 200;
+    bool usePerf = false;
+    std::vector<std::string> methodNames;
+    std::vector<std::string> command;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--") {
+            for (int j = i + 1; j < argc; j++) {
+                command.push_back(argv[j]);
+            }
+            break;
+        } else if (arg == "--perf") {
+            usePerf = true;
+        } else if (i + 1 < argc && arg == "--iterations") {
+            iterations = strtoul(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && arg == "--methods") {
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                methodNames.push_back(name);
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--iterations N] [--methods m1,m2,...] [--perf] [-- command args...]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (command.empty()) {
+        command.push_back("/bin/true");
+    }
+
+    commandPath = resolveInPath(command[0]);
+    for (size_t i = 0; i < command.size(); i++) {
+        commandArgs.push_back((char*)command[i].c_str());
+        commandLine += (i ? " " : "") + shellQuote(command[i]);
+    }
+    commandArgs.push_back(NULL);
+    serverArgs = commandArgs;
+    serverArgs[0] = (char*)commandPath.c_str();
+
+    CloneLauncher launcher;
+    if (!launcher.valid()) {
+        std::cerr << "Could not allocate clone stack: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    cloneLauncher = &launcher;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "{\"command\": \"" << commandPath << "\", \"iterations\": " << iterations
+              << ", \"perf\": " << (usePerf ? "true" : "false") << ", \"methods\": [\n";
+    bool first = true;
+    for (size_t m = 0; m < sizeof(kMethods) / sizeof(kMethods[0]); m++) {
+        if (!methodNames.empty() &&
+            std::find(methodNames.begin(), methodNames.end(), kMethods[m].name) == methodNames.end()) {
+            continue;
+        }
+        std::cerr << "Profiling " << kMethods[m].name << "..." << std::endl;
+        SpawnProfiler profiler(kMethods[m].name, usePerf && kMethods[m].ownChild);
+        for (size_t i = 0; i < iterations; i++) {
+            profiler.profile(kMethods[m].launch);
+        }
+        std::cout << (first ? "" : ",\n") << "    ";
+        profiler.writeJson(std::cout);
+        first = false;
+    }
+    std::cout << "\n]}" << std::endl;
+
+    return 0;
+}
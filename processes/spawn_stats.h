@@ -0,0 +1,359 @@
+#ifndef SPAWN_STATS_H
+#define SPAWN_STATS_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "perf_counter_group.h"
+
+// Instrumentation for process launch paths.
+//
+// SpawnProfiler wraps one launch path (fork+exec, vfork, posix_spawn, ...)
+// and records for every child:
+//   - spawn-to-exec latency: the child inherits the write end of an
+//     O_CLOEXEC "exec probe" pipe, so the parent sees EOF the moment the
+//     child's exec() succeeds
+//   - exec-to-exit latency, and the total launch-to-reap time
+//   - wait4() rusage: user/sys time, max RSS, page faults, context switches
+//   - optionally perf_event_open() counters (cycles, instructions, page
+//     faults) opened with inherit + enable_on_exec, so they count only the
+//     child's new program and are folded back into our counter at its exit
+// Latencies go into log-linear histograms; everything is exported as JSON.
+//
+// Perf counters count every child created while they are open, so only
+// profile one launch at a time per process.
+
+// Log-linear histogram of nanosecond values: 8 sub-buckets per power of two,
+// i.e. at most 12.5% relative error, in a fixed 4 KB table
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 3;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBuckets = 64 * kSubBuckets;
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t minValue;
+    uint64_t maxValue;
+    double sum;
+
+    static int bucketOf(uint64_t value) {
+        if (value < (uint64_t)kSubBuckets) {
+            return (int)value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int sub = (int)((value >> (msb - kSubBucketBits)) & (kSubBuckets - 1));
+        return (msb - kSubBucketBits + 1) * kSubBuckets + sub;
+    }
+
+    static uint64_t lowerBound(int bucket) {
+        if (bucket < kSubBuckets) {
+            return (uint64_t)bucket;
+        }
+        int msb = bucket / kSubBuckets + kSubBucketBits - 1;
+        int sub = bucket % kSubBuckets;
+        return ((uint64_t)(kSubBuckets + sub)) << (msb - kSubBucketBits);
+    }
+
+    static uint64_t upperBound(int bucket) {
+        return bucket + 1 < kBuckets ? lowerBound(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+public:
+    LatencyHistogram() : counts(kBuckets, 0), total(0), minValue(UINT64_MAX), maxValue(0), sum(0) {}
+
+    void record(uint64_t nanoseconds) {
+        counts[bucketOf(nanoseconds)]++;
+        total++;
+        sum += (double)nanoseconds;
+        if (nanoseconds < minValue) {
+            minValue = nanoseconds;
+        }
+        if (nanoseconds > maxValue) {
+            maxValue = nanoseconds;
+        }
+    }
+
+    uint64_t count() const { return total; }
+
+    double mean() const { return total > 0 ? sum / total : 0.0; }
+
+    // Value at or below which a fraction p of the samples fall (bucket midpoint)
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint64_t lower = lowerBound(i), upper = upperBound(i);
+                uint64_t mid = lower + (upper - lower) / 2;
+                return mid < minValue ? minValue : (mid > maxValue ? maxValue : mid);
+            }
+        }
+        return maxValue;
+    }
+
+    // {"count", "min_us", "mean_us", "p50_us", ..., "buckets": [[lower_us, upper_us, count], ...]}
+    void writeJson(std::ostream& out) const {
+        out << "{\"count\": " << total
+            << ", \"min_us\": " << (total ? minValue / 1000.0 : 0.0)
+            << ", \"mean_us\": " << mean() / 1000.0
+            << ", \"p50_us\": " << percentile(0.50) / 1000.0
+            << ", \"p90_us\": " << percentile(0.90) / 1000.0
+            << ", \"p99_us\": " << percentile(0.99) / 1000.0
+            << ", \"p999_us\": " << percentile(0.999) / 1000.0
+            << ", \"max_us\": " << maxValue / 1000.0
+            << ", \"buckets\": [";
+        bool first = true;
+        for (int i = 0; i < kBuckets; i++) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            out << (first ? "" : ", ") << "[" << lowerBound(i) / 1000.0 << ", "
+                << upperBound(i) / 1000.0 << ", " << counts[i] << "]";
+            first = false;
+        }
+        out << "]}";
+    }
+};
+
+// Cycles, instructions and page faults of the next child, inherited and
+// enabled at its exec() and read as one PerfCounterGroup. Counters the
+// kernel or the permissions do not allow stay closed.
+class ChildPerfCounters {
+public:
+    enum Counter { kCycles, kInstructions, kPageFaults, kCounterCount };
+
+private:
+    PerfCounterGroup group;
+
+    ChildPerfCounters(const ChildPerfCounters&);
+    ChildPerfCounters& operator=(const ChildPerfCounters&);
+
+public:
+    ChildPerfCounters() {}
+
+    // Opens the counters; returns true if at least one is available
+    bool open() {
+        return group.openForChild(1u << PerfCounterGroup::kCycles | 1u << PerfCounterGroup::kInstructions |
+                                  1u << PerfCounterGroup::kPageFaults);
+    }
+
+    void close() { group.close(); }
+
+    bool available(Counter counter) const { return group.available((PerfCounterGroup::Counter)counter); }
+
+    // Reads all counters of the (reaped) child at once; false on failure
+    bool readAll() { return group.readAll(); }
+
+    // Value from the last readAll(), or 0 if unavailable
+    uint64_t read(Counter counter) const { return group.read((PerfCounterGroup::Counter)counter); }
+};
+
+// Statistics of one launch path
+class SpawnProfiler {
+public:
+    // Starts a child and returns its PID, to be reaped by the profiler with
+    // wait4(). A launch path that reaps the child itself (system(), popen())
+    // returns 0 instead and stores the child's wait status in *status; its
+    // rusage is then taken from RUSAGE_CHILDREN and spawn-to-exec cannot be
+    // separated. Returns -1 on failure.
+    typedef std::function<pid_t(int* status)> LaunchFunction;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::string name;
+    bool usePerf;
+    uint64_t launches;
+    uint64_t failures;
+    uint64_t nonZeroExits;
+    LatencyHistogram spawnToExec;
+    LatencyHistogram execToExit;
+    LatencyHistogram total;
+    LatencyHistogram maxRssKb;  // reused as a plain value histogram
+    uint64_t maxRssKbMax;       // exact, the histogram only has bucket midpoints
+    double userSeconds;
+    double systemSeconds;
+    uint64_t minorFaults;
+    uint64_t majorFaults;
+    uint64_t voluntarySwitches;
+    uint64_t involuntarySwitches;
+    uint64_t perfSamples;
+    uint64_t perfTotals[ChildPerfCounters::kCounterCount];
+    bool perfAvailable[ChildPerfCounters::kCounterCount];
+
+    static uint64_t nanosBetween(Clock::time_point start, Clock::time_point end) {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    static double seconds(const struct timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    void addUsage(const struct rusage& usage, bool withMaxRss) {
+        userSeconds += seconds(usage.ru_utime);
+        systemSeconds += seconds(usage.ru_stime);
+        minorFaults += usage.ru_minflt;
+        majorFaults += usage.ru_majflt;
+        voluntarySwitches += usage.ru_nvcsw;
+        involuntarySwitches += usage.ru_nivcsw;
+        if (withMaxRss) {
+            maxRssKb.record((uint64_t)usage.ru_maxrss);
+            if ((uint64_t)usage.ru_maxrss > maxRssKbMax) {
+                maxRssKbMax = (uint64_t)usage.ru_maxrss;
+            }
+        }
+    }
+
+    static void subtractUsage(struct rusage& after, const struct rusage& before) {
+        timersub(&after.ru_utime, &before.ru_utime, &after.ru_utime);
+        timersub(&after.ru_stime, &before.ru_stime, &after.ru_stime);
+        after.ru_minflt -= before.ru_minflt;
+        after.ru_majflt -= before.ru_majflt;
+        after.ru_nvcsw -= before.ru_nvcsw;
+        after.ru_nivcsw -= before.ru_nivcsw;
+    }
+
+public:
+    explicit SpawnProfiler(const std::string& methodName, bool withPerf = false)
+        : name(methodName), usePerf(withPerf), launches(0), failures(0), nonZeroExits(0),
+          maxRssKbMax(0), userSeconds(0), systemSeconds(0), minorFaults(0), majorFaults(0),
+          voluntarySwitches(0), involuntarySwitches(0), perfSamples(0) {
+        for (int i = 0; i < ChildPerfCounters::kCounterCount; i++) {
+            perfTotals[i] = 0;
+            perfAvailable[i] = false;
+        }
+    }
+
+    const std::string& method() const { return name; }
+
+    // Runs one instrumented launch. Returns false if it failed.
+    bool profile(LaunchFunction launch) {
+        ChildPerfCounters counters;
+        bool perfOpen = usePerf && counters.open();
+
+        int probe[2];
+        if (pipe2(probe, O_CLOEXEC) < 0) {
+            failures++;
+            return false;
+        }
+
+        struct rusage childrenBefore;
+        getrusage(RUSAGE_CHILDREN, &childrenBefore);
+
+        Clock::time_point start = Clock::now();
+        int launchStatus = 0;
+        pid_t pid = launch(&launchStatus);
+        Clock::time_point returned = Clock::now();
+        close(probe[1]);
+
+        if (pid < 0) {
+            close(probe[0]);
+            failures++;
+            return false;
+        }
+        launches++;
+
+        if (pid == 0) {
+            // Reaped by the launch path itself
+            close(probe[0]);
+            total.record(nanosBetween(start, returned));
+            struct rusage usage;
+            getrusage(RUSAGE_CHILDREN, &usage);
+            subtractUsage(usage, childrenBefore);
+            addUsage(usage, false);
+            if (!WIFEXITED(launchStatus) || WEXITSTATUS(launchStatus) != 0) {
+                nonZeroExits++;
+            }
+        } else {
+            // EOF once every copy of the write end is gone, i.e. at exec()
+            char byte;
+            ssize_t n;
+            do {
+                n = read(probe[0], &byte, 1);
+            } while (n < 0 && errno == EINTR);
+            Clock::time_point execed = Clock::now();
+            close(probe[0]);
+
+            int status;
+            struct rusage usage;
+            pid_t rc;
+            do {
+                rc = wait4(pid, &status, 0, &usage);
+            } while (rc < 0 && errno == EINTR);
+            Clock::time_point reaped = Clock::now();
+            if (rc < 0) {
+                failures++;
+                return false;
+            }
+
+            spawnToExec.record(nanosBetween(start, execed));
+            execToExit.record(nanosBetween(execed, reaped));
+            total.record(nanosBetween(start, reaped));
+            addUsage(usage, true);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                nonZeroExits++;
+            }
+        }
+
+        if (perfOpen && counters.readAll()) {
+            perfSamples++;
+            for (int i = 0; i < ChildPerfCounters::kCounterCount; i++) {
+                ChildPerfCounters::Counter counter = (ChildPerfCounters::Counter)i;
+                if (counters.available(counter)) {
+                    perfAvailable[i] = true;
+                    perfTotals[i] += counters.read(counter);
+                }
+            }
+        }
+        return true;
+    }
+
+    void writeJson(std::ostream& out) const {
+        double n = launches > 0 ? (double)launches : 1.0;
+        out << "{\"method\": \"" << name << "\", \"launches\": " << launches
+            << ", \"failures\": " << failures << ", \"nonzero_exits\": " << nonZeroExits
+            << ",\n     \"spawn_to_exec\": ";
+        spawnToExec.writeJson(out);
+        out << ",\n     \"exec_to_exit\": ";
+        execToExit.writeJson(out);
+        out << ",\n     \"total\": ";
+        total.writeJson(out);
+        out << ",\n     \"rusage\": {\"user_sec\": " << userSeconds
+            << ", \"sys_sec\": " << systemSeconds
+            << ", \"max_rss_kb_p50\": " << maxRssKb.percentile(0.50)
+            << ", \"max_rss_kb_max\": " << maxRssKbMax
+            << ", \"minor_faults_avg\": " << minorFaults / n
+            << ", \"major_faults_avg\": " << majorFaults / n
+            << ", \"voluntary_switches_avg\": " << voluntarySwitches / n
+            << ", \"involuntary_switches_avg\": " << involuntarySwitches / n << "}";
+        out << ",\n     \"perf\": {";
+        static const char* const kNames[] = {"cycles_avg", "instructions_avg", "page_faults_avg"};
+        bool first = true;
+        for (int i = 0; i < ChildPerfCounters::kCounterCount; i++) {
+            if (perfAvailable[i] && perfSamples > 0) {
+                out << (first ? "" : ", ") << "\"" << kNames[i] << "\": "
+                    << (double)perfTotals[i] / perfSamples;
+                first = false;
+            }
+        }
+        out << "}}";
+    }
+};
+
+#endif // SPAWN_STATS_H
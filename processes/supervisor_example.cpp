@@ -0,0 +1,89 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string.h>
+#include "child_supervisor.h"
+
+// Fan-out example for ChildSupervisor (child_supervisor.h).
+//
+// Instead of one blocking waitpid() per child, thousands of children are
+// launched and reaped from this single thread through pidfds and epoll.
+// Every tenth job is a "sleep 10" that gets killed by its timeout.
+//
+// Usage: ./supervisor_example [children] [concurrency]
+
+int main(int argc, char* argv[]) {
+    size_t children = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    size_t concurrency = argc > 2 ? strtoul(argv[2], NULL, 10) : 256;
+
+    std::cout << "Parent process started with PID: " << getpid() << std::endl;
+
+    // One pidfd per running child
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < concurrency + 64) {
+        limit.rlim_cur = limit.rlim_max < concurrency + 64 ? limit.rlim_max : concurrency + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    ChildSupervisor supervisor(concurrency);
+    if (!supervisor.valid()) {
+        std::cerr << "epoll_create1 failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    size_t succeeded = 0, failed = 0, timedOut = 0, launchErrors = 0;
+    double slowest = 0.0;
+    ChildSupervisor::ExitCallback onExit = [&](const ChildExit& result) {
+        if (result.pid < 0) {
+            launchErrors++;
+        } else if (result.timedOut) {
+            timedOut++;
+        } else if (WIFEXITED(result.status) && WEXITSTATUS(result.status) == 0) {
+            succeeded++;
+        } else {
+            failed++;
+        }
+        if (!result.timedOut && result.wallSeconds > slowest) {
+            slowest = result.wallSeconds;
+        }
+    };
+
+    std::vector<std::string> quick;
+    quick.push_back("/bin/true");
+    std::vector<std::string> slow;
+    slow.push_back("/bin/sleep");
+    slow.push_back("10");
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < children; i++) {
+        if (i % 10 == 9) {
+            supervisor.submitCommand(slow, onExit, 200);
+        } else {
+            supervisor.submitCommand(quick, onExit);
+        }
+    }
+
+    std::cout << "Submitted " << children << " children, at most "
+              << concurrency << " running at once..." << std::endl;
+    if (!supervisor.run()) {
+        std::cerr << "Waiting for children failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Succeeded: " << succeeded << "\nFailed: " << failed
+              << "\nTimed out (killed): " << timedOut
+              << "\nLaunch errors: " << launchErrors
+              << "\nSlowest non-timed-out child: " << slowest * 1000.0 << " ms"
+              << "\nTotal time: " << seconds << " s ("
+              << (seconds > 0 ? children / seconds : 0.0) << " children/s)" << std::endl;
+
+    std::cout << "Parent process terminating" << std::endl;
+
+    return 0;
+}